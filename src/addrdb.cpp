@@ -12,6 +12,7 @@
 #include <cstdint>
 #include <hash.h>
 #include <logging/timer.h>
+#include <netaddress.h>
 #include <random.h>
 #include <streams.h>
 #include <tinyformat.h>
@@ -106,6 +107,27 @@ bool DeserializeDB(Stream& stream, Data& data, bool fCheckSum = true)
     return true;
 }
 
+/** Deserializes a banmap_t one entry at a time, without storing it. */
+class BanMapReader
+{
+    const std::function<void(const CSubNet&, const CBanEntry&)>& m_add_ban;
+
+public:
+    explicit BanMapReader(const std::function<void(const CSubNet&, const CBanEntry&)>& add_ban) : m_add_ban(add_ban) {}
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        const uint64_t count = ReadCompactSize(s);
+        for (uint64_t i = 0; i < count; ++i) {
+            CSubNet sub_net;
+            CBanEntry ban_entry;
+            s >> sub_net >> ban_entry;
+            m_add_ban(sub_net, ban_entry);
+        }
+    }
+};
+
 template <typename Data>
 bool DeserializeFileDB(const fs::path& path, Data& data)
 {
@@ -129,9 +151,10 @@ bool CBanDB::Write(const banmap_t& banSet)
     return SerializeFileDB("banlist", m_ban_list_path, banSet);
 }
 
-bool CBanDB::Read(banmap_t& banSet)
+bool CBanDB::Read(const std::function<void(const CSubNet&, const CBanEntry&)>& add_ban)
 {
-    return DeserializeFileDB(m_ban_list_path, banSet);
+    BanMapReader reader(add_ban);
+    return DeserializeFileDB(m_ban_list_path, reader);
 }
 
 CAddrDB::CAddrDB()
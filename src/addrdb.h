@@ -10,13 +10,15 @@
 #include <fs.h>
 #include <net_types.h> // For banmap_t
 #include <serialize.h>
+#include <streams.h> // For CDataStream
 
+#include <functional>
 #include <string>
 #include <vector>
 
 class CAddress;
 class CAddrMan;
-class CDataStream;
+class CSubNet;
 
 class CBanEntry
 {
@@ -71,7 +73,11 @@ private:
 public:
     explicit CBanDB(fs::path ban_list_path);
     bool Write(const banmap_t& banSet);
-    bool Read(banmap_t& banSet);
+    /**
+     * Read the banlist, passing each entry to add_ban as it is read. On
+     * failure some entries may have been passed already.
+     */
+    bool Read(const std::function<void(const CSubNet&, const CBanEntry&)>& add_ban);
 };
 
 /**
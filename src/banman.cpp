@@ -20,15 +20,31 @@ BanMan::BanMan(fs::path ban_file, CClientUIInterface* client_interface, int64_t
 
     int64_t n_start = GetTimeMillis();
     m_is_dirty = false;
-    banmap_t banmap;
-    if (m_ban_db.Read(banmap)) {
-        SetBanned(banmap);        // thread save setter
-        SetBannedSetDirty(false); // no need to write down, just read data
-        SweepBanned();            // sweep out unused entries
-
-        LogPrint(BCLog::NET, "Loaded %d banned node ips/subnets from banlist.dat  %dms\n",
-            m_banned.size(), GetTimeMillis() - n_start);
-    } else {
+    const int64_t now = GetTime();
+    bool read;
+    {
+        LOCK(m_cs_banned);
+        // Add the bans as they are read, leaving out the ones that have expired
+        // since, rather than reading the whole list first.
+        read = m_ban_db.Read([&](const CSubNet& sub_net, const CBanEntry& ban_entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_banned) {
+            if (!sub_net.IsValid() || now > ban_entry.nBanUntil) {
+                m_is_dirty = true;
+                return;
+            }
+            AddBan(sub_net, ban_entry);
+        });
+        if (read) {
+            LogPrint(BCLog::NET, "Loaded %d banned node ips/subnets from banlist.dat  %dms\n",
+                m_banned.size(), GetTimeMillis() - n_start);
+        } else {
+            // Forget whatever was read before the error.
+            m_banned.clear();
+            m_ban_trie.Clear();
+            m_unindexed_bans.clear();
+            m_ban_expiry.clear();
+        }
+    }
+    if (!read) {
         LogPrintf("Invalid or missing banlist.dat; recreating\n");
         SetBannedSetDirty(true); // force write
         DumpBanlist();
@@ -63,6 +79,9 @@ void BanMan::ClearBanned()
     {
         LOCK(m_cs_banned);
         m_banned.clear();
+        m_ban_trie.Clear();
+        m_unindexed_bans.clear();
+        m_ban_expiry.clear();
         m_is_dirty = true;
     }
     DumpBanlist(); //store banlist to disk
@@ -79,11 +98,9 @@ bool BanMan::IsBanned(const CNetAddr& net_addr)
 {
     auto current_time = GetTime();
     LOCK(m_cs_banned);
-    for (const auto& it : m_banned) {
-        CSubNet sub_net = it.first;
-        CBanEntry ban_entry = it.second;
-
-        if (current_time < ban_entry.nBanUntil && sub_net.Match(net_addr)) {
+    if (m_ban_trie.Match(net_addr, current_time)) return true;
+    for (const CSubNet& sub_net : m_unindexed_bans) {
+        if (current_time < m_banned.find(sub_net)->second.nBanUntil && sub_net.Match(net_addr)) {
             return true;
         }
     }
@@ -94,14 +111,8 @@ bool BanMan::IsBanned(const CSubNet& sub_net)
 {
     auto current_time = GetTime();
     LOCK(m_cs_banned);
-    banmap_t::iterator i = m_banned.find(sub_net);
-    if (i != m_banned.end()) {
-        CBanEntry ban_entry = (*i).second;
-        if (current_time < ban_entry.nBanUntil) {
-            return true;
-        }
-    }
-    return false;
+    banmap_t::const_iterator i = m_banned.find(sub_net);
+    return i != m_banned.end() && current_time < i->second.nBanUntil;
 }
 
 void BanMan::Ban(const CNetAddr& net_addr, int64_t ban_time_offset, bool since_unix_epoch)
@@ -130,11 +141,11 @@ void BanMan::Ban(const CSubNet& sub_net, int64_t ban_time_offset, bool since_uni
 
     {
         LOCK(m_cs_banned);
-        if (m_banned[sub_net].nBanUntil < ban_entry.nBanUntil) {
-            m_banned[sub_net] = ban_entry;
-            m_is_dirty = true;
-        } else
-            return;
+        if (!sub_net.IsValid()) return;
+        banmap_t::const_iterator it = m_banned.find(sub_net);
+        if (it != m_banned.end() && it->second.nBanUntil >= ban_entry.nBanUntil) return;
+        AddBan(sub_net, ban_entry);
+        m_is_dirty = true;
     }
     if (m_client_interface) m_client_interface->BannedListChanged();
 
@@ -152,7 +163,9 @@ bool BanMan::Unban(const CSubNet& sub_net)
 {
     {
         LOCK(m_cs_banned);
-        if (m_banned.erase(sub_net) == 0) return false;
+        banmap_t::iterator it = m_banned.find(sub_net);
+        if (it == m_banned.end()) return false;
+        RemoveBan(it);
         m_is_dirty = true;
     }
     if (m_client_interface) m_client_interface->BannedListChanged();
@@ -168,11 +181,20 @@ void BanMan::GetBanned(banmap_t& banmap)
     banmap = m_banned; //create a thread safe copy
 }
 
-void BanMan::SetBanned(const banmap_t& banmap)
+void BanMan::AddBan(const CSubNet& sub_net, const CBanEntry& ban_entry)
 {
-    LOCK(m_cs_banned);
-    m_banned = banmap;
-    m_is_dirty = true;
+    banmap_t::iterator it = m_banned.find(sub_net);
+    if (it != m_banned.end()) RemoveBan(it);
+    m_banned.emplace(sub_net, ban_entry);
+    if (!m_ban_trie.Insert(sub_net, ban_entry.nBanUntil)) m_unindexed_bans.insert(sub_net);
+    m_ban_expiry.emplace(ban_entry.nBanUntil, sub_net);
+}
+
+void BanMan::RemoveBan(banmap_t::iterator it)
+{
+    if (!m_ban_trie.Erase(it->first)) m_unindexed_bans.erase(it->first);
+    m_ban_expiry.erase(std::make_pair(it->second.nBanUntil, it->first));
+    m_banned.erase(it);
 }
 
 void BanMan::SweepBanned()
@@ -181,17 +203,12 @@ void BanMan::SweepBanned()
     bool notify_ui = false;
     {
         LOCK(m_cs_banned);
-        banmap_t::iterator it = m_banned.begin();
-        while (it != m_banned.end()) {
-            CSubNet sub_net = (*it).first;
-            CBanEntry ban_entry = (*it).second;
-            if (!sub_net.IsValid() || now > ban_entry.nBanUntil) {
-                m_banned.erase(it++);
-                m_is_dirty = true;
-                notify_ui = true;
-                LogPrint(BCLog::NET, "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, sub_net.ToString());
-            } else
-                ++it;
+        while (!m_ban_expiry.empty() && m_ban_expiry.begin()->first < now) {
+            const CSubNet sub_net = m_ban_expiry.begin()->second;
+            RemoveBan(m_banned.find(sub_net));
+            m_is_dirty = true;
+            notify_ui = true;
+            LogPrint(BCLog::NET, "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, sub_net.ToString());
         }
     }
     // update UI
@@ -7,14 +7,18 @@
 #define LABYRINTH_BANMAN_H
 
 #include <addrdb.h>
+#include <bantrie.h>
 #include <bloom.h>
 #include <fs.h>
 #include <net_types.h> // For banmap_t
+#include <netaddress.h>
 #include <sync.h>
 
 #include <chrono>
 #include <cstdint>
 #include <memory>
+#include <set>
+#include <utility>
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static constexpr unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24; // Default 24-hour ban
@@ -22,8 +26,6 @@ static constexpr unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24; // Def
 static constexpr std::chrono::minutes DUMP_BANS_INTERVAL{15};
 
 class CClientUIInterface;
-class CNetAddr;
-class CSubNet;
 
 // Banman manages two related but distinct concepts:
 //
@@ -80,7 +82,10 @@ public:
     void DumpBanlist();
 
 private:
-    void SetBanned(const banmap_t& banmap);
+    //! Add or replace a ban in m_banned and the indexes over it
+    void AddBan(const CSubNet& sub_net, const CBanEntry& ban_entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_banned);
+    //! Remove a ban from m_banned and the indexes over it
+    void RemoveBan(banmap_t::iterator it) EXCLUSIVE_LOCKS_REQUIRED(m_cs_banned);
     bool BannedSetIsDirty();
     //!set the "dirty" flag for the banlist
     void SetBannedSetDirty(bool dirty = true);
@@ -89,6 +94,13 @@ private:
 
     RecursiveMutex m_cs_banned;
     banmap_t m_banned GUARDED_BY(m_cs_banned);
+    //! The bans in m_banned, for matching addresses against
+    BanTrie m_ban_trie GUARDED_BY(m_cs_banned);
+    //! The bans in m_banned that m_ban_trie can't hold (netmasks that aren't a prefix), matched one by one
+    std::set<CSubNet> m_unindexed_bans GUARDED_BY(m_cs_banned);
+    //! The bans in m_banned by the time they expire. Expired bans are ignored
+    //! when matching, and only removed when the list is swept.
+    std::set<std::pair<int64_t, CSubNet>> m_ban_expiry GUARDED_BY(m_cs_banned);
     bool m_is_dirty GUARDED_BY(m_cs_banned);
     CClientUIInterface* m_client_interface = nullptr;
     CBanDB m_ban_db;
@@ -0,0 +1,228 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bantrie.h>
+
+#include <memusage.h>
+#include <netaddress.h>
+
+#include <algorithm>
+
+static inline int GetBit(const uint8_t* key, int bit)
+{
+    return (key[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+/** Number of leading bits keys a and b share, up to limit, given that they share the first from. */
+static int CommonBits(const uint8_t* a, const uint8_t* b, int from, int limit)
+{
+    for (int i = from / 8; i * 8 < limit; ++i) {
+        const uint8_t diff = a[i] ^ b[i];
+        if (diff == 0) continue;
+        int bits = i * 8;
+        while (!(diff & (0x80 >> (bits % 8)))) ++bits;
+        return std::min(bits, limit);
+    }
+    return limit;
+}
+
+BanTrie::BanTrie()
+{
+    Clear();
+}
+
+bool BanTrie::AddressKey(const CNetAddr& addr, Key& key)
+{
+    if (addr.m_addr.size() > MAX_KEY_SIZE - 2) return false;
+    key.fill(0);
+    key[0] = addr.m_net;
+    key[1] = addr.m_addr.size();
+    std::copy(addr.m_addr.begin(), addr.m_addr.end(), key.begin() + 2);
+    return true;
+}
+
+int BanTrie::SubNetKey(const CSubNet& sub_net, Key& key)
+{
+    if (!sub_net.valid || !AddressKey(sub_net.network, key)) return -1;
+    const size_t addr_size = sub_net.network.m_addr.size();
+    switch (sub_net.network.m_net) {
+    case NET_IPV4:
+    case NET_IPV6: {
+        int bits = 16;
+        bool zeros_found = false;
+        for (size_t i = 0; i < addr_size; ++i) {
+            const uint8_t mask = sub_net.netmask[i];
+            int ones = 0;
+            while (ones < 8 && (mask & (0x80 >> ones))) ++ones;
+            if (mask != (uint8_t)(0xFF << (8 - ones)) || (zeros_found && ones != 0)) return -1;
+            if (ones < 8) zeros_found = true;
+            bits += ones;
+        }
+        return bits;
+    }
+    case NET_ONION:
+    case NET_I2P:
+    case NET_CJDNS:
+        return 16 + 8 * addr_size;
+    case NET_INTERNAL:
+    case NET_UNROUTABLE:
+    case NET_MAX:
+        return -1;
+    }
+    return -1;
+}
+
+uint32_t BanTrie::NewNode(const Key& key, int bits)
+{
+    Node node;
+    node.key.fill(0);
+    std::copy(key.begin(), key.begin() + bits / 8, node.key.begin());
+    if (bits % 8) node.key[bits / 8] = key[bits / 8] & (uint8_t)(0xFF << (8 - bits % 8));
+    node.bits = bits;
+    node.banned = false;
+    node.ban_until = 0;
+    node.child[0] = node.child[1] = NO_NODE;
+    if (!m_free_nodes.empty()) {
+        const uint32_t index = m_free_nodes.back();
+        m_free_nodes.pop_back();
+        m_nodes[index] = node;
+        return index;
+    }
+    m_nodes.push_back(node);
+    return m_nodes.size() - 1;
+}
+
+void BanTrie::FreeNode(uint32_t node)
+{
+    m_free_nodes.push_back(node);
+}
+
+size_t BanTrie::Children(uint32_t node) const
+{
+    return (m_nodes[node].child[0] != NO_NODE) + (m_nodes[node].child[1] != NO_NODE);
+}
+
+void BanTrie::Splice(uint32_t parent, uint32_t node)
+{
+    const uint32_t child = m_nodes[node].child[0] != NO_NODE ? m_nodes[node].child[0] : m_nodes[node].child[1];
+    Node& p = m_nodes[parent];
+    p.child[p.child[0] == node ? 0 : 1] = child;
+    FreeNode(node);
+}
+
+bool BanTrie::Insert(const CSubNet& sub_net, int64_t ban_until)
+{
+    Key key;
+    const int bits = SubNetKey(sub_net, key);
+    if (bits < 0) return false;
+
+    // Walk down while the nodes are prefixes of the key; node is the last.
+    uint32_t node = 0;
+    uint32_t target;
+    while (true) {
+        const int node_bits = m_nodes[node].bits;
+        if (node_bits == bits) {
+            target = node;
+            break;
+        }
+        const int side = GetBit(key.data(), node_bits);
+        const uint32_t child = m_nodes[node].child[side];
+        if (child == NO_NODE) {
+            target = NewNode(key, bits);
+            m_nodes[node].child[side] = target;
+            break;
+        }
+        const int child_bits = m_nodes[child].bits;
+        const int common = CommonBits(m_nodes[child].key.data(), key.data(), node_bits, std::min(child_bits, bits));
+        if (common == child_bits) {
+            node = child;
+            continue;
+        }
+        if (common == bits) {
+            // The subnet contains the child's: insert it in between.
+            target = NewNode(key, bits);
+            m_nodes[target].child[GetBit(m_nodes[child].key.data(), bits)] = child;
+        } else {
+            // The keys diverge below the child: branch there.
+            const uint32_t branch = NewNode(key, common);
+            target = NewNode(key, bits);
+            m_nodes[branch].child[GetBit(key.data(), common)] = target;
+            m_nodes[branch].child[GetBit(m_nodes[child].key.data(), common)] = child;
+            m_nodes[node].child[side] = branch;
+            break;
+        }
+        m_nodes[node].child[side] = target;
+        break;
+    }
+
+    if (!m_nodes[target].banned) ++m_size;
+    m_nodes[target].banned = true;
+    m_nodes[target].ban_until = ban_until;
+    return true;
+}
+
+bool BanTrie::Erase(const CSubNet& sub_net)
+{
+    Key key;
+    const int bits = SubNetKey(sub_net, key);
+    if (bits < 0) return false;
+
+    uint32_t grandparent = NO_NODE, parent = NO_NODE, node = 0;
+    while (m_nodes[node].bits < bits) {
+        const int node_bits = m_nodes[node].bits;
+        const uint32_t next = m_nodes[node].child[GetBit(key.data(), node_bits)];
+        if (next == NO_NODE || m_nodes[next].bits > bits) return false;
+        if (CommonBits(m_nodes[next].key.data(), key.data(), node_bits, m_nodes[next].bits) < m_nodes[next].bits) return false;
+        grandparent = parent;
+        parent = node;
+        node = next;
+    }
+    if (!m_nodes[node].banned) return false;
+    m_nodes[node].banned = false;
+    --m_size;
+
+    // Drop the nodes that neither hold a ban nor branch any more. The node
+    // is never the root, which has no bits.
+    const size_t children = Children(node);
+    if (children == 1) {
+        Splice(parent, node);
+    } else if (children == 0) {
+        Node& p = m_nodes[parent];
+        p.child[p.child[0] == node ? 0 : 1] = NO_NODE;
+        FreeNode(node);
+        if (parent != 0 && !m_nodes[parent].banned) Splice(grandparent, parent);
+    }
+    return true;
+}
+
+bool BanTrie::Match(const CNetAddr& addr, int64_t now) const
+{
+    Key key;
+    if (!addr.IsValid() || !AddressKey(addr, key)) return false;
+
+    uint32_t node = 0;
+    while (true) {
+        const Node& n = m_nodes[node];
+        if (n.banned && now < n.ban_until) return true;
+        if (n.bits >= MAX_KEY_BITS) return false;
+        const uint32_t next = n.child[GetBit(key.data(), n.bits)];
+        if (next == NO_NODE) return false;
+        const Node& c = m_nodes[next];
+        if (CommonBits(c.key.data(), key.data(), n.bits, c.bits) < c.bits) return false;
+        node = next;
+    }
+}
+
+void BanTrie::Clear()
+{
+    m_nodes.clear();
+    m_free_nodes.clear();
+    m_size = 0;
+    NewNode(Key{}, 0);
+}
+
+size_t BanTrie::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(m_nodes) + memusage::DynamicUsage(m_free_nodes);
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_BANTRIE_H
+#define LABYRINTH_BANTRIE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CNetAddr;
+class CSubNet;
+
+/**
+ * Banned subnets of all networks, in a radix trie, to find the bans that
+ * match an address without testing every one of them.
+ *
+ * A key is the network of an address, the length of the address, and the
+ * address itself; a subnet is the first bits of the key of its network
+ * address, up to the end of its netmask. Each node holds the bits shared by
+ * all keys below it, and there is a node for every ban and every point at
+ * which the keys of two bans diverge. Matching an address follows the one
+ * path its key leads down, so it takes time in the order of the length of
+ * the key, however many bans there are.
+ *
+ * Only the subnets whose netmask is a prefix (as any parsed from a string,
+ * or of a single address) can be stored.
+ */
+class BanTrie
+{
+public:
+    BanTrie();
+
+    /**
+     * Store or replace the ban of a subnet.
+     * @returns false, without storing it, if the subnet is invalid or its
+     *          netmask is not a prefix
+     */
+    bool Insert(const CSubNet& sub_net, int64_t ban_until);
+    /** Remove the ban of a subnet; returns whether it was stored. */
+    bool Erase(const CSubNet& sub_net);
+    /** Whether an address is in a stored subnet banned until after now. */
+    bool Match(const CNetAddr& addr, int64_t now) const;
+    void Clear();
+
+    /** Number of bans stored. */
+    size_t Size() const { return m_size; }
+    size_t DynamicMemoryUsage() const;
+
+private:
+    //! Network, address length, and the longest address (TORv3 and I2P)
+    static constexpr size_t MAX_KEY_SIZE = 2 + 32;
+    static constexpr int MAX_KEY_BITS = MAX_KEY_SIZE * 8;
+    //! The root is node 0, so it is never a child
+    static constexpr uint32_t NO_NODE = 0;
+
+    using Key = std::array<uint8_t, MAX_KEY_SIZE>;
+
+    struct Node {
+        //! The first bits of the keys below this node; the rest are zero
+        Key key;
+        uint16_t bits;
+        bool banned;
+        int64_t ban_until;
+        uint32_t child[2];
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_free_nodes;
+    size_t m_size{0};
+
+    static bool AddressKey(const CNetAddr& addr, Key& key);
+    /** Build the key of a subnet; returns its length in bits, or -1 if it can't be stored. */
+    static int SubNetKey(const CSubNet& sub_net, Key& key);
+
+    uint32_t NewNode(const Key& key, int bits);
+    void FreeNode(uint32_t node);
+    size_t Children(uint32_t node) const;
+    /** Replace node, which has a single child, with that child. */
+    void Splice(uint32_t parent, uint32_t node);
+};
+
+#endif // LABYRINTH_BANTRIE_H
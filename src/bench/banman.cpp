@@ -0,0 +1,83 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addrdb.h>
+#include <banman.h>
+#include <bench/bench.h>
+#include <compat.h>
+#include <netaddress.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <cstring>
+#include <vector>
+
+static const size_t BANS = 100000;
+
+static CNetAddr RandomIPv4(FastRandomContext& rng)
+{
+    struct in_addr ipv4;
+    const uint32_t bits = rng.rand32();
+    memcpy(&ipv4, &bits, sizeof(ipv4));
+    return CNetAddr(ipv4);
+}
+
+static CNetAddr RandomIPv6(FastRandomContext& rng)
+{
+    struct in6_addr ipv6;
+    const uint256 bits = rng.rand256();
+    memcpy(&ipv6, bits.begin(), sizeof(ipv6));
+    // Stay clear of the ranges that embed IPv4 or Tor addresses.
+    ipv6.s6_addr[0] = 0x20;
+    return CNetAddr(ipv6);
+}
+
+// A banlist.dat of single IPv4 addresses, IPv4 /24 and IPv6 /48 subnets.
+static fs::path WriteBanList(FastRandomContext& rng)
+{
+    banmap_t banmap;
+    CBanEntry ban_entry(GetTime());
+    ban_entry.nBanUntil = GetTime() + 365 * 24 * 60 * 60;
+    while (banmap.size() < BANS) {
+        switch (rng.randrange(10)) {
+        case 0: banmap.emplace(CSubNet(RandomIPv4(rng), 24), ban_entry); break;
+        case 1: banmap.emplace(CSubNet(RandomIPv6(rng), 48), ban_entry); break;
+        default: banmap.emplace(CSubNet(RandomIPv4(rng)), ban_entry); break;
+        }
+    }
+    const fs::path ban_file = GetDataDir() / "banlist_bench.dat";
+    CBanDB(ban_file).Write(banmap);
+    return ban_file;
+}
+
+static void BanManLoad(benchmark::Bench& bench)
+{
+    BasicTestingSetup test_setup{CBaseChainParams::REGTEST, {"-nodebuglogfile", "-nodebug"}};
+    FastRandomContext rng(true);
+    const fs::path ban_file = WriteBanList(rng);
+
+    bench.batch(BANS).unit("ban").run([&] {
+        BanMan banman(ban_file, nullptr, DEFAULT_MISBEHAVING_BANTIME);
+    });
+}
+
+static void BanManIsBanned(benchmark::Bench& bench)
+{
+    BasicTestingSetup test_setup{CBaseChainParams::REGTEST, {"-nodebuglogfile", "-nodebug"}};
+    FastRandomContext rng(true);
+    BanMan banman(WriteBanList(rng), nullptr, DEFAULT_MISBEHAVING_BANTIME);
+
+    std::vector<CNetAddr> addrs;
+    for (int i = 0; i < 1000; ++i) {
+        addrs.push_back(i % 2 ? RandomIPv4(rng) : RandomIPv6(rng));
+    }
+    bench.batch(addrs.size()).unit("lookup").run([&] {
+        for (const CNetAddr& addr : addrs) banman.IsBanned(addr);
+    });
+}
+
+BENCHMARK(BanManLoad);
+BENCHMARK(BanManIsBanned);
@@ -0,0 +1,90 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockmap.h>
+#include <chain.h>
+#include <memusage.h>
+#include <random.h>
+#include <tinyformat.h>
+#include <uint256.h>
+#include <util/arena.h>
+
+#include <unordered_map>
+#include <vector>
+
+//! Entries in the simulated block index.
+static const size_t BLOCK_INDEX_ENTRIES = 100000;
+
+static std::vector<uint256> RandomBlockHashes()
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> hashes;
+    hashes.reserve(BLOCK_INDEX_ENTRIES);
+    for (size_t i = 0; i < BLOCK_INDEX_ENTRIES; ++i) hashes.push_back(rng.rand256());
+    return hashes;
+}
+
+namespace {
+//! The block index as InsertBlockIndex builds it.
+struct ArenaBlockIndex {
+    ChunkArena<CBlockIndex> arena;
+    BlockMap map;
+
+    explicit ArenaBlockIndex(const std::vector<uint256>& hashes)
+    {
+        for (const uint256& hash : hashes) {
+            CBlockIndex* pindex = arena.Emplace();
+            pindex->phashBlock = &map.insert(std::make_pair(hash, pindex)).first->first;
+        }
+    }
+
+    size_t DynamicMemoryUsage() const { return arena.DynamicMemoryUsage() + map.DynamicMemoryUsage(); }
+};
+
+//! The previous layout: one heap allocation per entry, which also carried the
+//! KawPoW header fields, in a std::unordered_map.
+struct LegacyBlockIndex {
+    struct Entry {
+        CBlockIndex index;
+        BlockHeaderPoW pow;
+    };
+    std::unordered_map<uint256, Entry*, BlockHasher> map;
+
+    explicit LegacyBlockIndex(const std::vector<uint256>& hashes)
+    {
+        for (const uint256& hash : hashes) {
+            Entry* entry = new Entry();
+            entry->index.phashBlock = &map.emplace(hash, entry).first->first;
+        }
+    }
+    ~LegacyBlockIndex()
+    {
+        for (const auto& entry : map) delete entry.second;
+    }
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(map) + map.size() * memusage::MallocUsage(sizeof(Entry)); }
+};
+} // namespace
+
+// Builds a block index of BLOCK_INDEX_ENTRIES entries. The memory it holds
+// per entry is part of the reported benchmark name.
+template <typename Index>
+static void BlockIndexLoad(benchmark::Bench& bench, const char* name)
+{
+    const std::vector<uint256> hashes = RandomBlockHashes();
+    const size_t usage = Index(hashes).DynamicMemoryUsage();
+    bench.name(strprintf("%s (%u bytes/entry)", name, usage / hashes.size()));
+
+    bench.batch(hashes.size()).unit("entry").run([&] {
+        Index index(hashes);
+        ankerl::nanobench::doNotOptimizeAway(index);
+    });
+}
+
+static void BlockIndexLoadArena(benchmark::Bench& bench) { BlockIndexLoad<ArenaBlockIndex>(bench, "BlockIndexLoadArena"); }
+static void BlockIndexLoadLegacy(benchmark::Bench& bench) { BlockIndexLoad<LegacyBlockIndex>(bench, "BlockIndexLoadLegacy"); }
+
+BENCHMARK(BlockIndexLoadArena);
+BENCHMARK(BlockIndexLoadLegacy);
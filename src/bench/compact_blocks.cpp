@@ -0,0 +1,94 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <crypto/siphash.h>
+#include <random.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <cassert>
+#include <vector>
+
+//! Transactions in the mempool the compact blocks are reconstructed from.
+static const int MEMPOOL_TXS = 50000;
+//! Transactions in each compact block, all of them in the mempool and spread
+//! over it, so that reconstruction looks at every mempool transaction.
+static const int BLOCK_TXS = 2000;
+
+static std::vector<uint256> RandomHashes(size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> hashes(count);
+    for (uint256& hash : hashes) hash = rng.rand256();
+    return hashes;
+}
+
+// The short IDs of a mempool's worth of witness hashes, one SipHash at a time,
+// as compact block reconstruction used to compute them.
+static void ShortTxIdsScalar(benchmark::Bench& bench)
+{
+    const std::vector<uint256> hashes = RandomHashes(MEMPOOL_TXS);
+    std::vector<uint64_t> ids(hashes.size());
+    uint64_t k1 = 0;
+    bench.batch(hashes.size()).unit("tx").run([&] {
+        ++k1;
+        for (size_t i = 0; i < hashes.size(); ++i) ids[i] = SipHashUint256(0, k1, hashes[i]) & 0xffffffffffffULL;
+    });
+}
+
+// The same, several at a time as compact block reconstruction now hashes them.
+static void ShortTxIdsBatch(benchmark::Bench& bench)
+{
+    const std::vector<uint256> hashes = RandomHashes(MEMPOOL_TXS);
+    std::vector<uint64_t> ids(hashes.size());
+    uint64_t k1 = 0;
+    bench.batch(hashes.size()).unit("tx").run([&] {
+        SipHashUint256Batch(0, ++k1, hashes.data(), hashes.size(), ids.data());
+        for (uint64_t& id : ids) id &= 0xffffffffffffULL;
+    });
+}
+
+// Initializing a PartiallyDownloadedBlock from a compact block. Every peer
+// announces a block under a nonce of its own, so each iteration encodes the
+// block afresh and all mempool short IDs are hashed under new keys; encoding
+// the block is a small part of the time.
+static void CompactBlockInitData(benchmark::Bench& bench)
+{
+    FastRandomContext rng(true);
+    CTxMemPool pool;
+    CBlock block;
+    block.nBits = 0x207fffff;
+    block.nNonce = rng.rand32();
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    {
+        LOCK2(cs_main, pool.cs);
+        for (int i = 0; i < MEMPOOL_TXS; ++i) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(rng.rand256(), 0);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = 1000;
+            const CTransactionRef ref = MakeTransactionRef(tx);
+            pool.addUnchecked(CTxMemPoolEntry(ref, 1000, 0, 1, false, 4, LockPoints()));
+            if (i % (MEMPOOL_TXS / BLOCK_TXS) == MEMPOOL_TXS / BLOCK_TXS - 1) block.vtx.push_back(ref);
+        }
+    }
+
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+    bench.run([&] {
+        const CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+        PartiallyDownloadedBlock partial(&pool);
+        const ReadStatus status = partial.InitData(cmpctblock, extra_txn);
+        assert(status == READ_STATUS_OK);
+    });
+}
+
+BENCHMARK(ShortTxIdsScalar);
+BENCHMARK(ShortTxIdsBatch);
+BENCHMARK(CompactBlockInitData);
@@ -5,6 +5,7 @@
 
 #include <bench/bench.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <test/util/setup_common.h>
 #include <txmempool.h>
 
@@ -139,4 +140,48 @@ static void MempoolEviction(benchmark::Bench& bench)
     });
 }
 
+// Sustained inflow into a mempool that is already at its size limit: each
+// round adds a burst of transactions that outbid the cheapest ones in the
+// pool and then trims back to the limit, as a batch submission does.
+static void MempoolEvictionFull(benchmark::Bench& bench)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    constexpr int POOL_TXS = 5000;
+    constexpr int BURST_TXS = 100;
+    FastRandomContext det_rand{true};
+    uint32_t next_prevout = 0;
+    const auto make_tx = [&]() {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(uint256::ONE, next_prevout++);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        return MakeTransactionRef(tx);
+    };
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    for (int i = 0; i < POOL_TXS; ++i) {
+        AddTx(make_tx(), 1000 + det_rand.randrange(10000), pool);
+    }
+    const size_t limit = pool.DynamicMemoryUsage();
+
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (int i = 0; i < BURST_TXS; ++i) {
+            AddTx(make_tx(), 10000 + det_rand.randrange(10000), pool);
+        }
+        pool.TrimToSize(limit);
+    });
+}
+
 BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolEvictionFull);
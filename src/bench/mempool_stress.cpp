@@ -7,7 +7,9 @@
 #include <policy/policy.h>
 #include <test/util/setup_common.h>
 #include <txmempool.h>
+#include <util/memory.h>
 
+#include <memory>
 #include <vector>
 
 static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
@@ -92,4 +94,38 @@ static void ComplexMemPool(benchmark::Bench& bench)
     });
 }
 
+static void MempoolConfirmChain(benchmark::Bench& bench)
+{
+    // A long chain of dependent transactions, all confirmed by one block.
+    std::vector<CTransactionRef> chain;
+    for (int i = 0; i < 500; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = chain.empty() ? COutPoint(uint256::ONE, 0) : COutPoint(chain.back()->GetHash(), 0);
+        tx.vin[0].scriptSig = CScript() << OP_TRUE;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = COIN;
+        chain.push_back(MakeTransactionRef(tx));
+    }
+    TestingSetup test_setup;
+    // Adding the chain takes time quadratic in its length, so each run
+    // confirms it in one of the pools set up beforehand.
+    std::vector<std::unique_ptr<CTxMemPool>> pools;
+    for (int i = 0; i < 20; ++i) {
+        pools.push_back(MakeUnique<CTxMemPool>());
+        LOCK2(cs_main, pools.back()->cs);
+        for (const auto& tx : chain) {
+            AddTx(tx, *pools.back());
+        }
+    }
+    size_t next = 0;
+    bench.epochs(1).epochIterations(pools.size()).run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        CTxMemPool& pool = *pools[next++ % pools.size()];
+        LOCK2(cs_main, pool.cs);
+        pool.removeForBlock(chain, 1);
+    });
+}
+
 BENCHMARK(ComplexMemPool);
+BENCHMARK(MempoolConfirmChain);
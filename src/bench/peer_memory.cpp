@@ -0,0 +1,59 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <tinyformat.h>
+#include <txinventory.h>
+#include <uint256.h>
+
+#include <memory>
+#include <vector>
+
+//! Hashes in a full table.
+static const uint32_t RING_SIZE = TxInventoryTable::DEFAULT_BUCKET_SIZE * TxInventoryTable::DEFAULT_BUCKETS;
+//! Every peer knows one in this many of the hashes.
+static const uint32_t KNOWN_SAMPLE = 64;
+
+// Known transaction inventory of the given number of peers, with the table
+// filled all the way around the ring: first announcements are spread over
+// the peers, and every peer knows hashes in every bucket, so that all its
+// bitmaps are allocated as they would be after relaying for a while. The
+// memory used per connection is part of the reported benchmark name; the
+// benchmark is announcing one more transaction to every peer.
+static void PeerInventoryMemory(benchmark::Bench& bench, const char* name, int peers)
+{
+    FastRandomContext rng(true);
+    TxInventoryTable table;
+    std::vector<std::unique_ptr<KnownTxInventory>> known;
+    for (int i = 0; i < peers; ++i) {
+        known.emplace_back(new KnownTxInventory(table));
+    }
+    for (uint32_t i = 0; i < RING_SIZE; ++i) {
+        const uint256 hash = rng.rand256();
+        known[i % peers]->insert(hash);
+        if (i % KNOWN_SAMPLE == 0) {
+            for (const auto& peer : known) peer->insert(hash);
+        }
+    }
+
+    size_t usage = table.SharedMemoryUsage();
+    for (const auto& peer : known) usage += peer->DynamicMemoryUsage();
+    bench.name(strprintf("%s (%u bytes/peer)", name, usage / peers));
+
+    bench.batch(peers).unit("peer").run([&] {
+        const uint256 hash = rng.rand256();
+        for (const auto& peer : known) {
+            if (!peer->contains(hash)) peer->insert(hash);
+        }
+    });
+}
+
+static void PeerInventoryMemory100(benchmark::Bench& bench) { PeerInventoryMemory(bench, "PeerInventoryMemory100", 100); }
+static void PeerInventoryMemory1000(benchmark::Bench& bench) { PeerInventoryMemory(bench, "PeerInventoryMemory1000", 1000); }
+static void PeerInventoryMemory5000(benchmark::Bench& bench) { PeerInventoryMemory(bench, "PeerInventoryMemory5000", 5000); }
+
+BENCHMARK(PeerInventoryMemory100);
+BENCHMARK(PeerInventoryMemory1000);
+BENCHMARK(PeerInventoryMemory5000);
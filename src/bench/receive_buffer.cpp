@@ -0,0 +1,57 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <streams.h>
+#include <support/bufferpool.h>
+#include <tinyformat.h>
+#include <version.h>
+
+#include <algorithm>
+#include <vector>
+
+//! Bytes handed over by one socket read.
+static const size_t RECV_CHUNK_SIZE = 0x10000;
+
+//! Payload sizes of a typical mix of received messages: inv, tx and getdata
+//! traffic with the odd compact block and full block.
+static const std::vector<size_t> MESSAGE_SIZES{37, 253, 226, 37, 370, 1261, 37, 226, 25000, 37, 226, 530, 37, 1000000};
+
+// Collects each message into a stream the way V1TransportDeserializer does:
+// the buffer grows one size class at a time as data arrives, and is freed
+// once the message was processed.
+template <typename Stream>
+static void ReceiveMessages(benchmark::Bench& bench, const char* name)
+{
+    const std::vector<char> payload(RECV_CHUNK_SIZE, 'x');
+    const auto receive_all = [&] {
+        for (const size_t size : MESSAGE_SIZES) {
+            Stream recv(SER_NETWORK, INIT_PROTO_VERSION);
+            for (size_t pos = 0; pos < size;) {
+                const size_t copy = std::min(size - pos, RECV_CHUNK_SIZE);
+                recv.reserve(std::min(size, BufferPool::SizeClass(pos + copy)));
+                recv.write(payload.data(), copy);
+                pos += copy;
+            }
+            ankerl::nanobench::doNotOptimizeAway(recv);
+        }
+    };
+
+    // The share of allocations the pool serves once it is warm is part of
+    // the reported benchmark name.
+    receive_all();
+    const BufferPool::Stats before = BufferPool::Instance().GetStats();
+    receive_all();
+    const BufferPool::Stats after = BufferPool::Instance().GetStats();
+    const uint64_t pooled = after.hits + after.misses - before.hits - before.misses;
+    bench.name(strprintf("%s (%u%% buffers reused)", name, pooled ? (after.hits - before.hits) * 100 / pooled : 0));
+
+    bench.minEpochIterations(10).batch(MESSAGE_SIZES.size()).unit("message").run(receive_all);
+}
+
+static void ReceiveBufferPooled(benchmark::Bench& bench) { ReceiveMessages<CPooledDataStream>(bench, "ReceiveBufferPooled"); }
+static void ReceiveBufferCleansed(benchmark::Bench& bench) { ReceiveMessages<CDataStream>(bench, "ReceiveBufferCleansed"); }
+
+BENCHMARK(ReceiveBufferPooled);
+BENCHMARK(ReceiveBufferCleansed);
@@ -0,0 +1,132 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <compat.h>
+#include <net.h>
+#include <netbase.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+/** File descriptors left to the test setup: databases, log and the connman's own. */
+static constexpr int RESERVED_FDS = 128;
+
+/** Open a TCP connection over loopback and return (accepted end, connecting end). */
+static std::pair<SOCKET, SOCKET> LoopbackConnection(SOCKET listener, const struct sockaddr_in& addr)
+{
+    SOCKET remote = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(remote != INVALID_SOCKET);
+    const int connected = connect(remote, (const struct sockaddr*)&addr, sizeof(addr));
+    assert(connected == 0);
+    SetSocketNoDelay(remote);
+    SOCKET local = accept(listener, nullptr, nullptr);
+    assert(local != INVALID_SOCKET);
+    SetSocketNonBlocking(local, true);
+    return {local, remote};
+}
+
+// Peers connected over loopback, of which only the first active_peers send a
+// ping per round; each round runs the socket handler until every ping has
+// been received. With persistent event registrations the idle peers cost no
+// system call work. Each peer takes two file descriptors, so the peer counts
+// are scaled down to what the descriptor limit allows and reported in the
+// benchmark name.
+static void SocketHandlerPeers(benchmark::Bench& bench, const char* name, int idle_peers, int active_peers)
+{
+    const int wanted = active_peers + idle_peers;
+    const int fd_limit = RaiseFileDescriptorLimit(2 * wanted + RESERVED_FDS);
+    const int available = fd_limit < 0 ? wanted : std::max(1, (fd_limit - RESERVED_FDS) / 2);
+    if (available < wanted) {
+        active_peers = std::max(1, active_peers * available / wanted);
+        idle_peers = available - active_peers;
+    }
+    bench.name(strprintf("%s (%d idle, %d active)", name, idle_peers, active_peers));
+
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+    ConnmanTestMsg connman{0x1337, 0x1337};
+
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(listener != INVALID_SOCKET);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    const int bound = bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    assert(bound == 0);
+    const int named = getsockname(listener, (struct sockaddr*)&addr, &addr_len);
+    assert(named == 0);
+    const int listening = listen(listener, SOMAXCONN);
+    assert(listening == 0);
+
+    // The nodes are owned by the connman, and deleted along with their
+    // sockets by ClearTestNodes.
+    std::vector<CNode*> nodes;
+    std::vector<SOCKET> remotes;
+    for (int i = 0; i < active_peers + idle_peers; ++i) {
+        const auto connection = LoopbackConnection(listener, addr);
+        CNode* node = new CNode(i, NODE_NETWORK, 0, connection.first, CAddress(), 0, 0, CAddress(), "", ConnectionType::INBOUND);
+        connman.AddTestNodeWithSocket(*node);
+        nodes.push_back(node);
+        remotes.push_back(connection.second);
+    }
+
+    CSerializedNetMsg ping = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::PING, uint64_t{0});
+    std::vector<unsigned char> wire;
+    V1TransportSerializer().prepareForTransport(ping, wire);
+    wire.insert(wire.end(), ping.data.begin(), ping.data.end());
+
+    bench.run([&] {
+        for (int i = 0; i < active_peers; ++i) {
+            const ssize_t sent = send(remotes[i], (const char*)wire.data(), wire.size(), MSG_NOSIGNAL);
+            assert(sent == (ssize_t)wire.size());
+        }
+        int received = 0;
+        while (received < active_peers) {
+            connman.SocketHandlerOnce();
+            received = 0;
+            for (int i = 0; i < active_peers; ++i) {
+                LOCK(nodes[i]->cs_vProcessMsg);
+                received += !nodes[i]->vProcessMsg.empty();
+            }
+        }
+        for (int i = 0; i < active_peers; ++i) {
+            LOCK(nodes[i]->cs_vProcessMsg);
+            nodes[i]->vProcessMsg.clear();
+            nodes[i]->nProcessQueueSize = 0;
+            nodes[i]->fPauseRecv = false;
+        }
+    });
+
+    connman.ClearTestNodes();
+    for (SOCKET& remote : remotes) CloseSocket(remote);
+    CloseSocket(listener);
+}
+
+static void SocketHandlerMostlyIdle(benchmark::Bench& bench)
+{
+    SocketHandlerPeers(bench, "SocketHandlerMostlyIdle", /* idle_peers */ 4000, /* active_peers */ 100);
+}
+
+static void SocketHandlerAllActive(benchmark::Bench& bench)
+{
+    SocketHandlerPeers(bench, "SocketHandlerAllActive", /* idle_peers */ 0, /* active_peers */ 1000);
+}
+
+BENCHMARK(SocketHandlerMostlyIdle);
+BENCHMARK(SocketHandlerAllActive);
@@ -0,0 +1,40 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdownload.h>
+
+#include <algorithm>
+#include <cmath>
+
+/** Shortest time between deliveries we measure, so the rate stays finite. */
+static constexpr std::chrono::microseconds MIN_SERVICE_TIME{1000};
+
+static std::chrono::microseconds Smooth(std::chrono::microseconds average, std::chrono::microseconds sample, double weight)
+{
+    return average + std::chrono::microseconds{static_cast<int64_t>((sample - average).count() * weight)};
+}
+
+void BlockDownloadRate::BlockReceived(std::chrono::microseconds request_time, std::chrono::microseconds now)
+{
+    const std::chrono::microseconds latency = std::max(now - request_time, std::chrono::microseconds{0});
+    const std::chrono::microseconds service_time = std::max(now - std::max(request_time, m_last_delivery), MIN_SERVICE_TIME);
+    const double weight = m_deliveries == 0 ? 1.0 : SMOOTHING;
+    m_latency = Smooth(m_latency, latency, weight);
+    m_service_time = Smooth(m_service_time, service_time, weight);
+    m_last_delivery = now;
+    ++m_deliveries;
+}
+
+double BlockDownloadRate::GetRate() const
+{
+    if (!HasEstimate()) return 0;
+    return 1e6 / std::max(m_service_time, MIN_SERVICE_TIME).count();
+}
+
+int BlockDownloadRate::GetWindow() const
+{
+    if (!HasEstimate()) return DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+    const double window = std::ceil(GetRate() * BLOCK_DOWNLOAD_QUEUE_TIME.count());
+    return static_cast<int>(std::max<double>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<double>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, window)));
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_BLOCKDOWNLOAD_H
+#define LABYRINTH_BLOCKDOWNLOAD_H
+
+#include <chrono>
+#include <stdint.h>
+
+/** Number of blocks requested from a peer at a time until its delivery rate is known. */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Fewest blocks requested from a peer at a time, however slow it is. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** Most blocks requested from a peer at a time, however fast it is. */
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/** How much work, in time, to queue at a peer: its window holds as many blocks as it delivers in this time. */
+static constexpr std::chrono::seconds BLOCK_DOWNLOAD_QUEUE_TIME{4};
+
+/**
+ * Measures how fast a peer delivers the blocks we request from it, and sizes
+ * the number of blocks to keep in flight from it accordingly.
+ *
+ * The rate is measured from the time each block takes to arrive after the
+ * peer was done with the one before it (or after it was requested, if the
+ * peer was idle), so it reflects what the peer can serve while it has work
+ * queued rather than how much we happened to ask for. Latency is the time
+ * from request to delivery. Both are exponentially weighted moving averages.
+ */
+class BlockDownloadRate
+{
+public:
+    /** Record the delivery at now of a block we requested at request_time. */
+    void BlockReceived(std::chrono::microseconds request_time, std::chrono::microseconds now);
+
+    /** Whether a block has been delivered yet, so there are estimates. */
+    bool HasEstimate() const { return m_deliveries > 0; }
+
+    uint64_t GetDeliveries() const { return m_deliveries; }
+
+    /** Blocks per second the peer delivers; 0 without an estimate. */
+    double GetRate() const;
+
+    /** Average time from requesting a block to receiving it. */
+    std::chrono::microseconds GetLatency() const { return m_latency; }
+
+    /** Number of blocks to keep in flight from the peer. */
+    int GetWindow() const;
+
+private:
+    //! Smoothing factor of the averages: the weight of a new sample
+    static constexpr double SMOOTHING = 1.0 / 8;
+
+    uint64_t m_deliveries{0};
+    std::chrono::microseconds m_last_delivery{0};
+    //! Average time between deliveries while the peer has requests to serve
+    std::chrono::microseconds m_service_time{0};
+    std::chrono::microseconds m_latency{0};
+};
+
+#endif // LABYRINTH_BLOCKDOWNLOAD_H
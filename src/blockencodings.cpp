@@ -15,8 +15,12 @@
 #include <validation.h>
 #include <util/system.h>
 
+#include <algorithm>
 #include <unordered_map>
 
+/** Mempool and extra transactions whose short IDs are hashed at once. */
+static const size_t SHORTID_BATCH_SIZE = 64;
+
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
         shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
@@ -45,6 +49,12 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* txhashes, size_t count, uint64_t* out) const {
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, count, out);
+    for (size_t i = 0; i < count; i++) out[i] &= 0xffffffffffffL;
+}
+
 
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
@@ -104,10 +114,18 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
+    uint256 batch_hashes[SHORTID_BATCH_SIZE];
+    uint64_t batch_shortids[SHORTID_BATCH_SIZE];
     {
     LOCK(pool->cs);
     for (size_t i = 0; i < pool->vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(pool->vTxHashes[i].first);
+        const size_t batch_pos = i % SHORTID_BATCH_SIZE;
+        if (batch_pos == 0) {
+            const size_t batch_count = std::min(SHORTID_BATCH_SIZE, pool->vTxHashes.size() - i);
+            for (size_t j = 0; j < batch_count; j++) batch_hashes[j] = pool->vTxHashes[i + j].first;
+            cmpctblock.GetShortIDs(batch_hashes, batch_count, batch_shortids);
+        }
+        uint64_t shortid = batch_shortids[batch_pos];
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
@@ -133,7 +151,13 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
+        const size_t batch_pos = i % SHORTID_BATCH_SIZE;
+        if (batch_pos == 0) {
+            const size_t batch_count = std::min(SHORTID_BATCH_SIZE, extra_txn.size() - i);
+            for (size_t j = 0; j < batch_count; j++) batch_hashes[j] = extra_txn[i + j].first;
+            cmpctblock.GetShortIDs(batch_hashes, batch_count, batch_shortids);
+        }
+        uint64_t shortid = batch_shortids[batch_pos];
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
@@ -108,6 +108,8 @@ public:
     CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    /** Compute the short IDs of count hashes into out, several at a time. */
+    void GetShortIDs(const uint256* txhashes, size_t count, uint64_t* out) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
@@ -123,6 +125,92 @@ public:
     }
 };
 
+/**
+ * A run of consecutive block headers, as sent in a "cmpctheaders" message.
+ *
+ * The first header is sent in full. For each following header, hashPrevBlock
+ * and nHeight follow from the header before it and are left out, nTime is
+ * sent as the (zigzag encoded) difference to the previous header's, and
+ * nVersion and nBits are only sent when they differ from the previous
+ * header's. The missing fields are filled back in when deserializing.
+ */
+class CompressedHeaders {
+private:
+    static constexpr uint8_t FLAG_VERSION = 1;
+    static constexpr uint8_t FLAG_BITS = 2;
+
+public:
+    std::vector<CBlockHeader> headers;
+
+    CompressedHeaders() {}
+    template <typename T>
+    explicit CompressedHeaders(const std::vector<T>& headers_in) : headers(headers_in.begin(), headers_in.end()) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, headers.size());
+        for (size_t i = 0; i < headers.size(); ++i) {
+            const CBlockHeader& header = headers[i];
+            if (i == 0) {
+                s << header;
+                continue;
+            }
+            const CBlockHeader& prev = headers[i - 1];
+            const uint8_t flags = (header.nVersion != prev.nVersion ? FLAG_VERSION : 0) | (header.nBits != prev.nBits ? FLAG_BITS : 0);
+            const int64_t time_delta = int64_t{header.nTime} - int64_t{prev.nTime};
+            s << flags;
+            if (flags & FLAG_VERSION) s << header.nVersion;
+            s << header.hashMerkleRoot;
+            s << VARINT((uint64_t(time_delta) << 1) ^ uint64_t(time_delta >> 63));
+            if (flags & FLAG_BITS) s << header.nBits;
+            s << header.nNonce << header.mix_hash;
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        ReadHeaders(s, ReadCompactSize(s));
+    }
+
+    /** Read count headers, for callers that check the count themselves. */
+    template <typename Stream>
+    void ReadHeaders(Stream& s, uint64_t count)
+    {
+        // Headers are appended one at a time, so a bogus count can't make
+        // us allocate more than the message holds.
+        headers.clear();
+        for (uint64_t i = 0; i < count; ++i) {
+            if (i == 0) {
+                headers.emplace_back();
+                s >> headers.back();
+                continue;
+            }
+            CBlockHeader header;
+            const CBlockHeader& prev = headers.back();
+            uint8_t flags;
+            s >> flags;
+            if (flags & ~(FLAG_VERSION | FLAG_BITS)) throw std::ios_base::failure("unknown compressed header flags");
+            header.nVersion = prev.nVersion;
+            if (flags & FLAG_VERSION) s >> header.nVersion;
+            header.hashPrevBlock = prev.GetHash();
+            s >> header.hashMerkleRoot;
+            uint64_t zigzag;
+            s >> VARINT(zigzag);
+            const int64_t time = int64_t{prev.nTime} + (int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1));
+            if (time < 0 || time > std::numeric_limits<uint32_t>::max()) throw std::ios_base::failure("compressed header time out of range");
+            header.nTime = time;
+            header.nBits = prev.nBits;
+            if (flags & FLAG_BITS) s >> header.nBits;
+            if (prev.nHeight == std::numeric_limits<int>::max()) throw std::ios_base::failure("compressed header height out of range");
+            header.nHeight = prev.nHeight + 1;
+            s >> header.nNonce >> header.mix_hash;
+            headers.push_back(header);
+        }
+    }
+};
+
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txn_available;
@@ -0,0 +1,173 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_BLOCKMAP_H
+#define LABYRINTH_BLOCKMAP_H
+
+#include <crypto/common.h> // for ReadLE64
+#include <uint256.h>
+#include <util/arena.h>
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+struct BlockHasher
+{
+    // this used to call `GetCheapHash()` in uint256, which was later moved; the
+    // cheap hash function simply calls ReadLE64() however, so the end result is
+    // identical
+    size_t operator()(const uint256& hash) const { return ReadLE64(hash.begin()); }
+};
+
+/**
+ * Map from block hash to block index entry.
+ *
+ * An open-addressing table of pointers into an arena of (hash, entry) pairs.
+ * Compared to std::unordered_map this drops the per-node heap allocation,
+ * the bucket array and the chaining pointer; a lookup probes a flat array.
+ *
+ * It offers the subset of the std::unordered_map interface the block index
+ * uses. Entries cannot be erased, only cleared all at once, and elements
+ * never move, so `&it->first` may be kept as CBlockIndex::phashBlock.
+ * Iterators are invalidated by insertion.
+ */
+class BlockMap
+{
+public:
+    using key_type = uint256;
+    using mapped_type = CBlockIndex*;
+    using value_type = std::pair<const uint256, CBlockIndex*>;
+
+private:
+    using Node = value_type;
+
+    template <bool IS_CONST>
+    class Iter
+    {
+        friend class BlockMap;
+        Node* const* m_pos{nullptr};
+        Node* const* m_end{nullptr};
+
+        Iter(Node* const* pos, Node* const* end) : m_pos(pos), m_end(end) { Skip(); }
+        void Skip()
+        {
+            while (m_pos != m_end && *m_pos == nullptr) ++m_pos;
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Node;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::conditional<IS_CONST, const Node*, Node*>::type;
+        using reference = typename std::conditional<IS_CONST, const Node&, Node&>::type;
+
+        Iter() = default;
+        template <bool OTHER_CONST, typename = typename std::enable_if<IS_CONST && !OTHER_CONST>::type>
+        Iter(const Iter<OTHER_CONST>& other) : m_pos(other.m_pos), m_end(other.m_end) {}
+
+        reference operator*() const { return **m_pos; }
+        pointer operator->() const { return *m_pos; }
+        Iter& operator++()
+        {
+            ++m_pos;
+            Skip();
+            return *this;
+        }
+        Iter operator++(int)
+        {
+            Iter copy = *this;
+            ++*this;
+            return copy;
+        }
+        friend bool operator==(const Iter& a, const Iter& b) { return a.m_pos == b.m_pos; }
+        friend bool operator!=(const Iter& a, const Iter& b) { return a.m_pos != b.m_pos; }
+
+        template <bool>
+        friend class Iter;
+    };
+
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    std::vector<value_type*> m_slots;
+    ChunkArena<value_type> m_nodes;
+    size_t m_size{0};
+
+    size_t SlotFor(const uint256& hash) const
+    {
+        const size_t mask = m_slots.size() - 1;
+        size_t i = BlockHasher()(hash) & mask;
+        while (m_slots[i] != nullptr && m_slots[i]->first != hash) i = (i + 1) & mask;
+        return i;
+    }
+
+    void Rehash(size_t capacity)
+    {
+        std::vector<value_type*> old_slots(capacity, nullptr);
+        old_slots.swap(m_slots);
+        for (value_type* node : old_slots) {
+            if (node != nullptr) m_slots[SlotFor(node->first)] = node;
+        }
+    }
+
+public:
+    using iterator = Iter<false>;
+    using const_iterator = Iter<true>;
+
+    BlockMap() = default;
+    BlockMap(const BlockMap&) = delete;
+    BlockMap& operator=(const BlockMap&) = delete;
+
+    iterator begin() { return iterator(m_slots.data(), m_slots.data() + m_slots.size()); }
+    iterator end() { return iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size()); }
+    const_iterator begin() const { return const_iterator(m_slots.data(), m_slots.data() + m_slots.size()); }
+    const_iterator end() const { return const_iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size()); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    iterator find(const uint256& hash)
+    {
+        if (m_size == 0) return end();
+        const size_t i = SlotFor(hash);
+        return m_slots[i] == nullptr ? end() : iterator(m_slots.data() + i, m_slots.data() + m_slots.size());
+    }
+    const_iterator find(const uint256& hash) const { return const_cast<BlockMap*>(this)->find(hash); }
+    size_t count(const uint256& hash) const { return find(hash) != end() ? 1 : 0; }
+
+    std::pair<iterator, bool> emplace(const uint256& hash, CBlockIndex* pindex)
+    {
+        // Keep the load factor at or below 3/4 so probe sequences stay short.
+        if ((m_size + 1) * 4 > m_slots.size() * 3) Rehash(m_slots.empty() ? MIN_CAPACITY : m_slots.size() * 2);
+        const size_t i = SlotFor(hash);
+        const bool inserted = m_slots[i] == nullptr;
+        if (inserted) {
+            m_slots[i] = m_nodes.Emplace(hash, pindex);
+            ++m_size;
+        }
+        return {iterator(m_slots.data() + i, m_slots.data() + m_slots.size()), inserted};
+    }
+
+    template <typename Pair>
+    std::pair<iterator, bool> insert(const Pair& value) { return emplace(value.first, value.second); }
+
+    CBlockIndex*& operator[](const uint256& hash) { return emplace(hash, nullptr).first->second; }
+
+    void clear()
+    {
+        m_slots.clear();
+        m_slots.shrink_to_fit();
+        m_nodes.Clear();
+        m_size = 0;
+    }
+
+    /** Heap memory used by the table and its nodes. */
+    size_t DynamicMemoryUsage() const { return m_slots.capacity() * sizeof(value_type*) + m_nodes.DynamicMemoryUsage(); }
+};
+
+#endif // LABYRINTH_BLOCKMAP_H
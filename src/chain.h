@@ -130,6 +130,20 @@ enum BlockStatus: uint32_t {
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
 };
 
+/**
+ * The KawPoW fields of a block header. CBlockIndex leaves them out to keep
+ * the in-memory block index small; GetRecentBlockHeader() and
+ * ReadBlockHeaders() look them up when a full header has to be rebuilt.
+ */
+struct BlockHeaderPoW
+{
+    uint64_t nNonce{0};
+    uint256 mix_hash{};
+
+    BlockHeaderPoW() {}
+    explicit BlockHeaderPoW(const CBlockHeader& block) : nNonce{block.nNonce}, mix_hash{block.mix_hash} {}
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -179,8 +193,7 @@ public:
     uint256 hashMerkleRoot{};
     uint32_t nTime{0};
     uint32_t nBits{0};
-    uint64_t nNonce{0};
-    uint256 mix_hash{};
+    //! nNonce and mix_hash are not kept in memory; see BlockHeaderPoW.
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId{0};
@@ -197,9 +210,7 @@ public:
           nVersion{block.nVersion},
           hashMerkleRoot{block.hashMerkleRoot},
           nTime{block.nTime},
-          nBits{block.nBits},
-          nNonce{block.nNonce},
-          mix_hash{block.mix_hash}
+          nBits{block.nBits}
     {
     }
 
@@ -221,7 +232,8 @@ public:
         return ret;
     }
 
-    CBlockHeader GetBlockHeader() const
+    //! Rebuild the full block header from this entry and its proof-of-work fields.
+    CBlockHeader GetBlockHeader(const BlockHeaderPoW& pow) const
     {
         CBlockHeader block;
         block.nVersion       = nVersion;
@@ -231,8 +243,8 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nHeight        = nHeight;
-        block.nNonce         = nNonce;
-        block.mix_hash       = mix_hash;
+        block.nNonce         = pow.nNonce;
+        block.mix_hash       = pow.mix_hash;
         return block;
     }
 
@@ -327,15 +339,25 @@ class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashPrev;
+    uint64_t nNonce{0};
+    uint256 mix_hash{};
 
     CDiskBlockIndex() {
         hashPrev = uint256();
     }
 
-    explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
+    CDiskBlockIndex(const CBlockIndex* pindex, const BlockHeaderPoW& pow) : CBlockIndex(*pindex), nNonce{pow.nNonce}, mix_hash{pow.mix_hash} {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
     }
 
+    BlockHeaderPoW GetPoW() const
+    {
+        BlockHeaderPoW pow;
+        pow.nNonce = nNonce;
+        pow.mix_hash = mix_hash;
+        return pow;
+    }
+
     SERIALIZE_METHODS(CDiskBlockIndex, obj)
     {
         int _nVersion = s.GetVersion();
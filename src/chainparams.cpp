@@ -154,6 +154,11 @@ public:
             }
         };
 
+        // Snapshots accepted by loadtxoutset, keyed by base block height. Values are
+        // the gettxoutsetinfo hash_serialized and nChainTx of the base block.
+        m_assumeutxo_data = MapAssumeutxo{
+        };
+
         chainTxData = ChainTxData{
             1668087208,
             6412,
@@ -247,6 +252,9 @@ public:
             }
         };
 
+        m_assumeutxo_data = MapAssumeutxo{
+        };
+
         chainTxData = ChainTxData{
             0,
             0,
@@ -335,6 +343,15 @@ public:
             }
         };
 
+        // The chain of feature_assumeutxo.py: 110 blocks mined to P2WSH(OP_TRUE)
+        // at mocktime 1700000000.
+        m_assumeutxo_data = MapAssumeutxo{
+            {
+                110,
+                {uint256S("0xc78a5d133f9238bcc5d28ae3564177a826a03494771567010bf12376674d994b"), 111},
+            },
+        };
+
         chainTxData = ChainTxData{
             0,
             0,
@@ -350,6 +367,17 @@ const CChainParams &Params() {
     return *globalChainParams;
 }
 
+const AssumeutxoData* ExpectedAssumeutxo(int height, const CChainParams& params)
+{
+    const MapAssumeutxo& valid_assumeutxos_map = params.Assumeutxo();
+    const auto assumeutxo_found = valid_assumeutxos_map.find(height);
+
+    if (assumeutxo_found != valid_assumeutxos_map.end()) {
+        return &assumeutxo_found->second;
+    }
+    return nullptr;
+}
+
 std::unique_ptr<const CChainParams> CreateChainParams(const ArgsManager& args, const std::string& chain)
 {
     if (chain == CBaseChainParams::MAIN) {
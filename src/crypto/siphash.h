@@ -6,6 +6,7 @@
 #ifndef LABYRINTH_CRYPTO_SIPHASH_H
 #define LABYRINTH_CRYPTO_SIPHASH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <uint256.h>
@@ -45,4 +46,11 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Compute out[i] = SipHashUint256(k0, k1, vals[i]) for count values.
+ *
+ *  Where the CPU supports it, several values are hashed at once in the lanes
+ *  of vector registers.
+ */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* vals, size_t count, uint64_t* out);
+
 #endif // LABYRINTH_CRYPTO_SIPHASH_H
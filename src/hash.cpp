@@ -82,20 +82,17 @@ uint256 SHA256Uint256(const uint256& input)
 
 uint256 Hash(const CBlockHeader& blockHeader, uint256& mix_hash)
 {
-    static kawpow::epoch_context_ptr context{nullptr, nullptr};
-
-    // Get the context from the block height
+    // Get the context from the block height. The global context is built once
+    // per epoch and shared, so headers can be hashed from several threads.
     const auto epoch_number = kawpow::get_epoch_number(blockHeader.nHeight);
-
-    if (!context || context->epoch_number != epoch_number)
-        context = kawpow::create_epoch_context(epoch_number);
+    const kawpow::epoch_context& context = kawpow::get_global_epoch_context(epoch_number);
 
     // Build the header_hash
     uint256 nHeaderHash = blockHeader.GetHeaderHash();
     const auto header_hash = to_hash256(nHeaderHash.GetHex());
 
     // ProgPow hash
-    const auto result = progpow::hash(*context, blockHeader.nHeight, header_hash, blockHeader.nNonce);
+    const auto result = progpow::hash(context, blockHeader.nHeight, header_hash, blockHeader.nNonce);
 
     mix_hash = uint256S(to_hex(result.mix_hash));
     return uint256S(to_hex(result.final_hash));
@@ -320,9 +320,12 @@ public:
         auto limit_ancestor_size = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
         auto limit_descendant_count = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
         auto limit_descendant_size = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+        auto limit_cluster_count = gArgs.GetArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT);
+        auto limit_cluster_size = gArgs.GetArg("-limitclustersize", DEFAULT_CLUSTER_SIZE_LIMIT) * 1000;
         std::string unused_error_string;
         LOCK(m_node.mempool->cs);
-        return m_node.mempool->CalculateMemPoolAncestors(
+        return m_node.mempool->CheckClusterLimits(entry, limit_cluster_count, limit_cluster_size, unused_error_string) &&
+               m_node.mempool->CalculateMemPoolAncestors(
             entry, ancestors, limit_ancestor_count, limit_ancestor_size,
             limit_descendant_count, limit_descendant_size, unused_error_string);
     }
@@ -26,6 +26,15 @@
 #include <algorithm>
 #include <utility>
 
+// Limit the number of attempts to add transactions to the block when it is
+// close to full; this is just a simple heuristic to finish quickly if the
+// mempool has a lot of entries.
+static constexpr int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+
+// Beyond this many queued mempool additions a full pass is cheaper than
+// replaying them, so the candidate is dropped instead.
+static constexpr size_t MAX_CANDIDATE_ADDED = 10000;
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     int64_t nOldTime = pblock->nTime;
@@ -57,10 +66,12 @@ BlockAssembler::Options::Options() {
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
 }
 
-BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, const Options& options)
+BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, const Options& options, BlockCandidate* candidate)
     : chainparams(params),
-      m_mempool(mempool)
+      m_mempool(mempool),
+      m_candidate(candidate)
 {
+    assert(!m_candidate || &m_candidate->m_mempool == &m_mempool);
     blockMinFeeRate = options.blockMinFeeRate;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
@@ -81,8 +92,67 @@ static BlockAssembler::Options DefaultOptions()
     return options;
 }
 
-BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& params)
-    : BlockAssembler(mempool, params, DefaultOptions()) {}
+BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, BlockCandidate* candidate)
+    : BlockAssembler(mempool, params, DefaultOptions(), candidate) {}
+
+BlockCandidate::BlockCandidate(CTxMemPool& mempool) : m_mempool(mempool)
+{
+    m_mempool.RegisterObserver(*this);
+}
+
+BlockCandidate::~BlockCandidate()
+{
+    m_mempool.UnregisterObserver(*this);
+}
+
+void BlockCandidate::EntryAdded(const CTxMemPoolEntry& entry)
+{
+    AssertLockHeld(m_mempool.cs);
+    ++m_transactions_updated;
+    if (!m_valid) return;
+    if (m_added.size() >= MAX_CANDIDATE_ADDED) {
+        Invalidate();
+        return;
+    }
+    m_added.push_back(entry.GetTx().GetHash());
+}
+
+void BlockCandidate::EntryRemoved(const CTxMemPoolEntry& entry, MemPoolRemovalReason reason)
+{
+    AssertLockHeld(m_mempool.cs);
+    ++m_transactions_updated;
+    // A transaction the last pass never evaluated took no part in it, and its
+    // descendants are removed along with it, so only the others matter.
+    const uint256& hash = entry.GetTx().GetHash();
+    if (m_valid && (m_selected.count(hash) || m_evaluated.count(hash))) {
+        Invalidate();
+    }
+}
+
+void BlockCandidate::Invalidate()
+{
+    m_valid = false;
+    m_added.clear();
+    m_txs.clear();
+    m_selected.clear();
+    m_evaluated.clear();
+    m_worst = nullopt;
+}
+
+void BlockCandidate::Evaluated(const Score& score)
+{
+    m_evaluated.insert(score.GetTx().GetHash());
+    if (!m_worst || CompareTxMemPoolEntryByAncestorFee()(*m_worst, score)) {
+        m_worst = score;
+    }
+}
+
+void BlockCandidate::Select(CTxMemPool::txiter it)
+{
+    m_txs.push_back(it);
+    m_selected.insert(it->GetTx().GetHash());
+    m_weight_bound += WITNESS_SCALE_FACTOR * it->GetTxSize();
+}
 
 void BlockAssembler::resetBlock()
 {
@@ -142,7 +212,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    const bool fIncremental = m_candidate && UpdateCandidate(pindexPrev->GetBlockHash(), nPackagesSelected);
+    if (!fIncremental) {
+        if (m_candidate) ResetCandidate(pindexPrev->GetBlockHash());
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -181,11 +255,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     BlockValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        if (m_candidate) m_candidate->Invalidate();
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, state.ToString()));
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d %spackages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, fIncremental ? "appended " : "", nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -325,11 +400,8 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = m_mempool.mapTx.get<ancestor_score>().begin();
     CTxMemPool::txiter iter;
 
-    // Limit the number of attempts to add transactions to the block when it is
-    // close to full; this is just a simple heuristic to finish quickly if the
-    // mempool has a lot of entries.
-    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
+    BlockCandidate::End end = BlockCandidate::End::EXHAUSTED;
 
     while (mi != m_mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty()) {
         // First try to find a new transaction in mapTx to evaluate.
@@ -377,13 +449,18 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             packageFees = modit->nModFeesWithAncestors;
             packageSigOpsCost = modit->nSigOpCostWithAncestors;
         }
+        if (m_candidate) {
+            m_candidate->Evaluated(fUsingModified ? BlockCandidate::Score(*modit) : BlockCandidate::Score(CTxMemPoolModifiedEntry(iter)));
+        }
 
         if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
             // Everything else we might consider has a lower fee rate
-            return;
+            end = BlockCandidate::End::MIN_FEE;
+            break;
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            if (m_candidate) m_candidate->m_clean = false;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -397,6 +474,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
                     nBlockMaxWeight - 4000) {
                 // Give up if we're close to full and haven't succeeded in a while
+                end = BlockCandidate::End::FULL;
                 break;
             }
             continue;
@@ -412,6 +490,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 
         // Test if all tx's are Final
         if (!TestPackageTransactions(ancestors)) {
+            if (m_candidate) m_candidate->m_clean = false;
             if (fUsingModified) {
                 mapModifiedTx.get<ancestor_score>().erase(modit);
                 failedTx.insert(iter);
@@ -428,6 +507,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 
         for (size_t i=0; i<sortedEntries.size(); ++i) {
             AddToBlock(sortedEntries[i]);
+            if (m_candidate) m_candidate->Select(sortedEntries[i]);
             // Erase from the modified set, if present
             mapModifiedTx.erase(sortedEntries[i]);
         }
@@ -437,6 +517,141 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
+
+    if (m_candidate) {
+        m_candidate->m_end = end;
+        m_candidate->m_consecutive_failed = nConsecutiveFailed;
+        m_candidate->m_weight = nBlockWeight;
+        m_candidate->m_sigops = nBlockSigOpsCost;
+    }
+}
+
+void BlockAssembler::ResetCandidate(const uint256& tip)
+{
+    BlockCandidate& candidate = *m_candidate;
+    candidate.Invalidate();
+    candidate.m_valid = true;
+    candidate.m_transactions_updated = m_mempool.GetTransactionsUpdated();
+    candidate.m_tip = tip;
+    candidate.m_height = nHeight;
+    candidate.m_lock_time_cutoff = nLockTimeCutoff;
+    candidate.m_include_witness = fIncludeWitness;
+    candidate.m_min_fee_rate = blockMinFeeRate;
+    candidate.m_max_weight = nBlockMaxWeight;
+    candidate.m_end = BlockCandidate::End::EXHAUSTED;
+    candidate.m_clean = true;
+    candidate.m_consecutive_failed = 0;
+    candidate.m_weight = nBlockWeight;
+    candidate.m_sigops = nBlockSigOpsCost;
+    candidate.m_weight_bound = nBlockWeight;
+}
+
+bool BlockAssembler::UpdateCandidate(const uint256& tip, int& nPackagesSelected)
+{
+    BlockCandidate& candidate = *m_candidate;
+    if (!candidate.m_valid || candidate.m_transactions_updated != m_mempool.GetTransactionsUpdated() ||
+        candidate.m_tip != tip || candidate.m_height != nHeight || candidate.m_lock_time_cutoff != nLockTimeCutoff ||
+        candidate.m_include_witness != fIncludeWitness || candidate.m_min_fee_rate != blockMinFeeRate ||
+        candidate.m_max_weight != nBlockMaxWeight) {
+        return false;
+    }
+
+    // TestPackage() checks against the running totals, so evaluate the new
+    // transactions against those of the candidate.
+    const uint64_t nBlockWeightEmpty = nBlockWeight;
+    const uint64_t nBlockSigOpsCostEmpty = nBlockSigOpsCost;
+    nBlockWeight = candidate.m_weight;
+    nBlockSigOpsCost = candidate.m_sigops;
+    bool fUpdated = true;
+    for (const uint256& hash : candidate.m_added) {
+        CTxMemPool::txiter it = m_mempool.mapTx.find(hash);
+        // Added and removed again
+        if (it == m_mempool.mapTx.end()) continue;
+        if (!AppendToCandidate(it, nPackagesSelected)) {
+            fUpdated = false;
+            break;
+        }
+    }
+    candidate.m_added.clear();
+    candidate.m_weight = nBlockWeight;
+    candidate.m_sigops = nBlockSigOpsCost;
+    nBlockWeight = nBlockWeightEmpty;
+    nBlockSigOpsCost = nBlockSigOpsCostEmpty;
+    if (!fUpdated) return false;
+
+    for (CTxMemPool::txiter it : candidate.m_txs) {
+        AddToBlock(it);
+    }
+    return true;
+}
+
+// A full pass evaluates packages best first and stops at the first one below
+// the minimum fee rate, or when it runs out of packages or space. A package's
+// score never exceeds the fee rate of its last transaction, so a new
+// transaction that scores below every package the pass evaluated would only
+// have been reached after all of them: the result is unchanged, or the
+// transaction is evaluated at the end if the pass ran out of packages.
+// Failing that, a transaction without unconfirmed parents is taken as is when
+// no package failed and everything still fits, since in that case the order
+// of evaluation does not change which packages get in.
+bool BlockAssembler::AppendToCandidate(CTxMemPool::txiter it, int& nPackagesSelected)
+{
+    BlockCandidate& candidate = *m_candidate;
+    CTxMemPoolModifiedEntry own(it);
+    own.nSizeWithAncestors = it->GetTxSize();
+    own.nModFeesWithAncestors = it->GetModifiedFee();
+    own.nSigOpCostWithAncestors = it->GetSigOpCost();
+    const BlockCandidate::Score score(own);
+    const bool fHasAncestors = it->GetCountWithAncestors() > 1;
+
+    if (!candidate.m_worst || CompareTxMemPoolEntryByAncestorFee()(*candidate.m_worst, score)) {
+        if (candidate.m_end != BlockCandidate::End::EXHAUSTED) return true;
+        if (fHasAncestors) {
+            // Ancestors outside the selection failed before; leave replaying
+            // their package to a full pass.
+            CTxMemPool::setEntries ancestors;
+            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+            std::string dummy;
+            m_mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            for (CTxMemPool::txiter ancestor : ancestors) {
+                if (!candidate.m_selected.count(ancestor->GetTx().GetHash())) return false;
+            }
+        }
+
+        candidate.Evaluated(score);
+        if (own.nModFeesWithAncestors < blockMinFeeRate.GetFee(own.nSizeWithAncestors)) {
+            candidate.m_end = BlockCandidate::End::MIN_FEE;
+            return true;
+        }
+        if (!TestPackage(own.nSizeWithAncestors, own.nSigOpCostWithAncestors)) {
+            candidate.m_clean = false;
+            ++candidate.m_consecutive_failed;
+            if (candidate.m_consecutive_failed > MAX_CONSECUTIVE_FAILURES && nBlockWeight > nBlockMaxWeight - 4000) {
+                candidate.m_end = BlockCandidate::End::FULL;
+            }
+            return true;
+        }
+        if (!TestPackageTransactions({it})) {
+            candidate.m_clean = false;
+            return true;
+        }
+        candidate.m_consecutive_failed = 0;
+    } else {
+        if (candidate.m_end != BlockCandidate::End::EXHAUSTED || !candidate.m_clean || fHasAncestors) return false;
+        if (own.nModFeesWithAncestors < blockMinFeeRate.GetFee(own.nSizeWithAncestors)) return false;
+        if (candidate.m_weight_bound + WITNESS_SCALE_FACTOR * own.nSizeWithAncestors >= nBlockMaxWeight ||
+            nBlockSigOpsCost + own.nSigOpCostWithAncestors >= MAX_BLOCK_SIGOPS_COST) {
+            return false;
+        }
+        if (!TestPackageTransactions({it})) return false;
+        candidate.Evaluated(score);
+    }
+
+    candidate.Select(it);
+    nBlockWeight += it->GetTxWeight();
+    nBlockSigOpsCost += it->GetSigOpCost();
+    ++nPackagesSelected;
+    return true;
 }
 
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
@@ -14,6 +14,7 @@
 
 #include <memory>
 #include <stdint.h>
+#include <unordered_set>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -123,6 +124,99 @@ struct update_for_parent_inclusion
     CTxMemPool::txiter iter;
 };
 
+/**
+ * Transaction selection for the next block, kept up to date between
+ * CreateNewBlock calls.
+ *
+ * A full addPackageTxs() pass walks the whole mempool. BlockAssembler records
+ * the outcome of the last pass here: the selected transactions in block order,
+ * every package that was evaluated, the lowest scoring of them, and why the
+ * pass stopped. Transactions added to the mempool are queued and removals are
+ * checked as they happen. The next template on the same tip reuses the
+ * selection if the queued transactions provably leave the result of a full
+ * pass unchanged or only add to it. Anything else (removing a transaction the
+ * pass looked at, a fee delta, a new tip, different options) falls back to a
+ * full pass.
+ *
+ * Appended transactions may sit later in the block than a full pass would put
+ * them; the set of transactions and the fees are the same.
+ *
+ * All members are guarded by the mempool's cs.
+ */
+class BlockCandidate final : public MemPoolObserver
+{
+public:
+    explicit BlockCandidate(CTxMemPool& mempool);
+    ~BlockCandidate();
+
+    void EntryAdded(const CTxMemPoolEntry& entry) override;
+    void EntryRemoved(const CTxMemPoolEntry& entry, MemPoolRemovalReason reason) override;
+
+private:
+    friend class BlockAssembler;
+
+    //! Why the last pass stopped
+    enum class End {
+        EXHAUSTED, //!< every candidate package was evaluated
+        MIN_FEE,   //!< a package was below the minimum fee rate
+        FULL,      //!< too many consecutive failures with the block nearly full
+    };
+
+    //! Fee and size of an evaluated package, ordered by CompareTxMemPoolEntryByAncestorFee
+    struct Score {
+        CTransactionRef tx;
+        CAmount nModFee;
+        size_t nTxSize;
+        CAmount nModFeesWithAncestors;
+        uint64_t nSizeWithAncestors;
+
+        explicit Score(const CTxMemPoolModifiedEntry& entry)
+            : tx(entry.iter->GetSharedTx()), nModFee(entry.GetModifiedFee()), nTxSize(entry.GetTxSize()),
+              nModFeesWithAncestors(entry.GetModFeesWithAncestors()), nSizeWithAncestors(entry.GetSizeWithAncestors()) {}
+
+        CAmount GetModifiedFee() const { return nModFee; }
+        size_t GetTxSize() const { return nTxSize; }
+        CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+        uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+        const CTransaction& GetTx() const { return *tx; }
+    };
+
+    CTxMemPool& m_mempool;
+
+    //! Whether the members below describe a pass whose inputs are still current
+    bool m_valid{false};
+    //! Expected GetTransactionsUpdated(), to catch changes not reported to observers
+    unsigned int m_transactions_updated{0};
+    //! Transactions added since the selection was last brought up to date
+    std::vector<uint256> m_added;
+
+    // Parameters of the pass
+    uint256 m_tip;
+    int m_height{0};
+    int64_t m_lock_time_cutoff{0};
+    bool m_include_witness{false};
+    CFeeRate m_min_fee_rate;
+    unsigned int m_max_weight{0};
+
+    // Outcome of the pass
+    std::vector<CTxMemPool::txiter> m_txs;
+    std::unordered_set<uint256, SaltedTxidHasher> m_selected;
+    std::unordered_set<uint256, SaltedTxidHasher> m_evaluated;
+    Optional<Score> m_worst;
+    End m_end{End::EXHAUSTED};
+    //! No package failed TestPackage() or TestPackageTransactions()
+    bool m_clean{true};
+    int64_t m_consecutive_failed{0};
+    uint64_t m_weight{0};
+    uint64_t m_sigops{0};
+    //! Reserved weight plus WITNESS_SCALE_FACTOR times the selection's virtual size
+    uint64_t m_weight_bound{0};
+
+    void Invalidate();
+    void Evaluated(const Score& score);
+    void Select(CTxMemPool::txiter it);
+};
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
@@ -147,6 +241,7 @@ private:
     int64_t nLockTimeCutoff;
     const CChainParams& chainparams;
     const CTxMemPool& m_mempool;
+    BlockCandidate* const m_candidate;
 
 public:
     struct Options {
@@ -155,8 +250,9 @@ public:
         CFeeRate blockMinFeeRate;
     };
 
-    explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params);
-    explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, const Options& options);
+    /** If candidate is given, it must observe mempool and is used to reuse work between calls. */
+    explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, BlockCandidate* candidate = nullptr);
+    explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, const Options& options, BlockCandidate* candidate = nullptr);
 
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
@@ -196,6 +292,16 @@ private:
       * state updated assuming given transactions are inBlock. Returns number
       * of updated descendants. */
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+
+    // Methods for maintaining m_candidate.
+    /** Clear the candidate and record the parameters of a new full pass */
+    void ResetCandidate(const uint256& tip) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Bring the candidate up to date and add its transactions to the block.
+      * Returns false, without touching the block, if a full pass is needed. */
+    bool UpdateCandidate(const uint256& tip, int& nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Apply a transaction added since the last pass to the candidate.
+      * Returns false if only a full pass can tell the outcome. */
+    bool AppendToCandidate(CTxMemPool::txiter it, int& nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
 /** Modify the extranonce in a block */
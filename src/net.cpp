@@ -20,13 +20,16 @@
 #include <protocol.h>
 #include <random.h>
 #include <scheduler.h>
+#include <support/bufferpool.h>
 #include <util/strencodings.h>
+#include <util/threadnames.h>
 #include <util/translation.h>
 
 #ifdef WIN32
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #if HAVE_DECL_GETIFADDRS && HAVE_DECL_FREEIFADDRS
@@ -37,6 +40,11 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/upnpcommands.h>
@@ -106,6 +114,19 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+#ifndef WIN32
+/** Maximum number of send queue parts handed to the kernel in one sendmsg() call. */
+static constexpr int MAX_SEND_IOV = 64;
+#endif
+
+/** Processing time, in microseconds, a peer can save up while it has nothing to process. */
+static constexpr int64_t MSGPROC_QUANTUM_USEC = 10000;
+
+#ifdef USE_EPOLL
+/** Maximum number of socket events retrieved by one epoll_wait() call. */
+static constexpr int MAX_EPOLL_EVENTS = 1024;
+#endif
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -625,6 +646,7 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
     stats.m_ping_usec = nPingUsecTime;
     stats.m_min_ping_usec  = nMinPingUsecTime;
     stats.m_ping_wait_usec = count_microseconds(ping_wait);
+    stats.m_msgproc_time_usec = m_msgproc_time_usec;
 
     // Leave string empty if addrLocal invalid (not filled in yet)
     CService addrLocalUnlocked = GetAddrLocal();
@@ -736,13 +758,13 @@ int V1TransportDeserializer::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
+    // Grow the buffer one pool size class at a time, so a peer can't make us
+    // allocate much more than it has sent, but never beyond the total
+    // message size.
+    vRecv.reserve(std::min<size_t>(hdr.nMessageSize, BufferPool::SizeClass(nDataPos + nCopy)));
 
     hasher.Write({(const unsigned char*)pch, nCopy});
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -793,12 +815,10 @@ Optional<CNetMessage> V1TransportDeserializer::GetMessage(const std::chrono::mic
     return msg;
 }
 
-void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
-    // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data);
-
+static void MakeV1Header(const std::string& msg_type, size_t size, const uint256& hash, std::vector<unsigned char>& header)
+{
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg_type.c_str(), size);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
@@ -806,33 +826,80 @@ void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vec
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
 }
 
+void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
+    // create dbl-sha256 checksum
+    uint256 hash = Hash(msg.data);
+    MakeV1Header(msg.m_type, msg.data.size(), hash, header);
+}
+
+void V1TransportSerializer::prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) {
+    MakeV1Header(msg.m_type, msg.data->size(), msg.m_hash, header);
+}
+
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg)
+    : data(std::make_shared<const std::vector<unsigned char>>(std::move(msg.data))),
+      m_type(std::move(msg.m_type)),
+      m_hash(Hash(*data))
+{
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
 {
     auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert(it->size() > pnode->nSendOffset);
+        size_t nBytesToSend = 0;
+#ifndef WIN32
+        // Hand as much of the queue as possible to the kernel at once, so a
+        // header and its payload, which may be shared with other peers, go
+        // out together without being copied into one buffer first.
+        struct iovec iov[MAX_SEND_IOV];
+        int iov_count = 0;
+        for (auto chunk = it; chunk != pnode->vSendMsg.end() && iov_count < MAX_SEND_IOV; ++chunk, ++iov_count) {
+            const size_t offset = iov_count == 0 ? pnode->nSendOffset : 0;
+            iov[iov_count].iov_base = const_cast<unsigned char*>(chunk->data()) + offset;
+            iov[iov_count].iov_len = chunk->size() - offset;
+            nBytesToSend += iov[iov_count].iov_len;
+        }
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+#else
+        nBytesToSend = it->size() - pnode->nSendOffset;
+#endif
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifndef WIN32
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(it->data()) + pnode->nSendOffset, nBytesToSend, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Move past every part of the queue that went out completely.
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                const size_t nLeft = it->size() - pnode->nSendOffset;
+                if (nRemaining < nLeft) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nBytesToSend) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1154,6 +1221,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     {
         LOCK(cs_vNodes);
+        RegisterSocket(pnode->hSocket, /* listen */ false);
         vNodes.push_back(pnode);
     }
 
@@ -1313,7 +1381,41 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
     return !recv_set.empty() || !send_set.empty() || !error_set.empty();
 }
 
-#ifdef USE_POLL
+#if defined(USE_EPOLL)
+void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    // Sockets stay registered for their whole lifetime, so there is nothing
+    // to rebuild here. Don't wait at all if the previous pass left sockets
+    // that are still readable or writable.
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    const int timeout = m_socket_work_pending ? 0 : SELECT_TIMEOUT_MILLISECONDS;
+    const int count = epoll_wait(m_epoll_fd, events, MAX_EPOLL_EVENTS, timeout);
+
+    if (interruptNet) return;
+
+    if (count < 0) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const int fd = events[i].data.fd;
+        if (fd == m_wake_fd) {
+            uint64_t value;
+            if (read(m_wake_fd, &value, sizeof(value)) < 0) {
+                // Nothing to do: the counter was already reset by an earlier read.
+            }
+            continue;
+        }
+        if (events[i].events & EPOLLIN)              recv_set.insert(fd);
+        if (events[i].events & EPOLLOUT)             send_set.insert(fd);
+        if (events[i].events & (EPOLLERR|EPOLLHUP))  error_set.insert(fd);
+    }
+}
+#elif defined(USE_POLL)
 void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
@@ -1459,6 +1561,9 @@ void CConnman::SocketHandler()
         for (CNode* pnode : vNodesCopy)
             pnode->AddRef();
     }
+#ifdef USE_EPOLL
+    bool work_pending = false;
+#endif
     for (CNode* pnode : vNodesCopy)
     {
         if (interruptNet)
@@ -1478,6 +1583,18 @@ void CConnman::SocketHandler()
             sendSet = send_set.count(pnode->hSocket) > 0;
             errorSet = error_set.count(pnode->hSocket) > 0;
         }
+#ifdef USE_EPOLL
+        // Events are edge-triggered, so remember readiness until an operation
+        // would block, and apply the same policy as GenerateSelectSet: drain
+        // the send queue before receiving more.
+        pnode->m_recv_ready |= recvSet;
+        pnode->m_send_ready |= sendSet;
+        {
+            LOCK(pnode->cs_vSend);
+            sendSet = pnode->m_send_ready && !pnode->vSendMsg.empty();
+            recvSet = pnode->m_recv_ready && !pnode->fPauseRecv && pnode->vSendMsg.empty();
+        }
+#endif
         if (recvSet || errorSet)
         {
             // typical socket buffer is 8K-64K
@@ -1489,6 +1606,10 @@ void CConnman::SocketHandler()
                     continue;
                 nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
             }
+#ifdef USE_EPOLL
+            // A short read drained the socket; more data raises a new edge.
+            pnode->m_recv_ready = nBytes == (int)sizeof(pchBuf);
+#endif
             if (nBytes > 0)
             {
                 bool notify = false;
@@ -1544,10 +1665,24 @@ void CConnman::SocketHandler()
             if (nBytes) {
                 RecordBytesSent(nBytes);
             }
+#ifdef USE_EPOLL
+            // Data left in the queue means the send would block; EPOLLOUT will follow.
+            pnode->m_send_ready = pnode->vSendMsg.empty();
+#endif
         }
 
+#ifdef USE_EPOLL
+        if (pnode->m_recv_ready && !pnode->fPauseRecv && !pnode->fDisconnect) {
+            LOCK(pnode->cs_vSend);
+            work_pending |= pnode->vSendMsg.empty();
+        }
+#endif
+
         InactivityCheck(pnode);
     }
+#ifdef USE_EPOLL
+    m_socket_work_pending = work_pending;
+#endif
     {
         LOCK(cs_vNodes);
         for (CNode* pnode : vNodesCopy)
@@ -1565,13 +1700,37 @@ void CConnman::ThreadSocketHandler()
     }
 }
 
+void CConnman::RegisterSocket(SOCKET hSocket, bool listen)
+{
+#ifdef USE_EPOLL
+    struct epoll_event event{};
+    // Listening sockets stay level-triggered as one connection is accepted per pass.
+    event.events = listen ? EPOLLIN : (EPOLLIN | EPOLLOUT | EPOLLET);
+    event.data.fd = hSocket;
+    // Closing the socket removes it from the epoll set again.
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, hSocket, &event) != 0) {
+        LogPrintf("%s: failed to register socket: %s\n", __func__, NetworkErrorString(errno));
+    }
+#endif
+}
+
+void CConnman::WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    const uint64_t one = 1;
+    if (write(m_wake_fd, &one, sizeof(one)) < 0) {
+        // The counter is saturated, so the socket handler will wake up anyway.
+    }
+#endif
+}
+
 void CConnman::WakeMessageHandler()
 {
     {
         LOCK(mutexMsgProc);
-        fMsgProcWake = true;
+        ++m_msgproc_wake_seq;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -2208,33 +2367,55 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     m_msgproc->InitializeNode(pnode);
     {
         LOCK(cs_vNodes);
+        RegisterSocket(pnode->hSocket, /* listen */ false);
         vNodes.push_back(pnode);
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int shard)
 {
+    if (shard > 0) util::ThreadRename(strprintf("msghand.%i", shard));
+
+    uint64_t wake_seq = WITH_LOCK(mutexMsgProc, return m_msgproc_wake_seq);
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % m_msgproc_threads != shard) continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
         bool fMoreWork = false;
+        int64_t nNextCredit = std::numeric_limits<int64_t>::max();
 
         for (CNode* pnode : vNodesCopy)
         {
             if (pnode->fDisconnect)
                 continue;
 
-            // Receive messages
-            bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
+            // A peer whose messages took more than its share of processing
+            // time sits out until it earned it back, so that one expensive
+            // peer doesn't hold up the others handled by this thread.
+            const int64_t nProcessStart = GetTimeMicros();
+            pnode->m_msgproc_credit = std::min(pnode->m_msgproc_credit + (nProcessStart - pnode->m_msgproc_refill_time), MSGPROC_QUANTUM_USEC);
+            pnode->m_msgproc_refill_time = nProcessStart;
+
+            if (pnode->m_msgproc_credit > 0) {
+                // Receive messages
+                const bool was_paused = pnode->fPauseRecv;
+                bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
+                fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
+                // Let the socket handler read what arrived while the peer was paused.
+                if (was_paused && !pnode->fPauseRecv) WakeSocketHandler();
+            } else {
+                // Sleep until the peer has earned credit again rather than
+                // spinning over it.
+                nNextCredit = std::min(nNextCredit, nProcessStart + 1 - pnode->m_msgproc_credit);
+            }
             if (flagInterruptMsgProc)
                 return;
             // Send messages
@@ -2243,6 +2424,10 @@ void CConnman::ThreadMessageHandler()
                 m_msgproc->SendMessages(pnode);
             }
 
+            const int64_t nProcessTime = GetTimeMicros() - nProcessStart;
+            pnode->m_msgproc_credit -= nProcessTime;
+            pnode->m_msgproc_time_usec += nProcessTime;
+
             if (flagInterruptMsgProc)
                 return;
         }
@@ -2255,9 +2440,10 @@ void CConnman::ThreadMessageHandler()
 
         WAIT_LOCK(mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) { return fMsgProcWake; });
+            const int64_t nWaitUsec = std::min<int64_t>(100000, std::max<int64_t>(0, nNextCredit - GetTimeMicros()));
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::microseconds(nWaitUsec), [&]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) { return m_msgproc_wake_seq != wake_seq; });
         }
-        fMsgProcWake = false;
+        wake_seq = m_msgproc_wake_seq;
     }
 }
 
@@ -2321,6 +2507,7 @@ bool CConnman::BindListenPort(const CService& addrBind, bilingual_str& strError,
         return false;
     }
 
+    RegisterSocket(hListenSocket, /* listen */ true);
     vhListenSocket.push_back(ListenSocket(hListenSocket, permissions));
     return true;
 }
@@ -2397,6 +2584,17 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In, bool network_active)
     Options connOptions;
     Init(connOptions);
     SetNetworkActive(network_active);
+
+#ifdef USE_EPOLL
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll_fd != -1 && m_wake_fd != -1) {
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = m_wake_fd;
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event);
+    }
+#endif
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2454,6 +2652,17 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 {
     Init(connOptions);
 
+#ifdef USE_EPOLL
+    if (m_epoll_fd == -1 || m_wake_fd == -1) {
+        if (clientInterface) {
+            clientInterface->ThreadSafeMessageBox(
+                _("Failed to set up socket event notification."),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+        return false;
+    }
+#endif
+
     {
         LOCK(cs_totalBytesRecv);
         nTotalBytesRecv = 0;
@@ -2524,11 +2733,6 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
-    }
-
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2552,7 +2756,10 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    LogPrintf("Using %d message processing threads\n", m_msgproc_threads);
+    for (int shard = 0; shard < m_msgproc_threads; ++shard) {
+        threadMessageHandlers.emplace_back(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, shard)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery([this] { DumpAddresses(); }, DUMP_PEERS_INTERVAL);
@@ -2584,6 +2791,7 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    WakeSocketHandler();
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2601,8 +2809,11 @@ void CConnman::Interrupt()
 
 void CConnman::StopThreads()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2667,6 +2878,10 @@ CConnman::~CConnman()
 {
     Interrupt();
     Stop();
+#ifdef USE_EPOLL
+    if (m_wake_fd != -1) close(m_wake_fd);
+    if (m_epoll_fd != -1) close(m_epoll_fd);
+#endif
 }
 
 void CConnman::SetServices(const CService &addr, ServiceFlags nServices)
@@ -2705,6 +2920,7 @@ std::vector<CAddress> CConnman::GetAddresses(CNode& requestor, size_t max_addres
         .Write(local_socket_bytes.data(), local_socket_bytes.size())
         .Finalize();
     const auto current_time = GetTime<std::chrono::microseconds>();
+    LOCK(m_addr_response_caches_mutex);
     auto r = m_addr_response_caches.emplace(cache_id, CachedAddrResponse{});
     CachedAddrResponse& cache_entry = r.first->second;
     if (cache_entry.m_cache_entry_expiration < current_time) { // If emplace() added new one it has expiration 0.
@@ -3011,7 +3227,22 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     // make sure we use the appropriate network transport format
     std::vector<unsigned char> serializedHeader;
     pnode->m_serializer->prepareForTransport(msg, serializedHeader);
-    size_t nTotalSize = nMessageSize + serializedHeader.size();
+    QueueMessage(pnode, msg.m_type, std::move(serializedHeader), CSendBuffer(std::move(msg.data)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    LogPrint(BCLog::NET, "sending %s (%d bytes, shared) peer=%d\n",  SanitizeString(msg.m_type), msg.data->size(), pnode->GetId());
+
+    std::vector<unsigned char> serializedHeader;
+    pnode->m_serializer->prepareForTransport(msg, serializedHeader);
+    QueueMessage(pnode, msg.m_type, std::move(serializedHeader), CSendBuffer(msg.data));
+}
+
+void CConnman::QueueMessage(CNode* pnode, const std::string& msg_type, std::vector<unsigned char>&& header, CSendBuffer&& payload)
+{
+    size_t nMessageSize = payload.size();
+    size_t nTotalSize = nMessageSize + header.size();
 
     size_t nBytesSent = 0;
     {
@@ -3019,14 +3250,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         bool optimisticSend(pnode->vSendMsg.empty());
 
         //log total amount of bytes per message type
-        pnode->mapSendBytesPerMsgCmd[msg.m_type] += nTotalSize;
+        pnode->mapSendBytesPerMsgCmd[msg_type] += nTotalSize;
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.emplace_back(std::move(header));
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(std::move(payload));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
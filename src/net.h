@@ -24,6 +24,7 @@
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
+#include <txinventory.h>
 #include <uint256.h>
 
 #include <atomic>
@@ -85,6 +86,10 @@ static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
 static const bool DEFAULT_BLOCKSONLY = false;
 /** -peertimeout default */
 static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
+/** -msgprocthreads default */
+static const int DEFAULT_MSGPROC_THREADS = 4;
+/** Maximum number of message processing threads */
+static const int MAX_MSGPROC_THREADS = 16;
 
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
@@ -116,6 +121,35 @@ struct CSerializedNetMsg
     std::string m_type;
 };
 
+/**
+ * A serialized message with an immutable payload, which can be queued for
+ * any number of peers without copying it.
+ */
+struct CSharedNetMsg
+{
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    std::string m_type;
+    /** Double-SHA256 of the payload, so it is hashed once for all peers. */
+    uint256 m_hash;
+};
+
+/** A part of a peer's send queue, either owned by it or shared with other peers. */
+class CSendBuffer
+{
+public:
+    explicit CSendBuffer(std::vector<unsigned char>&& data) : m_owned(std::move(data)) {}
+    explicit CSendBuffer(std::shared_ptr<const std::vector<unsigned char>> data) : m_shared(std::move(data)) {}
+
+    const unsigned char* data() const { return m_shared ? m_shared->data() : m_owned.data(); }
+    size_t size() const { return m_shared ? m_shared->size() : m_owned.size(); }
+
+private:
+    std::vector<unsigned char> m_owned;
+    std::shared_ptr<const std::vector<unsigned char>> m_shared;
+};
+
 /** Different types of connections to a peer. This enum encapsulates the
  * information we have available at the time of opening or accepting the
  * connection. Aside from INBOUND, all types are initiated by us.
@@ -213,6 +247,7 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        int m_msgproc_threads = 1;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -240,6 +275,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_msgproc_threads = std::max(1, std::min(connOptions.m_msgproc_threads, MAX_MSGPROC_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -275,6 +311,8 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    /** Queue a message whose payload is shared with other peers' send queues. */
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     using NodeFn = std::function<void(CNode*)>;
     void ForEachNode(const NodeFn& func)
@@ -425,7 +463,7 @@ private:
     void AddAddrFetch(const std::string& strDest);
     void ProcessAddrFetch();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int shard);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
@@ -434,6 +472,10 @@ private:
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketHandler();
     void ThreadSocketHandler();
+    /** Add a new socket to the event backend. A no-op unless it keeps persistent registrations. */
+    void RegisterSocket(SOCKET hSocket, bool listen);
+    /** Interrupt the socket handler's wait for events, if the backend supports it. */
+    void WakeSocketHandler();
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -458,6 +500,8 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+    /** Append a serialized header and payload to pnode's send queue and try to send them. */
+    void QueueMessage(CNode* pnode, const std::string& msg_type, std::vector<unsigned char>&& header, CSendBuffer&& payload);
     void DumpAddresses();
 
     // Network stats
@@ -519,6 +563,9 @@ private:
         std::chrono::microseconds m_cache_entry_expiration{0};
     };
 
+    /** Protects m_addr_response_caches, as getaddr requests are served concurrently. */
+    Mutex m_addr_response_caches_mutex;
+
     /**
      * Addr responses stored in different caches
      * per (network, local socket) prevent cross-network node identification.
@@ -533,7 +580,7 @@ private:
      * resulting in at most ~196 KB. Every separate local socket may
      * add up to ~196 KB extra.
      */
-    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches;
+    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches GUARDED_BY(m_addr_response_caches_mutex);
 
     /**
      * Services this instance offers.
@@ -579,8 +626,14 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake GUARDED_BY(mutexMsgProc);
+    /** Incremented to wake the message processing threads. */
+    uint64_t m_msgproc_wake_seq GUARDED_BY(mutexMsgProc){0};
+
+    /**
+     * Number of message processing threads. Every peer is handled by the
+     * thread its id maps to, so its messages are still processed in order.
+     */
+    int m_msgproc_threads{1};
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -588,11 +641,20 @@ private:
 
     CThreadInterrupt interruptNet;
 
+#ifdef USE_EPOLL
+    /** epoll instance every listening and peer socket is registered with once. */
+    int m_epoll_fd{-1};
+    /** eventfd other threads write to in order to wake the socket handler. */
+    int m_wake_fd{-1};
+    /** Whether the last SocketHandler pass left sockets it can service without waiting. */
+    bool m_socket_work_pending{false};
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of m_max_outbound_full_relay
@@ -713,6 +775,7 @@ public:
     int64_t m_ping_usec;
     int64_t m_ping_wait_usec;
     int64_t m_min_ping_usec;
+    int64_t m_msgproc_time_usec;
     CAmount minFeeFilter;
     // Our address, as reported by the peer
     std::string addrLocal;
@@ -734,13 +797,13 @@ public:
  */
 class CNetMessage {
 public:
-    CDataStream m_recv;                  //!< received message data
+    CPooledDataStream m_recv;            //!< received message data
     std::chrono::microseconds m_time{0}; //!< time of message receipt
     uint32_t m_message_size{0};          //!< size of the payload
     uint32_t m_raw_message_size{0};      //!< used wire size of the message (including header/checksum)
     std::string m_command;
 
-    CNetMessage(CDataStream&& recv_in) : m_recv(std::move(recv_in)) {}
+    CNetMessage(CPooledDataStream&& recv_in) : m_recv(std::move(recv_in)) {}
 
     void SetVersion(int nVersionIn)
     {
@@ -775,7 +838,7 @@ private:
     bool in_data;                   // parsing header (false) or data (true)
     CDataStream hdrbuf;             // partially received header
     CMessageHeader hdr;             // complete header
-    CDataStream vRecv;              // received message data
+    CPooledDataStream vRecv;        // received message data
     unsigned int nHdrPos;
     unsigned int nDataPos;
 
@@ -829,12 +892,15 @@ class TransportSerializer {
 public:
     // prepare message for transport (header construction, error-correction computation, payload encryption, etc.)
     virtual void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) = 0;
+    // prepare a message whose payload can't be modified, as it is shared with other peers
+    virtual void prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) = 0;
     virtual ~TransportSerializer() {}
 };
 
 class V1TransportSerializer  : public TransportSerializer {
 public:
     void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) override;
+    void prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) override;
 };
 
 /** Information about a peer */
@@ -853,7 +919,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CSendBuffer> vSendMsg GUARDED_BY(cs_vSend);
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -905,6 +971,10 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+    // Socket readiness reported by an edge-triggered event backend, kept until
+    // a recv or send would block. Only used by the socket handler thread.
+    bool m_recv_ready{false};
+    bool m_send_ready{false};
 
     bool IsOutboundOrBlockRelayConn() const {
         switch (m_conn_type) {
@@ -987,8 +1057,9 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    std::unique_ptr<CRollingBloomFilter> m_addr_known{nullptr};
+    Mutex cs_addrToSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addrToSend);
+    std::unique_ptr<CRollingBloomFilter> m_addr_known PT_GUARDED_BY(cs_addrToSend){nullptr};
     bool fGetAddr{false};
     std::chrono::microseconds m_next_addr_send GUARDED_BY(cs_sendProcessing){0};
     std::chrono::microseconds m_next_local_addr_send GUARDED_BY(cs_sendProcessing){0};
@@ -1009,7 +1080,7 @@ public:
         std::unique_ptr<CBloomFilter> pfilter PT_GUARDED_BY(cs_filter) GUARDED_BY(cs_filter){nullptr};
 
         mutable RecursiveMutex cs_tx_inventory;
-        CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_tx_inventory){50000, 0.000001};
+        KnownTxInventory filterInventoryKnown GUARDED_BY(cs_tx_inventory);
         // Set of transaction ids we still have to announce.
         // They are sorted by the mempool before relay, so the order is not important.
         std::set<uint256> setInventoryTxToSend;
@@ -1054,6 +1125,14 @@ public:
     std::atomic<int64_t> nPingUsecTime{0};
     // Best measured round-trip time.
     std::atomic<int64_t> nMinPingUsecTime{std::numeric_limits<int64_t>::max()};
+
+    // Processing time, in microseconds, the peer may still use before its
+    // message handler thread skips its messages. Refilled with the time
+    // passed since m_msgproc_refill_time; both are only used by that thread.
+    int64_t m_msgproc_credit{0};
+    int64_t m_msgproc_refill_time{0};
+    // Total time spent processing messages from and to this peer, in microseconds.
+    std::atomic<int64_t> m_msgproc_time_usec{0};
     // Whether a ping is requested.
     std::atomic<bool> fPingQueued{false};
 
@@ -1149,6 +1228,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrToSend);
         assert(m_addr_known);
         m_addr_known->insert(_addr.GetKey());
     }
@@ -1160,6 +1240,7 @@ public:
         // because they require ADDRv2 (BIP155) encoding.
         const bool addr_format_supported = m_wants_addrv2 || _addr.IsAddrV1Compatible();
 
+        LOCK(cs_addrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -8,6 +8,7 @@
 
 #include <addrman.h>
 #include <banman.h>
+#include <blockdownload.h>
 #include <blockencodings.h>
 #include <blockfilter.h>
 #include <chainparams.h>
@@ -39,6 +40,8 @@
 static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 /** Minimum time between orphan transactions expire time checks in seconds */
 static constexpr int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Maximum number of orphan transactions accepted together once their parents arrived */
+static constexpr size_t MAX_ORPHAN_TX_BATCH = 32;
 /** How long to cache transactions in mapRelay for normal relay */
 static constexpr std::chrono::seconds RELAY_TX_CACHE_TIME = std::chrono::minutes{15};
 /** How long a transaction has to be in the mempool before it can unconditionally be relayed (even when not in mapRelay). */
@@ -91,10 +94,10 @@ static constexpr auto OVERLOADED_PEER_TX_DELAY = std::chrono::seconds{2};
 static constexpr std::chrono::microseconds GETDATA_TX_INTERVAL{std::chrono::seconds{60}};
 /** Limit to avoid sending big packets. Not used in processing incoming GETDATA for compatibility */
 static const unsigned int MAX_GETDATA_SZ = 1000;
-/** Number of blocks that can be requested at any given time from a single peer. */
-static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** Minimum time a block holding up the download window must have been in flight before a faster peer is asked for it. */
+static constexpr std::chrono::seconds BLOCK_REREQUEST_MIN_WAIT{1};
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
@@ -231,6 +234,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        std::chrono::microseconds m_request_time;                //!< When the block was requested.
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
 
@@ -314,10 +318,14 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! How fast this peer delivers the blocks we request, which sizes its window of blocks in flight.
+    BlockDownloadRate m_block_download;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
     bool fPreferHeaders;
+    //! Whether this peer wants headers sent as cmpctheaders rather than headers messages.
+    bool fPreferCompressedHeaders;
     //! Whether this peer wants invs or cmpctblocks (when possible) for block announcements.
     bool fPreferHeaderAndIDs;
     /**
@@ -382,8 +390,22 @@ struct CNodeState {
     //! Whether this peer is a manual connection
     bool m_is_manual_connection;
 
-    //! A rolling bloom filter of all announced tx CInvs to this peer.
-    CRollingBloomFilter m_recently_announced_invs = CRollingBloomFilter{INVENTORY_MAX_RECENT_RELAY, 0.000001};
+    //! A rolling bloom filter of all announced tx CInvs to this peer. Only
+    //! allocated once we announce a transaction, which many peers never get.
+    std::unique_ptr<CRollingBloomFilter> m_recently_announced_invs;
+
+    void AddRecentlyAnnounced(const uint256& hash)
+    {
+        if (!m_recently_announced_invs) {
+            m_recently_announced_invs = MakeUnique<CRollingBloomFilter>(INVENTORY_MAX_RECENT_RELAY, 0.000001);
+        }
+        m_recently_announced_invs->insert(hash);
+    }
+
+    bool WasRecentlyAnnounced(const uint256& hash) const
+    {
+        return m_recently_announced_invs && m_recently_announced_invs->contains(hash);
+    }
 
     //! Whether this peer relays txs via wtxid
     bool m_wtxid_relay{false};
@@ -405,6 +427,7 @@ struct CNodeState {
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
+        fPreferCompressedHeaders = false;
         fPreferHeaderAndIDs = false;
         fProvidesHeaderAndIDs = false;
         fHaveWitness = false;
@@ -412,7 +435,6 @@ struct CNodeState {
         fSupportsDesiredCmpctVersion = false;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
-        m_recently_announced_invs.reset();
     }
 };
 
@@ -558,7 +580,8 @@ static bool MarkBlockAsInFlight(CTxMemPool& mempool, NodeId nodeid, const uint25
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr),
+             GetTime<std::chrono::microseconds>()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -675,7 +698,7 @@ static bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex) EXCLUSIV
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
-static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalling, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (count == 0)
         return;
@@ -712,6 +735,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -747,6 +771,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalling = pindexWaitingFor;
                     }
                     return;
                 }
@@ -757,11 +782,65 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
 }
 
+/** Whether a block that holds up the download window should be requested from
+ *  a peer instead of the staller it is in flight from: if the peer has proven
+ *  faster than the staller and the block is overdue by the peer's standards. */
+static bool ShouldRerequestStalledBlock(const CNodeState& state, const CNodeState& staller_state, const CBlockIndex* pindex, std::chrono::microseconds now) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (pindex == nullptr || !state.m_block_download.HasEstimate()) return false;
+    auto in_flight = mapBlocksInFlight.find(pindex->GetBlockHash());
+    if (in_flight == mapBlocksInFlight.end()) return false;
+    const std::chrono::microseconds waited = now - in_flight->second.second->m_request_time;
+    if (waited < std::max<std::chrono::microseconds>(BLOCK_REREQUEST_MIN_WAIT, 2 * state.m_block_download.GetLatency())) return false;
+    return !staller_state.m_block_download.HasEstimate() ||
+           state.m_block_download.GetRate() > staller_state.m_block_download.GetRate();
+}
+
+/** While a UTXO snapshot is validated in the background, find the next blocks
+ *  below the snapshot base that the background chainstate still needs. */
+static void FindNextHistoricalBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, const CChainState& background, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CBlockIndex* target = background.m_background_target;
+    if (count == 0 || target == nullptr)
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    ProcessBlockAvailability(nodeid);
+
+    // The peer has to have the whole chain up to the snapshot base.
+    if (state->pindexBestKnownBlock == nullptr || state->pindexBestKnownBlock->GetAncestor(target->nHeight) != target)
+        return;
+    if (!state->fHaveWitness && consensusParams.SegwitEnabled)
+        return;
+
+    const CBlockIndex* pindexFork = background.m_chain.Tip() ? LastCommonAncestor(background.m_chain.Tip(), target) : nullptr;
+    if (pindexFork == target)
+        return;
+    const int nStartHeight = pindexFork ? pindexFork->nHeight + 1 : 0;
+    const int nWindowEnd = std::min<int>(target->nHeight, nStartHeight + BLOCK_DOWNLOAD_WINDOW - 1);
+
+    std::vector<const CBlockIndex*> vToFetch(nWindowEnd - nStartHeight + 1);
+    const CBlockIndex* pindexWalk = target->GetAncestor(nWindowEnd);
+    for (auto it = vToFetch.rbegin(); it != vToFetch.rend(); ++it) {
+        *it = pindexWalk;
+        pindexWalk = pindexWalk->pprev;
+    }
+    for (const CBlockIndex* pindex : vToFetch) {
+        if (pindex->nStatus & BLOCK_HAVE_DATA || mapBlocksInFlight.count(pindex->GetBlockHash()))
+            continue;
+        vBlocks.push_back(pindex);
+        if (vBlocks.size() >= count)
+            return;
+    }
+}
+
 } // namespace
 
 void PeerManager::AddTxAnnouncement(const CNode& node, const GenTxid& gtxid, std::chrono::microseconds current_time)
@@ -868,6 +947,7 @@ void PeerManager::FinalizeNode(const CNode& node, bool& fUpdateConnectionTime) {
     }
     EraseOrphansFor(nodeid);
     m_txrequest.DisconnectedPeer(nodeid);
+    if (m_txreconciliation) m_txreconciliation->ForgetPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -902,6 +982,9 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
             if (queue.pindex)
                 stats.vHeightInFlight.push_back(queue.pindex->nHeight);
         }
+        stats.m_block_download_rate = state->m_block_download.GetRate();
+        stats.m_block_latency = state->m_block_download.GetLatency();
+        stats.m_block_download_window = state->m_block_download.GetWindow();
     }
 
     PeerRef peer = GetPeerRef(nodeid);
@@ -1173,6 +1256,10 @@ PeerManager::PeerManager(const CChainParams& chainparams, CConnman& connman, Ban
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
 
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION_ENABLE)) {
+        m_txreconciliation = MakeUnique<TxReconciliationTracker>();
+    }
+
     // Blocks don't typically have more than 4000 transactions, so this should
     // be at least six blocks (~1 hr) worth of transactions that we can store,
     // inserting both a txid and wtxid for every observed transaction.
@@ -1270,6 +1357,10 @@ void PeerManager::BlockDisconnected(const std::shared_ptr<const CBlock> &block,
 static RecursiveMutex cs_most_recent_block;
 static std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent_block);
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
+//! Witness CMPCTBLOCK message for most_recent_compact_block, serialized once for all peers
+static std::shared_ptr<const CSharedNetMsg> most_recent_compact_block_msg GUARDED_BY(cs_most_recent_block);
+//! Witness BLOCK message for most_recent_block, serialized on the first request for it
+static std::shared_ptr<const CSharedNetMsg> most_recent_block_msg GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
 
@@ -1280,6 +1371,7 @@ static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_
 void PeerManager::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    std::shared_ptr<const CSharedNetMsg> pcmpctblock_msg = std::make_shared<const CSharedNetMsg>(msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
 
     LOCK(cs_main);
 
@@ -1296,13 +1388,14 @@ void PeerManager::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_compact_block_msg = pcmpctblock_msg;
+        most_recent_block_msg.reset();
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
-    m_connman.ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+    m_connman.ForEachNode([this, &pcmpctblock_msg, pindex, fWitnessEnabled, &hashBlock](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
         AssertLockHeld(::cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->GetCommonVersion() < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -1314,7 +1407,7 @@ void PeerManager::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerManager::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            m_connman.PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            m_connman.PushMessage(pnode, *pcmpctblock_msg);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1446,6 +1539,20 @@ void RelayTransaction(const uint256& txid, const uint256& wtxid, const CConnman&
     });
 }
 
+void RelayTransactions(const std::vector<CTransactionRef>& txs, const CConnman& connman)
+{
+    if (txs.empty()) return;
+    connman.ForEachNode([&txs](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+        AssertLockHeld(::cs_main);
+
+        CNodeState* state = State(pnode->GetId());
+        if (state == nullptr) return;
+        for (const CTransactionRef& tx : txs) {
+            pnode->PushTxInventory(state->m_wtxid_relay ? tx->GetWitnessHash() : tx->GetHash());
+        }
+    });
+}
+
 static void RelayAddress(const CAddress& addr, bool fReachable, const CConnman& connman)
 {
     if (!fReachable && !addr.IsRelayable()) return;
@@ -1490,12 +1597,16 @@ void static ProcessGetBlockData(CNode& pfrom, const CChainParams& chainparams, c
     bool send = false;
     std::shared_ptr<const CBlock> a_recent_block;
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+    std::shared_ptr<const CSharedNetMsg> a_recent_compact_block_msg;
+    std::shared_ptr<const CSharedNetMsg> a_recent_block_msg;
     bool fWitnessesPresentInARecentCompactBlock;
     const Consensus::Params& consensusParams = chainparams.GetConsensus();
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
         a_recent_compact_block = most_recent_compact_block;
+        a_recent_compact_block_msg = most_recent_compact_block_msg;
+        a_recent_block_msg = most_recent_block_msg;
         fWitnessesPresentInARecentCompactBlock = fWitnessesPresentInMostRecentCompactBlock;
     }
 
@@ -1522,120 +1633,163 @@ void static ProcessGetBlockData(CNode& pfrom, const CChainParams& chainparams, c
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex* pindex = LookupBlockIndex(inv.hash);
-    if (pindex) {
-        send = BlockRequestAllowed(pindex, consensusParams);
-        if (!send) {
-            LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom.GetId());
-        }
-    }
+    // Everything needed to answer the request is looked up under cs_main, but
+    // the block itself is read from disk without it, so that peers fetching
+    // old blocks don't hold up message processing for the others.
     const CNetMsgMaker msgMaker(pfrom.GetCommonVersion());
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    if (send &&
-        connman.OutboundTargetReached(true) &&
-        (((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.IsMsgFilteredBlk()) &&
-        !pfrom.HasPermission(PF_DOWNLOAD) // nodes with the download permission may exceed target
-    ) {
-        LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom.GetId());
-
-        //disconnect node
-        pfrom.fDisconnect = true;
-        send = false;
+    const CBlockIndex* pindex;
+    bool fPeerWantsWitness;
+    bool fCanDirectFetchCompact;
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(inv.hash);
+        if (pindex) {
+            send = BlockRequestAllowed(pindex, consensusParams);
+            if (!send) {
+                LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom.GetId());
+            }
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        if (send &&
+            connman.OutboundTargetReached(true) &&
+            (((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.IsMsgFilteredBlk()) &&
+            !pfrom.HasPermission(PF_DOWNLOAD) // nodes with the download permission may exceed target
+        ) {
+            LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom.GetId());
+
+            //disconnect node
+            pfrom.fDisconnect = true;
+            send = false;
+        }
+        // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
+        if (send && !pfrom.HasPermission(PF_NOBAN) && (
+                (((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
+           )) {
+            LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom.GetId());
+
+            //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+            pfrom.fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!send || !(pindex->nStatus & BLOCK_HAVE_DATA)) return;
+
+        fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
+        fCanDirectFetchCompact = CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH;
+        hashTip = ::ChainActive().Tip()->GetBlockHash();
     }
-    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
-    if (send && !pfrom.HasPermission(PF_NOBAN) && (
-            (((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
-       )) {
-        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom.GetId());
 
-        //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+    // The block may have been pruned since it was looked up.
+    auto read_failed = [&]() {
+        if (WITH_LOCK(cs_main, return IsBlockPruned(pindex))) {
+            LogPrint(BCLog::NET, "Block was pruned before it could be read, disconnect peer=%d\n", pfrom.GetId());
+        } else {
+            assert(!"cannot load block from disk");
+        }
         pfrom.fDisconnect = true;
-        send = false;
+    };
+
+    std::shared_ptr<const CBlock> pblock;
+    if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        pblock = a_recent_block;
+    } else if (inv.IsMsgWitnessBlk() || inv.IsMsgBlk()) {
+        // Fast-path: serve the block directly from disk, reading it straight
+        // into the message payload. The format on disk is the witness
+        // serialization, so a non-witness request only needs the witness
+        // data cut out; no transactions are deserialized either way.
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        if (!ReadRawBlockFromDisk(msg.data, pindex, chainparams.MessageStart())) {
+            read_failed();
+            return;
+        }
+        if (inv.IsMsgBlk() && !StripRawBlockWitness(msg.data)) {
+            assert(!"cannot parse block from disk");
+        }
+        connman.PushMessage(&pfrom, std::move(msg));
+        // Don't set pblock as we've sent the block
+    } else {
+        // Send block from disk
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+            read_failed();
+            return;
+        }
+        pblock = pblockRead;
     }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
-    {
-        std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
-            pblock = a_recent_block;
+    if (pblock) {
+        if (inv.IsMsgBlk()) {
+            connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
         } else if (inv.IsMsgWitnessBlk()) {
-            // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
-                assert(!"cannot load block from disk");
-            }
-            connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
-            // Don't set pblock as we've sent the block
-        } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
-                assert(!"cannot load block from disk");
-            pblock = pblockRead;
-        }
-        if (pblock) {
-            if (inv.IsMsgBlk()) {
-                connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-            } else if (inv.IsMsgWitnessBlk()) {
-                connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
-            } else if (inv.IsMsgFilteredBlk()) {
-                bool sendMerkleBlock = false;
-                CMerkleBlock merkleBlock;
-                if (pfrom.m_tx_relay != nullptr) {
-                    LOCK(pfrom.m_tx_relay->cs_filter);
-                    if (pfrom.m_tx_relay->pfilter) {
-                        sendMerkleBlock = true;
-                        merkleBlock = CMerkleBlock(*pblock, *pfrom.m_tx_relay->pfilter);
-                    }
+            if (pblock == a_recent_block) {
+                // Peers fetching a new block tend to do so at about the same
+                // time, so serialize it once and share it between them.
+                if (!a_recent_block_msg) {
+                    a_recent_block_msg = std::make_shared<const CSharedNetMsg>(msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                    LOCK(cs_most_recent_block);
+                    if (most_recent_block == pblock && !most_recent_block_msg) most_recent_block_msg = a_recent_block_msg;
                 }
-                if (sendMerkleBlock) {
-                    connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                    // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                    // This avoids hurting performance by pointlessly requiring a round-trip
-                    // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                    // they must either disconnect and retry or request the full block.
-                    // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                    // however we MUST always provide at least what the remote peer needs
-                    typedef std::pair<unsigned int, uint256> PairType;
-                    for (PairType& pair : merkleBlock.vMatchedTxn)
-                        connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
+                connman.PushMessage(&pfrom, *a_recent_block_msg);
+            } else {
+                connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            }
+        } else if (inv.IsMsgFilteredBlk()) {
+            bool sendMerkleBlock = false;
+            CMerkleBlock merkleBlock;
+            if (pfrom.m_tx_relay != nullptr) {
+                LOCK(pfrom.m_tx_relay->cs_filter);
+                if (pfrom.m_tx_relay->pfilter) {
+                    sendMerkleBlock = true;
+                    merkleBlock = CMerkleBlock(*pblock, *pfrom.m_tx_relay->pfilter);
                 }
-                // else
-                    // no response
-            } else if (inv.IsMsgCmpctBlk()) {
-                // If a peer is asking for old blocks, we're almost guaranteed
-                // they won't have a useful mempool to match against a compact block,
-                // and we don't feel like constructing the object for them, so
-                // instead we respond with the full, non-compact block.
-                bool fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
-                int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                if (CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                    if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                        connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
-                    } else {
-                        CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                        connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                    }
+            }
+            if (sendMerkleBlock) {
+                connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                // This avoids hurting performance by pointlessly requiring a round-trip
+                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                // they must either disconnect and retry or request the full block.
+                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                // however we MUST always provide at least what the remote peer needs
+                typedef std::pair<unsigned int, uint256> PairType;
+                for (PairType& pair : merkleBlock.vMatchedTxn)
+                    connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
+            }
+            // else
+                // no response
+        } else if (inv.IsMsgCmpctBlk()) {
+            // If a peer is asking for old blocks, we're almost guaranteed
+            // they won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+            if (fCanDirectFetchCompact) {
+                if (fPeerWantsWitness && a_recent_compact_block_msg && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
+                    connman.PushMessage(&pfrom, *a_recent_compact_block_msg);
+                } else if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
+                    connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                 } else {
-                    connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
+                    connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                 }
+            } else {
+                connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
             }
         }
+    }
 
-        // Trigger the peer node to send a getblocks request for the next batch of inventory
-        if (inv.hash == pfrom.hashContinue)
-        {
-            // Send immediately. This must send even if redundant,
-            // and we want it right after the last block so they don't
-            // wait for other stuff first.
-            std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, ::ChainActive().Tip()->GetBlockHash()));
-            connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-            pfrom.hashContinue.SetNull();
-        }
+    // Trigger the peer node to send a getblocks request for the next batch of inventory
+    if (inv.hash == pfrom.hashContinue)
+    {
+        // Send immediately. This must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, hashTip));
+        connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom.hashContinue.SetNull();
     }
 }
 
@@ -1655,7 +1809,7 @@ static CTransactionRef FindTxForGetData(const CTxMemPool& mempool, const CNode&
     {
         LOCK(cs_main);
         // Otherwise, the transaction must have been announced recently.
-        if (State(peer.GetId())->m_recently_announced_invs.contains(gtxid.GetHash())) {
+        if (State(peer.GetId())->WasRecentlyAnnounced(gtxid.GetHash())) {
             // If it was, it can be relayed from either the mempool...
             if (txinfo.tx) return std::move(txinfo.tx);
             // ... or the relay pool.
@@ -1721,7 +1875,7 @@ void static ProcessGetData(CNode& pfrom, Peer& peer, const CChainParams& chainpa
                 // Relaying a transaction with a recent but unconfirmed parent.
                 if (WITH_LOCK(pfrom.m_tx_relay->cs_tx_inventory, return !pfrom.m_tx_relay->filterInventoryKnown.contains(parent_txid))) {
                     LOCK(cs_main);
-                    State(pfrom.GetId())->m_recently_announced_invs.insert(parent_txid);
+                    State(pfrom.GetId())->AddRecentlyAnnounced(parent_txid);
                 }
             }
         } else {
@@ -1784,6 +1938,58 @@ void PeerManager::SendBlockTransactions(CNode& pfrom, const CBlock& block, const
     m_connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
+/** Send a run of consecutive headers, compressed if the peer asked for that. */
+static void PushHeadersMessage(CConnman& connman, CNode& pto, bool prefer_compressed, const std::vector<CBlock>& headers)
+{
+    const CNetMsgMaker msgMaker(pto.GetCommonVersion());
+    if (prefer_compressed) {
+        connman.PushMessage(&pto, msgMaker.Make(NetMsgType::CMPCTHEADERS, CompressedHeaders(headers)));
+    } else {
+        connman.PushMessage(&pto, msgMaker.Make(NetMsgType::HEADERS, headers));
+    }
+}
+
+/** Keep a transaction we announce (or will announce) in mapRelay, by txid and wtxid. */
+static void AddToRelayCache(CTransactionRef tx, std::chrono::microseconds current_time) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    // Expire old relay messages
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < count_microseconds(current_time))
+    {
+        mapRelay.erase(vRelayExpiration.front().second);
+        vRelayExpiration.pop_front();
+    }
+
+    const uint256 wtxid = tx->GetWitnessHash();
+    auto ret = mapRelay.emplace(tx->GetHash(), std::move(tx));
+    if (ret.second) {
+        vRelayExpiration.emplace_back(count_microseconds(current_time + std::chrono::microseconds{RELAY_TX_CACHE_TIME}), ret.first);
+    }
+    // Add wtxid-based lookup into mapRelay as well, so that peers can request by wtxid
+    auto ret2 = mapRelay.emplace(wtxid, ret.first->second);
+    if (ret2.second) {
+        vRelayExpiration.emplace_back(count_microseconds(current_time + std::chrono::microseconds{RELAY_TX_CACHE_TIME}), ret2.first);
+    }
+}
+
+/** Announce the transactions a reconciliation round found the peer is missing. */
+static void AnnounceReconciledTxs(CConnman& connman, CNode& pto, const std::vector<uint256>& wtxids) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (wtxids.empty()) return;
+    CNodeState* state = State(pto.GetId());
+    const CNetMsgMaker msgMaker(pto.GetCommonVersion());
+    std::vector<CInv> vInv;
+    vInv.reserve(std::min<size_t>(wtxids.size(), MAX_INV_SZ));
+    for (const uint256& wtxid : wtxids) {
+        state->AddRecentlyAnnounced(wtxid);
+        vInv.emplace_back(MSG_WTX, wtxid);
+        if (vInv.size() == MAX_INV_SZ) {
+            connman.PushMessage(&pto, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty()) connman.PushMessage(&pto, msgMaker.Make(NetMsgType::INV, vInv));
+}
+
 void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHeader>& headers, bool via_compact_block)
 {
     const CNetMsgMaker msgMaker(pfrom.GetCommonVersion());
@@ -1885,7 +2091,8 @@ void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHe
             std::vector<const CBlockIndex*> vToFetch;
             const CBlockIndex *pindexWalk = pindexLast;
             // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
-            while (pindexWalk && !::ChainActive().Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            const int window = nodestate->m_block_download.GetWindow();
+            while (pindexWalk && !::ChainActive().Contains(pindexWalk) && vToFetch.size() <= (size_t)window) {
                 if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
                         !mapBlocksInFlight.count(pindexWalk->GetBlockHash()) &&
                         (!m_chainparams.GetConsensus().SegwitEnabled || State(pfrom.GetId())->fHaveWitness)) {
@@ -1906,7 +2113,7 @@ void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHe
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= window) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -1980,22 +2187,36 @@ void PeerManager::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
     AssertLockHeld(cs_main);
     AssertLockHeld(g_cs_orphans);
 
-    while (!orphan_work_set.empty()) {
+    // The orphans whose parents arrived are accepted together, so that their
+    // script checks share the script-checking threads. One batch is handled
+    // per call; orphans that it makes acceptable wait for the next call.
+    std::vector<CTransactionRef> batch;
+    while (!orphan_work_set.empty() && batch.size() < MAX_ORPHAN_TX_BATCH) {
         const uint256 orphanHash = *orphan_work_set.begin();
         orphan_work_set.erase(orphan_work_set.begin());
 
         auto orphan_it = mapOrphanTransactions.find(orphanHash);
         if (orphan_it == mapOrphanTransactions.end()) continue;
+        batch.push_back(orphan_it->second.tx);
+    }
+    if (batch.empty()) return;
 
-        const CTransactionRef porphanTx = orphan_it->second.tx;
-        TxValidationState state;
-        std::list<CTransactionRef> removed_txn;
+    std::vector<TxValidationState> states;
+    std::list<CTransactionRef> removed_txn;
+    const std::vector<bool> accepted = AcceptToMemoryPoolBatch(m_mempool, batch, states, &removed_txn);
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const CTransactionRef& porphanTx = batch[i];
+        const uint256& orphanHash = porphanTx->GetHash();
+        const TxValidationState& state = states[i];
+        auto orphan_it = mapOrphanTransactions.find(orphanHash);
+        if (orphan_it == mapOrphanTransactions.end()) continue;
 
-        if (AcceptToMemoryPool(m_mempool, state, porphanTx, &removed_txn, false /* bypass_limits */)) {
+        if (accepted[i]) {
             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
             RelayTransaction(orphanHash, porphanTx->GetWitnessHash(), m_connman);
-            for (unsigned int i = 0; i < porphanTx->vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(orphanHash, i));
+            for (unsigned int n = 0; n < porphanTx->vout.size(); n++) {
+                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(orphanHash, n));
                 if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
                     for (const auto& elem : it_by_prev->second) {
                         orphan_work_set.insert(elem->first);
@@ -2003,10 +2224,6 @@ void PeerManager::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
                 }
             }
             EraseOrphanTx(orphanHash);
-            for (const CTransactionRef& removedTx : removed_txn) {
-                AddToCompactExtraTransactions(removedTx);
-            }
-            break;
         } else if (state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
             if (state.IsInvalid()) {
                 LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s from peer=%d. %s\n",
@@ -2050,9 +2267,11 @@ void PeerManager::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
                 }
             }
             EraseOrphanTx(orphanHash);
-            break;
         }
     }
+    for (const CTransactionRef& removedTx : removed_txn) {
+        AddToCompactExtraTransactions(removedTx);
+    }
     m_mempool.check(&::ChainstateActive().CoinsTip());
 }
 
@@ -2134,7 +2353,7 @@ static bool PrepareBlockFilterRequest(CNode& peer, const CChainParams& chain_par
  * @param[in]   chain_params    Chain parameters
  * @param[in]   connman         Pointer to the connection manager
  */
-static void ProcessGetCFilters(CNode& peer, CDataStream& vRecv, const CChainParams& chain_params,
+static void ProcessGetCFilters(CNode& peer, CPooledDataStream& vRecv, const CChainParams& chain_params,
                                CConnman& connman)
 {
     uint8_t filter_type_ser;
@@ -2176,7 +2395,7 @@ static void ProcessGetCFilters(CNode& peer, CDataStream& vRecv, const CChainPara
  * @param[in]   chain_params    Chain parameters
  * @param[in]   connman         Pointer to the connection manager
  */
-static void ProcessGetCFHeaders(CNode& peer, CDataStream& vRecv, const CChainParams& chain_params,
+static void ProcessGetCFHeaders(CNode& peer, CPooledDataStream& vRecv, const CChainParams& chain_params,
                                 CConnman& connman)
 {
     uint8_t filter_type_ser;
@@ -2231,7 +2450,7 @@ static void ProcessGetCFHeaders(CNode& peer, CDataStream& vRecv, const CChainPar
  * @param[in]   chain_params    Chain parameters
  * @param[in]   connman         Pointer to the connection manager
  */
-static void ProcessGetCFCheckPt(CNode& peer, CDataStream& vRecv, const CChainParams& chain_params,
+static void ProcessGetCFCheckPt(CNode& peer, CPooledDataStream& vRecv, const CChainParams& chain_params,
                                 CConnman& connman)
 {
     uint8_t filter_type_ser;
@@ -2272,7 +2491,7 @@ static void ProcessGetCFCheckPt(CNode& peer, CDataStream& vRecv, const CChainPar
     connman.PushMessage(&peer, std::move(msg));
 }
 
-void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDataStream& vRecv,
+void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CPooledDataStream& vRecv,
                                          const std::chrono::microseconds time_received,
                                          const std::atomic<bool>& interruptMsgProc)
 {
@@ -2368,6 +2587,13 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             m_connman.PushMessage(&pfrom, msg_maker.Make(NetMsgType::WTXIDRELAY));
         }
 
+        // Offer transaction reconciliation after wtxidrelay, which it requires.
+        if (m_txreconciliation && greatest_common_version >= WTXID_RELAY_VERSION &&
+            pfrom.m_tx_relay != nullptr && fRelay && g_relay_txes) {
+            const uint64_t recon_salt = m_txreconciliation->PreRegisterPeer(pfrom.GetId());
+            m_connman.PushMessage(&pfrom, msg_maker.Make(NetMsgType::SENDTXRCNCL, TXRECONCILIATION_PROTOCOL_VERSION, recon_salt));
+        }
+
         // Signal ADDRv2 support (BIP155).
         if (greatest_common_version >= 70016) {
             // BIP155 defines addrv2 and sendaddrv2 for all protocol versions, but some
@@ -2514,6 +2740,11 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             // nodes)
             m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::SENDHEADERS));
         }
+        if (pfrom.GetCommonVersion() >= COMPRESSED_HEADERS_VERSION) {
+            // Tell our peer we can take headers with the redundant fields
+            // left out
+            m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::SENDCMPCTHDR));
+        }
         if (pfrom.GetCommonVersion() >= SHORT_IDS_BLOCKS_VERSION) {
             // Tell our peer we are willing to provide version 1 or 2 cmpctblocks
             // However, we do not request new block announcements using
@@ -2550,6 +2781,28 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         return;
     }
 
+    if (msg_type == NetMsgType::SENDTXRCNCL) {
+        if (pfrom.fSuccessfullyConnected) {
+            // Disconnect peers that send SENDTXRCNCL message after VERACK; this
+            // must be negotiated between VERSION and VERACK.
+            pfrom.fDisconnect = true;
+            return;
+        }
+        uint32_t recon_version;
+        uint64_t remote_salt;
+        vRecv >> recon_version >> remote_salt;
+        // Reconciliation is only set up if we offered it ourselves, and relies
+        // on wtxid relay, which was negotiated just before.
+        if (!m_txreconciliation || recon_version < TXRECONCILIATION_PROTOCOL_VERSION ||
+            !WITH_LOCK(cs_main, return State(pfrom.GetId())->m_wtxid_relay)) {
+            return;
+        }
+        if (m_txreconciliation->RegisterPeer(pfrom.GetId(), pfrom.IsInboundConn(), remote_salt)) {
+            LogPrint(BCLog::NET, "registered peer=%d for transaction reconciliation\n", pfrom.GetId());
+        }
+        return;
+    }
+
     if (msg_type == NetMsgType::SENDADDRV2) {
         if (pfrom.fSuccessfullyConnected) {
             // Disconnect peers that send SENDADDRV2 message after VERACK; this
@@ -2574,7 +2827,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             stream_version |= ADDRV2_FORMAT;
         }
 
-        OverrideStream<CDataStream> s(&vRecv, vRecv.GetType(), stream_version);
+        OverrideStream<CPooledDataStream> s(&vRecv, vRecv.GetType(), stream_version);
         std::vector<CAddress> vAddr;
 
         s >> vAddr;
@@ -2634,6 +2887,12 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         return;
     }
 
+    if (msg_type == NetMsgType::SENDCMPCTHDR) {
+        LOCK(cs_main);
+        State(pfrom.GetId())->fPreferCompressedHeaders = true;
+        return;
+    }
+
     if (msg_type == NetMsgType::SENDCMPCT) {
         bool fAnnounceUsingCMPCTBLOCK = false;
         uint64_t nCMPCTBLOCKVersion = 0;
@@ -2885,59 +3144,70 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             return;
         }
 
-        LOCK(cs_main);
-        if (::ChainstateActive().IsInitialBlockDownload() && !pfrom.HasPermission(PF_DOWNLOAD)) {
-            LogPrint(BCLog::NET, "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom.GetId());
-            return;
-        }
-
-        CNodeState *nodestate = State(pfrom.GetId());
-        const CBlockIndex* pindex = nullptr;
-        if (locator.IsNull())
+        std::vector<const CBlockIndex*> indexes;
+        bool prefer_compressed;
         {
-            // If locator is null, return the hashStop block
-            pindex = LookupBlockIndex(hashStop);
-            if (!pindex) {
+            LOCK(cs_main);
+            if (::ChainstateActive().IsInitialBlockDownload() && !pfrom.HasPermission(PF_DOWNLOAD)) {
+                LogPrint(BCLog::NET, "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom.GetId());
                 return;
             }
 
-            if (!BlockRequestAllowed(pindex, m_chainparams.GetConsensus())) {
-                LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block header that isn't in the main chain\n", __func__, pfrom.GetId());
-                return;
+            CNodeState *nodestate = State(pfrom.GetId());
+            const CBlockIndex* pindex = nullptr;
+            if (locator.IsNull())
+            {
+                // If locator is null, return the hashStop block
+                pindex = LookupBlockIndex(hashStop);
+                if (!pindex) {
+                    return;
+                }
+
+                if (!BlockRequestAllowed(pindex, m_chainparams.GetConsensus())) {
+                    LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block header that isn't in the main chain\n", __func__, pfrom.GetId());
+                    return;
+                }
+            }
+            else
+            {
+                // Find the last block the caller has in the main chain
+                pindex = FindForkInGlobalIndex(::ChainActive(), locator);
+                if (pindex)
+                    pindex = ::ChainActive().Next(pindex);
             }
-        }
-        else
-        {
-            // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(::ChainActive(), locator);
-            if (pindex)
-                pindex = ::ChainActive().Next(pindex);
-        }
 
+            int nLimit = MAX_HEADERS_RESULTS;
+            LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom.GetId());
+            for (; pindex; pindex = ::ChainActive().Next(pindex))
+            {
+                indexes.push_back(pindex);
+                if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
+                    break;
+            }
+            // pindex can be nullptr either if we sent ::ChainActive().Tip() OR
+            // if our peer has ::ChainActive().Tip() (and thus we are sending an empty
+            // headers message). In both cases it's safe to update
+            // pindexBestHeaderSent to be our tip.
+            //
+            // It is important that we simply reset the BestHeaderSent value here,
+            // and not max(BestHeaderSent, newHeaderSent). We might have announced
+            // the currently-being-connected tip using a compact block, which
+            // resulted in the peer sending a headers request, which we respond to
+            // without the new block. By resetting the BestHeaderSent, we ensure we
+            // will re-announce the new block via headers (or compact blocks again)
+            // in the SendMessages logic.
+            nodestate->pindexBestHeaderSent = pindex ? pindex : ::ChainActive().Tip();
+            prefer_compressed = nodestate->fPreferCompressedHeaders;
+        }
+
+        // The proof-of-work fields of older headers live only in the block
+        // tree DB; read them without holding cs_main. A failed read truncates
+        // the reply, which the peer handles like any short headers message.
+        std::vector<CBlockHeader> headers;
+        ReadBlockHeaders(indexes, headers);
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        std::vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
-        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom.GetId());
-        for (; pindex; pindex = ::ChainActive().Next(pindex))
-        {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                break;
-        }
-        // pindex can be nullptr either if we sent ::ChainActive().Tip() OR
-        // if our peer has ::ChainActive().Tip() (and thus we are sending an empty
-        // headers message). In both cases it's safe to update
-        // pindexBestHeaderSent to be our tip.
-        //
-        // It is important that we simply reset the BestHeaderSent value here,
-        // and not max(BestHeaderSent, newHeaderSent). We might have announced
-        // the currently-being-connected tip using a compact block, which
-        // resulted in the peer sending a headers request, which we respond to
-        // without the new block. By resetting the BestHeaderSent, we ensure we
-        // will re-announce the new block via headers (or compact blocks again)
-        // in the SendMessages logic.
-        nodestate->pindexBestHeaderSent = pindex ? pindex : ::ChainActive().Tip();
-        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        std::vector<CBlock> vHeaders(headers.begin(), headers.end());
+        PushHeadersMessage(m_connman, pfrom, prefer_compressed, vHeaders);
         return;
     }
 
@@ -3199,7 +3469,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         // dummy (empty) BLOCKTXN message, to re-use the logic there in
         // completing processing of the putative block (without cs_main).
         bool fProcessBLOCKTXN = false;
-        CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
+        CPooledDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
 
         // If we end up treating this as a plain headers message, call that as well
         // without cs_main.
@@ -3255,7 +3525,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         // We want to be a bit conservative just to be extra careful about DoS
         // possibilities in compact block processing...
         if (pindex->nHeight <= ::ChainActive().Height() + 2) {
-            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < nodestate->m_block_download.GetWindow()) ||
                  (fAlreadyInFlight && blockInFlightIt->second.first == pfrom.GetId())) {
                 std::list<QueuedBlock>::iterator* queuedBlockIt = nullptr;
                 if (!MarkBlockAsInFlight(m_mempool, pfrom.GetId(), pindex->GetBlockHash(), pindex, &queuedBlockIt)) {
@@ -3486,6 +3756,27 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         return ProcessHeadersMessage(pfrom, headers, /*via_compact_block=*/false);
     }
 
+    if (msg_type == NetMsgType::CMPCTHEADERS)
+    {
+        // Ignore headers received while importing
+        if (fImporting || fReindex) {
+            LogPrint(BCLog::NET, "Unexpected cmpctheaders message received from peer %d\n", pfrom.GetId());
+            return;
+        }
+
+        // Check the count before reading, as every header after the first
+        // costs a hash to reconstruct.
+        unsigned int nCount = ReadCompactSize(vRecv);
+        if (nCount > MAX_HEADERS_RESULTS) {
+            Misbehaving(pfrom.GetId(), 20, strprintf("cmpctheaders message size = %u", nCount));
+            return;
+        }
+        CompressedHeaders compressed;
+        compressed.ReadHeaders(vRecv, nCount);
+
+        return ProcessHeadersMessage(pfrom, compressed.headers, /*via_compact_block=*/false);
+    }
+
     if (msg_type == NetMsgType::BLOCK)
     {
         // Ignore block received while importing
@@ -3503,6 +3794,10 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            auto in_flight = mapBlocksInFlight.find(hash);
+            if (in_flight != mapBlocksInFlight.end() && in_flight->second.first == pfrom.GetId()) {
+                State(pfrom.GetId())->m_block_download.BlockReceived(in_flight->second.second->m_request_time, GetTime<std::chrono::microseconds>());
+            }
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
             forceProcessing |= MarkBlockAsReceived(hash);
@@ -3541,7 +3836,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         }
         pfrom.fSentAddr = true;
 
-        pfrom.vAddrToSend.clear();
+        WITH_LOCK(pfrom.cs_addrToSend, pfrom.vAddrToSend.clear());
         std::vector<CAddress> vAddr;
         if (pfrom.HasPermission(PF_ADDR)) {
             vAddr = m_connman.GetAddresses(MAX_ADDR_TO_SEND, MAX_PCT_ADDR_TO_SEND);
@@ -3735,6 +4030,50 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         return;
     }
 
+    if (msg_type == NetMsgType::REQRECON) {
+        uint16_t remote_set_size;
+        vRecv >> remote_set_size;
+        ReconciliationSketch sketch;
+        if (!m_txreconciliation || !m_txreconciliation->HandleReconciliationRequest(pfrom.GetId(), remote_set_size, GetTime<std::chrono::microseconds>(), sketch)) {
+            LogPrint(BCLog::NET, "unexpected reqrecon from peer=%d\n", pfrom.GetId());
+            return;
+        }
+        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+        return;
+    }
+
+    if (msg_type == NetMsgType::SKETCH) {
+        ReconciliationSketch sketch;
+        vRecv >> sketch;
+        bool success;
+        std::vector<uint256> to_announce;
+        std::vector<uint32_t> to_request;
+        if (!m_txreconciliation || !m_txreconciliation->HandleSketch(pfrom.GetId(), sketch, success, to_announce, to_request)) {
+            LogPrint(BCLog::NET, "unexpected sketch from peer=%d\n", pfrom.GetId());
+            return;
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d %s: announcing %u, requesting %u\n", pfrom.GetId(),
+                 success ? "succeeded" : "failed", to_announce.size(), to_request.size());
+        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, success, to_request));
+        LOCK(cs_main);
+        AnnounceReconciledTxs(m_connman, pfrom, to_announce);
+        return;
+    }
+
+    if (msg_type == NetMsgType::RECONCILDIFF) {
+        bool success;
+        std::vector<uint32_t> requested;
+        vRecv >> success >> requested;
+        std::vector<uint256> to_announce;
+        if (!m_txreconciliation || !m_txreconciliation->HandleReconciliationDiff(pfrom.GetId(), success, requested, to_announce)) {
+            LogPrint(BCLog::NET, "unexpected reconcildiff from peer=%d\n", pfrom.GetId());
+            return;
+        }
+        LOCK(cs_main);
+        AnnounceReconciledTxs(m_connman, pfrom, to_announce);
+        return;
+    }
+
     if (msg_type == NetMsgType::GETCFILTERS) {
         ProcessGetCFilters(pfrom, vRecv, m_chainparams, m_connman);
         return;
@@ -3813,6 +4152,23 @@ bool PeerManager::MaybeDiscourageAndDisconnect(CNode& pnode)
     return true;
 }
 
+/**
+ * Whether a message can be processed concurrently with the messages of peers
+ * handled by other message processing threads. These only use per-peer state,
+ * address manager state or block files, which are all protected by their own
+ * locks, and never wait on validation.
+ */
+static bool IsConcurrentMessage(const std::string& msg_type)
+{
+    return msg_type == NetMsgType::PING ||
+           msg_type == NetMsgType::PONG ||
+           msg_type == NetMsgType::ADDR ||
+           msg_type == NetMsgType::ADDRV2 ||
+           msg_type == NetMsgType::GETADDR ||
+           msg_type == NetMsgType::FEEFILTER ||
+           msg_type == NetMsgType::GETDATA;
+}
+
 bool PeerManager::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     bool fMoreWork = false;
@@ -3827,11 +4183,10 @@ bool PeerManager::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgP
         }
     }
 
-    {
+    if (WITH_LOCK(g_cs_orphans, return !peer->m_orphan_work_set.empty())) {
+        LOCK(m_msgproc_mutex);
         LOCK2(cs_main, g_cs_orphans);
-        if (!peer->m_orphan_work_set.empty()) {
-            ProcessOrphanTx(peer->m_orphan_work_set);
-        }
+        ProcessOrphanTx(peer->m_orphan_work_set);
     }
 
     if (pfrom->fDisconnect)
@@ -3873,7 +4228,12 @@ bool PeerManager::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgP
     unsigned int nMessageSize = msg.m_message_size;
 
     try {
-        ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        if (IsConcurrentMessage(msg_type)) {
+            ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        } else {
+            LOCK(m_msgproc_mutex);
+            ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        }
         if (interruptMsgProc) return false;
         {
             LOCK(peer->m_getdata_requests_mutex);
@@ -4044,6 +4404,7 @@ public:
 
 bool PeerManager::SendMessages(CNode* pto)
 {
+    LOCK(m_msgproc_mutex);
     const Consensus::Params& consensusParams = m_chainparams.GetConsensus();
 
     // We must call MaybeDiscourageAndDisconnect first, to ensure that we'll
@@ -4104,6 +4465,7 @@ bool PeerManager::SendMessages(CNode* pto)
         //
         if (pto->RelayAddrsWithConn() && pto->m_next_addr_send < current_time) {
             pto->m_next_addr_send = PoissonNextSend(current_time, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrToSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             assert(pto->m_addr_known);
@@ -4213,16 +4575,27 @@ bool PeerManager::SendMessages(CNode* pto)
                         break;
                     }
                     pBestIndex = pindex;
+                    CBlockHeader header;
                     if (fFoundStartingHeader) {
-                        // add this to the headers message
-                        vHeaders.push_back(pindex->GetBlockHeader());
+                        // add this to the headers message; the fields of
+                        // older headers are not in memory, announce those
+                        // with an inv rather than read them under cs_main.
+                        if (!GetRecentBlockHeader(pindex, header)) {
+                            fRevertToInv = true;
+                            break;
+                        }
+                        vHeaders.push_back(header);
                     } else if (PeerHasHeader(&state, pindex)) {
                         continue; // keep looking for the first new block
                     } else if (pindex->pprev == nullptr || PeerHasHeader(&state, pindex->pprev)) {
                         // Peer doesn't have this header but they do have the prior one.
                         // Start sending headers.
                         fFoundStartingHeader = true;
-                        vHeaders.push_back(pindex->GetBlockHeader());
+                        if (!GetRecentBlockHeader(pindex, header)) {
+                            fRevertToInv = true;
+                            break;
+                        }
+                        vHeaders.push_back(header);
                     } else {
                         // Peer doesn't have this header or the prior one -- nothing will
                         // connect, so bail out.
@@ -4244,7 +4617,9 @@ bool PeerManager::SendMessages(CNode* pto)
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
+                            if (state.fWantsCmpctWitness)
+                                m_connman.PushMessage(pto, *most_recent_compact_block_msg);
+                            else if (!fWitnessesPresentInMostRecentCompactBlock)
                                 m_connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
                             else {
                                 CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
@@ -4271,7 +4646,7 @@ bool PeerManager::SendMessages(CNode* pto)
                         LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
                                 vHeaders.front().GetHash().ToString(), pto->GetId());
                     }
-                    m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    PushHeadersMessage(m_connman, *pto, state.fPreferCompressedHeaders, vHeaders);
                     state.pindexBestHeaderSent = pBestIndex;
                 } else
                     fRevertToInv = true;
@@ -4396,6 +4771,8 @@ bool PeerManager::SendMessages(CNode* pto)
                     // No reason to drain out at many times the network's capacity,
                     // especially since we have many peers and some will draw much shorter delays.
                     unsigned int nRelayedTransactions = 0;
+                    // Peers are only registered for reconciliation if they relay by wtxid.
+                    const bool reconcile = m_txreconciliation && m_txreconciliation->IsPeerRegistered(pto->GetId());
                     LOCK(pto->m_tx_relay->cs_filter);
                     while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                         // Fetch the top element from the heap
@@ -4422,28 +4799,19 @@ bool PeerManager::SendMessages(CNode* pto)
                             continue;
                         }
                         if (pto->m_tx_relay->pfilter && !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                        AddToRelayCache(std::move(txinfo.tx), current_time);
+                        // Leave all but a few transactions to reconciliation;
+                        // they are announced once it finds the peer lacks them.
+                        if (reconcile && !m_txreconciliation->ShouldFlood(pto->GetId(), wtxid) &&
+                            m_txreconciliation->AddToSet(pto->GetId(), wtxid)) {
+                            pto->m_tx_relay->filterInventoryKnown.insert(hash);
+                            pto->m_tx_relay->filterInventoryKnown.insert(txid);
+                            continue;
+                        }
                         // Send
-                        State(pto->GetId())->m_recently_announced_invs.insert(hash);
+                        State(pto->GetId())->AddRecentlyAnnounced(hash);
                         vInv.push_back(inv);
                         nRelayedTransactions++;
-                        {
-                            // Expire old relay messages
-                            while (!vRelayExpiration.empty() && vRelayExpiration.front().first < count_microseconds(current_time))
-                            {
-                                mapRelay.erase(vRelayExpiration.front().second);
-                                vRelayExpiration.pop_front();
-                            }
-
-                            auto ret = mapRelay.emplace(txid, std::move(txinfo.tx));
-                            if (ret.second) {
-                                vRelayExpiration.emplace_back(count_microseconds(current_time + std::chrono::microseconds{RELAY_TX_CACHE_TIME}), ret.first);
-                            }
-                            // Add wtxid-based lookup into mapRelay as well, so that peers can request by wtxid
-                            auto ret2 = mapRelay.emplace(wtxid, ret.first->second);
-                            if (ret2.second) {
-                                vRelayExpiration.emplace_back(count_microseconds(current_time + std::chrono::microseconds{RELAY_TX_CACHE_TIME}), ret2.first);
-                            }
-                        }
                         if (vInv.size() == MAX_INV_SZ) {
                             m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
                             vInv.clear();
@@ -4464,6 +4832,21 @@ bool PeerManager::SendMessages(CNode* pto)
         if (!vInv.empty())
             m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reconciliation request
+        //
+        if (m_txreconciliation) {
+            if (const Optional<uint16_t> set_size = m_txreconciliation->MaybeRequestReconciliation(pto->GetId(), current_time)) {
+                m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, *set_size));
+            }
+            // Flood what we sketched for a peer that never finished the round.
+            std::vector<uint256> to_announce;
+            if (m_txreconciliation->ExpireReconciliation(pto->GetId(), current_time, to_announce)) {
+                LogPrint(BCLog::NET, "reconciliation with peer=%d timed out, announcing %u\n", pto->GetId(), to_announce.size());
+                AnnounceReconciledTxs(m_connman, *pto, to_announce);
+            }
+        }
+
         // Detect whether we're stalling
         current_time = GetTime<std::chrono::microseconds>();
         if (state.nStallingSince && state.nStallingSince < count_microseconds(current_time) - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -4529,10 +4912,22 @@ bool PeerManager::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        const int window = state.m_block_download.GetWindow();
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < window) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexStalling = nullptr;
+            FindNextBlocksToDownload(pto->GetId(), window - state.nBlocksInFlight, vToDownload, staller, pindexStalling, consensusParams);
+            if (staller != -1 && ShouldRerequestStalledBlock(state, *State(staller), pindexStalling, current_time)) {
+                // Moving the block over to this peer frees the staller from being disconnected for it.
+                LogPrint(BCLog::NET, "Re-requesting stalled block %s (%d) from peer=%d instead of peer=%d\n", pindexStalling->GetBlockHash().ToString(),
+                    pindexStalling->nHeight, pto->GetId(), staller);
+                vToDownload.push_back(pindexStalling);
+            }
+            if (m_chainman.IsSnapshotActive() && !m_chainman.IsSnapshotValidated() && !pto->m_limited_node) {
+                // Fill the remaining slots with history for the background chainstate.
+                FindNextHistoricalBlocksToDownload(pto->GetId(), window - state.nBlocksInFlight - vToDownload.size(), vToDownload, m_chainman.ValidatedChainstate(), consensusParams);
+            }
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(*pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -10,6 +10,7 @@
 #include <consensus/params.h>
 #include <net.h>
 #include <sync.h>
+#include <txreconciliation.h>
 #include <txrequest.h>
 #include <validationinterface.h>
 
@@ -85,7 +86,7 @@ public:
     void ReattemptInitialBroadcast(CScheduler& scheduler) const;
 
     /** Process a single message from a peer. Public for fuzz testing */
-    void ProcessMessage(CNode& pfrom, const std::string& msg_type, CDataStream& vRecv,
+    void ProcessMessage(CNode& pfrom, const std::string& msg_type, CPooledDataStream& vRecv,
                         const std::chrono::microseconds time_received, const std::atomic<bool>& interruptMsgProc);
 
     /**
@@ -142,6 +143,15 @@ private:
     ChainstateManager& m_chainman;
     CTxMemPool& m_mempool;
     TxRequestTracker m_txrequest GUARDED_BY(::cs_main);
+    /** Reconciliation state of our peers; nullptr unless -txreconciliation is set. */
+    std::unique_ptr<TxReconciliationTracker> m_txreconciliation;
+
+    /**
+     * Serializes SendMessages and the processing of messages that use chain
+     * state across the message processing threads. Messages for which
+     * IsConcurrentMessage() holds are processed without it.
+     */
+    Mutex m_msgproc_mutex;
 
     int64_t m_stale_tip_check_time; //!< Next time to check for stale tip
 };
@@ -151,6 +161,9 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    double m_block_download_rate = 0;
+    std::chrono::microseconds m_block_latency{0};
+    int m_block_download_window = 0;
 };
 
 /** Get statistics from node state */
@@ -159,4 +172,7 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Relay transaction to every node */
 void RelayTransaction(const uint256& txid, const uint256& wtxid, const CConnman& connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** Relay transactions to every node, in a single pass over the nodes */
+void RelayTransactions(const std::vector<CTransactionRef>& txs, const CConnman& connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 #endif // LABYRINTH_NET_PROCESSING_H
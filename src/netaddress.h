@@ -246,6 +246,7 @@ class CNetAddr
             }
         }
 
+        friend class BanTrie;
         friend class CSubNet;
 
     private:
@@ -497,6 +498,7 @@ class CSubNet
         std::string ToString() const;
         bool IsValid() const;
 
+        friend class BanTrie;
         friend bool operator==(const CSubNet& a, const CSubNet& b);
         friend bool operator!=(const CSubNet& a, const CSubNet& b) { return !(a == b); }
         friend bool operator<(const CSubNet& a, const CSubNet& b);
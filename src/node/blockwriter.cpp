@@ -0,0 +1,153 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockwriter.h>
+
+#include <logging.h>
+#include <util/system.h>
+#include <util/threadnames.h>
+
+#include <set>
+
+BlockFileWriter::BlockFileWriter(size_t max_buffered_bytes) : m_max_buffered_bytes(max_buffered_bytes) {}
+
+BlockFileWriter::~BlockFileWriter()
+{
+    Stop();
+}
+
+bool BlockFileWriter::Enqueue(Op&& op)
+{
+    const size_t size = op.data.size();
+    {
+        WAIT_LOCK(m_mutex, lock);
+        // Always admit an operation into an empty queue so that records larger
+        // than the buffer limit still make progress.
+        m_cond_done.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+            return m_failed || m_queue.empty() || m_buffered_bytes + size <= m_max_buffered_bytes;
+        });
+        if (m_failed) return false;
+        if (!m_thread.joinable()) {
+            m_stop = false;
+            m_thread = std::thread([this] {
+                util::ThreadRename("blockwrite");
+                ThreadWrite();
+            });
+        }
+        if (!op.flush) m_last_write[op.seq.FileName(op.pos)] = m_queued + 1;
+        m_buffered_bytes += size;
+        m_queue.push_back(std::move(op));
+        ++m_queued;
+    }
+    m_cond_queue.notify_one();
+    return true;
+}
+
+bool BlockFileWriter::Write(const FlatFileSeq& seq, const FlatFilePos& pos, std::vector<unsigned char>&& data)
+{
+    return Enqueue(Op{seq, pos, std::move(data), /* flush */ false, /* finalize */ false});
+}
+
+bool BlockFileWriter::Flush(const FlatFileSeq& seq, const FlatFilePos& pos, bool finalize)
+{
+    return Enqueue(Op{seq, pos, {}, /* flush */ true, finalize});
+}
+
+void BlockFileWriter::WaitForFile(const FlatFileSeq& seq, int file)
+{
+    WAIT_LOCK(m_mutex, lock);
+    auto it = m_last_write.find(seq.FileName(FlatFilePos(file, 0)));
+    if (it == m_last_write.end()) return;
+    const uint64_t target = it->second;
+    m_cond_done.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_failed || m_completed >= target; });
+}
+
+bool BlockFileWriter::Sync()
+{
+    WAIT_LOCK(m_mutex, lock);
+    const uint64_t target = m_queued;
+    m_cond_done.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_failed || m_completed >= target; });
+    return !m_failed;
+}
+
+void BlockFileWriter::Stop()
+{
+    WITH_LOCK(m_mutex, m_stop = true);
+    m_cond_queue.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void BlockFileWriter::ThreadWrite()
+{
+    while (true) {
+        std::vector<Op> batch;
+        size_t batch_bytes = 0;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond_queue.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) return;
+            batch.reserve(m_queue.size());
+            for (Op& op : m_queue) {
+                batch_bytes += op.data.size();
+                batch.push_back(std::move(op));
+            }
+            m_queue.clear();
+        }
+
+        const bool ok = ProcessBatch(batch);
+
+        {
+            LOCK(m_mutex);
+            if (!ok) m_failed = true;
+            m_completed += batch.size();
+            m_buffered_bytes -= batch_bytes;
+            if (m_completed == m_queued) m_last_write.clear();
+        }
+        m_cond_done.notify_all();
+    }
+}
+
+bool BlockFileWriter::ProcessBatch(std::vector<Op>& batch)
+{
+    // Files stay open for the whole batch; commits that do not truncate are
+    // deferred to the end so each file is synced at most once.
+    std::map<fs::path, FILE*> files;
+    std::set<FILE*> to_commit;
+    bool ok = true;
+
+    for (Op& op : batch) {
+        if (!ok) break;
+        const fs::path path = op.seq.FileName(op.pos);
+        FILE*& file = files[path];
+        if (!file) {
+            file = op.seq.Open(FlatFilePos(op.pos.nFile, 0));
+            if (!file) {
+                ok = error("%s: failed to open file %s", __func__, path.string());
+                break;
+            }
+        }
+        if (!op.flush) {
+            if (fseek(file, op.pos.nPos, SEEK_SET) != 0 ||
+                fwrite(op.data.data(), 1, op.data.size(), file) != op.data.size()) {
+                ok = error("%s: failed to write %u bytes to %s", __func__, op.data.size(), op.pos.ToString());
+            }
+            op.data = std::vector<unsigned char>();
+        } else if (op.finalize) {
+            if (fflush(file) != 0 || !TruncateFile(file, op.pos.nPos) || !FileCommit(file)) {
+                ok = error("%s: failed to finalize file %d", __func__, op.pos.nFile);
+            }
+            to_commit.erase(file);
+        } else {
+            to_commit.insert(file);
+        }
+    }
+
+    for (FILE* file : to_commit) {
+        if (ok && !FileCommit(file)) ok = error("%s: failed to commit file", __func__);
+    }
+    for (const auto& entry : files) {
+        if (entry.second && fclose(entry.second) != 0) ok = false;
+    }
+    return ok;
+}
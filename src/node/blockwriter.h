@@ -0,0 +1,82 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_NODE_BLOCKWRITER_H
+#define LABYRINTH_NODE_BLOCKWRITER_H
+
+#include <flatfile.h>
+#include <sync.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <thread>
+#include <vector>
+
+/**
+ * Background writer for block and undo files.
+ *
+ * Callers reserve file positions themselves (FindBlockPos/FindUndoPos) and
+ * hand the serialized record to Write(), which returns as soon as the data is
+ * buffered. A single worker thread performs the writes in submission order.
+ * Commit requests queued with Flush() are coalesced per file, so a burst of
+ * blocks costs one fsync per touched file instead of one per request.
+ *
+ * A failed write or commit is sticky: every later call returns false, so
+ * callers can abort the node before committing state that refers to data
+ * which never reached disk.
+ */
+class BlockFileWriter
+{
+private:
+    struct Op {
+        FlatFileSeq seq;
+        FlatFilePos pos;
+        std::vector<unsigned char> data;
+        bool flush;
+        bool finalize;
+    };
+
+    Mutex m_mutex;
+    std::condition_variable m_cond_queue;
+    std::condition_variable m_cond_done;
+    std::deque<Op> m_queue GUARDED_BY(m_mutex);
+    //! Sequence number of the last queued write, per file.
+    std::map<fs::path, uint64_t> m_last_write GUARDED_BY(m_mutex);
+    uint64_t m_queued GUARDED_BY(m_mutex){0};
+    uint64_t m_completed GUARDED_BY(m_mutex){0};
+    size_t m_buffered_bytes GUARDED_BY(m_mutex){0};
+    const size_t m_max_buffered_bytes;
+    bool m_failed GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
+
+    bool Enqueue(Op&& op);
+    void ThreadWrite();
+    //! Perform a batch of operations in order. Returns false on I/O failure.
+    static bool ProcessBatch(std::vector<Op>& batch);
+
+public:
+    /** @param max_buffered_bytes Write() waits while more than this many bytes are queued. */
+    explicit BlockFileWriter(size_t max_buffered_bytes);
+    ~BlockFileWriter();
+
+    /** Queue data to be written at pos. Returns false if an earlier operation failed. */
+    bool Write(const FlatFileSeq& seq, const FlatFilePos& pos, std::vector<unsigned char>&& data);
+
+    /** Queue a commit of the file at pos, with the semantics of FlatFileSeq::Flush. */
+    bool Flush(const FlatFileSeq& seq, const FlatFilePos& pos, bool finalize = false);
+
+    /** Wait until all queued writes to the given file have been written. */
+    void WaitForFile(const FlatFileSeq& seq, int file);
+
+    /** Wait until every queued operation has completed. Returns false if any failed. */
+    bool Sync();
+
+    /** Drain the queue and stop the worker thread. Later operations run a new one. */
+    void Stop();
+};
+
+#endif // LABYRINTH_NODE_BLOCKWRITER_H
@@ -124,3 +124,32 @@ static void FinalizeHash(CHashWriter& ss, CCoinsStats& stats)
     stats.hashSerialized = ss.GetHash();
 }
 static void FinalizeHash(std::nullptr_t, CCoinsStats& stats) {}
+
+CoinStatsHasher::CoinStatsHasher(const uint256& block_hash) : m_hasher(SER_GETHASH, PROTOCOL_VERSION)
+{
+    m_stats.hashBlock = block_hash;
+    PrepareHash(m_hasher, m_stats);
+}
+
+bool CoinStatsHasher::Add(const COutPoint& outpoint, const Coin& coin)
+{
+    if (!m_outputs.empty() && outpoint.hash != m_prevkey) {
+        if (outpoint.hash < m_prevkey) return false;
+        ApplyStats(m_stats, m_hasher, m_prevkey, m_outputs);
+        m_outputs.clear();
+    }
+    m_prevkey = outpoint.hash;
+    if (!m_outputs.emplace(outpoint.n, coin).second) return false;
+    m_stats.coins_count++;
+    return true;
+}
+
+void CoinStatsHasher::Finalize(CCoinsStats& stats)
+{
+    if (!m_outputs.empty()) {
+        ApplyStats(m_stats, m_hasher, m_prevkey, m_outputs);
+        m_outputs.clear();
+    }
+    FinalizeHash(m_hasher, m_stats);
+    stats = m_stats;
+}
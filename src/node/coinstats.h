@@ -8,10 +8,13 @@
 #define LABYRINTH_NODE_COINSTATS_H
 
 #include <amount.h>
+#include <coins.h>
+#include <hash.h>
 #include <uint256.h>
 
 #include <cstdint>
 #include <functional>
+#include <map>
 
 class CCoinsView;
 
@@ -38,4 +41,28 @@ struct CCoinsStats
 //! Calculate statistics about the unspent transaction output set
 bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, const CoinStatsHashType hash_type, const std::function<void()>& interruption_point = {});
 
+/**
+ * Computes the same statistics and HASH_SERIALIZED commitment as GetUTXOStats()
+ * over coins that are fed in coins database order rather than read from a
+ * CCoinsView. Used to verify a UTXO snapshot while it is being streamed in.
+ */
+class CoinStatsHasher
+{
+public:
+    explicit CoinStatsHasher(const uint256& block_hash);
+
+    //! Add the next coin. Coins must be grouped by txid in ascending txid order.
+    //! @returns false if the coin is out of order or a duplicate.
+    bool Add(const COutPoint& outpoint, const Coin& coin);
+
+    //! Write the final statistics and hash into stats.
+    void Finalize(CCoinsStats& stats);
+
+private:
+    CCoinsStats m_stats;
+    CHashWriter m_hasher;
+    uint256 m_prevkey;
+    std::map<uint32_t, Coin> m_outputs;
+};
+
 #endif // LABYRINTH_NODE_COINSTATS_H
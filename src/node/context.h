@@ -13,6 +13,7 @@
 
 class ArgsManager;
 class BanMan;
+class BlockCandidate;
 class CConnman;
 class CScheduler;
 class CTxMemPool;
@@ -37,6 +38,8 @@ class WalletClient;
 struct NodeContext {
     std::unique_ptr<CConnman> connman;
     std::unique_ptr<CTxMemPool> mempool;
+    //! Block template selection maintained across getblocktemplate calls
+    std::unique_ptr<BlockCandidate> block_candidate;
     std::unique_ptr<PeerManager> peerman;
     ChainstateManager* chainman{nullptr}; // Currently a raw pointer because the memory is not managed by this struct
     std::unique_ptr<BanMan> banman;
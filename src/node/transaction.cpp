@@ -106,3 +106,75 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
 
     return TransactionError::OK;
 }
+
+std::vector<bool> BroadcastTransactions(NodeContext& node, const std::vector<CTransactionRef>& txs, const std::vector<CAmount>& max_tx_fees,
+                                        std::vector<TxValidationState>& states, bool relay, bool wait_callback)
+{
+    assert(node.connman);
+    assert(node.mempool);
+    assert(max_tx_fees.size() == txs.size());
+    states.assign(txs.size(), TxValidationState());
+    std::vector<bool> in_mempool(txs.size(), false);
+
+    // Transactions already in the mempool are only relayed again, and those
+    // already confirmed are reported, as in BroadcastTransaction.
+    std::vector<size_t> positions;
+    std::vector<CTransactionRef> to_accept;
+    std::vector<CAmount> to_accept_max_fees;
+    {
+        LOCK2(cs_main, node.mempool->cs);
+        const CCoinsViewCache& view = ::ChainstateActive().CoinsTip();
+        for (size_t i = 0; i < txs.size(); ++i) {
+            const uint256& hash = txs[i]->GetHash();
+            if (node.mempool->exists(hash)) {
+                in_mempool[i] = true;
+                continue;
+            }
+            bool in_chain = false;
+            for (size_t o = 0; o < txs[i]->vout.size() && !in_chain; o++) {
+                in_chain = !view.AccessCoin(COutPoint(hash, o)).IsSpent();
+            }
+            if (in_chain) {
+                states[i].Invalid(TxValidationResult::TX_CONFLICT, "txn-already-known");
+                continue;
+            }
+            positions.push_back(i);
+            to_accept.push_back(txs[i]);
+            to_accept_max_fees.push_back(max_tx_fees[i]);
+        }
+    }
+
+    std::vector<TxValidationState> accept_states;
+    const std::vector<bool> accepted = AcceptToMemoryPoolBatch(*node.mempool, to_accept, accept_states, nullptr /* plTxnReplaced */, &to_accept_max_fees);
+    bool any_accepted = false;
+    for (size_t j = 0; j < positions.size(); ++j) {
+        states[positions[j]] = accept_states[j];
+        in_mempool[positions[j]] = accepted[j];
+        any_accepted |= accepted[j];
+    }
+
+    if (wait_callback && any_accepted) {
+        // See BroadcastTransaction
+        std::promise<void> promise;
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
+        promise.get_future().wait();
+    }
+
+    if (relay) {
+        std::vector<CTransactionRef> to_relay;
+        for (size_t i = 0; i < txs.size(); ++i) {
+            if (!in_mempool[i]) continue;
+            // the mempool tracks locally submitted transactions to make a
+            // best-effort of initial broadcast
+            node.mempool->AddUnbroadcastTx(txs[i]->GetHash());
+            to_relay.push_back(txs[i]);
+        }
+
+        LOCK(cs_main);
+        RelayTransactions(to_relay, *node.connman);
+    }
+
+    return in_mempool;
+}
@@ -11,6 +11,9 @@
 #include <primitives/transaction.h>
 #include <util/error.h>
 
+#include <vector>
+
+class TxValidationState;
 struct NodeContext;
 
 /** Maximum fee rate for sendrawtransaction and testmempoolaccept RPC calls.
@@ -20,6 +23,9 @@ struct NodeContext;
  */
 static const CFeeRate DEFAULT_MAX_RAW_TX_FEE_RATE{COIN / 10};
 
+/** Maximum number of transactions in one sendrawtransactions or testmempoolaccept call. */
+static const unsigned int MAX_RAW_TX_BATCH_SIZE = 1000;
+
 /**
  * Submit a transaction to the mempool and (optionally) relay it to all P2P peers.
  *
@@ -39,4 +45,23 @@ static const CFeeRate DEFAULT_MAX_RAW_TX_FEE_RATE{COIN / 10};
  */
 NODISCARD TransactionError BroadcastTransaction(NodeContext& node, CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback);
 
+/**
+ * Submit a batch of transactions to the mempool and (optionally) relay them to all P2P peers.
+ *
+ * The transactions may spend outputs of each other and are accepted together
+ * (see AcceptToMemoryPoolBatch). Those that end up in the mempool, including
+ * ones that already were, are announced to each peer in a single pass.
+ * wait_callback is as for BroadcastTransaction.
+ *
+ * @param[in]  node reference to node context
+ * @param[in]  txs the transactions to broadcast
+ * @param[in]  max_tx_fees reject each tx with a fee higher than this (if 0, accept any fee)
+ * @param[out] states validation state of each transaction
+ * @param[in]  relay flag if both mempool insertion and p2p relay are requested
+ * @param[in]  wait_callback wait until callbacks have been processed to avoid stale result due to a sequentially RPC.
+ * return whether each transaction is in the mempool
+ */
+std::vector<bool> BroadcastTransactions(NodeContext& node, const std::vector<CTransactionRef>& txs, const std::vector<CAmount>& max_tx_fees,
+                                        std::vector<TxValidationState>& states, bool relay, bool wait_callback);
+
 #endif // LABYRINTH_NODE_TRANSACTION_H
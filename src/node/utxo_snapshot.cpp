@@ -0,0 +1,270 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <clientversion.h>
+#include <hash.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util/boundedqueue.h>
+#include <util/memory.h>
+#include <util/system.h>
+#include <util/threadnames.h>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+
+//! Number of coins after which a chunk is closed at the next txid boundary.
+static constexpr size_t SNAPSHOT_CHUNK_COINS = 10000;
+//! Largest chunk payload a loader accepts.
+static constexpr uint32_t MAX_SNAPSHOT_CHUNK_SIZE = 32 * 1024 * 1024;
+//! Number of key ranges, by leading txid byte, that a dump is split into.
+static constexpr unsigned int SNAPSHOT_EXPORT_RANGES = 64;
+//! Upper bound on the worker threads used to encode or decode chunks.
+static constexpr int MAX_SNAPSHOT_THREADS = 8;
+//! Chunks buffered per range while dumping, or in flight while loading.
+static constexpr size_t SNAPSHOT_EXPORT_QUEUE_DEPTH = 4;
+static constexpr size_t SNAPSHOT_IMPORT_QUEUE_DEPTH = 32;
+//! Fewest payload bytes a coin can take: output index, height/coinbase code,
+//! compressed amount and script, one byte each at minimum.
+static constexpr size_t MIN_SNAPSHOT_COIN_SIZE = 4;
+
+static int SnapshotThreadCount()
+{
+    return std::max(1, std::min(GetNumCores(), MAX_SNAPSHOT_THREADS));
+}
+
+//! Leading txid byte of the first key in export range i.
+static unsigned int SnapshotRangeStart(unsigned int i)
+{
+    return i * 256 / SNAPSHOT_EXPORT_RANGES;
+}
+
+void EncodeSnapshotChunk(const SnapshotCoinBatch& coins, SnapshotChunkHeader& header, std::vector<unsigned char>& payload)
+{
+    payload.clear();
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, payload, 0);
+    size_t i = 0;
+    while (i < coins.size()) {
+        const uint256& txid = coins[i].first.hash;
+        size_t group_end = i;
+        while (group_end < coins.size() && coins[group_end].first.hash == txid) ++group_end;
+
+        writer << txid << VARINT(uint32_t(group_end - i));
+        for (; i < group_end; ++i) {
+            writer << VARINT(coins[i].first.n) << coins[i].second;
+        }
+    }
+    header.m_payload_size = payload.size();
+    header.m_coins_count = coins.size();
+    header.m_checksum = Hash(payload);
+}
+
+bool DecodeSnapshotChunk(const SnapshotChunkHeader& header, const std::vector<unsigned char>& payload, SnapshotCoinBatch& coins)
+{
+    if (payload.size() != header.m_payload_size || Hash(payload) != header.m_checksum) return false;
+
+    coins.clear();
+    // The coin count comes from the file, so only reserve what the payload
+    // could actually hold.
+    coins.reserve(std::min<size_t>(header.m_coins_count, payload.size() / MIN_SNAPSHOT_COIN_SIZE));
+    try {
+        CDataStream reader(payload, SER_DISK, CLIENT_VERSION);
+        while (!reader.empty()) {
+            uint256 txid;
+            uint32_t outputs;
+            reader >> txid >> VARINT(outputs);
+            if (outputs == 0 || outputs > header.m_coins_count - coins.size()) return false;
+            for (uint32_t j = 0; j < outputs; ++j) {
+                uint32_t n;
+                Coin coin;
+                reader >> VARINT(n) >> coin;
+                coins.emplace_back(COutPoint(txid, n), std::move(coin));
+            }
+        }
+    } catch (const std::ios_base::failure&) {
+        return false;
+    }
+    return coins.size() == header.m_coins_count;
+}
+
+std::vector<std::unique_ptr<CCoinsViewCursor>> MakeSnapshotCursors(const CCoinsViewDB& coinsdb)
+{
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    for (unsigned int i = 0; i < SNAPSHOT_EXPORT_RANGES; ++i) {
+        uint256 start;
+        *start.begin() = SnapshotRangeStart(i);
+        cursors.emplace_back(coinsdb.Cursor(start));
+    }
+    return cursors;
+}
+
+namespace {
+struct EncodedChunk {
+    SnapshotChunkHeader header;
+    std::vector<unsigned char> payload;
+};
+} // namespace
+
+bool WriteSnapshotChunks(CAutoFile& file, std::vector<std::unique_ptr<CCoinsViewCursor>> cursors,
+                         const std::function<void()>& interruption_point, uint64_t& coins_written)
+{
+    const size_t range_count = cursors.size();
+    std::vector<std::unique_ptr<BoundedQueue<EncodedChunk>>> outputs;
+    for (size_t i = 0; i < range_count; ++i) {
+        outputs.emplace_back(MakeUnique<BoundedQueue<EncodedChunk>>(SNAPSHOT_EXPORT_QUEUE_DEPTH));
+    }
+    std::atomic<size_t> next_range{0};
+    std::atomic<bool> read_failed{false};
+
+    // Ranges are handed out in order, so the range the writer is waiting on is
+    // always being encoded and workers that run ahead only block on their own
+    // range's queue.
+    auto encode_ranges = [&] {
+        size_t i;
+        while ((i = next_range++) < range_count) {
+            CCoinsViewCursor& cursor = *cursors[i];
+            BoundedQueue<EncodedChunk>& output = *outputs[i];
+            const unsigned int range_end = i + 1 < range_count ? SnapshotRangeStart(i + 1) : 256;
+            SnapshotCoinBatch coins;
+            bool open = true;
+            auto emit = [&] {
+                EncodedChunk chunk;
+                EncodeSnapshotChunk(coins, chunk.header, chunk.payload);
+                coins.clear();
+                open = output.Push(std::move(chunk));
+            };
+
+            COutPoint key;
+            Coin coin;
+            while (open && cursor.Valid() && cursor.GetKey(key) && *key.hash.begin() < range_end) {
+                if (!cursor.GetValue(coin)) {
+                    read_failed = true;
+                    break;
+                }
+                if (coins.size() >= SNAPSHOT_CHUNK_COINS && key.hash != coins.back().first.hash) emit();
+                coins.emplace_back(key, std::move(coin));
+                cursor.Next();
+            }
+            if (open && !read_failed && !coins.empty()) emit();
+            output.Close();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < SnapshotThreadCount(); ++t) {
+        workers.emplace_back([&, t] {
+            util::ThreadRename(strprintf("snapshotenc.%i", t));
+            encode_ranges();
+        });
+    }
+    auto stop_workers = [&] {
+        for (auto& output : outputs) output->Close();
+        for (auto& worker : workers) worker.join();
+    };
+
+    coins_written = 0;
+    try {
+        for (auto& output : outputs) {
+            EncodedChunk chunk;
+            while (output->Pop(chunk)) {
+                file << chunk.header;
+                file.write(reinterpret_cast<const char*>(chunk.payload.data()), chunk.payload.size());
+                coins_written += chunk.header.m_coins_count;
+                interruption_point();
+            }
+            if (read_failed) break;
+        }
+    } catch (...) {
+        stop_workers();
+        throw;
+    }
+    stop_workers();
+    if (read_failed) return false;
+
+    file << SnapshotChunkHeader{};
+    return true;
+}
+
+namespace {
+struct PendingChunk {
+    SnapshotChunkHeader header;
+    std::vector<unsigned char> payload;
+    SnapshotCoinBatch coins;
+    std::promise<bool> decoded;
+};
+using PendingChunkRef = std::shared_ptr<PendingChunk>;
+} // namespace
+
+bool ReadSnapshotChunks(CAutoFile& file, const std::function<bool(SnapshotCoinBatch&&)>& sink)
+{
+    // Chunks enter both queues in file order: workers decode them in any
+    // order while this thread consumes them from `ordered` as they complete.
+    BoundedQueue<PendingChunkRef> to_decode(SNAPSHOT_IMPORT_QUEUE_DEPTH);
+    BoundedQueue<PendingChunkRef> ordered(SNAPSHOT_IMPORT_QUEUE_DEPTH);
+    std::atomic<bool> stop{false};
+    bool read_ok{false};
+
+    std::thread reader([&] {
+        util::ThreadRename("snapshotread");
+        try {
+            while (!stop) {
+                auto chunk = std::make_shared<PendingChunk>();
+                file >> chunk->header;
+                if (chunk->header.IsEnd()) {
+                    // Nothing may follow the end marker.
+                    char extra;
+                    try {
+                        file.read(&extra, 1);
+                    } catch (const std::ios_base::failure&) {
+                        read_ok = chunk->header.m_coins_count == 0;
+                    }
+                    break;
+                }
+                if (chunk->header.m_payload_size > MAX_SNAPSHOT_CHUNK_SIZE) break;
+                chunk->payload.resize(chunk->header.m_payload_size);
+                file.read(reinterpret_cast<char*>(chunk->payload.data()), chunk->payload.size());
+                if (!ordered.Push(chunk) || !to_decode.Push(std::move(chunk))) break;
+            }
+        } catch (const std::ios_base::failure&) {
+            // Truncated file; read_ok stays false.
+        }
+        ordered.Close();
+        to_decode.Close();
+    });
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < SnapshotThreadCount(); ++t) {
+        workers.emplace_back([&, t] {
+            util::ThreadRename(strprintf("snapshotdec.%i", t));
+            PendingChunkRef chunk;
+            while (to_decode.Pop(chunk)) {
+                const bool ok = !stop && DecodeSnapshotChunk(chunk->header, chunk->payload, chunk->coins);
+                chunk->payload.clear();
+                chunk->payload.shrink_to_fit();
+                chunk->decoded.set_value(ok);
+            }
+        });
+    }
+
+    bool consumed_ok = true;
+    PendingChunkRef chunk;
+    while (ordered.Pop(chunk)) {
+        if (!chunk->decoded.get_future().get() || !sink(std::move(chunk->coins))) {
+            consumed_ok = false;
+            break;
+        }
+        chunk.reset();
+    }
+
+    stop = true;
+    ordered.Close();
+    to_decode.Close();
+    reader.join();
+    for (auto& worker : workers) worker.join();
+    return consumed_ok && read_ok;
+}
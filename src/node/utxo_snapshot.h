@@ -7,8 +7,30 @@
 #ifndef LABYRINTH_NODE_UTXO_SNAPSHOT_H
 #define LABYRINTH_NODE_UTXO_SNAPSHOT_H
 
-#include <uint256.h>
+#include <coins.h>
+#include <primitives/transaction.h>
 #include <serialize.h>
+#include <uint256.h>
+
+#include <algorithm>
+#include <functional>
+#include <ios>
+#include <memory>
+#include <vector>
+
+class CAutoFile;
+class CCoinsViewCursor;
+class CCoinsViewDB;
+
+//! Magic bytes that start a snapshot file in format version 2 or later.
+//! Version 1 files have no header and start with the base block hash.
+static const unsigned char SNAPSHOT_MAGIC_BYTES[] = {'u', 't', 'x', 'o', 0xff};
+
+//! Latest snapshot format dumptxoutset can write.
+static constexpr uint16_t SNAPSHOT_FORMAT_VERSION = 2;
+//! Snapshot format dumptxoutset writes unless asked for another. Version 2
+//! is opt-in so that existing consumers of version 1 files keep working.
+static constexpr uint16_t DEFAULT_SNAPSHOT_FORMAT_VERSION = 1;
 
 //! Metadata describing a serialized version of a UTXO set from which an
 //! assumeutxo CChainState can be constructed.
@@ -27,16 +49,109 @@ public:
     //! initial block download for the assumeutxo chainstate.
     unsigned int m_nchaintx = 0;
 
+    //! Layout of the coins that follow the metadata. Version 1 is a flat list
+    //! of (outpoint, coin) records; version 2 is a sequence of checksummed
+    //! chunks (see SnapshotChunkHeader) terminated by an empty chunk.
+    uint16_t m_version = 1;
+
     SnapshotMetadata() { }
     SnapshotMetadata(
         const uint256& base_blockhash,
         uint64_t coins_count,
-        unsigned int nchaintx) :
+        unsigned int nchaintx,
+        uint16_t version = 1) :
             m_base_blockhash(base_blockhash),
             m_coins_count(coins_count),
-            m_nchaintx(nchaintx) { }
+            m_nchaintx(nchaintx),
+            m_version(version) { }
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        if (m_version >= 2) {
+            s.write(reinterpret_cast<const char*>(SNAPSHOT_MAGIC_BYTES), sizeof(SNAPSHOT_MAGIC_BYTES));
+            s << m_version;
+        }
+        s << m_base_blockhash << m_coins_count << m_nchaintx;
+    }
 
-    SERIALIZE_METHODS(SnapshotMetadata, obj) { READWRITE(obj.m_base_blockhash, obj.m_coins_count, obj.m_nchaintx); }
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        // A version 1 file starts with the base block hash, so the magic bytes
+        // are ambiguous only for a hash starting with them (a 2^-40 chance).
+        unsigned char prefix[sizeof(SNAPSHOT_MAGIC_BYTES)];
+        s.read(reinterpret_cast<char*>(prefix), sizeof(prefix));
+        if (std::equal(prefix, prefix + sizeof(prefix), SNAPSHOT_MAGIC_BYTES)) {
+            s >> m_version;
+            if (m_version < 2 || m_version > SNAPSHOT_FORMAT_VERSION) {
+                throw std::ios_base::failure("unsupported snapshot format version");
+            }
+            s >> m_base_blockhash;
+        } else {
+            m_version = 1;
+            std::copy(prefix, prefix + sizeof(prefix), m_base_blockhash.begin());
+            s.read(reinterpret_cast<char*>(m_base_blockhash.begin() + sizeof(prefix)), m_base_blockhash.size() - sizeof(prefix));
+        }
+        s >> m_coins_count >> m_nchaintx;
+    }
 };
 
+//! Coins in coins database order, as exchanged between the stages of a
+//! snapshot load or dump.
+using SnapshotCoinBatch = std::vector<std::pair<COutPoint, Coin>>;
+
+/**
+ * Header of a chunk of coins in a version 2 snapshot.
+ *
+ * The payload that follows it lists the coins grouped by txid, so each txid is
+ * stored once: txid, VARINT(output count), then VARINT(n) and the compressed
+ * Coin for each output. The checksum lets every chunk be verified and decoded
+ * independently, so loaders can process chunks in parallel. A chunk with an
+ * empty payload ends the snapshot.
+ */
+struct SnapshotChunkHeader
+{
+    uint32_t m_payload_size{0};
+    uint32_t m_coins_count{0};
+    //! SHA256d of the payload.
+    uint256 m_checksum;
+
+    bool IsEnd() const { return m_payload_size == 0; }
+
+    SERIALIZE_METHODS(SnapshotChunkHeader, obj) { READWRITE(obj.m_payload_size, obj.m_coins_count, obj.m_checksum); }
+};
+
+//! Encode coins, which must be grouped by txid, into the payload of a chunk.
+void EncodeSnapshotChunk(const SnapshotCoinBatch& coins, SnapshotChunkHeader& header, std::vector<unsigned char>& payload);
+
+//! Verify a chunk against its header and decode its coins.
+//! @returns false if the payload is corrupt.
+bool DecodeSnapshotChunk(const SnapshotChunkHeader& header, const std::vector<unsigned char>& payload, SnapshotCoinBatch& coins);
+
+//! Open one cursor per key range of the coins database for WriteSnapshotChunks().
+//! The caller must prevent writes to the database while this runs so that all
+//! cursors see the same state.
+std::vector<std::unique_ptr<CCoinsViewCursor>> MakeSnapshotCursors(const CCoinsViewDB& coinsdb);
+
+/**
+ * Write the coins of the given key ranges to file as version 2 chunks, followed
+ * by the end marker. Ranges are encoded by a pool of threads and written in
+ * order. interruption_point is only called from the calling thread.
+ *
+ * @returns false if the coins database could not be read.
+ */
+bool WriteSnapshotChunks(CAutoFile& file, std::vector<std::unique_ptr<CCoinsViewCursor>> cursors,
+                         const std::function<void()>& interruption_point, uint64_t& coins_written);
+
+/**
+ * Read the chunks of a version 2 snapshot from file, verifying and decoding
+ * them on a pool of threads, and hand the coins of each chunk to sink in file
+ * order. Reading stops when sink returns false.
+ *
+ * @returns false if the snapshot is corrupt or truncated, has data after the
+ *          end marker, or sink returned false.
+ */
+bool ReadSnapshotChunks(CAutoFile& file, const std::function<bool(SnapshotCoinBatch&&)>& sink);
+
 #endif // LABYRINTH_NODE_UTXO_SNAPSHOT_H
@@ -10,6 +10,8 @@
 #include <streams.h>
 #include <txmempool.h>
 #include <util/system.h>
+#include <util/threadnames.h>
+#include <util/time.h>
 
 static constexpr double INF_FEERATE = 1e99;
 
@@ -33,6 +35,13 @@ std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
  *
  * The tracking of unconfirmed (mempool) transactions is completely independent of the
  * historical tracking of transactions that have been confirmed in a block.
+ *
+ * The moving averages are decayed lazily. A data point is added with weight
+ * m_weight to a single per-period counter, and decaying every average by one
+ * block only divides m_weight by the decay, so recording a transaction and
+ * processing a block cost O(1) instead of a pass over every counter. The
+ * cumulative averages the estimates and the data file use are rebuilt from
+ * the counters when they are next needed.
  */
 class TxConfirmStats
 {
@@ -41,22 +50,43 @@ private:
     const std::vector<double>& buckets;              // The upper-bound of the range for the bucket (inclusive)
     const std::map<double, unsigned int>& bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    /** Counters are rescaled once the weight of a new data point exceeds this. */
+    static constexpr double MAX_WEIGHT = 1e50;
+
+    // Weight of a data point recorded now; the counters below are in these units
+    double m_weight{1};
+
+    // For each bucket X, the weighted # of txs and the weighted sum of their feerates
+    std::vector<double> m_tx_count;
+    std::vector<double> m_feerate_sum;
+
+    // Weighted # of txs confirmed in exactly Y+1 periods in each bucket
+    std::vector<std::vector<double>> m_confirmed; // m_confirmed[Y][X]
+
+    // Weighted # of txs which left the mempool unconfirmed after Y+1 periods
+    // (the last row also counts everything older)
+    std::vector<std::vector<double>> m_failed; // m_failed[Y][X]
+
+    // The moving averages below are derived from the counters above by
+    // UpdateAverages() and are only valid while m_averages_stale is false.
+    mutable bool m_averages_stale{true};
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
-    std::vector<double> txCtAvg;
+    mutable std::vector<double> txCtAvg;
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of these totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    mutable std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    mutable std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
-    std::vector<double> m_feerate_avg;
+    mutable std::vector<double> m_feerate_avg;
 
     // Combine the conf counts with tx counts to calculate the confirmation % for each Y,X
     // Combine the total value with the tx counts to calculate the avg feerate per bucket
@@ -73,8 +103,20 @@ private:
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
+    // For each bucket X, the number of transactions that have been in the
+    // mempool for between Y and GetMaxConfirms() blocks at m_unconf_height,
+    // derived from unconfTxs by UpdateUnconfirmedSums().
+    mutable std::vector<std::vector<int>> m_unconf_since; // m_unconf_since[Y][X]
+    mutable unsigned int m_unconf_height{0};
+    mutable bool m_unconf_stale{true};
+
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Rebuild the moving averages from the weighted counters if they changed */
+    void UpdateAverages() const;
+    /** Rebuild m_unconf_since for nBlockHeight if unconfTxs changed */
+    void UpdateUnconfirmedSums(unsigned int nBlockHeight) const;
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -122,7 +164,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * m_confirmed.size(); }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -141,6 +183,11 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     : buckets(defaultBuckets), bucketMap(defaultBucketMap), decay(_decay), scale(_scale)
 {
     assert(_scale != 0 && "_scale must be non-zero");
+    m_confirmed.assign(maxPeriods, std::vector<double>(buckets.size()));
+    m_failed.assign(maxPeriods, std::vector<double>(buckets.size()));
+    m_tx_count.resize(buckets.size());
+    m_feerate_sum.resize(buckets.size());
+
     confAvg.resize(maxPeriods);
     failAvg.resize(maxPeriods);
     for (unsigned int i = 0; i < maxPeriods; i++) {
@@ -161,6 +208,8 @@ void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
         unconfTxs[i].resize(newbuckets);
     }
     oldUnconfTxs.resize(newbuckets);
+    m_unconf_since.assign(GetMaxConfirms() + 1, std::vector<int>(newbuckets));
+    m_unconf_stale = true;
 }
 
 // Roll the unconfirmed txs circular buffer
@@ -170,6 +219,7 @@ void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
         oldUnconfTxs[j] += unconfTxs[nBlockHeight % unconfTxs.size()][j];
         unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
     }
+    m_unconf_stale = true;
 }
 
 
@@ -178,26 +228,72 @@ void TxConfirmStats::Record(int blocksToConfirm, double feerate)
     // blocksToConfirm is 1-based
     if (blocksToConfirm < 1)
         return;
-    int periodsToConfirm = (blocksToConfirm + scale - 1) / scale;
+    unsigned int periodsToConfirm = (blocksToConfirm + scale - 1) / scale;
     unsigned int bucketindex = bucketMap.lower_bound(feerate)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    if (periodsToConfirm <= m_confirmed.size()) {
+        m_confirmed[periodsToConfirm - 1][bucketindex] += m_weight;
     }
-    txCtAvg[bucketindex]++;
-    m_feerate_avg[bucketindex] += feerate;
+    m_tx_count[bucketindex] += m_weight;
+    m_feerate_sum[bucketindex] += feerate * m_weight;
+    m_averages_stale = true;
 }
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    assert(confAvg.size() == failAvg.size());
+    m_weight /= decay;
+    m_averages_stale = true;
+    if (m_weight < MAX_WEIGHT) return;
+
+    // Fold the accumulated decay into the counters before the weights overflow
+    const double factor = 1 / m_weight;
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        for (unsigned int i = 0; i < m_confirmed.size(); i++) {
+            m_confirmed[i][j] *= factor;
+            m_failed[i][j] *= factor;
+        }
+        m_feerate_sum[j] *= factor;
+        m_tx_count[j] *= factor;
+    }
+    m_weight = 1;
+}
+
+void TxConfirmStats::UpdateAverages() const
+{
+    if (!m_averages_stale) return;
+    const double factor = 1 / m_weight;
+    const size_t periods = m_confirmed.size();
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        double confirmed = 0;
+        for (size_t i = 0; i < periods; i++) {
+            confirmed += m_confirmed[i][j];
+            confAvg[i][j] = confirmed * factor;
+        }
+        double failed = 0;
+        for (size_t i = periods; i-- > 0;) {
+            failed += m_failed[i][j];
+            failAvg[i][j] = failed * factor;
+        }
+        m_feerate_avg[j] = m_feerate_sum[j] * factor;
+        txCtAvg[j] = m_tx_count[j] * factor;
+    }
+    m_averages_stale = false;
+}
+
+void TxConfirmStats::UpdateUnconfirmedSums(unsigned int nBlockHeight) const
+{
+    if (!m_unconf_stale && m_unconf_height == nBlockHeight) return;
+    const unsigned int bins = unconfTxs.size();
+    const unsigned int max_confirms = GetMaxConfirms();
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++) {
-            confAvg[i][j] *= decay;
-            failAvg[i][j] *= decay;
+        int count = 0;
+        m_unconf_since[max_confirms][j] = 0;
+        for (unsigned int confct = max_confirms; confct-- > 0;) {
+            count += unconfTxs[(nBlockHeight - confct) % bins][j];
+            m_unconf_since[confct][j] = count;
         }
-        m_feerate_avg[j] *= decay;
-        txCtAvg[j] *= decay;
     }
+    m_unconf_height = nBlockHeight;
+    m_unconf_stale = false;
 }
 
 // returns -1 on error conditions
@@ -224,12 +320,14 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = maxbucketindex;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
     EstimatorBucket failBucket;
 
+    UpdateAverages();
+    UpdateUnconfirmedSums(nBlockHeight);
+
     // Start counting from highest feerate transactions
     for (int bucket = maxbucketindex; bucket >= 0; --bucket) {
         if (newBucketRange) {
@@ -240,8 +338,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
         nConf += confAvg[periodTarget - 1][bucket];
         totalNum += txCtAvg[bucket];
         failNum += failAvg[periodTarget - 1][bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct) % bins][bucket];
+        extraNum += m_unconf_since[std::min<unsigned int>(confTarget, GetMaxConfirms())][bucket];
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -326,25 +423,6 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
         failBucket.leftMempool = failNum;
     }
 
-    float passed_within_target_perc = 0.0;
-    float failed_within_target_perc = 0.0;
-    if ((passBucket.totalConfirmed + passBucket.inMempool + passBucket.leftMempool)) {
-        passed_within_target_perc = 100 * passBucket.withinTarget / (passBucket.totalConfirmed + passBucket.inMempool + passBucket.leftMempool);
-    }
-    if ((failBucket.totalConfirmed + failBucket.inMempool + failBucket.leftMempool)) {
-        failed_within_target_perc = 100 * failBucket.withinTarget / (failBucket.totalConfirmed + failBucket.inMempool + failBucket.leftMempool);
-    }
-
-    LogPrint(BCLog::ESTIMATEFEE, "FeeEst: %d > %.0f%% decay %.5f: feerate: %g from (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out) Fail: (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out)\n",
-             confTarget, 100.0 * successBreakPoint, decay,
-             median, passBucket.start, passBucket.end,
-             passed_within_target_perc,
-             passBucket.withinTarget, passBucket.totalConfirmed, passBucket.inMempool, passBucket.leftMempool,
-             failBucket.start, failBucket.end,
-             failed_within_target_perc,
-             failBucket.withinTarget, failBucket.totalConfirmed, failBucket.inMempool, failBucket.leftMempool);
-
-
     if (result) {
         result->pass = passBucket;
         result->fail = failBucket;
@@ -356,6 +434,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
+    UpdateAverages();
     fileout << decay;
     fileout << scale;
     fileout << m_feerate_avg;
@@ -412,6 +491,20 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
         }
     }
 
+    // Recover the per-period counters from the cumulative averages
+    m_weight = 1;
+    m_tx_count = txCtAvg;
+    m_feerate_sum = m_feerate_avg;
+    m_confirmed = confAvg;
+    m_failed = failAvg;
+    for (unsigned int i = 1; i < maxPeriods; i++) {
+        for (unsigned int j = 0; j < numBuckets; j++) {
+            m_confirmed[i][j] -= confAvg[i - 1][j];
+            m_failed[i - 1][j] -= failAvg[i][j];
+        }
+    }
+    m_averages_stale = false;
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -425,6 +518,7 @@ unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
     unconfTxs[blockIndex][bucketindex]++;
+    m_unconf_stale = true;
     return bucketindex;
 }
 
@@ -439,6 +533,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
+    m_unconf_stale = true;
     if (blocksAgo >= (int)unconfTxs.size()) {
         if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
@@ -458,10 +553,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     }
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
-        unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
-        }
+        unsigned int periodsAgo = std::min<size_t>(blocksAgo / scale, m_failed.size());
+        m_failed[periodsAgo - 1][bucketindex] += m_weight;
+        m_averages_stale = true;
     }
 }
 
@@ -470,15 +564,19 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
 // tracked. Txs that were part of a block have already been removed in
 // processBlockTx to ensure they are never double tracked, but it is
 // of no harm to try to remove them again.
-bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
+void CBlockPolicyEstimator::removeTx(const uint256& hash, bool inBlock)
+{
+    Enqueue(Event{Event::Kind::TX_REMOVED, hash, 0, 0, inBlock, {}});
+}
+
+bool CBlockPolicyEstimator::_removeTx(const uint256& hash, bool inBlock)
 {
-    LOCK(m_cs_fee_estimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        mapMemPoolTxs.erase(hash);
+        mapMemPoolTxs.erase(pos);
         return true;
     } else {
         return false;
@@ -501,17 +599,99 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
     shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
     longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+
+    LOCK(m_cs_fee_estimator);
+    RefreshEstimates();
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
 {
+    Stop();
+}
+
+void CBlockPolicyEstimator::Enqueue(Event&& event)
+{
+    {
+        LOCK(m_queue_mutex);
+        if (!m_thread.joinable()) {
+            m_stop = false;
+            m_thread = std::thread([this] {
+                util::ThreadRename("feeest");
+                ThreadProcessEvents();
+            });
+        }
+        m_queue.push_back(std::move(event));
+        ++m_queued;
+    }
+    m_cond_queue.notify_one();
+}
+
+void CBlockPolicyEstimator::Sync() const
+{
+    WAIT_LOCK(m_queue_mutex, lock);
+    const uint64_t target = m_queued;
+    m_cond_done.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_queue_mutex) { return m_completed >= target; });
+}
+
+void CBlockPolicyEstimator::Stop()
+{
+    WITH_LOCK(m_queue_mutex, m_stop = true);
+    m_cond_queue.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void CBlockPolicyEstimator::ThreadProcessEvents()
+{
+    while (true) {
+        std::deque<Event> batch;
+        {
+            WAIT_LOCK(m_queue_mutex, lock);
+            m_cond_queue.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_queue_mutex) { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) return;
+            batch.swap(m_queue);
+        }
+
+        {
+            LOCK(m_cs_fee_estimator);
+            bool new_block = false;
+            for (Event& event : batch) {
+                ProcessEvent(event);
+                if (event.kind == Event::Kind::BLOCK) new_block = true;
+            }
+            // Estimates only move meaningfully when a block is processed, so
+            // the table is recomputed once per batch that contained one.
+            if (new_block) RefreshEstimates();
+        }
+
+        WITH_LOCK(m_queue_mutex, m_completed += batch.size());
+        m_cond_done.notify_all();
+    }
+}
+
+void CBlockPolicyEstimator::ProcessEvent(Event& event)
+{
+    switch (event.kind) {
+    case Event::Kind::TX_ADDED:
+        _processTransaction(event.hash, event.height, event.feerate, event.flag);
+        break;
+    case Event::Kind::TX_REMOVED:
+        _removeTx(event.hash, event.flag);
+        break;
+    case Event::Kind::BLOCK:
+        _processBlock(event.height, event.block_txs);
+        break;
+    }
 }
 
 void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
 {
-    LOCK(m_cs_fee_estimator);
-    unsigned int txHeight = entry.GetHeight();
-    uint256 hash = entry.GetTx().GetHash();
+    // Feerates are stored and reported as LAB-per-kb:
+    CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
+    Enqueue(Event{Event::Kind::TX_ADDED, entry.GetTx().GetHash(), entry.GetHeight(), (double)feeRate.GetFeePerK(), validFeeEstimate, {}});
+}
+
+void CBlockPolicyEstimator::_processTransaction(const uint256& hash, unsigned int txHeight, double feerate, bool validFeeEstimate)
+{
     if (mapMemPoolTxs.count(hash)) {
         LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error mempool tx %s already being tracked\n",
                  hash.ToString());
@@ -534,21 +714,18 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     }
     trackedTxs++;
 
-    // Feerates are stored and reported as LAB-per-kb:
-    CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
-
     mapMemPoolTxs[hash].blockHeight = txHeight;
-    unsigned int bucketIndex = feeStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex = feeStats->NewTx(txHeight, feerate);
     mapMemPoolTxs[hash].bucketIndex = bucketIndex;
-    unsigned int bucketIndex2 = shortStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex2 = shortStats->NewTx(txHeight, feerate);
     assert(bucketIndex == bucketIndex2);
-    unsigned int bucketIndex3 = longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex3 = longStats->NewTx(txHeight, feerate);
     assert(bucketIndex == bucketIndex3);
 }
 
-bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
+bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const BlockTx& tx)
 {
-    if (!removeTx(entry->GetTx().GetHash(), true)) {
+    if (!_removeTx(tx.hash, true)) {
         // This transaction wasn't being tracked for fee estimation
         return false;
     }
@@ -556,7 +733,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     // How many blocks did it take for miners to include this transaction?
     // blocksToConfirm is 1-based, so a transaction included in the earliest
     // possible block has confirmation count of 1
-    int blocksToConfirm = nBlockHeight - entry->GetHeight();
+    int blocksToConfirm = nBlockHeight - tx.height;
     if (blocksToConfirm <= 0) {
         // This can't happen because we don't process transactions from a block with a height
         // lower than our greatest seen height
@@ -564,19 +741,27 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
         return false;
     }
 
-    // Feerates are stored and reported as LAB-per-kb:
-    CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
-
-    feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
-    shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
-    longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    feeStats->Record(blocksToConfirm, tx.feerate);
+    shortStats->Record(blocksToConfirm, tx.feerate);
+    longStats->Record(blocksToConfirm, tx.feerate);
     return true;
 }
 
 void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
                                          std::vector<const CTxMemPoolEntry*>& entries)
 {
-    LOCK(m_cs_fee_estimator);
+    Event event{Event::Kind::BLOCK, uint256(), nBlockHeight, 0, false, {}};
+    event.block_txs.reserve(entries.size());
+    for (const CTxMemPoolEntry* entry : entries) {
+        // Feerates are stored and reported as LAB-per-kb:
+        CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
+        event.block_txs.push_back(BlockTx{entry->GetTx().GetHash(), entry->GetHeight(), (double)feeRate.GetFeePerK()});
+    }
+    Enqueue(std::move(event));
+}
+
+void CBlockPolicyEstimator::_processBlock(unsigned int nBlockHeight, const std::vector<BlockTx>& txs)
+{
     if (nBlockHeight <= nBestSeenHeight) {
         // Ignore side chains and re-orgs; assuming they are random
         // they don't affect the estimate.
@@ -603,8 +788,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     unsigned int countedTxs = 0;
     // Update averages with data points from current block
-    for (const auto& entry : entries) {
-        if (processBlockTx(nBlockHeight, entry))
+    for (const BlockTx& tx : txs) {
+        if (processBlockTx(nBlockHeight, tx))
             countedTxs++;
     }
 
@@ -615,7 +800,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
 
     LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy estimates updated by %u of %u block txs, since last block %u of %u tracked, mempool map size %u, max target %u from %s\n",
-             countedTxs, entries.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size(),
+             countedTxs, txs.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size(),
              MaxUsableEstimate(), HistoricalBlockSpan() > BlockSpan() ? "historical" : "current");
 
     trackedTxs = 0;
@@ -654,6 +839,7 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
     }
     }
 
+    Sync();
     LOCK(m_cs_fee_estimator);
     // Return failure if trying to analyze a target we're not tracking
     if (confTarget <= 0 || (unsigned int)confTarget > stats->GetMaxConfirms())
@@ -661,8 +847,30 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
     if (successThreshold > 1)
         return CFeeRate(0);
 
+    EstimationResult tempResult;
+    if (!result) result = &tempResult;
     double median = stats->EstimateMedianVal(confTarget, sufficientTxs, successThreshold, nBestSeenHeight, result);
 
+    const EstimatorBucket& passBucket = result->pass;
+    const EstimatorBucket& failBucket = result->fail;
+    float passed_within_target_perc = 0.0;
+    float failed_within_target_perc = 0.0;
+    if ((passBucket.totalConfirmed + passBucket.inMempool + passBucket.leftMempool)) {
+        passed_within_target_perc = 100 * passBucket.withinTarget / (passBucket.totalConfirmed + passBucket.inMempool + passBucket.leftMempool);
+    }
+    if ((failBucket.totalConfirmed + failBucket.inMempool + failBucket.leftMempool)) {
+        failed_within_target_perc = 100 * failBucket.withinTarget / (failBucket.totalConfirmed + failBucket.inMempool + failBucket.leftMempool);
+    }
+
+    LogPrint(BCLog::ESTIMATEFEE, "FeeEst: %d > %.0f%% decay %.5f: feerate: %g from (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out) Fail: (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out)\n",
+             confTarget, 100.0 * successThreshold, result->decay,
+             median, passBucket.start, passBucket.end,
+             passed_within_target_perc,
+             passBucket.withinTarget, passBucket.totalConfirmed, passBucket.inMempool, passBucket.leftMempool,
+             failBucket.start, failBucket.end,
+             failed_within_target_perc,
+             failBucket.withinTarget, failBucket.totalConfirmed, failBucket.inMempool, failBucket.leftMempool);
+
     if (median < 0)
         return CFeeRate(0);
 
@@ -671,16 +879,11 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
 
 unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon horizon) const
 {
-    LOCK(m_cs_fee_estimator);
     switch (horizon) {
-    case FeeEstimateHorizon::SHORT_HALFLIFE: {
-        return shortStats->GetMaxConfirms();
-    }
-    case FeeEstimateHorizon::MED_HALFLIFE: {
-        return feeStats->GetMaxConfirms();
-    }
+    case FeeEstimateHorizon::SHORT_HALFLIFE:
+    case FeeEstimateHorizon::MED_HALFLIFE:
     case FeeEstimateHorizon::LONG_HALFLIFE: {
-        return longStats->GetMaxConfirms();
+        return std::atomic_load(&m_estimates)->highest_tracked[static_cast<int>(horizon)];
     }
     default: {
         throw std::out_of_range("CBlockPolicyEstimator::HighestTargetTracked unknown FeeEstimateHorizon");
@@ -781,33 +984,42 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
-    LOCK(m_cs_fee_estimator);
+    const std::shared_ptr<const EstimateTable> table = std::atomic_load(&m_estimates);
 
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
+        feeCalc->bestheight = table->height;
     }
 
-    double median = -1;
-    EstimationResult tempResult;
-
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms()) {
+    if (confTarget <= 0 || (unsigned int)confTarget > table->highest_tracked[static_cast<int>(FeeEstimateHorizon::LONG_HALFLIFE)]) {
         return CFeeRate(0);  // error condition
     }
 
     // It's not possible to get reasonable estimates for confTarget of 1
     if (confTarget == 1) confTarget = 2;
 
-    unsigned int maxUsableEstimate = MaxUsableEstimate();
-    if ((unsigned int)confTarget > maxUsableEstimate) {
-        confTarget = maxUsableEstimate;
+    if ((unsigned int)confTarget > table->max_usable) {
+        confTarget = table->max_usable;
     }
     if (feeCalc) feeCalc->returnedTarget = confTarget;
 
     if (confTarget <= 1) return CFeeRate(0); // error condition
 
-    assert(confTarget > 0); //estimateCombinedFee and estimateConservativeFee take unsigned ints
+    const EstimateTable::Entry& entry = (conservative ? table->conservative : table->economical)[confTarget];
+    if (feeCalc) {
+        feeCalc->est = entry.est;
+        feeCalc->reason = entry.reason;
+    }
+    return entry.feerate;
+}
+
+void CBlockPolicyEstimator::computeSmartFee(unsigned int confTarget, bool conservative, EstimateTable::Entry& entry) const
+{
+    double median = -1;
+    EstimationResult tempResult;
+
     /** true is passed to estimateCombined fee for target/2 and target so
      * that we check the max confirms for shorter time horizons as well.
      * This is necessary to preserve monotonically increasing estimates.
@@ -819,47 +1031,60 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
      * fluctuations lower our estimates by too much.
      */
     double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
-    if (feeCalc) {
-        feeCalc->est = tempResult;
-        feeCalc->reason = FeeReason::HALF_ESTIMATE;
-    }
+    entry.est = tempResult;
+    entry.reason = FeeReason::HALF_ESTIMATE;
     median = halfEst;
     double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
     if (actualEst > median) {
         median = actualEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::FULL_ESTIMATE;
-        }
+        entry.est = tempResult;
+        entry.reason = FeeReason::FULL_ESTIMATE;
     }
     double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
     if (doubleEst > median) {
         median = doubleEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::DOUBLE_ESTIMATE;
-        }
+        entry.est = tempResult;
+        entry.reason = FeeReason::DOUBLE_ESTIMATE;
     }
 
     if (conservative || median == -1) {
         double consEst =  estimateConservativeFee(2 * confTarget, &tempResult);
         if (consEst > median) {
             median = consEst;
-            if (feeCalc) {
-                feeCalc->est = tempResult;
-                feeCalc->reason = FeeReason::CONSERVATIVE;
-            }
+            entry.est = tempResult;
+            entry.reason = FeeReason::CONSERVATIVE;
         }
     }
 
-    if (median < 0) return CFeeRate(0); // error condition
+    entry.feerate = median < 0 ? CFeeRate(0) : CFeeRate(llround(median));
+}
 
-    return CFeeRate(llround(median));
+void CBlockPolicyEstimator::RefreshEstimates()
+{
+    int64_t start = GetTimeMicros();
+    auto table = std::make_shared<EstimateTable>();
+    table->height = nBestSeenHeight;
+    table->highest_tracked[static_cast<int>(FeeEstimateHorizon::SHORT_HALFLIFE)] = shortStats->GetMaxConfirms();
+    table->highest_tracked[static_cast<int>(FeeEstimateHorizon::MED_HALFLIFE)] = feeStats->GetMaxConfirms();
+    table->highest_tracked[static_cast<int>(FeeEstimateHorizon::LONG_HALFLIFE)] = longStats->GetMaxConfirms();
+    table->max_usable = MaxUsableEstimate();
+    if (table->max_usable > 1) {
+        table->economical.resize(table->max_usable + 1);
+        table->conservative.resize(table->max_usable + 1);
+        for (unsigned int target = 2; target <= table->max_usable; ++target) {
+            computeSmartFee(target, false, table->economical[target]);
+            computeSmartFee(target, true, table->conservative[target]);
+        }
+    }
+    std::atomic_store(&m_estimates, std::shared_ptr<const EstimateTable>(std::move(table)));
+    LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy smart fee estimates refreshed for targets up to %u in %.2fms\n",
+             MaxUsableEstimate(), (GetTimeMicros() - start) * 0.001);
 }
 
 
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
+    Sync();
     try {
         LOCK(m_cs_fee_estimator);
         fileout << 149900; // version required to read: 0.14.99 or later
@@ -885,6 +1110,7 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 
 bool CBlockPolicyEstimator::Read(CAutoFile& filein)
 {
+    Sync();
     try {
         LOCK(m_cs_fee_estimator);
         int nVersionRequired, nVersionThatWrote;
@@ -934,6 +1160,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            RefreshEstimates();
         }
     }
     catch (const std::exception& e) {
@@ -945,12 +1172,13 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
 
 void CBlockPolicyEstimator::FlushUnconfirmed() {
     int64_t startclear = GetTimeMicros();
+    Sync();
     LOCK(m_cs_fee_estimator);
     size_t num_entries = mapMemPoolTxs.size();
     // Remove every entry in mapMemPoolTxs
     while (!mapMemPoolTxs.empty()) {
         auto mi = mapMemPoolTxs.begin();
-        removeTx(mi->first, false); // this calls erase() on mapMemPoolTxs
+        _removeTx(mi->first, false); // this calls erase() on mapMemPoolTxs
     }
     int64_t endclear = GetTimeMicros();
     LogPrint(BCLog::ESTIMATEFEE, "Recorded %u unconfirmed txs from mempool in %gs\n", num_entries, (endclear - startclear)*0.000001);
@@ -12,9 +12,12 @@
 #include <random.h>
 #include <sync.h>
 
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 class CAutoFile;
@@ -72,6 +75,7 @@ struct FeeCalculation
     FeeReason reason = FeeReason::NONE;
     int desiredTarget = 0;
     int returnedTarget = 0;
+    unsigned int bestheight = 0;
 };
 
 /** \class CBlockPolicyEstimator
@@ -121,6 +125,13 @@ struct FeeCalculation
  *  We want to be able to estimate feerates that are needed on tx's to be included in
  * a certain number of blocks.  Every time a block is added to the best chain, this class records
  * stats on the transactions included in that block
+ *
+ * The mempool reports transactions and blocks through processTransaction,
+ * removeTx and processBlock, which only queue a compact event and return.
+ * A worker thread applies the events in order, and after each block
+ * recomputes the estimateSmartFee answer for every target into an immutable
+ * table that readers use without taking any lock.  The other estimate
+ * functions, Write and FlushUnconfirmed wait for queued events first.
  */
 class CBlockPolicyEstimator
 {
@@ -178,15 +189,15 @@ public:
     CBlockPolicyEstimator();
     ~CBlockPolicyEstimator();
 
-    /** Process all the transactions that have been included in a block */
+    /** Queue processing of all the transactions that have been included in a block */
     void processBlock(unsigned int nBlockHeight,
                       std::vector<const CTxMemPoolEntry*>& entries);
 
-    /** Process a transaction accepted to the mempool*/
+    /** Queue processing of a transaction accepted to the mempool*/
     void processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate);
 
-    /** Remove a transaction from the mempool tracking stats*/
-    bool removeTx(uint256 hash, bool inBlock);
+    /** Queue removal of a transaction from the mempool tracking stats*/
+    void removeTx(const uint256& hash, bool inBlock);
 
     /** DEPRECATED. Return a feerate estimate */
     CFeeRate estimateFee(int confTarget) const;
@@ -195,6 +206,8 @@ public:
      *  blocks. If no answer can be given at confTarget, return an estimate at
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
+     *  Answers come from the table computed after the last processed block,
+     *  whose height is returned in feeCalc->bestheight.
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
@@ -216,7 +229,59 @@ public:
     /** Calculation of highest target that estimates are tracked for */
     unsigned int HighestTargetTracked(FeeEstimateHorizon horizon) const;
 
+    /** Wait until every queued event has been processed. */
+    void Sync() const;
+
+    /** Process the remaining events and stop the worker thread. Later events start a new one. */
+    void Stop();
+
 private:
+    /** A transaction confirmed in a block, as far as fee estimation cares. */
+    struct BlockTx {
+        uint256 hash;
+        unsigned int height;
+        double feerate;
+    };
+
+    /** A mempool notification waiting to be applied by the worker thread. */
+    struct Event {
+        enum class Kind { TX_ADDED, TX_REMOVED, BLOCK } kind;
+        uint256 hash;
+        //! Entry height of an added transaction, or the height of a block.
+        unsigned int height;
+        double feerate;
+        //! validFeeEstimate for an added transaction, inBlock for a removed one.
+        bool flag;
+        std::vector<BlockTx> block_txs;
+    };
+
+    /** estimateSmartFee answers for every usable target, indexed by target. */
+    struct EstimateTable {
+        struct Entry {
+            CFeeRate feerate;
+            EstimationResult est;
+            FeeReason reason = FeeReason::NONE;
+        };
+        //! Height of the last block processed when the table was built.
+        unsigned int height{0};
+        unsigned int max_usable{0};
+        unsigned int highest_tracked[3]{0, 0, 0};
+        std::vector<Entry> economical;
+        std::vector<Entry> conservative;
+    };
+
+    mutable Mutex m_queue_mutex;
+    mutable std::condition_variable m_cond_queue;
+    mutable std::condition_variable m_cond_done;
+    std::deque<Event> m_queue GUARDED_BY(m_queue_mutex);
+    uint64_t m_queued GUARDED_BY(m_queue_mutex){0};
+    uint64_t m_completed GUARDED_BY(m_queue_mutex){0};
+    bool m_stop GUARDED_BY(m_queue_mutex){false};
+    std::thread m_thread;
+
+    //! Published with std::atomic_store, read with std::atomic_load.
+    std::shared_ptr<const EstimateTable> m_estimates;
+
     mutable RecursiveMutex m_cs_fee_estimator;
 
     unsigned int nBestSeenHeight GUARDED_BY(m_cs_fee_estimator);
@@ -245,8 +310,22 @@ private:
     std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
 
+    void Enqueue(Event&& event);
+    void ThreadProcessEvents();
+
+    /** Apply a queued event to the stats */
+    void ProcessEvent(Event& event) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    void _processTransaction(const uint256& hash, unsigned int txHeight, double feerate, bool validFeeEstimate) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    void _processBlock(unsigned int nBlockHeight, const std::vector<BlockTx>& txs) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    bool _removeTx(const uint256& hash, bool inBlock) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+
     /** Process a transaction confirmed in a block*/
-    bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    bool processBlockTx(unsigned int nBlockHeight, const BlockTx& tx) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+
+    /** Recompute and publish the estimateSmartFee table */
+    void RefreshEstimates() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** estimateSmartFee for a target already clamped to [2, MaxUsableEstimate()] */
+    void computeSmartFee(unsigned int confTarget, bool conservative, EstimateTable::Entry& entry) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
     /** Helper for estimateSmartFee */
     double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
@@ -261,6 +261,40 @@ extern const char* CFCHECKPT;
  * @since protocol version 70016 as described by BIP 339.
  */
 extern const char* WTXIDRELAY;
+/**
+ * Indicates that a node prefers to receive headers in "cmpctheaders"
+ * messages rather than "headers" messages.
+ * @since protocol version 70019.
+ */
+extern const char* SENDCMPCTHDR;
+/**
+ * Contains a CompressedHeaders object: a run of consecutive block headers
+ * with the fields that follow from the previous header left out.
+ * Sent instead of "headers" to peers that sent "sendcmpcthdr".
+ * @since protocol version 70019.
+ */
+extern const char* CMPCTHEADERS;
+/**
+ * Offers transaction reconciliation, with the protocol version and a salt for
+ * short transaction ids. Sent between "version" and "verack"; peers that both
+ * sent it reconcile transactions instead of announcing most of them.
+ */
+extern const char* SENDTXRCNCL;
+/**
+ * Starts a reconciliation round: contains the size of the sender's
+ * reconciliation set.
+ */
+extern const char* REQRECON;
+/**
+ * Answers "reqrecon" with a sketch of the sender's reconciliation set.
+ */
+extern const char* SKETCH;
+/**
+ * Finishes a reconciliation round: whether the difference could be recovered
+ * from the sketch, and the short ids of the transactions the sender is
+ * missing.
+ */
+extern const char* RECONCILDIFF;
 }; // namespace NetMsgType
 
 /* Get a vector of all valid message types (see above) */
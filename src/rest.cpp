@@ -175,25 +175,29 @@ static bool rest_headers(const util::Ref& context,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     const CBlockIndex* tip = nullptr;
-    std::vector<const CBlockIndex *> headers;
-    headers.reserve(count);
+    std::vector<const CBlockIndex *> indexes;
+    indexes.reserve(count);
     {
         LOCK(cs_main);
         tip = ::ChainActive().Tip();
         const CBlockIndex* pindex = LookupBlockIndex(hash);
         while (pindex != nullptr && ::ChainActive().Contains(pindex)) {
-            headers.push_back(pindex);
-            if (headers.size() == (unsigned long)count)
+            indexes.push_back(pindex);
+            if (indexes.size() == (unsigned long)count)
                 break;
             pindex = ::ChainActive().Next(pindex);
         }
     }
+    std::vector<CBlockHeader> headers;
+    if (!ReadBlockHeaders(indexes, headers)) {
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Block header not found in block index database");
+    }
 
     switch (rf) {
     case RetFormat::BINARY: {
         CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-        for (const CBlockIndex *pindex : headers) {
-            ssHeader << pindex->GetBlockHeader();
+        for (const CBlockHeader& header : headers) {
+            ssHeader << header;
         }
 
         std::string binaryHeader = ssHeader.str();
@@ -204,8 +208,8 @@ static bool rest_headers(const util::Ref& context,
 
     case RetFormat::HEX: {
         CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-        for (const CBlockIndex *pindex : headers) {
-            ssHeader << pindex->GetBlockHeader();
+        for (const CBlockHeader& header : headers) {
+            ssHeader << header;
         }
 
         std::string strHex = HexStr(ssHeader) + "\n";
@@ -215,8 +219,8 @@ static bool rest_headers(const util::Ref& context,
     }
     case RetFormat::JSON: {
         UniValue jsonHeaders(UniValue::VARR);
-        for (const CBlockIndex *pindex : headers) {
-            jsonHeaders.push_back(blockheaderToJSON(tip, pindex));
+        for (size_t i = 0; i < indexes.size(); ++i) {
+            jsonHeaders.push_back(blockheaderToJSON(tip, indexes[i], headers[i]));
         }
         std::string strJSON = jsonHeaders.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
@@ -243,6 +247,7 @@ static bool rest_block(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     CBlock block;
+    std::vector<uint8_t> block_data;
     CBlockIndex* pblockindex = nullptr;
     CBlockIndex* tip = nullptr;
     {
@@ -256,24 +261,27 @@ static bool rest_block(HTTPRequest* req,
         if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (rf == RetFormat::BINARY || rf == RetFormat::HEX) {
+            // Serve the stored bytes without deserializing the block.
+            if (!ReadRawBlockFromDisk(block_data, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            if ((RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS) && !StripRawBlockWitness(block_data))
+                return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, hashStr + " could not be read");
+        } else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
     }
 
     switch (rf) {
     case RetFormat::BINARY: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string binaryBlock = ssBlock.str();
+        std::string binaryBlock(block_data.begin(), block_data.end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RetFormat::HEX: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock) + "\n";
+        std::string strHex = HexStr(block_data) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
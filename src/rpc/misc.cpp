@@ -16,6 +16,7 @@
 #include <rpc/util.h>
 #include <scheduler.h>
 #include <script/descriptor.h>
+#include <support/bufferpool.h>
 #include <util/check.h>
 #include <util/message.h> // For MessageSign(), MessageVerify()
 #include <util/ref.h>
@@ -444,6 +445,16 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCBufferMemoryInfo()
+{
+    BufferPool::Stats stats = BufferPool::Instance().GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("cached", uint64_t(stats.cached_bytes));
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -488,6 +499,12 @@ static RPCHelpMan getmemoryinfo()
                                 {RPCResult::Type::NUM, "chunks_used", "Number allocated chunks"},
                                 {RPCResult::Type::NUM, "chunks_free", "Number unused chunks"},
                             }},
+                            {RPCResult::Type::OBJ, "buffers", "Information about the network receive buffers kept for reuse",
+                            {
+                                {RPCResult::Type::NUM, "cached", "Number of bytes held in freed buffers"},
+                                {RPCResult::Type::NUM, "hits", "Number of buffers handed out again"},
+                                {RPCResult::Type::NUM, "misses", "Number of buffers allocated anew"},
+                            }},
                         }
                     },
                     RPCResult{"mode \"mallocinfo\"",
@@ -504,6 +521,7 @@ static RPCHelpMan getmemoryinfo()
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("buffers", RPCBufferMemoryInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
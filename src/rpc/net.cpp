@@ -124,6 +124,7 @@ static RPCHelpMan getpeerinfo()
                             {RPCResult::Type::NUM, "pingtime", "ping time (if available)"},
                             {RPCResult::Type::NUM, "minping", "minimum observed ping time (if any at all)"},
                             {RPCResult::Type::NUM, "pingwait", "ping wait (if non-zero)"},
+                            {RPCResult::Type::NUM, "msgproctime", "The total time spent processing messages from and to this peer, in seconds"},
                             {RPCResult::Type::NUM, "version", "The peer version, such as 70001"},
                             {RPCResult::Type::STR, "subver", "The string version"},
                             {RPCResult::Type::BOOL, "inbound", "Inbound (true) or Outbound (false)"},
@@ -140,6 +141,9 @@ static RPCHelpMan getpeerinfo()
                             {
                                 {RPCResult::Type::NUM, "n", "The heights of blocks we're currently asking from this peer"},
                             }},
+                            {RPCResult::Type::NUM, "block_download_rate", "The blocks per second this peer delivers when asked (0 if it hasn't delivered any)"},
+                            {RPCResult::Type::NUM, "block_latency", "The average time in seconds from requesting a block from this peer to receiving it"},
+                            {RPCResult::Type::NUM, "block_download_window", "The number of blocks we ask from this peer at a time"},
                             {RPCResult::Type::BOOL, "whitelisted", /* optional */ true, "Whether the peer is whitelisted with default permissions\n"
                                                                                         "(DEPRECATED, returned only if config option -deprecatedrpc=whitelisted is passed)"},
                             {RPCResult::Type::ARR, "permissions", "Any special permissions that have been granted to this peer",
@@ -214,6 +218,7 @@ static RPCHelpMan getpeerinfo()
         if (stats.m_ping_wait_usec > 0) {
             obj.pushKV("pingwait", ((double)stats.m_ping_wait_usec) / 1e6);
         }
+        obj.pushKV("msgproctime", ((double)stats.m_msgproc_time_usec) / 1e6);
         obj.pushKV("version", stats.nVersion);
         // Use the sanitized form of subver here, to avoid tricksy remote peers from
         // corrupting or modifying the JSON output by putting special characters in
@@ -237,6 +242,9 @@ static RPCHelpMan getpeerinfo()
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("block_download_rate", statestats.m_block_download_rate);
+            obj.pushKV("block_latency", count_microseconds(statestats.m_block_latency) / 1e6);
+            obj.pushKV("block_download_window", statestats.m_block_download_window);
         }
         if (IsDeprecatedRPCEnabled("whitelisted")) {
             // whitelisted is deprecated in v0.21 for removal in v0.22
@@ -814,6 +814,31 @@ static RPCHelpMan signrawtransactionwithkey()
     };
 }
 
+/** Decode an array of raw transactions and compute the maximum fee of each from max_fee_rate. */
+static void DecodeRawTransactions(const UniValue& rawtxs, const CFeeRate& max_fee_rate, std::vector<CTransactionRef>& txs, std::vector<CAmount>& max_fees)
+{
+    if (rawtxs.size() < 1 || rawtxs.size() > MAX_RAW_TX_BATCH_SIZE) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Array must contain between 1 and %u raw transactions", MAX_RAW_TX_BATCH_SIZE));
+    }
+    for (size_t i = 0; i < rawtxs.size(); ++i) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed. Make sure the tx has at least one input.");
+        }
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+        max_fees.push_back(max_fee_rate.GetFee(GetVirtualTransactionSize(*txs.back())));
+    }
+}
+
+/** The reject-reason reported for a transaction that failed mempool acceptance. */
+static std::string RejectReason(const TxValidationState& state)
+{
+    if (state.IsInvalid() && state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
+        return "missing-inputs";
+    }
+    return state.GetRejectReason();
+}
+
 static RPCHelpMan sendrawtransaction()
 {
     return RPCHelpMan{"sendrawtransaction",
@@ -877,12 +902,14 @@ static RPCHelpMan sendrawtransaction()
 static RPCHelpMan testmempoolaccept()
 {
     return RPCHelpMan{"testmempoolaccept",
-                "\nReturns result of mempool acceptance tests indicating if raw transaction (serialized, hex-encoded) would be accepted by mempool.\n"
-                "\nThis checks if the transaction violates the consensus or policy rules.\n"
+                "\nReturns result of mempool acceptance tests indicating if raw transactions (serialized, hex-encoded) would be accepted by mempool.\n"
+                "\nThis checks if the transactions violate the consensus or policy rules.\n"
+                "\nThe transactions may spend outputs of each other. They are tested parents first, each as if\n"
+                "the earlier ones that would be accepted had been added.\n"
                 "\nSee sendrawtransaction call.\n",
                 {
-                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions.\n"
-            "                                        Length must be one for now.",
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, strprintf("An array of hex strings of raw transactions.\n"
+            "                                        Length must be between 1 and %u.", MAX_RAW_TX_BATCH_SIZE),
                         {
                             {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
                         },
@@ -890,8 +917,7 @@ static RPCHelpMan testmempoolaccept()
                     {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK()), "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT + "/kB\n"},
                 },
                 RPCResult{
-                    RPCResult::Type::ARR, "", "The result of the mempool acceptance test for each raw transaction in the input array.\n"
-                        "Length is exactly one for now.",
+                    RPCResult::Type::ARR, "", "The result of the mempool acceptance test for each raw transaction in the input array.",
                     {
                         {RPCResult::Type::OBJ, "", "",
                         {
@@ -923,67 +949,108 @@ static RPCHelpMan testmempoolaccept()
         UniValueType(), // VNUM or VSTR, checked inside AmountFromValue()
     });
 
-    if (request.params[0].get_array().size() != 1) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Array must contain exactly one raw transaction for now");
-    }
-
-    CMutableTransaction mtx;
-    if (!DecodeHexTx(mtx, request.params[0].get_array()[0].get_str())) {
-        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed. Make sure the tx has at least one input.");
-    }
-    CTransactionRef tx(MakeTransactionRef(std::move(mtx)));
-    const uint256& tx_hash = tx->GetHash();
-
     const CFeeRate max_raw_tx_fee_rate = request.params[1].isNull() ?
                                              DEFAULT_MAX_RAW_TX_FEE_RATE :
                                              CFeeRate(AmountFromValue(request.params[1]));
+    std::vector<CTransactionRef> txs;
+    std::vector<CAmount> max_raw_tx_fees;
+    DecodeRawTransactions(request.params[0].get_array(), max_raw_tx_fee_rate, txs, max_raw_tx_fees);
 
     CTxMemPool& mempool = EnsureMemPool(request.context);
-    int64_t virtual_size = GetVirtualTransactionSize(*tx);
-    CAmount max_raw_tx_fee = max_raw_tx_fee_rate.GetFee(virtual_size);
-
-    UniValue result(UniValue::VARR);
-    UniValue result_0(UniValue::VOBJ);
-    result_0.pushKV("txid", tx_hash.GetHex());
-
-    TxValidationState state;
-    bool test_accept_res;
-    CAmount fee{0};
+    std::vector<TxValidationState> states;
+    std::vector<CAmount> fees;
+    std::vector<bool> test_accept_res;
     {
         LOCK(cs_main);
-        test_accept_res = AcceptToMemoryPool(mempool, state, std::move(tx),
-            nullptr /* plTxnReplaced */, false /* bypass_limits */, /* test_accept */ true, &fee);
-    }
-
-    // Check that fee does not exceed maximum fee
-    if (test_accept_res && max_raw_tx_fee && fee > max_raw_tx_fee) {
-        result_0.pushKV("allowed", false);
-        result_0.pushKV("reject-reason", "max-fee-exceeded");
-        result.push_back(std::move(result_0));
-        return result;
-    }
-    result_0.pushKV("allowed", test_accept_res);
-
-    // Only return the fee and vsize if the transaction would pass ATMP.
-    // These can be used to calculate the feerate.
-    if (test_accept_res) {
-        result_0.pushKV("vsize", virtual_size);
-        UniValue fees(UniValue::VOBJ);
-        fees.pushKV("base", ValueFromAmount(fee));
-        result_0.pushKV("fees", fees);
-    } else {
-        if (state.IsInvalid()) {
-            if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
-                result_0.pushKV("reject-reason", "missing-inputs");
-            } else {
-                result_0.pushKV("reject-reason", strprintf("%s", state.GetRejectReason()));
-            }
+        test_accept_res = TestPackageAcceptance(mempool, txs, states, fees, &max_raw_tx_fees);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        UniValue result_i(UniValue::VOBJ);
+        result_i.pushKV("txid", txs[i]->GetHash().GetHex());
+        result_i.pushKV("allowed", test_accept_res[i]);
+
+        // Only return the fee and vsize if the transaction would pass ATMP.
+        // These can be used to calculate the feerate.
+        if (test_accept_res[i]) {
+            result_i.pushKV("vsize", GetVirtualTransactionSize(*txs[i]));
+            UniValue fee(UniValue::VOBJ);
+            fee.pushKV("base", ValueFromAmount(fees[i]));
+            result_i.pushKV("fees", fee);
         } else {
-            result_0.pushKV("reject-reason", state.GetRejectReason());
+            result_i.pushKV("reject-reason", RejectReason(states[i]));
         }
+        result.push_back(std::move(result_i));
     }
+    return result;
+},
+    };
+}
+
+static RPCHelpMan sendrawtransactions()
+{
+    return RPCHelpMan{"sendrawtransactions",
+                "\nSubmit raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nThe transactions may spend outputs of each other; parents are accepted before their children.\n"
+                "Script checks of independent transactions run in parallel, and the transactions that are\n"
+                "in the mempool afterwards are announced to peers together.\n"
+                "\nSee sendrawtransaction call.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, strprintf("An array of hex strings of raw transactions.\n"
+            "                                        Length must be between 1 and %u.", MAX_RAW_TX_BATCH_SIZE),
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK()),
+                        "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT +
+                            "/kB.\nSet to 0 to accept any fee rate.\n"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The result for each raw transaction in the input array.",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction hash in hex"},
+                            {RPCResult::Type::BOOL, "accepted", "If the transaction is in the mempool"},
+                            {RPCResult::Type::STR, "reject-reason", "Rejection string (only present when 'accepted' is false)"},
+                        }},
+                    }
+                },
+                RPCExamples{
+            "\nSend signed transactions\n"
+            + HelpExampleCli("sendrawtransactions", R"('["signedhex1","signedhex2"]')") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex1\",\"signedhex2\"]")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValueType(), // VNUM or VSTR, checked inside AmountFromValue()
+    });
 
-    result.push_back(std::move(result_0));
+    const CFeeRate max_raw_tx_fee_rate = request.params[1].isNull() ?
+                                             DEFAULT_MAX_RAW_TX_FEE_RATE :
+                                             CFeeRate(AmountFromValue(request.params[1]));
+    std::vector<CTransactionRef> txs;
+    std::vector<CAmount> max_raw_tx_fees;
+    DecodeRawTransactions(request.params[0].get_array(), max_raw_tx_fee_rate, txs, max_raw_tx_fees);
+
+    AssertLockNotHeld(cs_main);
+    NodeContext& node = EnsureNodeContext(request.context);
+    std::vector<TxValidationState> states;
+    const std::vector<bool> accepted = BroadcastTransactions(node, txs, max_raw_tx_fees, states, /*relay*/ true, /*wait_callback*/ true);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        UniValue result_i(UniValue::VOBJ);
+        result_i.pushKV("txid", txs[i]->GetHash().GetHex());
+        result_i.pushKV("accepted", accepted[i]);
+        if (!accepted[i]) result_i.pushKV("reject-reason", RejectReason(states[i]));
+        result.push_back(std::move(result_i));
+    }
     return result;
 },
     };
@@ -1870,6 +1937,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
     { "rawtransactions",    "testmempoolaccept",            &testmempoolaccept,         {"rawtxs","maxfeerate"} },
+    { "rawtransactions",    "sendrawtransactions",          &sendrawtransactions,       {"rawtxs","maxfeerate"} },
     { "rawtransactions",    "decodepsbt",                   &decodepsbt,                {"psbt"} },
     { "rawtransactions",    "combinepsbt",                  &combinepsbt,               {"txs"} },
     { "rawtransactions",    "finalizepsbt",                 &finalizepsbt,              {"psbt", "extract"} },
@@ -0,0 +1,50 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_SUPPORT_ALLOCATORS_POOLED_H
+#define LABYRINTH_SUPPORT_ALLOCATORS_POOLED_H
+
+#include <support/bufferpool.h>
+
+#include <memory>
+#include <vector>
+
+//
+// Allocator that takes its memory from the process-wide BufferPool.
+// Memory is not cleansed when freed: only for data that is not secret.
+//
+template <typename T>
+struct pooled_allocator {
+    typedef T value_type;
+
+    pooled_allocator() noexcept {}
+    template <typename U>
+    pooled_allocator(const pooled_allocator<U>&) noexcept
+    {
+    }
+    template <typename _Other>
+    struct rebind {
+        typedef pooled_allocator<_Other> other;
+    };
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(BufferPool::Instance().Allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        BufferPool::Instance().Free(p, sizeof(T) * n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const pooled_allocator<T>&, const pooled_allocator<U>&) noexcept { return true; }
+template <typename T, typename U>
+bool operator!=(const pooled_allocator<T>&, const pooled_allocator<U>&) noexcept { return false; }
+
+// Byte-vector backed by the buffer pool, for non-secret data.
+typedef std::vector<char, pooled_allocator<char> > CPooledSerializeData;
+
+#endif // LABYRINTH_SUPPORT_ALLOCATORS_POOLED_H
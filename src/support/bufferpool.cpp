@@ -0,0 +1,101 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <support/bufferpool.h>
+
+#include <new>
+
+/** Index of the smallest size class holding size bytes, or -1 if there is none. */
+static int ClassIndex(size_t size)
+{
+    int bits = BufferPool::MIN_CLASS_BITS;
+    while (bits <= BufferPool::MAX_CLASS_BITS && (size_t{1} << bits) < size) {
+        ++bits;
+    }
+    return bits <= BufferPool::MAX_CLASS_BITS ? bits - BufferPool::MIN_CLASS_BITS : -1;
+}
+
+static size_t ClassSize(int index)
+{
+    return size_t{1} << (index + BufferPool::MIN_CLASS_BITS);
+}
+
+static size_t MaxCached(int index)
+{
+    return BufferPool::MAX_CLASS_CACHED_BYTES / ClassSize(index);
+}
+
+BufferPool::BufferPool()
+{
+    // Freeing a buffer must not allocate.
+    for (int index = 0; index < NUM_CLASSES; ++index) {
+        free_lists[index].reserve(MaxCached(index));
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    for (auto& free_list : free_lists) {
+        for (void* ptr : free_list) {
+            ::operator delete(ptr);
+        }
+    }
+}
+
+size_t BufferPool::SizeClass(size_t size)
+{
+    const int index = ClassIndex(size);
+    return index < 0 ? size : ClassSize(index);
+}
+
+void* BufferPool::Allocate(size_t size)
+{
+    const int index = ClassIndex(size);
+    if (index < 0) {
+        return ::operator new(size);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<void*>& free_list = free_lists[index];
+        if (!free_list.empty()) {
+            void* ptr = free_list.back();
+            free_list.pop_back();
+            cached_bytes -= ClassSize(index);
+            ++hits;
+            return ptr;
+        }
+        ++misses;
+    }
+    return ::operator new(ClassSize(index));
+}
+
+void BufferPool::Free(void* ptr, size_t size)
+{
+    if (ptr == nullptr) return;
+    const int index = ClassIndex(size);
+    if (index >= 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<void*>& free_list = free_lists[index];
+        if (free_list.size() < MaxCached(index) && cached_bytes + ClassSize(index) <= MAX_CACHED_BYTES) {
+            free_list.push_back(ptr);
+            cached_bytes += ClassSize(index);
+            return;
+        }
+    }
+    ::operator delete(ptr);
+}
+
+BufferPool::Stats BufferPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return Stats{hits, misses, cached_bytes};
+}
+
+BufferPool& BufferPool::Instance()
+{
+    // Deliberately leaked: containers with static storage duration may
+    // return buffers to the pool while the program exits.
+    static BufferPool* const instance = new BufferPool();
+    return *instance;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_SUPPORT_BUFFERPOOL_H
+#define LABYRINTH_SUPPORT_BUFFERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+/**
+ * Pool of plain byte buffers, in power-of-two size classes from 256 B to
+ * 4 MiB.
+ *
+ * Receive buffers for network messages are allocated and freed at a high
+ * rate and in a small number of sizes. Freed buffers are kept on a free list
+ * per size class, up to MAX_CLASS_CACHED_BYTES per class and MAX_CACHED_BYTES
+ * in all, and handed out again by the next allocation of that class. Other
+ * requests go straight to the system allocator.
+ *
+ * Buffers are not cleared, neither when freed nor when reused, so the pool
+ * must not be used for secret data.
+ */
+class BufferPool
+{
+public:
+    static constexpr int MIN_CLASS_BITS = 8;
+    static constexpr int MAX_CLASS_BITS = 22;
+    static constexpr size_t MAX_CLASS_CACHED_BYTES = 256 << 10;
+    static constexpr size_t MAX_CACHED_BYTES = 1 << 20;
+
+    /** Memory statistics. */
+    struct Stats
+    {
+        uint64_t hits;       //!< allocations served from a free list
+        uint64_t misses;     //!< allocations that went to the system allocator
+        size_t cached_bytes; //!< bytes held on the free lists
+    };
+
+    BufferPool();
+    ~BufferPool();
+
+    BufferPool(const BufferPool& other) = delete; // non construction-copyable
+    BufferPool& operator=(const BufferPool&) = delete; // non copyable
+
+    /** Size of the buffer actually allocated for a request of size bytes. */
+    static size_t SizeClass(size_t size);
+
+    /** Allocate at least size bytes. Throws std::bad_alloc on failure. */
+    void* Allocate(size_t size);
+
+    /** Return a buffer obtained from Allocate(size) to the pool. */
+    void Free(void* ptr, size_t size);
+
+    Stats GetStats() const;
+
+    /** Return the process-wide pool. It is never destroyed, so buffers may
+     * safely be freed by objects with static storage duration.
+     */
+    static BufferPool& Instance();
+
+private:
+    static constexpr int NUM_CLASSES = MAX_CLASS_BITS - MIN_CLASS_BITS + 1;
+
+    mutable std::mutex mutex;
+    std::vector<void*> free_lists[NUM_CLASSES];
+    uint64_t hits{0};
+    uint64_t misses{0};
+    size_t cached_bytes{0};
+};
+
+#endif // LABYRINTH_SUPPORT_BUFFERPOOL_H
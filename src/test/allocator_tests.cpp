@@ -3,6 +3,8 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <support/allocators/pooled.h>
+#include <support/bufferpool.h>
 #include <util/memory.h>
 #include <util/system.h>
 
@@ -234,4 +236,62 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(bufferpool_tests)
+{
+    BOOST_CHECK_EQUAL(BufferPool::SizeClass(0), 256U);
+    BOOST_CHECK_EQUAL(BufferPool::SizeClass(256), 256U);
+    BOOST_CHECK_EQUAL(BufferPool::SizeClass(257), 512U);
+    BOOST_CHECK_EQUAL(BufferPool::SizeClass(3000000), 4194304U);
+    BOOST_CHECK_EQUAL(BufferPool::SizeClass(4194305), 4194305U);
+
+    BufferPool pool;
+    // Buffers are reused within a size class
+    void* a0 = pool.Allocate(1000);
+    pool.Free(a0, 1000);
+    BOOST_CHECK_EQUAL(pool.GetStats().cached_bytes, 1024U);
+    void* a1 = pool.Allocate(600);
+    BOOST_CHECK(a1 == a0);
+    BOOST_CHECK_EQUAL(pool.GetStats().hits, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats().cached_bytes, 0U);
+    // ... but not across classes
+    void* a2 = pool.Allocate(2000);
+    BOOST_CHECK(a2 != a1);
+    BOOST_CHECK_EQUAL(pool.GetStats().misses, 2U);
+    pool.Free(a1, 600);
+    pool.Free(a2, 2000);
+
+    // Each class only keeps a bounded number of free buffers
+    const size_t max_cached = BufferPool::MAX_CLASS_CACHED_BYTES / 256;
+    std::vector<void*> small;
+    for (size_t i = 0; i < max_cached + 10; ++i) small.push_back(pool.Allocate(100));
+    for (void* ptr : small) pool.Free(ptr, 100);
+    BOOST_CHECK_EQUAL(pool.GetStats().cached_bytes, 1024U + 2048U + BufferPool::MAX_CLASS_CACHED_BYTES);
+
+    // Classes larger than that bound and requests beyond the largest class aren't kept
+    for (size_t size : {size_t{1} << 20, size_t{5} << 20}) {
+        void* large = pool.Allocate(size);
+        pool.Free(large, size);
+    }
+    BOOST_CHECK_EQUAL(pool.GetStats().cached_bytes, 1024U + 2048U + BufferPool::MAX_CLASS_CACHED_BYTES);
+
+    // ... and neither are buffers beyond the bound on all classes together
+    BufferPool capped;
+    std::vector<std::pair<void*, size_t>> buffers;
+    for (int bits = 12; bits <= 18; ++bits) {
+        for (size_t i = 0; i < BufferPool::MAX_CLASS_CACHED_BYTES >> bits; ++i) {
+            buffers.emplace_back(capped.Allocate(size_t{1} << bits), size_t{1} << bits);
+        }
+    }
+    for (const auto& buffer : buffers) capped.Free(buffer.first, buffer.second);
+    BOOST_CHECK_EQUAL(capped.GetStats().cached_bytes, size_t{BufferPool::MAX_CACHED_BYTES});
+
+    // Containers using the pooled allocator return their buffers to the shared pool
+    const uint64_t hits = BufferPool::Instance().GetStats().hits;
+    for (int i = 0; i < 2; ++i) {
+        CPooledSerializeData data(70000, 'x');
+        BOOST_CHECK_EQUAL(data[69999], 'x');
+    }
+    BOOST_CHECK(BufferPool::Instance().GetStats().hits > hits);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,142 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <banman.h>
+#include <bantrie.h>
+#include <compat.h>
+#include <netaddress.h>
+#include <netbase.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+static CNetAddr Addr(const std::string& str)
+{
+    CNetAddr addr;
+    BOOST_REQUIRE(LookupHost(str, addr, false));
+    return addr;
+}
+
+static CSubNet SubNet(const std::string& str)
+{
+    CSubNet sub_net;
+    BOOST_REQUIRE(LookupSubNet(str, sub_net));
+    return sub_net;
+}
+
+BOOST_FIXTURE_TEST_SUITE(bantrie_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(match_subnets)
+{
+    BanTrie trie;
+    for (const char* sub_net : {"1.2.0.0/16", "1.2.3.4", "10.0.0.0/8", "2a00:1450::/32", "2a00:1450:1::/48",
+                                "pg6mmjiyjmcrsslvykfwnntlaru7p5svn6y2ymmju6nubxndf4pscryd.onion"}) {
+        BOOST_CHECK(trie.Insert(SubNet(sub_net), 100));
+    }
+    BOOST_CHECK_EQUAL(trie.Size(), 6U);
+
+    BOOST_CHECK(trie.Match(Addr("1.2.200.1"), 0));
+    BOOST_CHECK(trie.Match(Addr("::ffff:1.2.3.4"), 0));
+    BOOST_CHECK(trie.Match(Addr("10.255.255.255"), 0));
+    BOOST_CHECK(trie.Match(Addr("2a00:1450:ffff::1"), 0));
+    BOOST_CHECK(trie.Match(Addr("pg6mmjiyjmcrsslvykfwnntlaru7p5svn6y2ymmju6nubxndf4pscryd.onion"), 0));
+    BOOST_CHECK(!trie.Match(Addr("1.3.0.1"), 0));
+    BOOST_CHECK(!trie.Match(Addr("11.0.0.0"), 0));
+    BOOST_CHECK(!trie.Match(Addr("2a00:1451::1"), 0));
+    BOOST_CHECK(!trie.Match(Addr("::102:1"), 0));
+    BOOST_CHECK(!trie.Match(Addr("6hzph5hv6337r6p2.onion"), 0));
+
+    // Expired bans don't match.
+    BOOST_CHECK(trie.Match(Addr("10.0.0.1"), 99));
+    BOOST_CHECK(!trie.Match(Addr("10.0.0.1"), 100));
+
+    // Removing a subnet leaves the ones inside and around it.
+    BOOST_CHECK(trie.Erase(SubNet("1.2.0.0/16")));
+    BOOST_CHECK(!trie.Erase(SubNet("1.2.0.0/16")));
+    BOOST_CHECK(!trie.Erase(SubNet("1.2.0.0/15")));
+    BOOST_CHECK(!trie.Match(Addr("1.2.200.1"), 0));
+    BOOST_CHECK(trie.Match(Addr("1.2.3.4"), 0));
+    BOOST_CHECK(trie.Erase(SubNet("2a00:1450::/32")));
+    BOOST_CHECK(!trie.Match(Addr("2a00:1450:ffff::1"), 0));
+    BOOST_CHECK(trie.Match(Addr("2a00:1450:1::1"), 0));
+    BOOST_CHECK_EQUAL(trie.Size(), 4U);
+
+    trie.Clear();
+    BOOST_CHECK(!trie.Match(Addr("1.2.3.4"), 0));
+    BOOST_CHECK_EQUAL(trie.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(same_as_subnet_match)
+{
+    // Subnets and addresses in a small range, so that they overlap.
+    const auto random_addr = [] {
+        struct in_addr ipv4;
+        const uint8_t bytes[4] = {10, (uint8_t)InsecureRandRange(4), (uint8_t)InsecureRandRange(4), (uint8_t)InsecureRandBits(8)};
+        memcpy(&ipv4, bytes, sizeof(bytes));
+        return CNetAddr(ipv4);
+    };
+    BanTrie trie;
+    std::vector<CSubNet> sub_nets;
+    for (int i = 0; i < 200; ++i) {
+        sub_nets.emplace_back(random_addr(), 8 + InsecureRandRange(25));
+        trie.Insert(sub_nets.back(), 1);
+    }
+
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 2000; ++i) {
+            const CNetAddr addr = random_addr();
+            bool banned = false;
+            for (const CSubNet& sub_net : sub_nets) banned |= sub_net.Match(addr);
+            BOOST_CHECK_EQUAL(trie.Match(addr, 0), banned);
+        }
+        // Again with half of them removed.
+        while (sub_nets.size() > 100) {
+            const size_t i = InsecureRandRange(sub_nets.size());
+            const CSubNet sub_net = sub_nets[i];
+            sub_nets.erase(sub_nets.begin() + i);
+            if (std::find(sub_nets.begin(), sub_nets.end(), sub_net) == sub_nets.end()) {
+                BOOST_CHECK(trie.Erase(sub_net));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(banman_reload)
+{
+    const fs::path ban_file = GetDataDir() / "banlist_test.dat";
+    SetMockTime(1000000);
+    {
+        BanMan banman(ban_file, nullptr, /* default_ban_time= */ 60);
+        banman.Ban(SubNet("1.2.0.0/16"));
+        banman.Ban(SubNet("2a00:1450::/32"), 120);
+        BOOST_CHECK(banman.IsBanned(Addr("1.2.3.4")));
+        BOOST_CHECK(banman.IsBanned(SubNet("2a00:1450::/32")));
+
+        SetMockTime(1000090);
+        BOOST_CHECK(!banman.IsBanned(Addr("1.2.3.4")));
+        BOOST_CHECK(banman.IsBanned(Addr("2a00:1450::1")));
+        banman.Ban(SubNet("10.0.0.0/8"), 1000, /* since_unix_epoch= */ true);
+        BOOST_CHECK(!banman.IsBanned(Addr("10.0.0.1")));
+    }
+
+    // Bans that expired are dropped, when written or when read.
+    BanMan banman(ban_file, nullptr, 60);
+    banmap_t banned;
+    banman.GetBanned(banned);
+    BOOST_CHECK_EQUAL(banned.size(), 1U);
+    BOOST_CHECK(banman.IsBanned(Addr("2a00:1450::1")));
+    BOOST_CHECK(banman.Unban(SubNet("2a00:1450::/32")));
+    BOOST_CHECK(!banman.IsBanned(Addr("2a00:1450::1")));
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
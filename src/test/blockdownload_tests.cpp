@@ -0,0 +1,46 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdownload.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockdownload_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(window_follows_rate)
+{
+    using std::chrono::milliseconds;
+    using std::chrono::seconds;
+
+    BlockDownloadRate fast, slow;
+    BOOST_CHECK(!fast.HasEstimate());
+    BOOST_CHECK_EQUAL(fast.GetWindow(), DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // 16 blocks requested at once from each peer; the fast peer delivers one
+    // every 50ms after a 200ms round trip, the slow one every 2s.
+    const std::chrono::microseconds start{1000000};
+    for (int i = 0; i < 16; ++i) {
+        fast.BlockReceived(start, start + milliseconds{200} + i * milliseconds{50});
+        slow.BlockReceived(start, start + seconds{2} + i * seconds{2});
+    }
+    BOOST_CHECK_EQUAL(fast.GetDeliveries(), 16U);
+    BOOST_CHECK(fast.GetRate() > 10 && fast.GetRate() <= 20);
+    BOOST_CHECK(slow.GetRate() > 0.4 && slow.GetRate() <= 0.5);
+    BOOST_CHECK(fast.GetLatency() < slow.GetLatency());
+
+    BOOST_CHECK(fast.GetWindow() > DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK(fast.GetWindow() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(slow.GetWindow(), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // The time a peer sat idle doesn't count against it.
+    BlockDownloadRate idle;
+    idle.BlockReceived(start, start + milliseconds{100});
+    idle.BlockReceived(start + seconds{60}, start + seconds{60} + milliseconds{100});
+    BOOST_CHECK(idle.GetRate() > 9.9 && idle.GetRate() < 10.1);
+    BOOST_CHECK_EQUAL(idle.GetWindow(), 40);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
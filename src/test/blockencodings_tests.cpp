@@ -311,6 +311,42 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ManyTransactionsRoundTripTest)
+{
+    // Enough mempool and extra transactions for their short IDs to be hashed
+    // in several batches, the last of them partial.
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+    block.vtx.resize(1);
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 250; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1000;
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    // Every other transaction is in the block: the first 150 are in the
+    // mempool, the rest only among the extra transactions.
+    for (int i = 0; i < 150; i += 2) block.vtx.push_back(txs[i]);
+    std::vector<std::pair<uint256, CTransactionRef>> extra;
+    for (int i = 150; i < 250; i++) {
+        extra.emplace_back(txs[i]->GetWitnessHash(), txs[i]);
+        if (i % 2 == 0) block.vtx.push_back(txs[i]);
+    }
+
+    LOCK2(cs_main, pool.cs);
+    for (int i = 0; i < 150; i++) pool.addUnchecked(entry.FromTx(txs[i]));
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(CBlockHeaderAndShortTxIDs(block, true), extra) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -380,4 +416,44 @@ BOOST_AUTO_TEST_CASE(TransactionsRequestDeserializationOverflowTest) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(CompressedHeadersRoundTripTest) {
+    std::vector<CBlockHeader> headers(20);
+    for (size_t i = 0; i < headers.size(); ++i) {
+        CBlockHeader& header = headers[i];
+        header.nVersion = i < 10 ? 0x20000000 : 0x20000004;
+        header.hashPrevBlock = i == 0 ? InsecureRand256() : headers[i - 1].GetHash();
+        header.hashMerkleRoot = InsecureRand256();
+        // Timestamps don't have to increase
+        header.nTime = 1600000000 + 60 * i - (i % 3 == 2 ? 90 : 0);
+        header.nBits = i < 15 ? 0x1e0fffff : 0x1e0ffff0;
+        header.nHeight = 1000 + i;
+        header.nNonce = InsecureRandBits(64);
+        header.mix_hash = InsecureRand256();
+    }
+
+    CDataStream plain(SER_NETWORK, PROTOCOL_VERSION);
+    plain << headers;
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CompressedHeaders(headers);
+    BOOST_CHECK(stream.size() < plain.size() * 2 / 3);
+
+    CompressedHeaders compressed;
+    stream >> compressed;
+    BOOST_REQUIRE_EQUAL(compressed.headers.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); ++i) {
+        BOOST_CHECK_EQUAL(compressed.headers[i].nVersion, headers[i].nVersion);
+        BOOST_CHECK(compressed.headers[i].hashPrevBlock == headers[i].hashPrevBlock);
+        BOOST_CHECK_EQUAL(compressed.headers[i].nTime, headers[i].nTime);
+        BOOST_CHECK_EQUAL(compressed.headers[i].nBits, headers[i].nBits);
+        BOOST_CHECK_EQUAL(compressed.headers[i].nHeight, headers[i].nHeight);
+        BOOST_CHECK(compressed.headers[i].GetHash() == headers[i].GetHash());
+    }
+
+    // Unknown flags are rejected
+    CDataStream bad(SER_NETWORK, PROTOCOL_VERSION);
+    bad << CompressedHeaders(std::vector<CBlockHeader>(headers.begin(), headers.begin() + 2));
+    bad[1 + 120] = 0x04;
+    BOOST_CHECK_THROW(bad >> compressed, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,74 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockmap.h>
+#include <chain.h>
+#include <test/util/setup_common.h>
+#include <util/arena.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+
+BOOST_FIXTURE_TEST_SUITE(blockmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockmap_insert_find)
+{
+    ChunkArena<CBlockIndex, 16> arena;
+    BlockMap map;
+    std::map<uint256, CBlockIndex*> expected;
+    std::map<uint256, const uint256*> keys;
+
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(InsecureRand256()) == map.end());
+
+    // Enough entries to force several rehashes and arena chunks.
+    for (int i = 0; i < 1000; ++i) {
+        const uint256 hash = InsecureRand256();
+        CBlockIndex* pindex = arena.Emplace();
+        auto inserted = map.emplace(hash, pindex);
+        BOOST_CHECK(inserted.second);
+        BOOST_CHECK(inserted.first->first == hash);
+        pindex->phashBlock = &inserted.first->first;
+        expected.emplace(hash, pindex);
+        keys.emplace(hash, pindex->phashBlock);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 1000U);
+    BOOST_CHECK_EQUAL(arena.Size(), 1000U);
+
+    // Duplicates are rejected and keep the original entry.
+    const auto& first = *expected.begin();
+    auto dup = map.insert(std::make_pair(first.first, (CBlockIndex*)nullptr));
+    BOOST_CHECK(!dup.second);
+    BOOST_CHECK_EQUAL(dup.first->second, first.second);
+
+    for (const auto& entry : expected) {
+        auto it = map.find(entry.first);
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK_EQUAL(it->second, entry.second);
+        // Keys did not move while the table grew.
+        BOOST_CHECK_EQUAL(&it->first, keys[entry.first]);
+        BOOST_CHECK(entry.second->GetBlockHash() == entry.first);
+        BOOST_CHECK_EQUAL(map.count(entry.first), 1U);
+    }
+
+    size_t visited = 0;
+    for (const BlockMap::value_type& entry : map) {
+        BOOST_CHECK_EQUAL(expected.at(entry.first), entry.second);
+        ++visited;
+    }
+    BOOST_CHECK_EQUAL(visited, expected.size());
+
+    // operator[] inserts a null entry for unknown hashes.
+    const uint256 missing = InsecureRand256();
+    BOOST_CHECK(map[missing] == nullptr);
+    BOOST_CHECK_EQUAL(map.size(), 1001U);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(first.first) == map.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
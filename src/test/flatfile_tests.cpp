@@ -5,6 +5,7 @@
 
 #include <clientversion.h>
 #include <flatfile.h>
+#include <node/blockwriter.h>
 #include <streams.h>
 #include <test/util/setup_common.h>
 #include <util/system.h>
@@ -124,4 +125,42 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1U);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_async_writer)
+{
+    const auto data_dir = GetDataDir();
+    FlatFileSeq seq(data_dir, "a", 100);
+    // A tiny buffer limit forces writers to wait for the background thread.
+    BlockFileWriter writer(4);
+
+    bool out_of_space;
+    seq.Allocate(FlatFilePos(0, 0), 1, out_of_space);
+
+    std::vector<unsigned char> expected;
+    for (unsigned char i = 0; i < 10; ++i) {
+        std::vector<unsigned char> record(3, i);
+        BOOST_CHECK(writer.Write(seq, FlatFilePos(0, expected.size()), std::vector<unsigned char>(record)));
+        expected.insert(expected.end(), record.begin(), record.end());
+    }
+
+    // Reads wait for pending writes to the file.
+    writer.WaitForFile(seq, 0);
+    {
+        std::vector<unsigned char> data(expected.size());
+        CAutoFile file(seq.Open(FlatFilePos(0, 0), true), SER_DISK, CLIENT_VERSION);
+        file.read(reinterpret_cast<char*>(data.data()), data.size());
+        BOOST_CHECK(data == expected);
+    }
+
+    // Queued commits behave like FlatFileSeq::Flush.
+    BOOST_CHECK(writer.Flush(seq, FlatFilePos(0, expected.size())));
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 0))), 100U);
+
+    BOOST_CHECK(writer.Flush(seq, FlatFilePos(0, expected.size()), true));
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 0))), expected.size());
+
+    writer.Stop();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
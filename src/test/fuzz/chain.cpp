@@ -32,7 +32,7 @@ void test_one_input(const std::vector<uint8_t>& buffer)
     (void)disk_block_index->IsValid();
     (void)disk_block_index->ToString();
 
-    const CBlockHeader block_header = disk_block_index->GetBlockHeader();
+    const CBlockHeader block_header = disk_block_index->GetBlockHeader(disk_block_index->GetPoW());
     (void)CDiskBlockIndex{*disk_block_index};
     (void)disk_block_index->BuildSkip();
 
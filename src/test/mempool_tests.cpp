@@ -5,6 +5,7 @@
 
 #include <policy/policy.h>
 #include <txmempool.h>
+#include <util/rbf.h>
 #include <util/system.h>
 #include <util/time.h>
 
@@ -576,6 +577,59 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitStaleScoreTest)
+{
+    TestMemPoolEntryHelper entry;
+
+    // All transactions have the same size: one input and two outputs.
+    auto make_spend = [](const COutPoint& prevout, opcodetype op) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vin[0].scriptSig = CScript() << op;
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.scriptPubKey = CScript() << op << OP_EQUAL;
+            out.nValue = COIN;
+        }
+        return tx;
+    };
+    const CMutableTransaction parent = make_spend(COutPoint(), OP_1);
+    const CMutableTransaction child1 = make_spend(COutPoint(parent.GetHash(), 0), OP_2);
+    const CMutableTransaction child2 = make_spend(COutPoint(parent.GetHash(), 1), OP_3);
+    const CMutableTransaction other = make_spend(COutPoint(), OP_4);
+
+    // The memory held by a pool with only the parent and its high feerate child,
+    // with and without the unrelated transaction.
+    size_t kept_usage, other_usage;
+    {
+        CTxMemPool pool;
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.Fee(1000LL).FromTx(parent));
+        pool.addUnchecked(entry.Fee(20000LL).FromTx(child1));
+        kept_usage = pool.DynamicMemoryUsage();
+        pool.addUnchecked(entry.Fee(8000LL).FromTx(other));
+        other_usage = pool.DynamicMemoryUsage() - kept_usage;
+    }
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(parent));
+    pool.addUnchecked(entry.Fee(20000LL).FromTx(child1));
+    pool.addUnchecked(entry.Fee(500LL).FromTx(child2));
+    pool.addUnchecked(entry.Fee(8000LL).FromTx(other));
+
+    // The low feerate child goes first. The parent's descendant score counts
+    // it until then and is below the unrelated transaction's, but without it
+    // the parent pays for itself and its remaining child, so the unrelated
+    // transaction must be evicted instead of them.
+    pool.TrimToSize(kept_usage + other_usage / 2);
+    BOOST_CHECK(pool.exists(parent.GetHash()));
+    BOOST_CHECK(pool.exists(child1.GetHash()));
+    BOOST_CHECK(!pool.exists(child2.GetHash()));
+    BOOST_CHECK(!pool.exists(other.GetHash()));
+}
+
 inline CTransactionRef make_tx(std::vector<CAmount>&& output_values, std::vector<CTransactionRef>&& inputs=std::vector<CTransactionRef>(), std::vector<uint32_t>&& input_indices=std::vector<uint32_t>())
 {
     CMutableTransaction tx = CMutableTransaction();
@@ -789,4 +843,143 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolEntryInfoTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction parent;
+    parent.vin.resize(1);
+    parent.vin[0].scriptSig = CScript() << OP_11;
+    parent.vin[0].nSequence = MAX_BIP125_RBF_SEQUENCE;
+    parent.vout.resize(1);
+    parent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    parent.vout[0].nValue = 10 * COIN;
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vin[0].scriptSig = CScript() << OP_11;
+    child.vin[0].prevout = COutPoint(parent.GetHash(), 0);
+    child.vout.resize(1);
+    child.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    child.vout[0].nValue = 9 * COIN;
+
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.Fee(10000).FromTx(parent));
+    pool.addUnchecked(entry.Fee(20000).FromTx(child));
+
+    const MemPoolEntryInfo parent_info = pool.GetEntryInfo(*pool.mapTx.find(parent.GetHash()));
+    const MemPoolEntryInfo child_info = pool.GetEntryInfo(*pool.mapTx.find(child.GetHash()));
+    BOOST_CHECK(parent_info.tx->GetHash() == parent.GetHash());
+    BOOST_CHECK_EQUAL(parent_info.fee, 10000);
+    BOOST_CHECK_EQUAL(parent_info.mod_fees_with_descendants, 30000);
+    BOOST_CHECK_EQUAL(child_info.count_with_ancestors, 2U);
+    BOOST_CHECK(parent_info.children == std::vector<uint256>{child.GetHash()});
+    BOOST_CHECK(child_info.parents == std::vector<uint256>{parent.GetHash()});
+    // Only the entry's own signal is reported.
+    BOOST_CHECK(parent_info.bip125_replaceable);
+    BOOST_CHECK(!child_info.bip125_replaceable);
+    BOOST_CHECK(!child_info.unbroadcast);
+
+    // Copies taken earlier do not change; later ones see fee deltas and the
+    // unbroadcast set.
+    pool.PrioritiseTransaction(child.GetHash(), 5000);
+    pool.AddUnbroadcastTx(child.GetHash());
+    BOOST_CHECK_EQUAL(pool.GetEntryInfo(*pool.mapTx.find(parent.GetHash())).mod_fees_with_descendants, 35000);
+    BOOST_CHECK_EQUAL(pool.GetEntryInfo(*pool.mapTx.find(child.GetHash())).modified_fee, 25000);
+    BOOST_CHECK(pool.GetEntryInfo(*pool.mapTx.find(child.GetHash())).unbroadcast);
+    BOOST_CHECK_EQUAL(parent_info.mod_fees_with_descendants, 30000);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolClusterTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    LOCK2(cs_main, pool.cs);
+
+    const auto make_tx = [](const std::vector<COutPoint>& prevouts, size_t outputs) {
+        CMutableTransaction tx;
+        tx.vin.resize(prevouts.size());
+        for (size_t i = 0; i < prevouts.size(); ++i) {
+            tx.vin[i].prevout = prevouts[i];
+            tx.vin[i].scriptSig = CScript() << OP_11;
+        }
+        tx.vout.resize(outputs);
+        for (CTxOut& out : tx.vout) {
+            out.scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+            out.nValue = COIN;
+        }
+        return MakeTransactionRef(tx);
+    };
+    const auto cluster = [&](const CTransactionRef& tx) -> const TxMemPoolCluster& {
+        return pool.mapTx.find(tx->GetHash())->GetCluster();
+    };
+
+    // A diamond: a is spent by b and c, which are both spent by d.
+    const CTransactionRef a = make_tx({COutPoint(InsecureRand256(), 0)}, 2);
+    const CTransactionRef b = make_tx({COutPoint(a->GetHash(), 0)}, 1);
+    const CTransactionRef c = make_tx({COutPoint(a->GetHash(), 1)}, 1);
+    const CTransactionRef d = make_tx({COutPoint(b->GetHash(), 0), COutPoint(c->GetHash(), 0)}, 1);
+    const CTransactionRef e = make_tx({COutPoint(InsecureRand256(), 0)}, 1);
+    // b and c start clusters of their own before a joins them.
+    pool.addUnchecked(entry.Fee(2000).SigOpsCost(1).FromTx(b));
+    pool.addUnchecked(entry.Fee(3000).SigOpsCost(1).FromTx(c));
+    BOOST_CHECK(&cluster(b) != &cluster(c));
+    pool.addUnchecked(entry.Fee(1000).SigOpsCost(1).FromTx(a));
+    pool.UpdateTransactionsFromBlock({a->GetHash()});
+    pool.addUnchecked(entry.Fee(4000).SigOpsCost(1).FromTx(d));
+    pool.addUnchecked(entry.Fee(5000).SigOpsCost(1).FromTx(e));
+
+    BOOST_CHECK(&cluster(a) == &cluster(b));
+    BOOST_CHECK(&cluster(a) == &cluster(c));
+    BOOST_CHECK(&cluster(a) == &cluster(d));
+    BOOST_CHECK(&cluster(a) != &cluster(e));
+    BOOST_CHECK_EQUAL(cluster(a).nCount, 4U);
+    BOOST_CHECK_EQUAL(cluster(a).nSize, GetVirtualTransactionSize(*a) + GetVirtualTransactionSize(*b) +
+                                            GetVirtualTransactionSize(*c) + GetVirtualTransactionSize(*d));
+    BOOST_CHECK_EQUAL(cluster(e).nCount, 1U);
+
+    // A transaction joining a and e would make a cluster of 6.
+    std::string error;
+    const CTransactionRef f = make_tx({COutPoint(d->GetHash(), 0), COutPoint(e->GetHash(), 0)}, 1);
+    const CTxMemPoolEntry f_entry = entry.FromTx(f);
+    BOOST_CHECK(pool.CheckClusterLimits(f_entry, 6, cluster(a).nSize + cluster(e).nSize + f_entry.GetTxSize(), error));
+    BOOST_CHECK(!pool.CheckClusterLimits(f_entry, 5, std::numeric_limits<uint64_t>::max(), error));
+    BOOST_CHECK_EQUAL(error, "too many transactions in cluster [limit: 5]");
+    BOOST_CHECK(!pool.CheckClusterLimits(f_entry, 6, cluster(a).nSize + cluster(e).nSize, error));
+    // A limit of 0 does not apply.
+    BOOST_CHECK(pool.CheckClusterLimits(f_entry, 0, 0, error));
+    BOOST_CHECK(pool.CheckClusterLimits(f_entry, 6, 0, error));
+    BOOST_CHECK(!pool.CheckClusterLimits(f_entry, 0, cluster(a).nSize + cluster(e).nSize, error));
+
+    // Confirming a keeps b, c and d together through d.
+    pool.removeForBlock({a}, 1);
+    BOOST_CHECK_EQUAL(cluster(b).nCount, 3U);
+    BOOST_CHECK(&cluster(b) == &cluster(d));
+
+    // Without d, b and c are no longer connected.
+    pool.removeRecursive(*d, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK(&cluster(b) != &cluster(c));
+    BOOST_CHECK_EQUAL(cluster(b).nCount, 1U);
+    BOOST_CHECK_EQUAL(cluster(c).nCount, 1U);
+
+    // A chain confirmed in full leaves the ancestor state of the others intact.
+    std::vector<CTransactionRef> chain{make_tx({COutPoint(e->GetHash(), 0)}, 1)};
+    for (int i = 0; i < 20; ++i) chain.push_back(make_tx({COutPoint(chain.back()->GetHash(), 0)}, 1));
+    for (const CTransactionRef& tx : chain) pool.addUnchecked(entry.Fee(1000).FromTx(tx));
+    BOOST_CHECK_EQUAL(cluster(e).nCount, 22U);
+    const TxMemPoolCluster* const chain_cluster = &cluster(e);
+    std::vector<CTransactionRef> block{e};
+    block.insert(block.end(), chain.begin(), chain.begin() + 10);
+    pool.removeForBlock(block, 2);
+    BOOST_CHECK_EQUAL(pool.size(), 13U);
+    // With a single remaining neighbour, the rest of the chain cannot have
+    // split up and keeps its cluster.
+    BOOST_CHECK(&cluster(chain[10]) == chain_cluster);
+    BOOST_CHECK_EQUAL(cluster(chain[10]).nCount, 11U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(chain[20]->GetHash())->GetCountWithAncestors(), 11U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(chain[10]->GetHash())->GetCountWithDescendants(), 11U);
+    pool.removeForBlock(std::vector<CTransactionRef>(chain.begin() + 10, chain.end()), 3);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,8 +9,10 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <founder.h>
+#include <key.h>
 #include <miner.h>
 #include <policy/policy.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -21,6 +23,7 @@
 
 #include <test/util/setup_common.h>
 
+#include <algorithm>
 #include <memory>
 
 #include <boost/test/unit_test.hpp>
@@ -520,4 +523,103 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+// Templates built from a maintained BlockCandidate must contain the same
+// transactions and fees as a full pass over the mempool.
+BOOST_FIXTURE_TEST_CASE(block_candidate, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    const CScript scriptPubKey = CScript() << OP_TRUE;
+    const CAmount nOutputValue = 2 * COIN;
+    BlockAssembler::Options options;
+    options.nBlockMaxWeight = MAX_BLOCK_WEIGHT;
+    options.blockMinFeeRate = blockMinFeeRate;
+
+    // Split the mature coinbase into outputs anyone can spend.
+    CMutableTransaction fund;
+    fund.vin.resize(1);
+    fund.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    fund.vout.assign(20, CTxOut(nOutputValue, scriptPubKey));
+    std::vector<unsigned char> vchSig;
+    const uint256 sighash = SignatureHash(m_coinbase_txns[0]->vout[0].scriptPubKey, fund, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(sighash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    fund.vin[0].scriptSig << vchSig;
+    CreateAndProcessBlock({fund}, scriptPubKey);
+
+    BlockCandidate candidate(*m_node.mempool);
+    TestMemPoolEntryHelper entry;
+    const auto add_tx = [&](const COutPoint& prevout, CAmount nInput, CAmount nFee) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vout.assign(1, CTxOut(nInput - nFee, scriptPubKey));
+        m_node.mempool->addUnchecked(entry.Fee(nFee).Time(GetTime()).FromTx(tx));
+        return tx.GetHash();
+    };
+    const auto block_txs = [](const CBlockTemplate& tmpl) {
+        std::vector<uint256> txids;
+        for (size_t i = 1; i < tmpl.block.vtx.size(); ++i) txids.push_back(tmpl.block.vtx[i]->GetHash());
+        return txids;
+    };
+    // Returns the template built with the candidate after comparing it to a full pass.
+    const auto check = [&]() EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs) {
+        std::unique_ptr<CBlockTemplate> full = BlockAssembler(*m_node.mempool, chainparams, options).CreateNewBlock(scriptPubKey);
+        std::unique_ptr<CBlockTemplate> incremental = BlockAssembler(*m_node.mempool, chainparams, options, &candidate).CreateNewBlock(scriptPubKey);
+        std::vector<uint256> full_txids = block_txs(*full);
+        std::vector<uint256> incremental_txids = block_txs(*incremental);
+        std::sort(full_txids.begin(), full_txids.end());
+        std::sort(incremental_txids.begin(), incremental_txids.end());
+        BOOST_CHECK(full_txids == incremental_txids);
+        BOOST_CHECK_EQUAL(full->vTxFees[0], incremental->vTxFees[0]);
+        return incremental;
+    };
+
+    {
+        LOCK2(::cs_main, m_node.mempool->cs);
+        check();
+
+        // Independent transactions are appended as they arrive; a later one
+        // with a higher fee rate does not cause a full pass.
+        const uint256 txid_low = add_tx(COutPoint(fund.GetHash(), 0), nOutputValue, 1000);
+        add_tx(COutPoint(fund.GetHash(), 1), nOutputValue, 2000);
+        BOOST_CHECK_EQUAL(check()->block.vtx.size(), 3U);
+        const uint256 txid_high = add_tx(COutPoint(fund.GetHash(), 2), nOutputValue, 50000);
+        std::unique_ptr<CBlockTemplate> tmpl = check();
+        BOOST_CHECK_EQUAL(tmpl->block.vtx.size(), 4U);
+        BOOST_CHECK(tmpl->block.vtx.back()->GetHash() == txid_high);
+
+        // A transaction below the minimum fee rate stays out.
+        const uint256 txid_free = add_tx(COutPoint(fund.GetHash(), 3), nOutputValue, 0);
+        BOOST_CHECK_EQUAL(check()->block.vtx.size(), 4U);
+
+        // A high fee child pulls in its zero fee parent.
+        add_tx(COutPoint(txid_free, 0), nOutputValue, 100000);
+        BOOST_CHECK_EQUAL(check()->block.vtx.size(), 6U);
+
+        // Children of selected transactions, with low and high fee rates.
+        const uint256 txid_child = add_tx(COutPoint(txid_low, 0), nOutputValue - 1000, 1000);
+        add_tx(COutPoint(txid_high, 0), nOutputValue - 50000, 200000);
+        BOOST_CHECK_EQUAL(check()->block.vtx.size(), 8U);
+
+        // Removing a selected transaction and its descendant.
+        m_node.mempool->removeRecursive(*m_node.mempool->get(txid_low), MemPoolRemovalReason::CONFLICT);
+        BOOST_CHECK(!m_node.mempool->exists(txid_child));
+        BOOST_CHECK_EQUAL(check()->block.vtx.size(), 6U);
+
+        // Fee deltas are not reported to observers.
+        m_node.mempool->PrioritiseTransaction(txid_high, -50000);
+        for (int i = 4; i < 8; ++i) add_tx(COutPoint(fund.GetHash(), i), nOutputValue, 1000 * i);
+        BOOST_CHECK_EQUAL(check()->block.vtx.size(), 10U);
+    }
+
+    // A new tip needs a full pass.
+    CreateAndProcessBlock({}, scriptPubKey);
+    {
+        LOCK2(::cs_main, m_node.mempool->cs);
+        std::unique_ptr<CBlockTemplate> tmpl = check();
+        add_tx(COutPoint(fund.GetHash(), 8), nOutputValue, 3000);
+        BOOST_CHECK_EQUAL(check()->block.vtx.size(), tmpl->block.vtx.size() + 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include <cstdint>
 #include <net.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <serialize.h>
 #include <span.h>
 #include <streams.h>
@@ -755,6 +756,36 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
     BOOST_CHECK_EQUAL(IsLocal(addr), false);
 }
 
+BOOST_AUTO_TEST_CASE(shared_message_payload)
+{
+    CConnman connman(0x1337, 0x1337);
+    CAddress addr(CService(UtilBuildAddress(0x002, 0x001, 0x001, 0x001), 7777), NODE_NETWORK);
+    std::unique_ptr<CNode> node1 = MakeUnique<CNode>(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress{}, std::string{}, ConnectionType::OUTBOUND_FULL_RELAY);
+    std::unique_ptr<CNode> node2 = MakeUnique<CNode>(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress{}, std::string{}, ConnectionType::INBOUND);
+
+    const std::vector<unsigned char> payload(1000, 0x42);
+    const CSharedNetMsg msg(CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, payload));
+    connman.PushMessage(node1.get(), msg);
+    connman.PushMessage(node2.get(), msg);
+
+    // Each peer gets its own header, but the payload is queued by reference
+    const size_t header_size = CMessageHeader::HEADER_SIZE;
+    for (CNode* node : {node1.get(), node2.get()}) {
+        LOCK(node->cs_vSend);
+        BOOST_REQUIRE_EQUAL(node->vSendMsg.size(), 2U);
+        BOOST_CHECK_EQUAL(node->vSendMsg[0].size(), header_size);
+        BOOST_CHECK(node->vSendMsg[1].data() == msg.data->data());
+        BOOST_CHECK_EQUAL(node->nSendSize, header_size + msg.data->size());
+    }
+
+    // The header checksum matches the one of an unshared message
+    std::vector<unsigned char> header, shared_header;
+    CSerializedNetMsg unshared = CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, payload);
+    V1TransportSerializer().prepareForTransport(unshared, header);
+    V1TransportSerializer().prepareForTransport(msg, shared_header);
+    BOOST_CHECK(header == shared_header);
+}
+
 BOOST_AUTO_TEST_CASE(PoissonNextSend)
 {
     g_mock_deterministic_tests = true;
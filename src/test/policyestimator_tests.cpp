@@ -111,6 +111,23 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
         origFeeEst.push_back(feeEst.estimateFee(i).GetFeePerK());
     }
 
+    // Smart fee estimates come from the table computed after the last block
+    feeEst.Sync();
+    FeeCalculation feeCalc;
+    CAmount prevSmartFee = 0;
+    for (int i = 2; i < 10; i++) {
+        CAmount smartFee = feeEst.estimateSmartFee(i, &feeCalc, false).GetFeePerK();
+        BOOST_CHECK_EQUAL(feeCalc.returnedTarget, i);
+        BOOST_CHECK_EQUAL(feeCalc.bestheight, (unsigned int)blocknum);
+        BOOST_CHECK(smartFee > 0);
+        if (i > 2) BOOST_CHECK(smartFee <= prevSmartFee);
+        prevSmartFee = smartFee;
+    }
+    // Targets beyond the available history are answered at the longest usable one
+    BOOST_CHECK(feeEst.estimateSmartFee(1000, &feeCalc, true) != CFeeRate(0));
+    BOOST_CHECK_EQUAL(feeCalc.desiredTarget, 1000);
+    BOOST_CHECK(feeCalc.returnedTarget > 9 && feeCalc.returnedTarget < 1000);
+
     // Mine 50 more blocks with no transactions happening, estimates shouldn't change
     // We haven't decayed the moving average enough so we still have enough data points in every bucket
     while (blocknum < 250)
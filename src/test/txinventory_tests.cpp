@@ -0,0 +1,120 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memusage.h>
+#include <txinventory.h>
+#include <uint256.h>
+
+#include <test/util/setup_common.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txinventory_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(known_per_peer)
+{
+    TxInventoryTable table(/* bucket_size= */ 64, /* buckets= */ 4, /* peer_quota= */ 64);
+    KnownTxInventory peer1(table), peer2(table);
+    const uint256 a = InsecureRand256(), b = InsecureRand256();
+
+    peer1.insert(a);
+    peer2.insert(b);
+    peer2.insert(a);
+    BOOST_CHECK(peer1.contains(a));
+    BOOST_CHECK(!peer1.contains(b));
+    BOOST_CHECK(peer2.contains(a));
+    BOOST_CHECK(peer2.contains(b));
+
+    // A new peer in a freed slot knows nothing.
+    {
+        KnownTxInventory peer3(table);
+        peer3.insert(b);
+    }
+    KnownTxInventory peer4(table);
+    BOOST_CHECK(!peer4.contains(a));
+    BOOST_CHECK(!peer4.contains(b));
+    BOOST_CHECK_EQUAL(peer2.DynamicMemoryUsage(), peer4.DynamicMemoryUsage() + memusage::MallocUsage(64 / 8));
+}
+
+BOOST_AUTO_TEST_CASE(oldest_bucket_retired)
+{
+    TxInventoryTable table(/* bucket_size= */ 64, /* buckets= */ 4, /* peer_quota= */ 64);
+    KnownTxInventory peer(table);
+
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 64 * 4; ++i) {
+        hashes.push_back(InsecureRand256());
+        peer.insert(hashes.back());
+    }
+    for (const uint256& hash : hashes) BOOST_CHECK(peer.contains(hash));
+
+    // Known again, but that doesn't keep it from being forgotten with its bucket.
+    peer.insert(hashes[0]);
+    peer.insert(InsecureRand256());
+    for (int i = 0; i < 64; ++i) BOOST_CHECK(!peer.contains(hashes[i]));
+    for (int i = 64; i < 64 * 4; ++i) BOOST_CHECK(peer.contains(hashes[i]));
+
+    // Once forgotten, a hash can be learnt again.
+    peer.insert(hashes[0]);
+    BOOST_CHECK(peer.contains(hashes[0]));
+}
+
+BOOST_AUTO_TEST_CASE(peer_quota)
+{
+    TxInventoryTable table(/* bucket_size= */ 64, /* buckets= */ 4, /* peer_quota= */ 16);
+    KnownTxInventory peer(table), flooder(table);
+    const uint256 known = InsecureRand256();
+    peer.insert(known);
+
+    // A peer can't add more than its quota of new hashes to a bucket, so
+    // it can't push the ring around by itself.
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 64 * 4; ++i) {
+        hashes.push_back(InsecureRand256());
+        flooder.insert(hashes.back());
+    }
+    for (int i = 0; i < 16; ++i) BOOST_CHECK(flooder.contains(hashes[i]));
+    for (int i = 16; i < 64 * 4; ++i) BOOST_CHECK(!flooder.contains(hashes[i]));
+    BOOST_CHECK(peer.contains(known));
+
+    // Hashes others added still count, and other peers can still add theirs.
+    flooder.insert(known);
+    BOOST_CHECK(flooder.contains(known));
+    peer.insert(hashes[16]);
+    BOOST_CHECK(peer.contains(hashes[16]));
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_peers)
+{
+    // Peers handled by different threads add the same hashes and their own.
+    TxInventoryTable table;
+    std::vector<uint256> shared;
+    std::vector<std::vector<uint256>> own(4);
+    for (int i = 0; i < 1000; ++i) {
+        shared.push_back(InsecureRand256());
+        for (auto& hashes : own) hashes.push_back(InsecureRand256());
+    }
+    std::atomic<int> missing{0};
+    std::vector<std::thread> threads;
+    for (const auto& hashes : own) {
+        threads.emplace_back([&table, &shared, &hashes, &missing] {
+            KnownTxInventory peer(table);
+            for (size_t i = 0; i < hashes.size(); ++i) {
+                peer.insert(shared[i]);
+                peer.insert(hashes[i]);
+            }
+            for (size_t i = 0; i < hashes.size(); ++i) {
+                missing += !peer.contains(shared[i]) + !peer.contains(hashes[i]);
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    BOOST_CHECK_EQUAL(missing, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
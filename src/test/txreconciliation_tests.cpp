@@ -0,0 +1,142 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <streams.h>
+#include <txreconciliation.h>
+#include <uint256.h>
+
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sketch_decode)
+{
+    const size_t cells = ReconciliationSketch::CellsForCapacity(30);
+    ReconciliationSketch here(cells), there(cells);
+    std::set<uint32_t> only_here_expected, only_there_expected;
+    for (int i = 0; i < 200; ++i) {
+        const uint32_t id = 1 + InsecureRand32() % 0xfffffffe;
+        if (i < 10) {
+            here.Add(id);
+            only_here_expected.insert(id);
+        } else if (i < 30) {
+            there.Add(id);
+            only_there_expected.insert(id);
+        } else {
+            here.Add(id);
+            there.Add(id);
+        }
+    }
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << here;
+    ReconciliationSketch received;
+    stream >> received;
+    BOOST_CHECK_EQUAL(received.Cells(), cells);
+
+    received.Subtract(there);
+    std::vector<uint32_t> only_here, only_there;
+    BOOST_CHECK(received.Decode(only_here, only_there));
+    BOOST_CHECK(std::set<uint32_t>(only_here.begin(), only_here.end()) == only_here_expected);
+    BOOST_CHECK(std::set<uint32_t>(only_there.begin(), only_there.end()) == only_there_expected);
+
+    // A difference far beyond the capacity can't be recovered.
+    ReconciliationSketch small(ReconciliationSketch::CellsForCapacity(2));
+    for (int i = 0; i < 100; ++i) small.Add(1 + InsecureRand32() % 0xfffffffe);
+    only_here.clear();
+    only_there.clear();
+    BOOST_CHECK(!small.Decode(only_here, only_there));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_round)
+{
+    TxReconciliationTracker initiator, responder;
+    const NodeId peer_of_initiator = 1, peer_of_responder = 2;
+
+    // Nothing happens with peers that aren't registered.
+    BOOST_CHECK(initiator.ShouldFlood(peer_of_initiator, InsecureRand256()));
+    BOOST_CHECK(!initiator.AddToSet(peer_of_initiator, InsecureRand256()));
+    BOOST_CHECK(!initiator.RegisterPeer(peer_of_initiator, false, 0));
+
+    const uint64_t initiator_salt = initiator.PreRegisterPeer(peer_of_initiator);
+    const uint64_t responder_salt = responder.PreRegisterPeer(peer_of_responder);
+    BOOST_CHECK(initiator.RegisterPeer(peer_of_initiator, /* is_peer_inbound= */ false, responder_salt));
+    BOOST_CHECK(responder.RegisterPeer(peer_of_responder, /* is_peer_inbound= */ true, initiator_salt));
+    BOOST_CHECK(initiator.IsPeerRegistered(peer_of_initiator));
+
+    std::set<uint256> only_initiator, only_responder;
+    for (int i = 0; i < 100; ++i) {
+        const uint256 wtxid = InsecureRand256();
+        if (i < 5) {
+            BOOST_CHECK(initiator.AddToSet(peer_of_initiator, wtxid));
+            only_initiator.insert(wtxid);
+        } else if (i < 12) {
+            BOOST_CHECK(responder.AddToSet(peer_of_responder, wtxid));
+            only_responder.insert(wtxid);
+        } else {
+            BOOST_CHECK(initiator.AddToSet(peer_of_initiator, wtxid));
+            BOOST_CHECK(responder.AddToSet(peer_of_responder, wtxid));
+        }
+    }
+
+    // Only the initiator requests, once per interval.
+    const std::chrono::microseconds now{1000000};
+    BOOST_CHECK(!responder.MaybeRequestReconciliation(peer_of_responder, now));
+    const Optional<uint16_t> set_size = initiator.MaybeRequestReconciliation(peer_of_initiator, now);
+    BOOST_REQUIRE(set_size);
+    BOOST_CHECK_EQUAL(*set_size, 93);
+    BOOST_CHECK(!initiator.MaybeRequestReconciliation(peer_of_initiator, now + std::chrono::seconds{1}));
+
+    ReconciliationSketch sketch;
+    BOOST_CHECK(responder.HandleReconciliationRequest(peer_of_responder, *set_size, now, sketch));
+    BOOST_CHECK(sketch.Cells() > 0);
+    // The responder answers one request per round and interval.
+    ReconciliationSketch ignored;
+    BOOST_CHECK(!responder.HandleReconciliationRequest(peer_of_responder, *set_size, now + RECON_REQUEST_INTERVAL, ignored));
+
+    bool success;
+    std::vector<uint256> initiator_announces;
+    std::vector<uint32_t> to_request;
+    BOOST_CHECK(initiator.HandleSketch(peer_of_initiator, sketch, success, initiator_announces, to_request));
+    BOOST_CHECK(success);
+    BOOST_CHECK(std::set<uint256>(initiator_announces.begin(), initiator_announces.end()) == only_initiator);
+    BOOST_CHECK_EQUAL(to_request.size(), only_responder.size());
+    // The round is over.
+    BOOST_CHECK(!initiator.HandleSketch(peer_of_initiator, sketch, success, initiator_announces, to_request));
+
+    std::vector<uint256> responder_announces;
+    BOOST_CHECK(responder.HandleReconciliationDiff(peer_of_responder, success, to_request, responder_announces));
+    BOOST_CHECK(std::set<uint256>(responder_announces.begin(), responder_announces.end()) == only_responder);
+    BOOST_CHECK(!responder.HandleReconciliationRequest(peer_of_responder, 0, now + RECON_REQUEST_INTERVAL / 2, ignored));
+
+    // A failed round announces the whole set instead.
+    const uint256 wtxid = InsecureRand256();
+    BOOST_CHECK(responder.AddToSet(peer_of_responder, wtxid));
+    BOOST_CHECK(responder.HandleReconciliationRequest(peer_of_responder, 0, now + RECON_REQUEST_INTERVAL, sketch));
+    responder_announces.clear();
+    BOOST_CHECK(responder.HandleReconciliationDiff(peer_of_responder, false, {}, responder_announces));
+    BOOST_CHECK(responder_announces == std::vector<uint256>{wtxid});
+
+    // So does a round the initiator doesn't finish in time.
+    const uint256 wtxid2 = InsecureRand256();
+    BOOST_CHECK(responder.AddToSet(peer_of_responder, wtxid2));
+    const std::chrono::microseconds sketch_time = now + 2 * RECON_REQUEST_INTERVAL;
+    BOOST_CHECK(responder.HandleReconciliationRequest(peer_of_responder, 0, sketch_time, sketch));
+    responder_announces.clear();
+    BOOST_CHECK(!responder.ExpireReconciliation(peer_of_responder, sketch_time + RECON_RESPONSE_TIMEOUT - std::chrono::seconds{1}, responder_announces));
+    BOOST_CHECK(responder.ExpireReconciliation(peer_of_responder, sketch_time + RECON_RESPONSE_TIMEOUT, responder_announces));
+    BOOST_CHECK(responder_announces == std::vector<uint256>{wtxid2});
+    BOOST_CHECK(!responder.HandleReconciliationDiff(peer_of_responder, true, {}, responder_announces));
+
+    responder.ForgetPeer(peer_of_responder);
+    BOOST_CHECK(!responder.IsPeerRegistered(peer_of_responder));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
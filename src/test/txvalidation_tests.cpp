@@ -5,6 +5,7 @@
 
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
 #include <test/util/setup_common.h>
 #include <founder.h>
@@ -55,4 +56,202 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
 }
 
+/**
+ * Ensure that a batch gets the same results as submitting its transactions one at a time.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_accept_batch, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto spend = [&](const CTransaction& from, uint32_t n, size_t outputs, CAmount fee, bool valid_sig = true) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(from.GetHash(), n);
+        tx.vout.assign(outputs, CTxOut((from.vout[n].nValue - fee) / outputs, scriptPubKey));
+        const uint256 sighash = SignatureHash(from.vout[n].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        std::vector<unsigned char> sig;
+        BOOST_CHECK(coinbaseKey.Sign(valid_sig ? sighash : uint256::ONE, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << sig;
+        return MakeTransactionRef(tx);
+    };
+
+    const CTransactionRef fund = spend(*m_coinbase_txns[0], 0, 8, 1 * COIN);
+    CreateAndProcessBlock({CMutableTransaction(*fund)}, scriptPubKey);
+
+    std::vector<CTransactionRef> txs;
+    for (uint32_t n = 0; n < 4; ++n) txs.push_back(spend(*fund, n, 2, 10000));
+    const CTransactionRef bad_sig = spend(*fund, 4, 2, 10000, /* valid_sig */ false);
+    const CTransactionRef conflict = spend(*fund, 0, 1, 20000);
+    const CTransactionRef child = spend(*txs[0], 0, 1, 10000);
+    const CTransactionRef orphan = spend(*conflict, 0, 1, 10000);
+    // The child precedes its parent in the batch.
+    txs.insert(txs.begin(), child);
+    txs.push_back(bad_sig);
+    txs.push_back(conflict);
+    txs.push_back(orphan);
+    txs.push_back(txs[2]);
+
+    const unsigned int initial_pool_size = WITH_LOCK(m_node.mempool->cs, return m_node.mempool->size());
+    std::vector<TxValidationState> states;
+    const std::vector<bool> accepted = AcceptToMemoryPoolBatch(*m_node.mempool, txs, states, nullptr);
+    BOOST_REQUIRE_EQUAL(accepted.size(), txs.size());
+    BOOST_REQUIRE_EQUAL(states.size(), txs.size());
+
+    // Independent transactions, and the child once its parent is in.
+    for (size_t i = 0; i < 5; ++i) {
+        BOOST_CHECK(accepted[i]);
+        BOOST_CHECK(states[i].IsValid());
+        BOOST_CHECK(m_node.mempool->exists(txs[i]->GetHash()));
+    }
+    BOOST_CHECK(!accepted[5]);
+    BOOST_CHECK_EQUAL(states[5].GetRejectReason().find("mandatory-script-verify-flag-failed"), 0U);
+    BOOST_CHECK(!accepted[6]);
+    BOOST_CHECK_EQUAL(states[6].GetRejectReason(), "txn-mempool-conflict");
+    BOOST_CHECK(!accepted[7]);
+    BOOST_CHECK_EQUAL(states[7].GetRejectReason(), "bad-txns-inputs-missingorspent");
+    BOOST_CHECK(!accepted[8]);
+    BOOST_CHECK_EQUAL(states[8].GetRejectReason(), "txn-already-in-mempool");
+    BOOST_CHECK_EQUAL(WITH_LOCK(m_node.mempool->cs, return m_node.mempool->size()), initial_pool_size + 5);
+}
+
+/**
+ * Ensure that the scripts of transactions with many inputs are verified on the script-checking threads.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_parallel_script_checks, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto sign = [&](CMutableTransaction& tx, const std::vector<CTxOut>& spent, size_t bad_input) {
+        for (size_t i = 0; i < tx.vin.size(); ++i) {
+            const uint256 sighash = SignatureHash(spent[i].scriptPubKey, tx, i, SIGHASH_ALL, spent[i].nValue, SigVersion::BASE);
+            std::vector<unsigned char> sig;
+            BOOST_CHECK(coinbaseKey.Sign(i == bad_input ? uint256::ONE : sighash, sig));
+            sig.push_back((unsigned char)SIGHASH_ALL);
+            tx.vin[i].scriptSig = CScript() << sig;
+        }
+    };
+
+    const size_t input_count = 2 * DEFAULT_MEMPOOL_PARALLEL_SCRIPT_INPUTS;
+    CMutableTransaction fund;
+    fund.vin.resize(1);
+    fund.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    fund.vout.assign(2 * input_count, CTxOut(1 * COIN, scriptPubKey));
+    sign(fund, {m_coinbase_txns[0]->vout[0]}, /* bad_input */ fund.vin.size());
+    CreateAndProcessBlock({fund}, scriptPubKey);
+
+    const auto spend = [&](uint32_t first, size_t bad_input) {
+        CMutableTransaction tx;
+        for (uint32_t n = first; n < first + input_count; ++n) tx.vin.emplace_back(COutPoint(fund.GetHash(), n));
+        tx.vout.assign(1, CTxOut(input_count * COIN - 100000, scriptPubKey));
+        sign(tx, std::vector<CTxOut>(input_count, fund.vout[0]), bad_input);
+        return MakeTransactionRef(tx);
+    };
+
+    BOOST_REQUIRE(g_parallel_script_checks);
+    LOCK(cs_main);
+    TxValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPool(*m_node.mempool, state, spend(0, input_count - 1), nullptr, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason().find("mandatory-script-verify-flag-failed"), 0U);
+
+    state = TxValidationState();
+    const CTransactionRef tx = spend(input_count, /* bad_input */ input_count);
+    BOOST_CHECK(AcceptToMemoryPool(*m_node.mempool, state, tx, nullptr, false));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK(m_node.mempool->exists(tx->GetHash()));
+}
+
+/**
+ * Ensure that packages are tested parents first without changing the mempool.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_test_package, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto spend = [&](const CTransaction& from, uint32_t n, CAmount fee) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(from.GetHash(), n);
+        tx.vout.assign(1, CTxOut(from.vout[n].nValue - fee, scriptPubKey));
+        const uint256 sighash = SignatureHash(from.vout[n].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        std::vector<unsigned char> sig;
+        BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << sig;
+        return MakeTransactionRef(tx);
+    };
+
+    const CTransactionRef parent = spend(*m_coinbase_txns[0], 0, 10000);
+    const CTransactionRef child = spend(*parent, 0, 20000);
+    const CTransactionRef grandchild = spend(*child, 0, 30000);
+    const CTransactionRef double_spend = spend(*parent, 0, 40000);
+
+    LOCK(cs_main);
+    const unsigned int initial_pool_size = WITH_LOCK(m_node.mempool->cs, return m_node.mempool->size());
+    std::vector<TxValidationState> states;
+    std::vector<CAmount> fees;
+    std::vector<bool> allowed = TestPackageAcceptance(*m_node.mempool, {grandchild, child, parent, double_spend}, states, fees);
+    BOOST_CHECK(allowed == std::vector<bool>({true, true, true, false}));
+    BOOST_CHECK_EQUAL(fees[0], 30000);
+    BOOST_CHECK_EQUAL(fees[1], 20000);
+    BOOST_CHECK_EQUAL(fees[2], 10000);
+    BOOST_CHECK(states[3].GetResult() == TxValidationResult::TX_MISSING_INPUTS);
+
+    // Without its parent the child cannot be accepted, and neither can the
+    // descendants of a transaction that exceeds its maximum fee.
+    allowed = TestPackageAcceptance(*m_node.mempool, {child}, states, fees);
+    BOOST_CHECK(!allowed[0]);
+    BOOST_CHECK(states[0].GetResult() == TxValidationResult::TX_MISSING_INPUTS);
+    const std::vector<CAmount> max_fees{15000, 5000};
+    allowed = TestPackageAcceptance(*m_node.mempool, {parent, child}, states, fees, &max_fees);
+    BOOST_CHECK(allowed == std::vector<bool>({true, false}));
+    const std::vector<CAmount> max_fees_low{5000, 0};
+    allowed = TestPackageAcceptance(*m_node.mempool, {parent, child}, states, fees, &max_fees_low);
+    BOOST_CHECK(allowed == std::vector<bool>({false, false}));
+    BOOST_CHECK_EQUAL(states[0].GetRejectReason(), "max-fee-exceeded");
+
+    BOOST_CHECK_EQUAL(WITH_LOCK(m_node.mempool->cs, return m_node.mempool->size()), initial_pool_size);
+}
+
+/**
+ * Ensure that a dumped mempool is restored, both on the chain tip it was dumped at and on another one.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_dump_load, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto spend = [&](const CTransaction& from, uint32_t n, CAmount fee) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(from.GetHash(), n);
+        tx.vout.assign(1, CTxOut(from.vout[n].nValue - fee, scriptPubKey));
+        const uint256 sighash = SignatureHash(from.vout[n].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        std::vector<unsigned char> sig;
+        BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << sig;
+        return MakeTransactionRef(tx);
+    };
+
+    const CTransactionRef parent = spend(*m_coinbase_txns[0], 0, 10000);
+    const CTransactionRef child = spend(*parent, 0, 10000);
+    {
+        LOCK(cs_main);
+        for (const CTransactionRef& tx : {parent, child}) {
+            TxValidationState state;
+            BOOST_CHECK(AcceptToMemoryPool(*m_node.mempool, state, tx, nullptr /* plTxnReplaced */, false /* bypass_limits */));
+        }
+    }
+    CTxMemPool& pool = *m_node.mempool;
+    const auto parent_time = WITH_LOCK(pool.cs, return pool.info(parent->GetHash()).m_time);
+
+    for (const bool same_tip : {true, false}) {
+        BOOST_CHECK(DumpMempool(pool));
+        WITH_LOCK(pool.cs, pool.clear());
+        if (!same_tip) CreateAndProcessBlock({}, scriptPubKey);
+        BOOST_CHECK(LoadMempool(pool));
+        LOCK(pool.cs);
+        BOOST_CHECK_EQUAL(pool.size(), 2U);
+        BOOST_CHECK(pool.exists(parent->GetHash()));
+        BOOST_CHECK(pool.exists(child->GetHash()));
+        BOOST_CHECK(pool.info(parent->GetHash()).m_time == parent_time);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
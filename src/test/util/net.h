@@ -15,6 +15,13 @@ struct ConnmanTestMsg : public CConnman {
         LOCK(cs_vNodes);
         vNodes.push_back(&node);
     }
+    /** Add a node whose socket the socket handler services like a connected peer's. */
+    void AddTestNodeWithSocket(CNode& node)
+    {
+        RegisterSocket(node.hSocket, /* listen */ false);
+        AddTestNode(node);
+    }
+    void SocketHandlerOnce() { SocketHandler(); }
     void ClearTestNodes()
     {
         LOCK(cs_vNodes);
@@ -5,13 +5,22 @@
 //
 #include <chainparams.h>
 #include <consensus/validation.h>
+#include <fs.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <random.h>
+#include <rpc/blockchain.h>
+#include <streams.h>
 #include <sync.h>
 #include <test/util/setup_common.h>
 #include <uint256.h>
+#include <univalue.h>
+#include <util/system.h>
 #include <validation.h>
 #include <validationinterface.h>
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -152,4 +161,191 @@ BOOST_AUTO_TEST_CASE(chainstatemanager_rebalance_caches)
     BOOST_CHECK_CLOSE(c2.m_coinsdb_cache_size_bytes, max_cache * 0.95, 1);
 }
 
+//! Test loading a UTXO snapshot into a new active chainstate.
+BOOST_FIXTURE_TEST_CASE(chainstatemanager_activate_snapshot, TestChain100Setup)
+{
+    ChainstateManager& chainman = *Assert(m_node.chainman);
+    CTxMemPool& mempool = *Assert(m_node.mempool);
+    CChainState& ibd_chainstate = chainman.ActiveChainstate();
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    for (int i = 0; i < 10; ++i) {
+        CreateAndProcessBlock({}, script_pub_key);
+    }
+    const CBlockIndex* base = WITH_LOCK(::cs_main, return chainman.ActiveTip());
+    BOOST_REQUIRE_EQUAL(base->nHeight, 110);
+
+    const fs::path snapshot_path = GetDataDir() / "test_snapshot.dat";
+    {
+        FILE* outfile{fsbridge::fopen(snapshot_path, "wb")};
+        CAutoFile auto_outfile{outfile, SER_DISK, CLIENT_VERSION};
+        UniValue result = CreateUTXOSnapshot(m_node, ibd_chainstate, auto_outfile, SNAPSHOT_FORMAT_VERSION);
+        BOOST_CHECK_EQUAL(result["base_height"].get_int(), 110);
+        BOOST_CHECK_EQUAL(result["base_hash"].get_str(), base->GetBlockHash().ToString());
+    }
+
+    CCoinsStats ibd_stats;
+    CCoinsViewDB* ibd_coinsdb = WITH_LOCK(::cs_main, return &ibd_chainstate.CoinsDB());
+    BOOST_REQUIRE(GetUTXOStats(ibd_coinsdb, ibd_stats, CoinStatsHashType::HASH_SERIALIZED, [] {}));
+    const AssumeutxoData au_data{ibd_stats.hashSerialized, base->nChainTx};
+
+    auto load_snapshot = [&](const AssumeutxoData* data, uint64_t extra_coins) {
+        FILE* infile{fsbridge::fopen(snapshot_path, "rb")};
+        CAutoFile auto_infile{infile, SER_DISK, CLIENT_VERSION};
+        SnapshotMetadata metadata;
+        auto_infile >> metadata;
+        metadata.m_coins_count += extra_coins;
+        if (!data) return chainman.ActivateSnapshot(auto_infile, metadata, mempool, /* in_memory */ true);
+        return chainman.ActivateSnapshot(auto_infile, metadata, *data, mempool, /* in_memory */ true);
+    };
+
+    // Regtest commits to no snapshots in its chainparams.
+    BOOST_CHECK(!load_snapshot(nullptr, 0));
+    // A snapshot whose contents don't match the commitment is refused.
+    const AssumeutxoData bad_hash{InsecureRand256(), base->nChainTx};
+    BOOST_CHECK(!load_snapshot(&bad_hash, 0));
+    // So is a truncated snapshot.
+    BOOST_CHECK(!load_snapshot(&au_data, 1));
+    BOOST_CHECK(!chainman.IsSnapshotActive());
+
+    BOOST_REQUIRE(load_snapshot(&au_data, 0));
+    BOOST_CHECK(chainman.IsSnapshotActive());
+    BOOST_CHECK(!chainman.IsSnapshotValidated());
+    BOOST_CHECK(chainman.IsBackgroundIBD(&ibd_chainstate));
+    CChainState& snapshot_chainstate = chainman.ActiveChainstate();
+    BOOST_CHECK(&snapshot_chainstate != &ibd_chainstate);
+    BOOST_CHECK_EQUAL(WITH_LOCK(::cs_main, return chainman.ActiveTip()), base);
+
+    CCoinsStats snapshot_stats;
+    CCoinsViewDB* snapshot_coinsdb = WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsDB());
+    BOOST_REQUIRE(GetUTXOStats(snapshot_coinsdb, snapshot_stats, CoinStatsHashType::HASH_SERIALIZED, [] {}));
+    BOOST_CHECK_EQUAL(snapshot_stats.hashSerialized, ibd_stats.hashSerialized);
+    BOOST_CHECK_EQUAL(snapshot_stats.coins_count, ibd_stats.coins_count);
+
+    // Only one snapshot can be active.
+    BOOST_CHECK(!load_snapshot(&au_data, 0));
+
+    // New blocks connect on top of the snapshot chainstate while the background
+    // chainstate, already at the snapshot base, completes validation.
+    CreateAndProcessBlock({}, script_pub_key);
+    BOOST_CHECK_EQUAL(WITH_LOCK(::cs_main, return chainman.ActiveHeight()), 111);
+    BOOST_CHECK_EQUAL(WITH_LOCK(::cs_main, return ibd_chainstate.m_chain.Height()), 110);
+    BOOST_CHECK(chainman.IsSnapshotValidated());
+    BOOST_CHECK_EQUAL(&chainman.ValidatedChainstate(), &snapshot_chainstate);
+}
+
+//! CoinStatsHasher must agree with GetUTXOStats and reject out-of-order coins.
+BOOST_FIXTURE_TEST_CASE(coinstats_hasher, TestChain100Setup)
+{
+    CChainState& chainstate = Assert(m_node.chainman)->ActiveChainstate();
+    CCoinsViewDB* coinsdb = WITH_LOCK(::cs_main, chainstate.ForceFlushStateToDisk(); return &chainstate.CoinsDB());
+
+    CCoinsStats expected;
+    BOOST_REQUIRE(GetUTXOStats(coinsdb, expected, CoinStatsHashType::HASH_SERIALIZED, [] {}));
+
+    CoinStatsHasher hasher(expected.hashBlock);
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    std::unique_ptr<CCoinsViewCursor> cursor(coinsdb->Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(key) && cursor->GetValue(coin));
+        BOOST_CHECK(hasher.Add(key, coin));
+        coins.emplace_back(key, coin);
+    }
+    CCoinsStats stats;
+    hasher.Finalize(stats);
+    BOOST_CHECK_EQUAL(stats.hashSerialized, expected.hashSerialized);
+    BOOST_CHECK_EQUAL(stats.coins_count, expected.coins_count);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+
+    // Coins of a later transaction may not be followed by an earlier one.
+    auto later = std::find_if(coins.begin(), coins.end(),
+        [&](const std::pair<COutPoint, Coin>& entry) { return entry.first.hash != coins[0].first.hash; });
+    BOOST_REQUIRE(later != coins.end());
+    CoinStatsHasher reordered(expected.hashBlock);
+    BOOST_CHECK(reordered.Add(later->first, later->second));
+    BOOST_CHECK(!reordered.Add(coins[0].first, coins[0].second));
+    CoinStatsHasher duplicated(expected.hashBlock);
+    BOOST_CHECK(duplicated.Add(coins[0].first, coins[0].second));
+    BOOST_CHECK(!duplicated.Add(coins[0].first, coins[0].second));
+}
+
+//! Version 2 snapshots must round-trip through the parallel writer and reader
+//! and reject corrupted chunks.
+BOOST_FIXTURE_TEST_CASE(snapshot_chunks, TestChain100Setup)
+{
+    CChainState& chainstate = Assert(m_node.chainman)->ActiveChainstate();
+    CCoinsViewDB* coinsdb = WITH_LOCK(::cs_main, chainstate.ForceFlushStateToDisk(); return &chainstate.CoinsDB());
+
+    SnapshotCoinBatch expected;
+    std::unique_ptr<CCoinsViewCursor> cursor(coinsdb->Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(key) && cursor->GetValue(coin));
+        expected.emplace_back(key, coin);
+    }
+    BOOST_REQUIRE(!expected.empty());
+
+    // Metadata of both versions round-trips.
+    for (uint16_t version : {1, 2}) {
+        CDataStream stream(SER_DISK, CLIENT_VERSION);
+        stream << SnapshotMetadata{InsecureRand256(), 100, 101, version};
+        SnapshotMetadata metadata;
+        stream >> metadata;
+        BOOST_CHECK_EQUAL(metadata.m_version, version);
+        BOOST_CHECK_EQUAL(metadata.m_coins_count, 100U);
+        BOOST_CHECK(stream.empty());
+    }
+
+    const fs::path path = GetDataDir() / "test_chunks.dat";
+    {
+        CAutoFile file{fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION};
+        uint64_t coins_written;
+        BOOST_REQUIRE(WriteSnapshotChunks(file, MakeSnapshotCursors(*coinsdb), [] {}, coins_written));
+        BOOST_CHECK_EQUAL(coins_written, expected.size());
+    }
+
+    auto read_chunks = [&](SnapshotCoinBatch& coins) {
+        CAutoFile file{fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION};
+        return ReadSnapshotChunks(file, [&](SnapshotCoinBatch&& chunk) {
+            coins.insert(coins.end(), chunk.begin(), chunk.end());
+            return true;
+        });
+    };
+    SnapshotCoinBatch loaded;
+    BOOST_REQUIRE(read_chunks(loaded));
+    BOOST_REQUIRE_EQUAL(loaded.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        BOOST_CHECK(loaded[i].first == expected[i].first);
+        BOOST_CHECK(loaded[i].second.out == expected[i].second.out);
+        BOOST_CHECK_EQUAL(loaded[i].second.nHeight, expected[i].second.nHeight);
+    }
+
+    // Flipping a payload byte breaks the chunk checksum.
+    {
+        FILE* file = fsbridge::fopen(path, "r+b");
+        BOOST_REQUIRE(file);
+        const long payload_offset = ::GetSerializeSize(SnapshotChunkHeader{}, CLIENT_VERSION) + 10;
+        BOOST_REQUIRE_EQUAL(fseek(file, payload_offset, SEEK_SET), 0);
+        const int byte = fgetc(file);
+        BOOST_REQUIRE_EQUAL(fseek(file, payload_offset, SEEK_SET), 0);
+        fputc(byte ^ 0xff, file);
+        fclose(file);
+    }
+    loaded.clear();
+    BOOST_CHECK(!read_chunks(loaded));
+
+    // A checksummed chunk that overstates its coin count is rejected without
+    // allocating for the claimed count.
+    SnapshotChunkHeader header;
+    std::vector<unsigned char> payload;
+    EncodeSnapshotChunk(SnapshotCoinBatch(expected.begin(), expected.begin() + 1), header, payload);
+    header.m_coins_count = std::numeric_limits<uint32_t>::max();
+    SnapshotCoinBatch decoded;
+    BOOST_CHECK(!DecodeSnapshotChunk(header, payload, decoded));
+    BOOST_CHECK(decoded.capacity() <= payload.size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
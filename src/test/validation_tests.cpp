@@ -4,7 +4,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <clientversion.h>
 #include <net.h>
+#include <primitives/block.h>
+#include <streams.h>
 #include <validation.h>
 
 #include <test/util/setup_common.h>
@@ -58,4 +61,91 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, CAmount{27000000000000000});
 }
 
+BOOST_AUTO_TEST_CASE(strip_raw_block_witness)
+{
+    CBlock block;
+    block.nHeight = 1;
+    for (int i = 0; i < 3; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), i);
+        tx.vin[0].scriptSig = CScript() << OP_1 << std::vector<unsigned char>(300, i);
+        tx.vin[1].prevout = COutPoint(InsecureRand256(), 70000);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i * COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        // Only the middle transaction carries witness data.
+        if (i == 1) {
+            tx.vin[1].scriptWitness.stack = {std::vector<unsigned char>(520, 0xaa), {}};
+        }
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    CDataStream with_witness(SER_DISK, CLIENT_VERSION);
+    with_witness << block;
+    CDataStream without_witness(SER_DISK, CLIENT_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    without_witness << block;
+    BOOST_REQUIRE(with_witness.size() > without_witness.size());
+
+    std::vector<uint8_t> raw(with_witness.begin(), with_witness.end());
+    BOOST_CHECK(StripRawBlockWitness(raw));
+    BOOST_CHECK(raw == std::vector<uint8_t>(without_witness.begin(), without_witness.end()));
+
+    // Blocks without witness data come out unchanged.
+    BOOST_CHECK(StripRawBlockWitness(raw));
+    BOOST_CHECK(raw == std::vector<uint8_t>(without_witness.begin(), without_witness.end()));
+
+    // Truncated or padded data is rejected.
+    std::vector<uint8_t> truncated(with_witness.begin(), with_witness.end() - 1);
+    BOOST_CHECK(!StripRawBlockWitness(truncated));
+    std::vector<uint8_t> padded(with_witness.begin(), with_witness.end());
+    padded.push_back(0);
+    BOOST_CHECK(!StripRawBlockWitness(padded));
+}
+
+BOOST_AUTO_TEST_CASE(test_assumeutxo)
+{
+    const auto params = CreateChainParams(*m_node.args, CBaseChainParams::REGTEST);
+
+    // These heights don't have assumeutxo configurations associated, per the contents
+    // of chainparams.cpp.
+    for (const int height : {0, 100, 109, 111, 115}) {
+        BOOST_CHECK(!ExpectedAssumeutxo(height, *params));
+    }
+
+    const AssumeutxoData* out110 = ExpectedAssumeutxo(110, *params);
+    BOOST_REQUIRE(out110);
+    BOOST_CHECK_EQUAL(out110->hash_serialized.ToString(), "c78a5d133f9238bcc5d28ae3564177a826a03494771567010bf12376674d994b");
+    BOOST_CHECK_EQUAL(out110->nChainTx, 111U);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_header_pow, TestChain100Setup)
+{
+    std::vector<const CBlockIndex*> indexes;
+    {
+        LOCK(cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        for (const CBlockIndex* pindex = ::ChainActive().Tip(); pindex; pindex = pindex->pprev) {
+            indexes.push_back(pindex);
+        }
+    }
+
+    // Written headers are rebuilt from the block tree DB, outside cs_main.
+    std::vector<CBlockHeader> headers;
+    BOOST_REQUIRE(ReadBlockHeaders(indexes, headers));
+    BOOST_REQUIRE_EQUAL(headers.size(), indexes.size());
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        BOOST_CHECK_EQUAL(headers[i].GetHash(), indexes[i]->GetBlockHash());
+    }
+
+    // Blocks near the tip keep their fields in memory once written, so they
+    // can be announced without reading the DB.
+    LOCK(cs_main);
+    for (const CBlockIndex* pindex : indexes) {
+        CBlockHeader header;
+        BOOST_REQUIRE(GetRecentBlockHeader(pindex, header));
+        BOOST_CHECK_EQUAL(header.GetHash(), pindex->GetBlockHash());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,171 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txinventory.h>
+
+#include <crypto/siphash.h>
+#include <memusage.h>
+#include <random.h>
+
+#include <cassert>
+#include <cstring>
+
+TxInventoryTable::SaltedHasher::SaltedHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t TxInventoryTable::SaltedHasher::operator()(const uint256& hash) const
+{
+    return SipHashUint256(k0, k1, hash);
+}
+
+TxInventoryTable::TxInventoryTable(uint32_t bucket_size, uint32_t buckets, uint32_t peer_quota)
+    : m_bucket_size(bucket_size), m_buckets(buckets), m_peer_quota(peer_quota),
+      m_bucket_state(new Bucket[buckets]), m_index(new IndexShard[INDEX_SHARDS])
+{
+    assert(bucket_size > 0 && bucket_size % 64 == 0 && buckets > 1 && peer_quota > 0);
+    for (uint32_t i = 0; i < buckets; ++i) {
+        LOCK(m_bucket_state[i].m_mutex);
+        m_bucket_state[i].m_hashes.resize(bucket_size);
+    }
+    for (size_t i = 0; i < INDEX_SHARDS; ++i) {
+        LOCK(m_index[i].m_mutex);
+        m_index[i].m_positions.reserve(size_t{bucket_size} * buckets / INDEX_SHARDS);
+    }
+}
+
+uint32_t TxInventoryTable::AddPeer()
+{
+    LOCK(m_peers_mutex);
+    if (m_free_peers.empty()) return m_num_peers++;
+    const uint32_t peer = m_free_peers.back();
+    m_free_peers.pop_back();
+    return peer;
+}
+
+void TxInventoryTable::RemovePeer(uint32_t peer)
+{
+    for (uint32_t i = 0; i < m_buckets; ++i) {
+        Bucket& bucket = m_bucket_state[i];
+        LOCK(bucket.m_mutex);
+        if (peer < bucket.m_peers.size()) bucket.m_peers[peer] = PeerBucket();
+    }
+    LOCK(m_peers_mutex);
+    assert(peer < m_num_peers);
+    m_free_peers.push_back(peer);
+}
+
+TxInventoryTable::IndexShard& TxInventoryTable::Shard(const uint256& hash) const
+{
+    return m_index[m_shard_hasher(hash) % INDEX_SHARDS];
+}
+
+int64_t TxInventoryTable::Find(const uint256& hash) const
+{
+    const IndexShard& shard = Shard(hash);
+    LOCK(shard.m_mutex);
+    auto it = shard.m_positions.find(hash);
+    return it == shard.m_positions.end() ? -1 : int64_t{it->second};
+}
+
+void TxInventoryTable::RetireBucket(Bucket& bucket)
+{
+    for (uint256& hash : bucket.m_hashes) {
+        if (hash.IsNull()) continue;
+        IndexShard& shard = Shard(hash);
+        WITH_LOCK(shard.m_mutex, shard.m_positions.erase(hash));
+        hash.SetNull();
+    }
+    for (PeerBucket& peer : bucket.m_peers) peer = PeerBucket();
+}
+
+void TxInventoryTable::MarkKnown(Bucket& bucket, uint32_t peer, uint32_t offset, const uint256& hash)
+{
+    // The bucket may have been retired since the position was looked up.
+    if (bucket.m_hashes[offset] != hash) return;
+    if (bucket.m_peers.size() <= peer) bucket.m_peers.resize(peer + 1);
+    std::unique_ptr<uint64_t[]>& bitmap = bucket.m_peers[peer].bitmap;
+    if (!bitmap) {
+        bitmap.reset(new uint64_t[m_bucket_size / 64]);
+        std::memset(bitmap.get(), 0, m_bucket_size / 8);
+    }
+    bitmap[offset / 64] |= uint64_t{1} << (offset % 64);
+}
+
+void TxInventoryTable::Insert(uint32_t peer, const uint256& hash)
+{
+    int64_t position = Find(hash);
+    if (position < 0) {
+        LOCK(m_ring_mutex);
+        // Another peer may have added it in the meantime.
+        position = Find(hash);
+        if (position < 0) {
+            const uint32_t new_position = m_next_position;
+            const uint32_t offset = new_position % m_bucket_size;
+            Bucket& bucket = m_bucket_state[new_position / m_bucket_size];
+            LOCK(bucket.m_mutex);
+            if (offset == 0) {
+                RetireBucket(bucket);
+            } else if (peer < bucket.m_peers.size() && bucket.m_peers[peer].added >= m_peer_quota) {
+                return;
+            }
+            m_next_position = (new_position + 1) % (m_bucket_size * m_buckets);
+            bucket.m_hashes[offset] = hash;
+            IndexShard& shard = Shard(hash);
+            WITH_LOCK(shard.m_mutex, shard.m_positions.emplace(hash, new_position));
+            MarkKnown(bucket, peer, offset, hash);
+            ++bucket.m_peers[peer].added;
+            return;
+        }
+    }
+    Bucket& bucket = m_bucket_state[position / m_bucket_size];
+    LOCK(bucket.m_mutex);
+    MarkKnown(bucket, peer, position % m_bucket_size, hash);
+}
+
+bool TxInventoryTable::Contains(uint32_t peer, const uint256& hash) const
+{
+    const int64_t position = Find(hash);
+    if (position < 0) return false;
+    const Bucket& bucket = m_bucket_state[position / m_bucket_size];
+    const uint32_t offset = position % m_bucket_size;
+    LOCK(bucket.m_mutex);
+    if (bucket.m_hashes[offset] != hash || peer >= bucket.m_peers.size()) return false;
+    const std::unique_ptr<uint64_t[]>& bitmap = bucket.m_peers[peer].bitmap;
+    return bitmap && (bitmap[offset / 64] >> (offset % 64)) & 1;
+}
+
+size_t TxInventoryTable::SharedMemoryUsage() const
+{
+    size_t usage = memusage::MallocUsage(sizeof(Bucket) * m_buckets) + memusage::MallocUsage(sizeof(IndexShard) * INDEX_SHARDS);
+    for (uint32_t i = 0; i < m_buckets; ++i) {
+        LOCK(m_bucket_state[i].m_mutex);
+        usage += memusage::DynamicUsage(m_bucket_state[i].m_hashes);
+    }
+    for (size_t i = 0; i < INDEX_SHARDS; ++i) {
+        LOCK(m_index[i].m_mutex);
+        usage += memusage::DynamicUsage(m_index[i].m_positions);
+    }
+    LOCK(m_peers_mutex);
+    return usage + memusage::DynamicUsage(m_free_peers);
+}
+
+size_t TxInventoryTable::PeerMemoryUsage(uint32_t peer) const
+{
+    // Every bucket has an entry for each peer slot.
+    size_t usage = m_buckets * sizeof(PeerBucket);
+    for (uint32_t i = 0; i < m_buckets; ++i) {
+        LOCK(m_bucket_state[i].m_mutex);
+        if (peer < m_bucket_state[i].m_peers.size() && m_bucket_state[i].m_peers[peer].bitmap) {
+            usage += memusage::MallocUsage(m_bucket_size / 8);
+        }
+    }
+    return usage;
+}
+
+TxInventoryTable& TxInventoryTable::Instance()
+{
+    // Deliberately leaked, like BufferPool::Instance(): peers may be
+    // destroyed while the program exits.
+    static TxInventoryTable* const instance = new TxInventoryTable();
+    return *instance;
+}
@@ -0,0 +1,155 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_TXINVENTORY_H
+#define LABYRINTH_TXINVENTORY_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * Which recently seen transaction hashes each peer knows about, for all peers
+ * at once.
+ *
+ * Every peer used to have a rolling bloom filter of its own for this, sized
+ * for 50000 hashes at a one in a million false positive rate: about half a
+ * megabyte, allocated up front. But the hashes peers know are largely the
+ * same ones, so here they are stored once, in a table that assigns each hash
+ * a position in a ring, and a peer only has a bitmap over the positions.
+ *
+ * The ring is divided into buckets that are filled in the order hashes are
+ * first seen. When the ring wraps around, the oldest bucket is retired: its
+ * hashes are forgotten, for all peers at once. A peer's bitmap is allocated
+ * per bucket, on the first hash it knows in that bucket. A hash is forgotten
+ * somewhere between (buckets - 1) * bucket_size and buckets * bucket_size new
+ * hashes after it was first seen; there are no false positives.
+ *
+ * So that a single peer announcing made-up hashes can't rotate out what all
+ * other peers know, a peer may only add peer_quota new hashes to a bucket;
+ * beyond that, the new hashes it knows aren't recorded, and may be announced
+ * to it again.
+ *
+ * Each bucket has a lock of its own for its hashes and the peers' bitmaps
+ * over it, and the index from hashes to positions is split into shards with
+ * a lock each, so peers handled by different threads rarely wait on each
+ * other. Locks are taken in the order: ring, bucket, index shard.
+ */
+class TxInventoryTable
+{
+public:
+    static constexpr uint32_t DEFAULT_BUCKET_SIZE = 8192;
+    static constexpr uint32_t DEFAULT_BUCKETS = 16;
+    static constexpr uint32_t DEFAULT_PEER_QUOTA = DEFAULT_BUCKET_SIZE / 4;
+    static constexpr size_t INDEX_SHARDS = 16;
+
+    /** bucket_size must be a multiple of 64. */
+    explicit TxInventoryTable(uint32_t bucket_size = DEFAULT_BUCKET_SIZE, uint32_t buckets = DEFAULT_BUCKETS, uint32_t peer_quota = DEFAULT_PEER_QUOTA);
+
+    TxInventoryTable(const TxInventoryTable&) = delete;
+    TxInventoryTable& operator=(const TxInventoryTable&) = delete;
+
+    /** Start tracking a peer; returns its slot in the table. */
+    uint32_t AddPeer();
+    /** Stop tracking a peer and free its slot. */
+    void RemovePeer(uint32_t peer);
+
+    /** Record that a peer knows about a hash. */
+    void Insert(uint32_t peer, const uint256& hash);
+    /** Whether a peer knows about a hash that is still in the table. */
+    bool Contains(uint32_t peer, const uint256& hash) const;
+
+    /** Memory used for the hashes, shared by all peers. */
+    size_t SharedMemoryUsage() const;
+    /** Memory used for one peer's bitmaps. */
+    size_t PeerMemoryUsage(uint32_t peer) const;
+
+    /** The table shared by all peers of this process. */
+    static TxInventoryTable& Instance();
+
+private:
+    class SaltedHasher
+    {
+        const uint64_t k0, k1;
+
+    public:
+        SaltedHasher();
+        size_t operator()(const uint256& hash) const;
+    };
+
+    struct PeerBucket {
+        //! Bitmap of bucket_size bits, or nullptr if the peer knows no hash in the bucket
+        std::unique_ptr<uint64_t[]> bitmap;
+        //! Number of hashes the peer added to the bucket
+        uint32_t added{0};
+    };
+
+    struct Bucket {
+        mutable Mutex m_mutex;
+        //! The hash at each position in the bucket, null if the position is unused
+        std::vector<uint256> m_hashes GUARDED_BY(m_mutex);
+        //! By peer slot
+        std::vector<PeerBucket> m_peers GUARDED_BY(m_mutex);
+    };
+
+    struct IndexShard {
+        mutable Mutex m_mutex;
+        std::unordered_map<uint256, uint32_t, SaltedHasher> m_positions GUARDED_BY(m_mutex);
+    };
+
+    const uint32_t m_bucket_size;
+    const uint32_t m_buckets;
+    const uint32_t m_peer_quota;
+    const SaltedHasher m_shard_hasher;
+
+    //! Serializes adding new hashes to the ring
+    Mutex m_ring_mutex;
+    //! The position the next new hash gets
+    uint32_t m_next_position GUARDED_BY(m_ring_mutex){0};
+
+    std::unique_ptr<Bucket[]> m_bucket_state;
+    std::unique_ptr<IndexShard[]> m_index;
+
+    mutable Mutex m_peers_mutex;
+    uint32_t m_num_peers GUARDED_BY(m_peers_mutex){0};
+    std::vector<uint32_t> m_free_peers GUARDED_BY(m_peers_mutex);
+
+    IndexShard& Shard(const uint256& hash) const;
+    /** The position of a hash, or -1 if it isn't in the table. */
+    int64_t Find(const uint256& hash) const;
+    /** Set a peer's bit for the hash at position, if it is still there. */
+    void MarkKnown(Bucket& bucket, uint32_t peer, uint32_t offset, const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(bucket.m_mutex);
+    void RetireBucket(Bucket& bucket) EXCLUSIVE_LOCKS_REQUIRED(m_ring_mutex, bucket.m_mutex);
+};
+
+/**
+ * A peer's view of the TxInventoryTable: the hashes the peer knows about,
+ * with the interface of the rolling bloom filter it replaces.
+ */
+class KnownTxInventory
+{
+public:
+    explicit KnownTxInventory(TxInventoryTable& table = TxInventoryTable::Instance())
+        : m_table(table), m_peer(table.AddPeer()) {}
+    ~KnownTxInventory() { m_table.RemovePeer(m_peer); }
+
+    KnownTxInventory(const KnownTxInventory&) = delete;
+    KnownTxInventory& operator=(const KnownTxInventory&) = delete;
+
+    void insert(const uint256& hash) { m_table.Insert(m_peer, hash); }
+    bool contains(const uint256& hash) const { return m_table.Contains(m_peer, hash); }
+
+    size_t DynamicMemoryUsage() const { return m_table.PeerMemoryUsage(m_peer); }
+
+private:
+    TxInventoryTable& m_table;
+    const uint32_t m_peer;
+};
+
+#endif // LABYRINTH_TXINVENTORY_H
@@ -17,9 +17,12 @@
 #include <reverse_iterator.h>
 #include <util/system.h>
 #include <util/moneystr.h>
+#include <util/rbf.h>
 #include <util/time.h>
 #include <validationinterface.h>
 
+#include <algorithm>
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
@@ -143,6 +146,7 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
                 if (!visited(childIter) && !setAlreadyIncluded.count(childHash)) {
                     UpdateChild(it, childIter, true);
                     UpdateParent(childIter, it, true);
+                    MergeClusters(it, childIter);
                 }
             }
         } // release epoch guard for UpdateForDescendants
@@ -150,6 +154,32 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
     }
 }
 
+bool CTxMemPool::CheckClusterLimits(const CTxMemPoolEntry& entry, uint64_t limitClusterCount, uint64_t limitClusterSize, std::string& errString) const
+{
+    if (limitClusterCount == 0 && limitClusterSize == 0) return true;
+
+    // The transaction joins the clusters of all its parents.
+    std::set<const TxMemPoolCluster*> parent_clusters;
+    uint64_t cluster_count = 1;
+    uint64_t cluster_size = entry.GetTxSize();
+    for (const CTxIn& txin : entry.GetTx().vin) {
+        Optional<txiter> piter = GetIter(txin.prevout.hash);
+        if (piter && parent_clusters.insert(&(*piter)->GetCluster()).second) {
+            cluster_count += (*piter)->GetCluster().nCount;
+            cluster_size += (*piter)->GetCluster().nSize;
+        }
+    }
+    if (limitClusterCount != 0 && cluster_count > limitClusterCount) {
+        errString = strprintf("too many transactions in cluster [limit: %u]", limitClusterCount);
+        return false;
+    }
+    if (limitClusterSize != 0 && cluster_size > limitClusterSize) {
+        errString = strprintf("exceeds cluster size limit [limit: %u]", limitClusterSize);
+        return false;
+    }
+    return true;
+}
+
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
     CTxMemPoolEntry::Parents staged_ancestors;
@@ -252,8 +282,12 @@ void CTxMemPool::UpdateChildrenForRemoval(txiter it)
     }
 }
 
-void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
+void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants,
+                                             const std::map<const TxMemPoolCluster*, uint64_t>& removedPerCluster)
 {
+    const auto whole_cluster_removed = [&](txiter it) {
+        return removedPerCluster.at(&it->GetCluster()) == it->GetCluster().nCount;
+    };
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
     const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -265,6 +299,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // and CTxMemPoolEntry::Children (which we need to preserve until we're
         // finished with all operations that need to traverse the mempool).
         for (txiter removeIt : entriesToRemove) {
+            if (whole_cluster_removed(removeIt)) continue;
             setEntries setDescendants;
             CalculateDescendants(removeIt, setDescendants);
             setDescendants.erase(removeIt); // don't update state for self
@@ -277,6 +312,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         }
     }
     for (txiter removeIt : entriesToRemove) {
+        if (whole_cluster_removed(removeIt)) continue;
         setEntries setAncestors;
         const CTxMemPoolEntry &entry = *removeIt;
         std::string dummy;
@@ -308,6 +344,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
     // transaction being removed and any mempool children (ie, update CTxMemPoolEntry::m_parents
     // for each direct child of a transaction being removed).
     for (txiter removeIt : entriesToRemove) {
+        if (whole_cluster_removed(removeIt)) continue;
         UpdateChildrenForRemoval(removeIt);
     }
 }
@@ -393,9 +430,16 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     // In that case, our disconnect block logic will call UpdateTransactionsFromBlock
     // to clean up the mess we're leaving here.
 
+    // The new transaction starts a cluster of its own, which then joins
+    // those of its parents.
+    newit->m_cluster = m_clusters.emplace(m_clusters.end());
+    newit->m_cluster->nCount = 1;
+    newit->m_cluster->nSize = newit->GetTxSize();
+
     // Update ancestors with information about this tx
     for (const auto& pit : GetIterSet(setParentTransactions)) {
             UpdateParent(newit, pit, true);
+            MergeClusters(newit, pit);
     }
     UpdateAncestorsOf(true, newit, setAncestors);
     UpdateEntryForAncestors(newit, setAncestors);
@@ -406,6 +450,10 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
+
+    for (MemPoolObserver* observer : m_observers) {
+        observer->EntryAdded(*newit);
+    }
 }
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
@@ -421,6 +469,9 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
         // notification.
         GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx(), reason, mempool_sequence);
     }
+    for (MemPoolObserver* observer : m_observers) {
+        observer->EntryRemoved(*it, reason);
+    }
 
     const uint256 hash = it->GetTx().GetHash();
     for (const CTxIn& txin : it->GetTx().vin)
@@ -576,14 +627,16 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     // Before the txs in the new block have been removed from the mempool, update policy estimates
     if (minerPolicyEstimator) {minerPolicyEstimator->processBlock(nBlockHeight, entries);}
+    // Remove them all at once, so that the clusters confirmed in full are
+    // dropped without updating the state of their remaining transactions one
+    // by one.
+    setEntries stage;
+    for (const CTxMemPoolEntry* entry : entries) {
+        stage.insert(mapTx.iterator_to(*entry));
+    }
+    RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
     for (const auto& tx : vtx)
     {
-        txiter it = mapTx.find(tx->GetHash());
-        if (it != mapTx.end()) {
-            setEntries stage;
-            stage.insert(it);
-            RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
-        }
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
@@ -595,6 +648,7 @@ void CTxMemPool::_clear()
 {
     mapTx.clear();
     mapNextTx.clear();
+    m_clusters.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -636,6 +690,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     const int64_t spendheight = GetSpendHeight(mempoolDuplicate);
 
     std::list<const CTxMemPoolEntry*> waitingOnDependants;
+    std::map<const TxMemPoolCluster*, TxMemPoolCluster> clusterChecks;
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
@@ -667,6 +722,13 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         };
         assert(setParentCheck.size() == it->GetMemPoolParentsConst().size());
         assert(std::equal(setParentCheck.begin(), setParentCheck.end(), it->GetMemPoolParentsConst().begin(), comp));
+        // A transaction is in the cluster of its parents.
+        for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+            assert(parent.m_cluster == it->m_cluster);
+        }
+        TxMemPoolCluster& clusterCheck = clusterChecks[&it->GetCluster()];
+        clusterCheck.nCount++;
+        clusterCheck.nSize += it->GetTxSize();
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -732,6 +794,12 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(&tx == it->second);
     }
 
+    assert(clusterChecks.size() == m_clusters.size());
+    for (const auto& cluster : clusterChecks) {
+        assert(cluster.first->nCount == cluster.second.nCount);
+        assert(cluster.first->nSize == cluster.second.nSize);
+    }
+
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
 }
@@ -930,7 +998,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + memusage::MallocUsage(sizeof(TxMemPoolCluster) + 2 * sizeof(void*)) * m_clusters.size() + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked) {
@@ -944,10 +1012,38 @@ void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked)
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
     AssertLockHeld(cs);
-    UpdateForRemoveFromMempool(stage, updateDescendants);
+    std::map<const TxMemPoolCluster*, uint64_t> removed_per_cluster;
+    std::vector<std::list<TxMemPoolCluster>::iterator> clusters;
+    for (txiter it : stage) {
+        if (removed_per_cluster[&it->GetCluster()]++ == 0) clusters.push_back(it->m_cluster);
+    }
+    // The transactions left in a cluster stay connected if the removed ones
+    // had at most one remaining neighbour there. Otherwise the cluster may
+    // split up, and only its remaining transactions are regrouped.
+    std::map<const TxMemPoolCluster*, setEntries> remaining_neighbours;
+    for (txiter it : stage) {
+        for (const auto* relatives : {&it->GetMemPoolParentsConst(), &it->GetMemPoolChildrenConst()}) {
+            for (const CTxMemPoolEntry& relative : *relatives) {
+                const txiter relative_it = mapTx.iterator_to(relative);
+                if (!stage.count(relative_it)) remaining_neighbours[&it->GetCluster()].insert(relative_it);
+            }
+        }
+    }
+    UpdateForRemoveFromMempool(stage, updateDescendants, removed_per_cluster);
     for (txiter it : stage) {
+        it->m_cluster->nCount -= 1;
+        it->m_cluster->nSize -= it->GetTxSize();
         removeUnchecked(it, reason);
     }
+    for (const auto& cluster : clusters) {
+        const auto neighbours = remaining_neighbours.find(&*cluster);
+        if (cluster->nCount == 0) {
+            m_clusters.erase(cluster);
+        } else if (neighbours != remaining_neighbours.end() && neighbours->second.size() > 1) {
+            RebuildClusters(std::vector<txiter>(neighbours->second.begin(), neighbours->second.end()));
+            m_clusters.erase(cluster);
+        }
+    }
 }
 
 int CTxMemPool::Expire(std::chrono::seconds time)
@@ -987,6 +1083,61 @@ void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
     }
 }
 
+void CTxMemPool::MergeClusters(txiter a, txiter b)
+{
+    AssertLockHeld(cs);
+    if (a->m_cluster == b->m_cluster) return;
+    if (a->GetCluster().nCount > b->GetCluster().nCount) std::swap(a, b);
+    // Move the transactions of a's cluster, which are all connected to a, to b's.
+    const auto from = a->m_cluster;
+    const auto to = b->m_cluster;
+    to->nCount += from->nCount;
+    to->nSize += from->nSize;
+    std::vector<txiter> stack{a};
+    a->m_cluster = to;
+    while (!stack.empty()) {
+        const txiter it = stack.back();
+        stack.pop_back();
+        for (const auto* relatives : {&it->GetMemPoolParentsConst(), &it->GetMemPoolChildrenConst()}) {
+            for (const CTxMemPoolEntry& relative : *relatives) {
+                if (relative.m_cluster == from) {
+                    relative.m_cluster = to;
+                    stack.push_back(mapTx.iterator_to(relative));
+                }
+            }
+        }
+    }
+    m_clusters.erase(from);
+}
+
+void CTxMemPool::RebuildClusters(const std::vector<txiter>& roots)
+{
+    AssertLockHeld(cs);
+    std::set<const TxMemPoolCluster*> rebuilt;
+    std::vector<txiter> stack;
+    for (const txiter root : roots) {
+        if (rebuilt.count(&root->GetCluster())) continue;
+        const auto cluster = m_clusters.emplace(m_clusters.end());
+        rebuilt.insert(&*cluster);
+        const auto add = [&](txiter it) {
+            it->m_cluster = cluster;
+            cluster->nCount += 1;
+            cluster->nSize += it->GetTxSize();
+            stack.push_back(it);
+        };
+        add(root);
+        while (!stack.empty()) {
+            const txiter it = stack.back();
+            stack.pop_back();
+            for (const auto* relatives : {&it->GetMemPoolParentsConst(), &it->GetMemPoolChildrenConst()}) {
+                for (const CTxMemPoolEntry& relative : *relatives) {
+                    if (relative.m_cluster != cluster) add(mapTx.iterator_to(relative));
+                }
+            }
+        }
+    }
+}
+
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
     AssertLockHeld(cs);
@@ -1036,31 +1187,55 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
-
-        // We set the new mempool min fee to the feerate of the removed set, plus the
-        // "minimum reasonable fee rate" (ie some value under which we consider txn
-        // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
-        // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
-        removed += incrementalRelayFee;
-        trackPackageRemoved(removed);
-        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
-
+        // Stage packages in descendant score order until removing them is
+        // expected to free enough memory, then remove the whole batch at once.
+        // The estimate counts every structure an entry may release, so it errs
+        // on the side of evicting too little and another batch follows if needed.
+        const size_t excess = DynamicMemoryUsage() - sizelimit;
+        size_t freed = 0;
         setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+        CFeeRate batchFeeRate(0);
+        for (auto it = mapTx.get<descendant_score>().begin(); it != mapTx.get<descendant_score>().end() && freed < excess; ++it) {
+            txiter root = mapTx.project<0>(it);
+            if (stage.count(root)) continue;
+
+            // The descendant score of an ancestor of staged transactions still
+            // counts them, and is only right once they are gone: end the batch.
+            setEntries package;
+            CalculateDescendants(root, package);
+            if (std::any_of(package.begin(), package.end(), [&](txiter iter) { return stage.count(iter) > 0; })) break;
+
+            // We set the new mempool min fee to the feerate of the removed set, plus the
+            // "minimum reasonable fee rate" (ie some value under which we consider txn
+            // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
+            // equal to txn which were removed with no block in between.
+            CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+            removed += incrementalRelayFee;
+            batchFeeRate = std::max(batchFeeRate, removed);
+
+            for (txiter iter : package) {
+                if (stage.insert(iter).second) {
+                    freed += memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) + iter->DynamicMemoryUsage() +
+                             2 * (memusage::DynamicUsage(iter->GetMemPoolParentsConst()) + memusage::DynamicUsage(iter->GetMemPoolChildrenConst())) +
+                             memusage::IncrementalDynamicUsage(mapNextTx) * iter->GetTx().vin.size() +
+                             memusage::MallocUsage(sizeof(TxMemPoolCluster) + 2 * sizeof(void*)) + sizeof(std::pair<uint256, txiter>);
+                }
+            }
+        }
+        trackPackageRemoved(batchFeeRate);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, batchFeeRate);
         nTxnRemoved += stage.size();
 
-        std::vector<CTransaction> txn;
+        std::vector<CTransactionRef> txn;
         if (pvNoSpendsRemaining) {
             txn.reserve(stage.size());
             for (txiter iter : stage)
-                txn.push_back(iter->GetTx());
+                txn.push_back(iter->GetSharedTx());
         }
         RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
         if (pvNoSpendsRemaining) {
-            for (const CTransaction& tx : txn) {
-                for (const CTxIn& txin : tx.vin) {
+            for (const CTransactionRef& tx : txn) {
+                for (const CTxIn& txin : tx->vin) {
                     if (exists(txin.prevout.hash)) continue;
                     pvNoSpendsRemaining->push_back(txin.prevout);
                 }
@@ -1117,6 +1292,46 @@ void CTxMemPool::SetIsLoaded(bool loaded)
     m_is_loaded = loaded;
 }
 
+MemPoolEntryInfo CTxMemPool::GetEntryInfo(const CTxMemPoolEntry& e) const
+{
+    AssertLockHeld(cs);
+    MemPoolEntryInfo entry;
+    entry.tx = e.GetSharedTx();
+    entry.fee = e.GetFee();
+    entry.modified_fee = e.GetModifiedFee();
+    entry.vsize = e.GetTxSize();
+    entry.weight = e.GetTxWeight();
+    entry.time = e.GetTime();
+    entry.height = e.GetHeight();
+    entry.count_with_descendants = e.GetCountWithDescendants();
+    entry.size_with_descendants = e.GetSizeWithDescendants();
+    entry.mod_fees_with_descendants = e.GetModFeesWithDescendants();
+    entry.count_with_ancestors = e.GetCountWithAncestors();
+    entry.size_with_ancestors = e.GetSizeWithAncestors();
+    entry.mod_fees_with_ancestors = e.GetModFeesWithAncestors();
+    for (const CTxMemPoolEntry& parent : e.GetMemPoolParentsConst()) {
+        entry.parents.push_back(parent.GetTx().GetHash());
+    }
+    for (const CTxMemPoolEntry& child : e.GetMemPoolChildrenConst()) {
+        entry.children.push_back(child.GetTx().GetHash());
+    }
+    entry.bip125_replaceable = SignalsOptInRBF(e.GetTx());
+    entry.unbroadcast = m_unbroadcast_txids.count(e.GetTx().GetHash()) != 0;
+    return entry;
+}
+
+void CTxMemPool::RegisterObserver(MemPoolObserver& observer)
+{
+    LOCK(cs);
+    m_observers.push_back(&observer);
+}
+
+void CTxMemPool::UnregisterObserver(MemPoolObserver& observer)
+{
+    LOCK(cs);
+    m_observers.erase(std::remove(m_observers.begin(), m_observers.end(), &observer), m_observers.end());
+}
+
 
 CTxMemPool::EpochGuard CTxMemPool::GetFreshEpoch() const
 {
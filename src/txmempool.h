@@ -8,6 +8,7 @@
 #define LABYRINTH_TXMEMPOOL_H
 
 #include <atomic>
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -50,6 +51,15 @@ struct LockPoints
     LockPoints() : height(0), time(0), maxInputBlock(nullptr) { }
 };
 
+/** Aggregate state of a cluster: a connected component of the graph of
+ *  in-mempool transactions linked by spending each other's outputs. Every
+ *  ancestor and descendant of a transaction is in its cluster. */
+struct TxMemPoolCluster
+{
+    uint64_t nCount{0};     //!< number of transactions
+    uint64_t nSize{0};      //!< ... and their total virtual size
+};
+
 struct CompareIteratorByHash {
     // SFINAE for T where T is either a pointer type (e.g., a txiter) or a reference_wrapper<T>
     // (e.g. a wrapped CTxMemPoolEntry&)
@@ -155,7 +165,11 @@ public:
     Parents& GetMemPoolParents() const { return m_parents; }
     Children& GetMemPoolChildren() const { return m_children; }
 
+    //! Only valid for entries in the mempool
+    const TxMemPoolCluster& GetCluster() const { return *m_cluster; }
+
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable std::list<TxMemPoolCluster>::iterator m_cluster; //!< Cluster in the mempool's m_clusters
     mutable uint64_t m_epoch; //!< epoch when last touched, useful for graph algorithms
 };
 
@@ -413,6 +427,47 @@ public:
     }
 };
 
+/**
+ * Copy of the per-entry data reported by RPC, so that it can be rendered
+ * without holding CTxMemPool::cs; see CTxMemPool::GetEntryInfo().
+ */
+struct MemPoolEntryInfo {
+    CTransactionRef tx;
+    CAmount fee;
+    CAmount modified_fee;
+    size_t vsize;
+    size_t weight;
+    std::chrono::seconds time;
+    unsigned int height;
+    uint64_t count_with_descendants;
+    uint64_t size_with_descendants;
+    CAmount mod_fees_with_descendants;
+    uint64_t count_with_ancestors;
+    uint64_t size_with_ancestors;
+    CAmount mod_fees_with_ancestors;
+    //! Txids of in-mempool parents and children, in ascending order
+    std::vector<uint256> parents;
+    std::vector<uint256> children;
+    bool bip125_replaceable;
+    bool unbroadcast;
+};
+
+/**
+ * Interface for components that keep state derived from the mempool contents.
+ * Callbacks run synchronously with CTxMemPool::cs held, so they must be cheap.
+ * Other changes (prioritisetransaction, clear, reorgs) are not reported and
+ * can be detected through CTxMemPool::GetTransactionsUpdated().
+ */
+class MemPoolObserver
+{
+public:
+    virtual ~MemPoolObserver() {}
+    /** Called after a transaction and its ancestor state were added. */
+    virtual void EntryAdded(const CTxMemPoolEntry& entry) = 0;
+    /** Called before a transaction is removed. */
+    virtual void EntryRemoved(const CTxMemPoolEntry& entry, MemPoolRemovalReason reason) = 0;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -511,6 +566,8 @@ private:
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    std::vector<MemPoolObserver*> m_observers GUARDED_BY(cs);
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -590,6 +647,18 @@ private:
     void UpdateParent(txiter entry, txiter parent, bool add) EXCLUSIVE_LOCKS_REQUIRED(cs);
     void UpdateChild(txiter entry, txiter child, bool add) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** Clusters of the transactions in mapTx. They are merged when a link
+     *  between two transactions is added, and regrouped when a removal may
+     *  have split one up. Nodes that set -limitclustercount or
+     *  -limitclustersize keep them within those limits at admission
+     *  (CheckClusterLimits), which bounds the cost of both. */
+    std::list<TxMemPoolCluster> m_clusters GUARDED_BY(cs);
+
+    /** Merge the clusters of two linked transactions, moving the smaller one. */
+    void MergeClusters(txiter a, txiter b) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Put each transaction connected to one of roots into a new cluster of its connected component. */
+    void RebuildClusters(const std::vector<txiter>& roots) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     /**
@@ -676,6 +745,13 @@ public:
      */
     void UpdateTransactionsFromBlock(const std::vector<uint256>& vHashesToUpdate) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
 
+    /** Check that entry, which is not in the mempool, would not join its
+     *  parents' clusters into one of more than limitClusterCount transactions
+     *  or limitClusterSize virtual bytes. A limit of 0 is no limit.
+     *  errString = populated with error reason if a limit is hit
+     */
+    bool CheckClusterLimits(const CTxMemPoolEntry& entry, uint64_t limitClusterCount, uint64_t limitClusterSize, std::string& errString) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     /** Try to calculate all in-mempool ancestors of entry.
      *  (these are all calculated including the tx itself)
      *  limitAncestorCount = max number of ancestors
@@ -702,6 +778,8 @@ public:
     CFeeRate GetMinFee(size_t sizelimit) const;
 
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
+      *  The lowest descendant score packages are evicted in batches, each removed
+      *  in a single pass and bumping the rolling minimum fee once.
       *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
       */
@@ -722,6 +800,16 @@ public:
     /** Sets the current loaded state */
     void SetIsLoaded(bool loaded);
 
+    /**
+     * Copy the data of a single entry. bip125_replaceable only reflects the
+     * entry's own signal; inherited replaceability needs its ancestors.
+     */
+    MemPoolEntryInfo GetEntryInfo(const CTxMemPoolEntry& e) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Report each transaction added to or removed from the pool to observer. */
+    void RegisterObserver(MemPoolObserver& observer);
+    void UnregisterObserver(MemPoolObserver& observer);
+
     unsigned long size() const
     {
         LOCK(cs);
@@ -814,8 +902,10 @@ private:
     void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** For each transaction being removed, update ancestors and any direct children.
       * If updateDescendants is true, then also update in-mempool descendants'
-      * ancestor state. */
-    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants) EXCLUSIVE_LOCKS_REQUIRED(cs);
+      * ancestor state. Transactions whose whole cluster is removed, as counted
+      * in removedPerCluster, have no relatives left to update and are skipped. */
+    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants,
+                                    const std::map<const TxMemPoolCluster*, uint64_t>& removedPerCluster) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -0,0 +1,385 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <crypto/common.h>
+#include <crypto/siphash.h>
+#include <hash.h>
+#include <random.h>
+#include <sync.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+namespace {
+
+/** Finalizer of MurmurHash3: a cheap, well-mixing permutation of 32-bit values. */
+uint32_t Mix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+uint32_t CheckSum(uint32_t short_id)
+{
+    return Mix(short_id ^ 0x5bd1e995);
+}
+
+size_t CellIndex(uint32_t short_id, size_t hash_num, size_t cells)
+{
+    const size_t part_size = cells / ReconciliationSketch::NUM_HASHES;
+    return hash_num * part_size + Mix(short_id + 0x9e3779b9 * (hash_num + 1)) % part_size;
+}
+
+} // namespace
+
+size_t ReconciliationSketch::CellsForCapacity(size_t capacity)
+{
+    // A table with about 1.5 cells per id recovers large differences; small
+    // ones need a few extra cells to be recovered reliably.
+    const size_t cells = capacity + capacity / 2 + 6;
+    return (cells + NUM_HASHES - 1) / NUM_HASHES * NUM_HASHES;
+}
+
+void ReconciliationSketch::Toggle(uint32_t short_id, uint8_t count_delta)
+{
+    for (size_t i = 0; i < NUM_HASHES; ++i) {
+        Cell& cell = m_cells[CellIndex(short_id, i, m_cells.size())];
+        cell.count += count_delta;
+        cell.id_sum ^= short_id;
+        cell.check_sum ^= CheckSum(short_id);
+    }
+}
+
+void ReconciliationSketch::Add(uint32_t short_id)
+{
+    assert(!m_cells.empty() && IsValid());
+    Toggle(short_id, 1);
+}
+
+void ReconciliationSketch::Subtract(const ReconciliationSketch& other)
+{
+    assert(other.Cells() == Cells());
+    for (size_t i = 0; i < m_cells.size(); ++i) {
+        m_cells[i].count -= other.m_cells[i].count;
+        m_cells[i].id_sum ^= other.m_cells[i].id_sum;
+        m_cells[i].check_sum ^= other.m_cells[i].check_sum;
+    }
+}
+
+bool ReconciliationSketch::Decode(std::vector<uint32_t>& only_here, std::vector<uint32_t>& only_there) const
+{
+    if (m_cells.empty() || !IsValid()) return false;
+    ReconciliationSketch work(*this);
+    size_t peeled = 0;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (const Cell& cell : work.m_cells) {
+            if ((cell.count != 1 && cell.count != 0xff) || cell.check_sum != CheckSum(cell.id_sum)) continue;
+            const uint32_t short_id = cell.id_sum;
+            if (cell.count == 1) {
+                only_here.push_back(short_id);
+                work.Toggle(short_id, 0xff);
+            } else {
+                only_there.push_back(short_id);
+                work.Toggle(short_id, 1);
+            }
+            // Every id takes up a cell, so more can only come from a bogus sketch.
+            if (++peeled > work.Cells()) return false;
+            progress = true;
+        }
+    }
+    return std::all_of(work.m_cells.begin(), work.m_cells.end(), [](const Cell& cell) { return cell.IsEmpty(); });
+}
+
+class TxReconciliationTracker::Impl
+{
+    enum class Phase {
+        NONE,
+        //! We sent "reqrecon" and are waiting for the sketch
+        REQUESTED,
+        //! We sent a sketch and are waiting for "reconcildiff"
+        RESPONDED,
+    };
+
+    struct PeerState {
+        bool m_we_initiate;
+        //! SipHash keys for short ids, derived from both peers' salts
+        uint64_t m_k0, m_k1;
+        //! Transactions to reconcile in the next round
+        std::set<uint256> m_local_set;
+        //! Transactions of the round in progress, by short id
+        std::map<uint32_t, uint256> m_round_set;
+        Phase m_phase{Phase::NONE};
+        std::chrono::microseconds m_next_request{0};
+        //! When we sent "reqrecon" or our sketch, whichever is in progress
+        std::chrono::microseconds m_request_time{0};
+
+        uint32_t ShortId(const uint256& wtxid) const
+        {
+            return 1 + SipHashUint256(m_k0, m_k1, wtxid) % 0xffffffff;
+        }
+
+        /** Move the local set into the round set. Transactions with a short
+         * id that is already taken stay for the next round.
+         */
+        void StartRound()
+        {
+            for (const auto& entry : m_round_set) m_local_set.insert(entry.second);
+            m_round_set.clear();
+            for (auto it = m_local_set.begin(); it != m_local_set.end();) {
+                if (m_round_set.emplace(ShortId(*it), *it).second) {
+                    it = m_local_set.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        void RoundSketch(ReconciliationSketch& sketch) const
+        {
+            for (const auto& entry : m_round_set) sketch.Add(entry.first);
+        }
+
+        void EndRound(std::vector<uint256>* to_announce)
+        {
+            if (to_announce) {
+                for (const auto& entry : m_round_set) to_announce->push_back(entry.second);
+            }
+            m_round_set.clear();
+            m_phase = Phase::NONE;
+        }
+    };
+
+    mutable Mutex m_mutex;
+    std::map<NodeId, uint64_t> m_local_salts GUARDED_BY(m_mutex);
+    std::map<NodeId, PeerState> m_states GUARDED_BY(m_mutex);
+
+    PeerState* GetState(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        auto it = m_states.find(peer);
+        return it == m_states.end() ? nullptr : &it->second;
+    }
+
+public:
+    uint64_t PreRegisterPeer(NodeId peer)
+    {
+        const uint64_t salt = GetRand(std::numeric_limits<uint64_t>::max());
+        LOCK(m_mutex);
+        m_local_salts[peer] = salt;
+        return salt;
+    }
+
+    bool RegisterPeer(NodeId peer, bool is_peer_inbound, uint64_t remote_salt)
+    {
+        LOCK(m_mutex);
+        auto salt_it = m_local_salts.find(peer);
+        if (salt_it == m_local_salts.end() || m_states.count(peer)) return false;
+        const uint64_t local_salt = salt_it->second;
+        m_local_salts.erase(salt_it);
+
+        uint256 key = (TaggedHash("Tx Relay Salting") << std::min(local_salt, remote_salt) << std::max(local_salt, remote_salt)).GetSHA256();
+        PeerState state;
+        // Reconciliation is initiated by the side that opened the connection.
+        state.m_we_initiate = is_peer_inbound == false;
+        state.m_k0 = ReadLE64(key.begin());
+        state.m_k1 = ReadLE64(key.begin() + 8);
+        m_states.emplace(peer, std::move(state));
+        return true;
+    }
+
+    void ForgetPeer(NodeId peer)
+    {
+        LOCK(m_mutex);
+        m_local_salts.erase(peer);
+        m_states.erase(peer);
+    }
+
+    bool IsPeerRegistered(NodeId peer) const
+    {
+        LOCK(m_mutex);
+        return m_states.count(peer);
+    }
+
+    bool ShouldFlood(NodeId peer, const uint256& wtxid) const
+    {
+        LOCK(m_mutex);
+        auto it = m_states.find(peer);
+        if (it == m_states.end()) return true;
+        const PeerState& state = it->second;
+        const uint64_t ratio = state.m_we_initiate ? RECON_OUTBOUND_FANOUT_RATIO : RECON_INBOUND_FANOUT_RATIO;
+        return SipHashUint256Extra(state.m_k0, state.m_k1, wtxid, 1) % ratio == 0;
+    }
+
+    bool AddToSet(NodeId peer, const uint256& wtxid)
+    {
+        LOCK(m_mutex);
+        PeerState* state = GetState(peer);
+        if (!state || state->m_local_set.size() >= MAX_RECON_SET_SIZE) return false;
+        state->m_local_set.insert(wtxid);
+        return true;
+    }
+
+    Optional<uint16_t> MaybeRequestReconciliation(NodeId peer, std::chrono::microseconds now)
+    {
+        LOCK(m_mutex);
+        PeerState* state = GetState(peer);
+        if (!state || !state->m_we_initiate) return nullopt;
+        if (state->m_phase == Phase::REQUESTED) {
+            if (now < state->m_request_time + RECON_RESPONSE_TIMEOUT) return nullopt;
+            state->m_phase = Phase::NONE;
+        }
+        if (now < state->m_next_request) return nullopt;
+        state->m_phase = Phase::REQUESTED;
+        state->m_request_time = now;
+        state->m_next_request = now + RECON_REQUEST_INTERVAL;
+        return static_cast<uint16_t>(std::min<size_t>(state->m_local_set.size(), std::numeric_limits<uint16_t>::max()));
+    }
+
+    bool HandleReconciliationRequest(NodeId peer, uint16_t remote_set_size, std::chrono::microseconds now, ReconciliationSketch& sketch)
+    {
+        LOCK(m_mutex);
+        PeerState* state = GetState(peer);
+        if (!state || state->m_we_initiate) return false;
+        // Only one round at a time, and no more often than we'd start them.
+        if (state->m_phase == Phase::RESPONDED || now < state->m_next_request) return false;
+        state->StartRound();
+        state->m_phase = Phase::RESPONDED;
+        state->m_request_time = now;
+        state->m_next_request = now + RECON_REQUEST_INTERVAL;
+
+        const size_t local_set_size = state->m_round_set.size();
+        const size_t capacity = std::max<size_t>(local_set_size, remote_set_size) - std::min<size_t>(local_set_size, remote_set_size) +
+                                std::min<size_t>(local_set_size, remote_set_size) / 4 + 1;
+        const size_t cells = ReconciliationSketch::CellsForCapacity(capacity);
+        if (cells > MAX_SKETCH_CELLS) {
+            sketch = ReconciliationSketch();
+        } else {
+            sketch = ReconciliationSketch(cells);
+            state->RoundSketch(sketch);
+        }
+        return true;
+    }
+
+    bool HandleSketch(NodeId peer, const ReconciliationSketch& sketch, bool& success, std::vector<uint256>& to_announce, std::vector<uint32_t>& to_request)
+    {
+        LOCK(m_mutex);
+        PeerState* state = GetState(peer);
+        if (!state || !state->m_we_initiate || state->m_phase != Phase::REQUESTED || !sketch.IsValid()) return false;
+        state->StartRound();
+
+        std::vector<uint32_t> only_local;
+        success = false;
+        if (sketch.Cells() > 0) {
+            ReconciliationSketch diff(sketch);
+            ReconciliationSketch local(sketch.Cells());
+            state->RoundSketch(local);
+            diff.Subtract(local);
+            success = diff.Decode(to_request, only_local);
+        }
+        if (!success) {
+            to_request.clear();
+            state->EndRound(&to_announce);
+            return true;
+        }
+        for (const uint32_t short_id : only_local) {
+            auto it = state->m_round_set.find(short_id);
+            if (it != state->m_round_set.end()) to_announce.push_back(it->second);
+        }
+        state->EndRound(nullptr);
+        return true;
+    }
+
+    bool ExpireReconciliation(NodeId peer, std::chrono::microseconds now, std::vector<uint256>& to_announce)
+    {
+        LOCK(m_mutex);
+        PeerState* state = GetState(peer);
+        if (!state || state->m_phase != Phase::RESPONDED || now < state->m_request_time + RECON_RESPONSE_TIMEOUT) return false;
+        state->EndRound(&to_announce);
+        return true;
+    }
+
+    bool HandleReconciliationDiff(NodeId peer, bool success, const std::vector<uint32_t>& requested, std::vector<uint256>& to_announce)
+    {
+        LOCK(m_mutex);
+        PeerState* state = GetState(peer);
+        if (!state || state->m_we_initiate || state->m_phase != Phase::RESPONDED) return false;
+        if (!success) {
+            state->EndRound(&to_announce);
+            return true;
+        }
+        for (const uint32_t short_id : requested) {
+            auto it = state->m_round_set.find(short_id);
+            if (it != state->m_round_set.end()) to_announce.push_back(it->second);
+        }
+        state->EndRound(nullptr);
+        return true;
+    }
+};
+
+TxReconciliationTracker::TxReconciliationTracker() : m_impl{MakeUnique<TxReconciliationTracker::Impl>()} {}
+
+TxReconciliationTracker::~TxReconciliationTracker() = default;
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer)
+{
+    return m_impl->PreRegisterPeer(peer);
+}
+
+bool TxReconciliationTracker::RegisterPeer(NodeId peer, bool is_peer_inbound, uint64_t remote_salt)
+{
+    return m_impl->RegisterPeer(peer, is_peer_inbound, remote_salt);
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer)
+{
+    m_impl->ForgetPeer(peer);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer) const
+{
+    return m_impl->IsPeerRegistered(peer);
+}
+
+bool TxReconciliationTracker::ShouldFlood(NodeId peer, const uint256& wtxid) const
+{
+    return m_impl->ShouldFlood(peer, wtxid);
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer, const uint256& wtxid)
+{
+    return m_impl->AddToSet(peer, wtxid);
+}
+
+Optional<uint16_t> TxReconciliationTracker::MaybeRequestReconciliation(NodeId peer, std::chrono::microseconds now)
+{
+    return m_impl->MaybeRequestReconciliation(peer, now);
+}
+
+bool TxReconciliationTracker::HandleReconciliationRequest(NodeId peer, uint16_t remote_set_size, std::chrono::microseconds now, ReconciliationSketch& sketch)
+{
+    return m_impl->HandleReconciliationRequest(peer, remote_set_size, now, sketch);
+}
+
+bool TxReconciliationTracker::ExpireReconciliation(NodeId peer, std::chrono::microseconds now, std::vector<uint256>& to_announce)
+{
+    return m_impl->ExpireReconciliation(peer, now, to_announce);
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId peer, const ReconciliationSketch& sketch, bool& success, std::vector<uint256>& to_announce, std::vector<uint32_t>& to_request)
+{
+    return m_impl->HandleSketch(peer, sketch, success, to_announce, to_request);
+}
+
+bool TxReconciliationTracker::HandleReconciliationDiff(NodeId peer, bool success, const std::vector<uint32_t>& requested, std::vector<uint256>& to_announce)
+{
+    return m_impl->HandleReconciliationDiff(peer, success, requested, to_announce);
+}
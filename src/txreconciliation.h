@@ -0,0 +1,170 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_TXRECONCILIATION_H
+#define LABYRINTH_TXRECONCILIATION_H
+
+#include <net.h> // For NodeId
+#include <optional.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+
+/** Whether transaction reconciliation is offered to peers by default. */
+static const bool DEFAULT_TXRECONCILIATION_ENABLE = false;
+/** Version of the reconciliation protocol we implement, sent in "sendtxrcncl". */
+static const uint32_t TXRECONCILIATION_PROTOCOL_VERSION = 1;
+/** How often we start a reconciliation round with each peer we initiate with. */
+static constexpr std::chrono::seconds RECON_REQUEST_INTERVAL{8};
+/** How long we wait for a sketch, or for "reconcildiff" after sending one, before giving up on a round. */
+static constexpr std::chrono::seconds RECON_RESPONSE_TIMEOUT{60};
+/** Maximum number of transactions waiting to be reconciled with a peer. */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Maximum number of cells in a sketch. */
+static const size_t MAX_SKETCH_CELLS = 3 * 1000;
+/** Transactions are flooded to one in this many inbound reconciling peers... */
+static const uint64_t RECON_INBOUND_FANOUT_RATIO = 10;
+/** ... and to one in this many outbound reconciling peers. */
+static const uint64_t RECON_OUTBOUND_FANOUT_RATIO = 8;
+
+/**
+ * Sketch of a set of 32-bit short transaction ids: an invertible Bloom lookup
+ * table.
+ *
+ * Every id is added to one cell in each of NUM_HASHES equally sized parts of
+ * the table. Subtracting the sketch of one set from a sketch of the same size
+ * of another cancels out the ids both sets have, and as long as the remaining
+ * difference is small enough compared to the number of cells, it can be
+ * recovered by repeatedly taking out the ids that are alone in a cell.
+ */
+class ReconciliationSketch
+{
+public:
+    static constexpr size_t NUM_HASHES = 3;
+
+    ReconciliationSketch() {}
+    explicit ReconciliationSketch(size_t cells) : m_cells(cells) {}
+
+    /** Number of cells a sketch needs to recover a difference of capacity ids with good probability. */
+    static size_t CellsForCapacity(size_t capacity);
+
+    size_t Cells() const { return m_cells.size(); }
+    /** Whether the number of cells is one this class can work with. */
+    bool IsValid() const { return Cells() % NUM_HASHES == 0 && Cells() <= MAX_SKETCH_CELLS; }
+
+    void Add(uint32_t short_id);
+    /** Subtract a sketch with the same number of cells. */
+    void Subtract(const ReconciliationSketch& other);
+    /** Recover the difference after Subtract(): the ids only in this sketch's
+     * set and those only in the other's. Returns false if it can't be fully
+     * recovered.
+     */
+    bool Decode(std::vector<uint32_t>& only_here, std::vector<uint32_t>& only_there) const;
+
+    SERIALIZE_METHODS(ReconciliationSketch, obj) { READWRITE(obj.m_cells); }
+
+private:
+    struct Cell {
+        //! Number of ids in the cell, modulo 256
+        uint8_t count{0};
+        //! XOR of the ids in the cell
+        uint32_t id_sum{0};
+        //! XOR of a hash of the ids in the cell, to tell single ids apart
+        uint32_t check_sum{0};
+
+        bool IsEmpty() const { return count == 0 && id_sum == 0 && check_sum == 0; }
+
+        SERIALIZE_METHODS(Cell, obj) { READWRITE(obj.count, obj.id_sum, obj.check_sum); }
+    };
+
+    std::vector<Cell> m_cells;
+
+    void Toggle(uint32_t short_id, uint8_t count_delta);
+};
+
+/**
+ * Transaction reconciliation state of our peers (after the Erlay protocol).
+ *
+ * Peers that both offer it in "sendtxrcncl" before "verack" only get a small
+ * fraction of our transactions announced right away ("low-fanout flooding");
+ * the others are added to a per-peer reconciliation set. Every
+ * RECON_REQUEST_INTERVAL, the side that opened the connection sends
+ * "reqrecon" with the size of its set, and the other side answers with a
+ * "sketch" of its own. The initiator subtracts a sketch of its set to find
+ * the difference: it announces what the other side is missing in an "inv",
+ * and asks for the short ids it is missing in "reconcildiff", which are then
+ * announced to it by "inv" as well, so transactions are still fetched through
+ * the TxRequestTracker. If the difference can't be recovered, both sides
+ * announce their whole set instead.
+ *
+ * Sets hold wtxids; short ids are SipHash-based, keyed by both peers' salts.
+ */
+class TxReconciliationTracker
+{
+    // Avoid littering this header file with implementation details.
+    class Impl;
+    const std::unique_ptr<Impl> m_impl;
+
+public:
+    TxReconciliationTracker();
+    ~TxReconciliationTracker();
+
+    /** Generate the salt to send to a peer in our "sendtxrcncl". */
+    uint64_t PreRegisterPeer(NodeId peer);
+
+    /** Start reconciling with a peer once its "sendtxrcncl" arrived. Returns
+     * false if we didn't offer reconciliation to it or it's already registered.
+     */
+    bool RegisterPeer(NodeId peer, bool is_peer_inbound, uint64_t remote_salt);
+
+    /** Forget everything about a peer. */
+    void ForgetPeer(NodeId peer);
+
+    bool IsPeerRegistered(NodeId peer) const;
+
+    /** Whether a transaction should be announced to a registered peer right away. */
+    bool ShouldFlood(NodeId peer, const uint256& wtxid) const;
+
+    /** Add a transaction to a registered peer's reconciliation set. Returns
+     * false if the set is full, in which case it should be announced instead.
+     */
+    bool AddToSet(NodeId peer, const uint256& wtxid);
+
+    /** If we initiate reconciliation with the peer and it's time for the next
+     * round, start it and return the size of our set to send in "reqrecon".
+     */
+    Optional<uint16_t> MaybeRequestReconciliation(NodeId peer, std::chrono::microseconds now);
+
+    /** Answer the peer's "reqrecon" with a sketch of our set; an empty sketch
+     * if the difference is too large to reconcile. Returns false if the
+     * request was unexpected: the peer doesn't initiate, the previous round
+     * isn't finished or it came sooner than RECON_REQUEST_INTERVAL after it.
+     */
+    bool HandleReconciliationRequest(NodeId peer, uint16_t remote_set_size, std::chrono::microseconds now, ReconciliationSketch& sketch);
+
+    /** Give up on a round the peer didn't finish with "reconcildiff" within
+     * RECON_RESPONSE_TIMEOUT of our sketch: fills the wtxids of the round,
+     * to be announced to it instead. Returns whether the round expired.
+     */
+    bool ExpireReconciliation(NodeId peer, std::chrono::microseconds now, std::vector<uint256>& to_announce);
+
+    /** Find the difference between our set and the peer's from its sketch.
+     * Fills the wtxids to announce to the peer and the short ids to ask it
+     * for, and whether the difference could be recovered. Returns false if
+     * the sketch was unexpected or malformed.
+     */
+    bool HandleSketch(NodeId peer, const ReconciliationSketch& sketch, bool& success, std::vector<uint256>& to_announce, std::vector<uint32_t>& to_request);
+
+    /** Finish a round on the peer's "reconcildiff": fills the wtxids to
+     * announce to it. Returns false if it was unexpected.
+     */
+    bool HandleReconciliationDiff(NodeId peer, bool success, const std::vector<uint32_t>& requested, std::vector<uint256>& to_announce);
+};
+
+#endif // LABYRINTH_TXRECONCILIATION_H
@@ -0,0 +1,71 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_UTIL_ARENA_H
+#define LABYRINTH_UTIL_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Append-only arena for objects that are created one at a time and all
+ * destroyed together.
+ *
+ * Objects are placed back to back in fixed-size chunks, so each one costs
+ * exactly sizeof(T) instead of a separate heap allocation with its own
+ * header and alignment slack. Objects never move: pointers stay valid until
+ * Clear() or destruction.
+ */
+template <typename T, size_t CHUNK_SIZE = 4096>
+class ChunkArena
+{
+private:
+    using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    std::vector<std::unique_ptr<Storage[]>> m_chunks;
+    //! Number of objects constructed in the last chunk.
+    size_t m_last_used{CHUNK_SIZE};
+
+public:
+    ChunkArena() = default;
+    ChunkArena(const ChunkArena&) = delete;
+    ChunkArena& operator=(const ChunkArena&) = delete;
+    ~ChunkArena() { Clear(); }
+
+    template <typename... Args>
+    T* Emplace(Args&&... args)
+    {
+        if (m_last_used == CHUNK_SIZE) {
+            m_chunks.emplace_back(new Storage[CHUNK_SIZE]);
+            m_last_used = 0;
+        }
+        T* obj = new (&m_chunks.back()[m_last_used]) T(std::forward<Args>(args)...);
+        ++m_last_used;
+        return obj;
+    }
+
+    /** Destroy all objects and release the chunks. */
+    void Clear()
+    {
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            const size_t used = i + 1 == m_chunks.size() ? m_last_used : CHUNK_SIZE;
+            for (size_t j = 0; j < used; ++j) {
+                reinterpret_cast<T*>(&m_chunks[i][j])->~T();
+            }
+        }
+        m_chunks.clear();
+        m_last_used = CHUNK_SIZE;
+    }
+
+    size_t Size() const { return m_chunks.empty() ? 0 : (m_chunks.size() - 1) * CHUNK_SIZE + m_last_used; }
+
+    /** Bytes reserved by the arena, including the unused tail of the last chunk. */
+    size_t DynamicMemoryUsage() const { return m_chunks.size() * CHUNK_SIZE * sizeof(Storage); }
+};
+
+#endif // LABYRINTH_UTIL_ARENA_H
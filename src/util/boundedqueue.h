@@ -0,0 +1,78 @@
+// Copyright (c) 2021-2022 The Labyrinth Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LABYRINTH_UTIL_BOUNDEDQUEUE_H
+#define LABYRINTH_UTIL_BOUNDEDQUEUE_H
+
+#include <sync.h>
+
+#include <condition_variable>
+#include <deque>
+#include <utility>
+
+/**
+ * Fixed-capacity FIFO for handing items between the stages of a pipeline.
+ *
+ * Producers block in Push() while the queue is full and consumers block in
+ * Pop() while it is empty. Once Close() has been called, Push() fails and
+ * Pop() drains the remaining items before failing, so a consumer loop of
+ * `while (queue.Pop(item))` terminates cleanly.
+ */
+template <typename T>
+class BoundedQueue
+{
+private:
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond_not_empty;
+    std::condition_variable m_cond_not_full;
+    std::deque<T> m_items GUARDED_BY(m_mutex);
+    const size_t m_capacity;
+    bool m_closed GUARDED_BY(m_mutex){false};
+
+public:
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity > 0 ? capacity : 1) {}
+
+    /** Append an item, waiting for space. Returns false if the queue was closed. */
+    bool Push(T item)
+    {
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond_not_full.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed) return false;
+            m_items.push_back(std::move(item));
+        }
+        m_cond_not_empty.notify_one();
+        return true;
+    }
+
+    /** Take the oldest item, waiting for one. Returns false once closed and drained. */
+    bool Pop(T& item)
+    {
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond_not_empty.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_closed || !m_items.empty(); });
+            if (m_items.empty()) return false;
+            item = std::move(m_items.front());
+            m_items.pop_front();
+        }
+        m_cond_not_full.notify_one();
+        return true;
+    }
+
+    /** Stop accepting new items and wake all waiters. */
+    void Close()
+    {
+        WITH_LOCK(m_mutex, m_closed = true);
+        m_cond_not_empty.notify_all();
+        m_cond_not_full.notify_all();
+    }
+
+    size_t Size() const
+    {
+        LOCK(m_mutex);
+        return m_items.size();
+    }
+};
+
+#endif // LABYRINTH_UTIL_BOUNDEDQUEUE_H
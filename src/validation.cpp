@@ -21,7 +21,10 @@
 #include <index/txindex.h>
 #include <logging.h>
 #include <logging/timer.h>
+#include <node/blockwriter.h>
+#include <node/coinstats.h>
 #include <node/ui_interface.h>
+#include <node/utxo_snapshot.h>
 #include <optional.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
@@ -34,22 +37,29 @@
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <shutdown.h>
+#include <streams.h>
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <undo.h>
+#include <util/boundedqueue.h>
 #include <util/check.h> // For NDEBUG compile time check
 #include <util/moneystr.h>
 #include <util/rbf.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <util/translation.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <atomic>
+#include <future>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -72,6 +82,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static constexpr std::chrono::hours DATABASE_WRITE_INTERVAL{1};
 /** Time to wait between flushing chainstate to disk. */
 static constexpr std::chrono::hours DATABASE_FLUSH_INTERVAL{24};
+/** Number of changed block index entries after which the block index is written even if the write interval has not passed. */
+static constexpr size_t MAX_DIRTY_BLOCK_INDEX{100000};
+/** Depth below a chainstate's tip down to which written block index entries with block data keep their KawPoW fields in memory. */
+static constexpr int BLOCK_INDEX_POW_DEPTH{MIN_BLOCKS_TO_KEEP};
 /** Maximum age of our tip for us to be considered current for fee estimation */
 static constexpr std::chrono::hours MAX_FEE_ESTIMATION_TIP_AGE{3};
 const std::vector<std::string> CHECKLEVEL_DOC {
@@ -133,6 +147,7 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 bool g_parallel_script_checks{false};
+unsigned int g_mempool_parallel_script_inputs{DEFAULT_MEMPOOL_PARALLEL_SCRIPT_INPUTS};
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -168,6 +183,19 @@ namespace {
 
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
+
+    /**
+     * KawPoW header fields of the block index entries that are not written to
+     * the block tree DB yet, and of written entries with block data near a
+     * chainstate tip: those are the ones that get written again as they are
+     * connected, and that are announced to peers. Entries that receive their
+     * block data after being dropped from here get their fields back from the
+     * block.
+     */
+    std::unordered_map<const CBlockIndex*, BlockHeaderPoW> mapBlockIndexPoW;
+
+    /** Writes block and undo data to disk off the validation thread. */
+    BlockFileWriter g_block_writer(MAX_BLOCK_WRITE_BUFFER);
 } // anon namespace
 
 CBlockIndex* LookupBlockIndex(const uint256& hash)
@@ -199,6 +227,9 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
 bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
+static bool VerifyInputScripts(const CTransaction& tx, TxValidationState& state, unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck>* pvChecks = nullptr);
+static bool VerifyInputScriptsParallel(const CTransaction& tx, unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata);
+static bool RunScriptChecksParallel(std::vector<CScriptCheck>& checks);
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
@@ -253,7 +284,7 @@ bool TestLockPointValidity(const LockPoints* lp)
     return true;
 }
 
-bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp, bool useExistingLockPoints)
+bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp, bool useExistingLockPoints, const CCoinsView* coins_view)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(pool.cs);
@@ -280,12 +311,13 @@ bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flag
     else {
         // CoinsTip() contains the UTXO set for ::ChainActive().Tip()
         CCoinsViewMemPool viewMemPool(&::ChainstateActive().CoinsTip(), pool);
+        if (!coins_view) coins_view = &viewMemPool;
         std::vector<int> prevheights;
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
             Coin coin;
-            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
+            if (!coins_view->GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
             if (coin.nHeight == MEMPOOL_HEIGHT) {
@@ -408,9 +440,10 @@ static void UpdateMempoolForReorg(CTxMemPool& mempool, DisconnectedBlockTransact
 }
 
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
-// were somehow broken and returning the wrong scriptPubKeys
+// were somehow broken and returning the wrong scriptPubKeys. package_coins holds
+// the outputs of the earlier transactions of a package under test, if any.
 static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationState& state, const CCoinsViewCache& view, const CTxMemPool& pool,
-                 unsigned int flags, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+                 unsigned int flags, PrecomputedTransactionData& txdata, const CCoinsViewCache* package_coins) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     AssertLockHeld(cs_main);
 
     // pool.cs should be locked already, but go ahead and re-take the lock here
@@ -435,8 +468,14 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationS
             assert(txFrom->vout[txin.prevout.n] == coin.out);
         } else {
             const Coin& coinFromDisk = ::ChainstateActive().CoinsTip().AccessCoin(txin.prevout);
-            assert(!coinFromDisk.IsSpent());
-            assert(coinFromDisk.out == coin.out);
+            if (package_coins && coinFromDisk.IsSpent()) {
+                const Coin& coinFromPackage = package_coins->AccessCoin(txin.prevout);
+                assert(coinFromPackage.nHeight == MEMPOOL_HEIGHT);
+                assert(coinFromPackage.out == coin.out);
+            } else {
+                assert(!coinFromDisk.IsSpent());
+                assert(coinFromDisk.out == coin.out);
+            }
         }
     }
 
@@ -449,11 +488,15 @@ namespace {
 class MemPoolAccept
 {
 public:
-    MemPoolAccept(CTxMemPool& mempool) : m_pool(mempool), m_view(&m_dummy), m_viewmempool(&::ChainstateActive().CoinsTip(), m_pool),
+    // With package_coins, inputs are looked up there instead of in the mempool
+    // and chain; see TestPackageAcceptance.
+    explicit MemPoolAccept(CTxMemPool& mempool, CCoinsViewCache* package_coins = nullptr) : m_pool(mempool), m_view(&m_dummy), m_viewmempool(&::ChainstateActive().CoinsTip(), m_pool), m_package_coins(package_coins),
         m_limit_ancestors(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT)),
         m_limit_ancestor_size(gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000),
         m_limit_descendants(gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT)),
-        m_limit_descendant_size(gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000) {}
+        m_limit_descendant_size(gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000),
+        m_limit_cluster_count(gArgs.GetArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT)),
+        m_limit_cluster_size(gArgs.GetArg("-limitclustersize", DEFAULT_CLUSTER_SIZE_LIMIT)*1000) {}
 
     // We put the arguments we're handed into a struct, so we can pass them
     // around easier.
@@ -473,12 +516,13 @@ public:
         std::vector<COutPoint>& m_coins_to_uncache;
         const bool m_test_accept;
         CAmount* m_fee_out;
+        // Reject transactions paying a higher fee than this (0 for no limit).
+        const CAmount m_max_fee;
     };
 
     // Single transaction acceptance
     bool AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
     struct Workspace {
@@ -497,15 +541,33 @@ private:
         const uint256& m_hash;
     };
 
+    // The stages of batch acceptance. PrepareScriptChecks runs the cheap
+    // checks into ws and loads the spent outputs into txdata. The script
+    // checks (PolicyScriptChecks) then need no locks and may run concurrently
+    // for different transactions. AcceptCheckedTransaction adds the
+    // transaction. With reuse_prechecks (nothing but earlier transactions of
+    // the batch was added to the mempool, and the tip is the same) only the
+    // ancestors are evaluated again; otherwise the cheap checks are repeated
+    // against the current mempool, and the scripts are only verified again if
+    // its inputs changed in between.
+    bool PrepareScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+    bool AcceptCheckedTransaction(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata, bool reuse_prechecks) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    // Run the script checks using our policy flags. As this can be slow, we should
+    // only invoke this on transactions that have otherwise passed policy checks.
+    // Only the spent outputs in txdata are used, so no locks are required.
+    static bool PolicyScriptChecks(const CTransaction& tx, TxValidationState& state, PrecomputedTransactionData& txdata);
+
+private:
     // Run the policy checks on a given transaction, excluding any script checks.
     // Looks up inputs, calculates feerate, considers replacement, evaluates
     // package limits, etc. As this function can be invoked for "free" by a peer,
     // only tests that are fast should be done here (to avoid CPU DoS).
     bool PreChecks(ATMPArgs& args, Workspace& ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
 
-    // Run the script checks using our policy flags. As this can be slow, we should
-    // only invoke this on transactions that have otherwise passed policy checks.
-    bool PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    // Initialize txdata with the outputs spent by the transaction, as found
+    // in m_view by PreChecks().
+    void LoadSpentOutputs(const CTransaction& tx, PrecomputedTransactionData& txdata);
 
     // Re-run the script checks, using consensus flags, and try to cache the
     // result in the scriptcache. This should be done after
@@ -537,6 +599,7 @@ private:
     CCoinsViewCache m_view;
     CCoinsViewMemPool m_viewmempool;
     CCoinsView m_dummy;
+    CCoinsViewCache* const m_package_coins;
 
     // The package limits in effect at the time of invocation.
     const size_t m_limit_ancestors;
@@ -545,6 +608,8 @@ private:
     // in-mempool conflicts; see below).
     size_t m_limit_descendants;
     size_t m_limit_descendant_size;
+    const size_t m_limit_cluster_count;
+    const size_t m_limit_cluster_size;
 };
 
 bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
@@ -638,7 +703,11 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     }
 
     LockPoints lp;
-    m_view.SetBackend(m_viewmempool);
+    if (m_package_coins) {
+        m_view.SetBackend(*m_package_coins);
+    } else {
+        m_view.SetBackend(m_viewmempool);
+    }
 
     CCoinsViewCache& coins_cache = ::ChainstateActive().CoinsTip();
     // do all inputs exist?
@@ -674,9 +743,8 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     // Only accept BIP68 sequence locked transactions that can be mined in the next
     // block; we don't want our mempool filled up with transactions that can't
     // be mined yet.
-    // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
-    // CoinsViewCache instead of create its own
-    if (!CheckSequenceLocks(m_pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+    // The inputs are read from m_view, which already holds all of them.
+    if (!CheckSequenceLocks(m_pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp, /* useExistingLockPoints */ false, &m_view))
         return state.Invalid(TxValidationResult::TX_PREMATURE_SPEND, "non-BIP68-final");
 
     CAmount nFees = 0;
@@ -689,6 +757,10 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         *args.m_fee_out = nFees;
     }
 
+    if (args.m_max_fee && nFees > args.m_max_fee) {
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "max-fee-exceeded", strprintf("%d > %d", nFees, args.m_max_fee));
+    }
+
     // Check for non-standard pay-to-script-hash in inputs
     const auto& params = args.m_chainparams.GetConsensus();
     if (fRequireStandard && !AreInputsStandard(tx, m_view, params.TaprootEnabled)) {
@@ -728,6 +800,14 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     // blocks
     if (!bypass_limits && !CheckFeeRate(nSize, nModifiedFees, state)) return false;
 
+    // Optionally keep clusters within a bounded size, so that linking and
+    // unlinking them stays cheap. The clusters of replaced transactions are
+    // counted as they are now.
+    std::string errString;
+    if (!m_pool.CheckClusterLimits(*entry, m_limit_cluster_count, m_limit_cluster_size, errString)) {
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-large-mempool-cluster", errString);
+    }
+
     const CTxMemPool::setEntries setIterConflicting = m_pool.GetIterSet(setConflicts);
     // Calculate in-mempool ancestors, up to a limit.
     if (setConflicts.size() == 1) {
@@ -765,7 +845,6 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         m_limit_descendant_size += conflict->GetSizeWithDescendants();
     }
 
-    std::string errString;
     if (!m_pool.CalculateMemPoolAncestors(*entry, setAncestors, m_limit_ancestors, m_limit_ancestor_size, m_limit_descendants, m_limit_descendant_size, errString)) {
         setAncestors.clear();
         // If CalculateMemPoolAncestors fails second time, we want the original error string.
@@ -920,23 +999,39 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     return true;
 }
 
-bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata)
+void MemPoolAccept::LoadSpentOutputs(const CTransaction& tx, PrecomputedTransactionData& txdata)
 {
-    const CTransaction& tx = *ws.m_ptx;
-
-    TxValidationState &state = args.m_state;
+    std::vector<CTxOut> spent_outputs;
+    spent_outputs.reserve(tx.vin.size());
+    for (const CTxIn& txin : tx.vin) {
+        spent_outputs.emplace_back(m_view.AccessCoin(txin.prevout).out);
+    }
+    txdata.Init(tx, std::move(spent_outputs));
+}
 
+bool MemPoolAccept::PolicyScriptChecks(const CTransaction& tx, TxValidationState& state, PrecomputedTransactionData& txdata)
+{
     constexpr unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
+    // The script execution cache is not consulted: it only ever holds
+    // results for consensus flags, which never equal the standard flags.
+    //
+    // The inputs of large transactions are verified on the script-checking
+    // threads. That only yields pass or fail, so a failure is verified again
+    // below to determine which error to report.
+    if (g_parallel_script_checks && g_mempool_parallel_script_inputs > 0 && tx.vin.size() >= g_mempool_parallel_script_inputs &&
+            VerifyInputScriptsParallel(tx, scriptVerifyFlags, true, txdata)) {
+        return true;
+    }
+    if (!VerifyInputScripts(tx, state, scriptVerifyFlags, true, txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
-        TxValidationState state_dummy; // Want reported failures to be from first CheckInputScripts
-        if (!tx.HasWitness() && CheckInputScripts(tx, state_dummy, m_view, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
-                !CheckInputScripts(tx, state_dummy, m_view, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
+        TxValidationState state_dummy; // Want reported failures to be from first VerifyInputScripts
+        if (!tx.HasWitness() && VerifyInputScripts(tx, state_dummy, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
+                !VerifyInputScripts(tx, state_dummy, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
             // Only the witness is missing, so the transaction itself may be fine.
             state.Invalid(TxValidationResult::TX_WITNESS_STRIPPED,
                     state.GetRejectReason(), state.GetDebugMessage());
@@ -971,7 +1066,7 @@ bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, Precomp
     // invalid blocks (using TestBlockValidity), however allowing such
     // transactions into the mempool can be exploited as a DoS attack.
     unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(::ChainActive().Tip(), chainparams.GetConsensus());
-    if (!CheckInputsFromMempoolAndCache(tx, state, m_view, m_pool, currentBlockScriptVerifyFlags, txdata)) {
+    if (!CheckInputsFromMempoolAndCache(tx, state, m_view, m_pool, currentBlockScriptVerifyFlags, txdata, m_package_coins)) {
         return error("%s: BUG! PLEASE REPORT THIS! CheckInputScripts failed against latest-block but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), state.ToString());
     }
@@ -1040,8 +1135,9 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
     // checks first and avoid hashing and signature verification unless those
     // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
     PrecomputedTransactionData txdata;
+    LoadSpentOutputs(*ptx, txdata);
 
-    if (!PolicyScriptChecks(args, workspace, txdata)) return false;
+    if (!PolicyScriptChecks(*ptx, args.m_state, txdata)) return false;
 
     if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
 
@@ -1055,6 +1151,80 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
     return true;
 }
 
+bool MemPoolAccept::PrepareScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata)
+{
+    if (!PreChecks(args, ws)) return false;
+
+    LoadSpentOutputs(*ws.m_ptx, txdata);
+    return true;
+}
+
+bool MemPoolAccept::AcceptCheckedTransaction(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata, bool reuse_prechecks)
+{
+    AssertLockHeld(cs_main);
+    LOCK(m_pool.cs);
+
+    const CTransactionRef& ptx = ws.m_ptx;
+
+    // Replacements are always checked again: an earlier addition may have
+    // evicted some of the transactions they conflict with.
+    reuse_prechecks = reuse_prechecks && ws.m_conflicts.empty();
+    if (reuse_prechecks) {
+        // Batch parents were prepared as if they were accepted, which they
+        // may not have been. ConsensusScriptChecks reads the inputs from here.
+        m_view.SetBackend(m_viewmempool);
+        for (const CTxIn& txin : ptx->vin) {
+            if (!m_view.HaveCoin(txin.prevout)) {
+                reuse_prechecks = false;
+                break;
+            }
+        }
+    }
+    if (reuse_prechecks) {
+        // Batch parents added since the preparation are new ancestors, and
+        // their clusters new relatives.
+        std::string dummy_err_string;
+        ws.m_ancestors.clear();
+        reuse_prechecks = m_pool.CheckClusterLimits(*ws.m_entry, m_limit_cluster_count, m_limit_cluster_size, dummy_err_string) &&
+                          m_pool.CalculateMemPoolAncestors(*ws.m_entry, ws.m_ancestors, m_limit_ancestors, m_limit_ancestor_size,
+                                                           m_limit_descendants, m_limit_descendant_size, dummy_err_string);
+    }
+
+    Workspace rechecked(ptx);
+    Workspace& workspace = reuse_prechecks ? ws : rechecked;
+    if (!reuse_prechecks) {
+        // The mempool and chain may have changed since the scripts were
+        // checked, so conflicts, fees and package limits are evaluated again.
+        if (!PreChecks(args, workspace)) return false;
+
+        // The policy script checks remain valid as long as every input still
+        // refers to the same output.
+        bool inputs_changed = false;
+        for (size_t i = 0; i < ptx->vin.size(); ++i) {
+            if (!(m_view.AccessCoin(ptx->vin[i].prevout).out == txdata.m_spent_outputs[i])) {
+                inputs_changed = true;
+                break;
+            }
+        }
+        if (inputs_changed) {
+            txdata = PrecomputedTransactionData();
+            LoadSpentOutputs(*ptx, txdata);
+            if (!PolicyScriptChecks(*ptx, args.m_state, txdata)) return false;
+        }
+    }
+
+    // The signatures are in the signature cache since PolicyScriptChecks.
+    if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
+
+    if (args.m_test_accept) return true;
+
+    if (!Finalize(args, workspace)) return false;
+
+    GetMainSignals().TransactionAddedToMempool(ptx, m_pool.GetAndIncrementSequence());
+
+    return true;
+}
+
 } // anon namespace
 
 /** (try to) add transaction to memory pool with a specified acceptance time **/
@@ -1063,7 +1233,7 @@ static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPo
                         bool bypass_limits, bool test_accept, CAmount* fee_out=nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::vector<COutPoint> coins_to_uncache;
-    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, coins_to_uncache, test_accept, fee_out };
+    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, coins_to_uncache, test_accept, fee_out, /* max_fee */ 0 };
     bool res = MemPoolAccept(pool).AcceptSingleTransaction(tx, args);
     if (!res) {
         // Remove coins that were not present in the coins cache before calling ATMPW;
@@ -1088,6 +1258,174 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, test_accept, fee_out);
 }
 
+/** Order the transactions so that each comes after those of txs it spends, and otherwise keeps its position. */
+static std::vector<size_t> DependencyOrder(const std::vector<CTransactionRef>& txs)
+{
+    std::map<uint256, size_t> positions;
+    for (size_t i = 0; i < txs.size(); ++i) positions.emplace(txs[i]->GetHash(), i);
+
+    std::vector<size_t> order;
+    order.reserve(txs.size());
+    std::vector<bool> visited(txs.size(), false);
+    // Depth-first, emitting each transaction once all its parents are emitted
+    std::vector<std::pair<size_t, size_t>> stack; // (position, next input to visit)
+    for (size_t root = 0; root < txs.size(); ++root) {
+        if (visited[root]) continue;
+        visited[root] = true;
+        stack.emplace_back(root, 0);
+        while (!stack.empty()) {
+            const size_t pos = stack.back().first;
+            const size_t input = stack.back().second++;
+            if (input == txs[pos]->vin.size()) {
+                order.push_back(pos);
+                stack.pop_back();
+                continue;
+            }
+            auto it = positions.find(txs[pos]->vin[input].prevout.hash);
+            if (it != positions.end() && !visited[it->second]) {
+                visited[it->second] = true;
+                stack.emplace_back(it->second, 0);
+            }
+        }
+    }
+    return order;
+}
+
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs,
+                                          std::vector<TxValidationState>& states, std::list<CTransactionRef>* plTxnReplaced,
+                                          const std::vector<CAmount>* max_fees, const std::vector<int64_t>* accept_times)
+{
+    const CChainParams& chainparams = Params();
+    const int64_t now = GetTime();
+    const size_t count = txs.size();
+    states.assign(count, TxValidationState());
+    std::vector<bool> accepted(count, false);
+    std::vector<std::vector<COutPoint>> coins_to_uncache(count);
+    std::vector<PrecomputedTransactionData> txdata(count);
+    // Transactions whose script checks run in parallel, parents before
+    // children, and those that conflict with another transaction of the
+    // batch (or descend from one that does).
+    std::vector<size_t> checked;
+    std::vector<size_t> deferred;
+    std::vector<std::unique_ptr<MemPoolAccept::Workspace>> workspaces(count);
+    // The mempool and tip the checks were prepared against
+    uint64_t prepared_sequence;
+    const CBlockIndex* prepared_tip;
+
+    {
+        LOCK2(cs_main, pool.cs);
+        // Each prepared transaction spends its inputs and creates its outputs
+        // in this view, so that its children in the batch can be prepared too.
+        CCoinsViewMemPool viewmempool(&::ChainstateActive().CoinsTip(), pool);
+        CCoinsViewCache package_coins(&viewmempool);
+        std::set<uint256> deferred_txids;
+        std::set<COutPoint> batch_spent;
+        for (const size_t i : DependencyOrder(txs)) {
+            bool independent = true;
+            for (const CTxIn& txin : txs[i]->vin) {
+                if (deferred_txids.count(txin.prevout.hash) || !batch_spent.insert(txin.prevout).second) independent = false;
+            }
+            if (!independent) {
+                deferred.push_back(i);
+                deferred_txids.insert(txs[i]->GetHash());
+                continue;
+            }
+            MemPoolAccept::ATMPArgs args{chainparams, states[i], accept_times ? (*accept_times)[i] : now, plTxnReplaced, /* bypass_limits */ false, coins_to_uncache[i], /* test_accept */ false, /* fee_out */ nullptr, max_fees ? (*max_fees)[i] : 0};
+            workspaces[i] = MakeUnique<MemPoolAccept::Workspace>(txs[i]);
+            if (MemPoolAccept(pool, &package_coins).PrepareScriptChecks(args, *workspaces[i], txdata[i])) {
+                checked.push_back(i);
+                for (const CTxIn& txin : txs[i]->vin) package_coins.SpendCoin(txin.prevout);
+                AddCoins(package_coins, *txs[i], MEMPOOL_HEIGHT);
+            }
+        }
+        prepared_sequence = pool.GetSequence();
+        prepared_tip = ::ChainActive().Tip();
+    }
+
+    // Script checks only read the spent outputs loaded above, so they run
+    // without cs_main, on the script-checking threads. The queue only reports
+    // whether all of them passed; after a failure each transaction is checked
+    // again here to find the invalid ones and their errors.
+    bool all_scripts_ok = false;
+    if (g_parallel_script_checks && !checked.empty()) {
+        std::vector<CScriptCheck> checks;
+        for (const size_t i : checked) {
+            TxValidationState state_dummy; // Nothing is checked yet when collecting checks
+            VerifyInputScripts(*txs[i], state_dummy, STANDARD_SCRIPT_VERIFY_FLAGS, true, txdata[i], &checks);
+        }
+        all_scripts_ok = RunScriptChecksParallel(checks);
+    }
+    std::vector<char> scripts_ok(count, false);
+    for (const size_t i : checked) {
+        scripts_ok[i] = all_scripts_ok || MemPoolAccept::PolicyScriptChecks(*txs[i], states[i], txdata[i]);
+    }
+
+    LOCK2(cs_main, pool.cs);
+    // Every addition and removal advances the mempool sequence by one. While
+    // it only advanced by the additions of this batch, and the tip is the
+    // same, the prepared checks still hold.
+    uint64_t added = 0;
+    for (const size_t i : checked) {
+        if (!scripts_ok[i]) continue;
+        const bool unchanged = ::ChainActive().Tip() == prepared_tip && pool.GetSequence() == prepared_sequence + added;
+        MemPoolAccept::ATMPArgs args{chainparams, states[i], accept_times ? (*accept_times)[i] : now, plTxnReplaced, /* bypass_limits */ false, coins_to_uncache[i], /* test_accept */ false, /* fee_out */ nullptr, max_fees ? (*max_fees)[i] : 0};
+        accepted[i] = MemPoolAccept(pool).AcceptCheckedTransaction(args, *workspaces[i], txdata[i], unchanged);
+        if (accepted[i]) ++added;
+    }
+    for (const size_t i : deferred) {
+        MemPoolAccept::ATMPArgs args{chainparams, states[i], accept_times ? (*accept_times)[i] : now, plTxnReplaced, /* bypass_limits */ false, coins_to_uncache[i], /* test_accept */ false, /* fee_out */ nullptr, max_fees ? (*max_fees)[i] : 0};
+        accepted[i] = MemPoolAccept(pool).AcceptSingleTransaction(txs[i], args);
+    }
+
+    // See AcceptToMemoryPoolWithTime
+    for (size_t i = 0; i < count; ++i) {
+        if (accepted[i]) continue;
+        for (const COutPoint& outpoint : coins_to_uncache[i]) {
+            ::ChainstateActive().CoinsTip().Uncache(outpoint);
+        }
+    }
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+    return accepted;
+}
+
+std::vector<bool> TestPackageAcceptance(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, std::vector<TxValidationState>& states,
+                                        std::vector<CAmount>& fees, const std::vector<CAmount>* max_fees)
+{
+    AssertLockHeld(cs_main);
+    LOCK(pool.cs);
+    const CChainParams& chainparams = Params();
+    const int64_t accept_time = GetTime();
+    const size_t count = txs.size();
+    states.assign(count, TxValidationState());
+    fees.assign(count, 0);
+    std::vector<bool> accepted(count, false);
+    std::vector<std::vector<COutPoint>> coins_to_uncache(count);
+
+    // Inputs are shared through one view, in which each transaction that
+    // passes spends its inputs and creates its outputs, as if it was added.
+    CCoinsViewMemPool viewmempool(&::ChainstateActive().CoinsTip(), pool);
+    CCoinsViewCache package_coins(&viewmempool);
+    for (const size_t i : DependencyOrder(txs)) {
+        MemPoolAccept::ATMPArgs args{chainparams, states[i], accept_time, /* replaced_transactions */ nullptr, /* bypass_limits */ false, coins_to_uncache[i], /* test_accept */ true, &fees[i], max_fees ? (*max_fees)[i] : 0};
+        accepted[i] = MemPoolAccept(pool, &package_coins).AcceptSingleTransaction(txs[i], args);
+        if (!accepted[i]) continue;
+        for (const CTxIn& txin : txs[i]->vin) package_coins.SpendCoin(txin.prevout);
+        AddCoins(package_coins, *txs[i], MEMPOOL_HEIGHT);
+    }
+
+    // See AcceptToMemoryPoolWithTime
+    for (size_t i = 0; i < count; ++i) {
+        if (accepted[i]) continue;
+        for (const COutPoint& outpoint : coins_to_uncache[i]) {
+            ::ChainstateActive().CoinsTip().Uncache(outpoint);
+        }
+    }
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+    return accepted;
+}
+
 CTransactionRef GetTransaction(const CBlockIndex* const block_index, const CTxMemPool* const mempool, const uint256& hash, const Consensus::Params& consensusParams, uint256& hashBlock)
 {
     LOCK(cs_main);
@@ -1122,21 +1460,15 @@ CTransactionRef GetTransaction(const CBlockIndex* const block_index, const CTxMe
 
 static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("WriteBlockToDisk: OpenBlockFile failed");
-
-    // Write index header
-    unsigned int nSize = GetSerializeSize(block, fileout.GetVersion());
-    fileout << messageStart << nSize;
+    // Serialize index header and block; the write itself happens in the background
+    std::vector<unsigned char> data;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, data, 0);
+    unsigned int nSize = GetSerializeSize(block, CLIENT_VERSION);
+    writer << messageStart << nSize << block;
 
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("WriteBlockToDisk: ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    if (!g_block_writer.Write(BlockFileSeq(), pos, std::move(data)))
+        return error("WriteBlockToDisk: queueing write failed");
+    pos.nPos += CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize);
 
     return true;
 }
@@ -1227,6 +1559,135 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+bool StripRawBlockWitness(std::vector<uint8_t>& block)
+{
+    // Walk the block with a read and a write cursor. Stripped data is never
+    // longer than the original, so the kept ranges can be moved forward in
+    // the same buffer.
+    static const size_t header_size = ::GetSerializeSize(CBlockHeader(), PROTOCOL_VERSION);
+    const size_t size = block.size();
+    size_t read_pos = 0;
+    size_t write_pos = 0;
+
+    auto keep = [&](uint64_t len) {
+        if (size - read_pos < len) return false;
+        if (write_pos != read_pos) memmove(block.data() + write_pos, block.data() + read_pos, len);
+        read_pos += len;
+        write_pos += len;
+        return true;
+    };
+    auto skip = [&](uint64_t len) {
+        if (size - read_pos < len) return false;
+        read_pos += len;
+        return true;
+    };
+    // Decode the CompactSize at the read cursor without consuming it.
+    auto peek_compact_size = [&](uint64_t& value, size_t& len) {
+        if (read_pos >= size) return false;
+        const uint8_t first = block[read_pos];
+        len = first < 253 ? 1 : first == 253 ? 3 : first == 254 ? 5 : 9;
+        if (size - read_pos < len) return false;
+        value = first;
+        if (len > 1) {
+            value = 0;
+            for (size_t i = len - 1; i > 0; --i) value = (value << 8) | block[read_pos + i];
+        }
+        return true;
+    };
+    auto keep_compact_size = [&](uint64_t& value) {
+        size_t len;
+        return peek_compact_size(value, len) && keep(len);
+    };
+    auto skip_compact_size = [&](uint64_t& value) {
+        size_t len;
+        return peek_compact_size(value, len) && skip(len);
+    };
+    auto keep_script = [&]() {
+        uint64_t len;
+        return keep_compact_size(len) && keep(len);
+    };
+
+    uint64_t tx_count;
+    if (!keep(header_size) || !keep_compact_size(tx_count)) return false;
+    for (uint64_t t = 0; t < tx_count; ++t) {
+        if (!keep(4)) return false; // nVersion
+
+        uint64_t vin_count;
+        size_t len;
+        if (!peek_compact_size(vin_count, len)) return false;
+        uint8_t flags = 0;
+        if (vin_count == 0) {
+            // Witness marker: a dummy empty vin followed by the flags byte.
+            if (!skip(len) || read_pos >= size) return false;
+            flags = block[read_pos];
+            if (flags != 1 || !skip(1)) return false;
+        }
+        if (!keep_compact_size(vin_count)) return false;
+        for (uint64_t i = 0; i < vin_count; ++i) {
+            if (!keep(36) || !keep_script() || !keep(4)) return false; // prevout, scriptSig, nSequence
+        }
+        uint64_t vout_count;
+        if (!keep_compact_size(vout_count)) return false;
+        for (uint64_t i = 0; i < vout_count; ++i) {
+            if (!keep(8) || !keep_script()) return false; // nValue, scriptPubKey
+        }
+        if (flags) {
+            for (uint64_t i = 0; i < vin_count; ++i) {
+                uint64_t stack_size;
+                if (!skip_compact_size(stack_size)) return false;
+                for (uint64_t j = 0; j < stack_size; ++j) {
+                    uint64_t item_size;
+                    if (!skip_compact_size(item_size) || !skip(item_size)) return false;
+                }
+            }
+        }
+        if (!keep(4)) return false; // nLockTime
+    }
+    if (read_pos != size) return false;
+    block.resize(write_pos);
+    return true;
+}
+
+bool GetRecentBlockHeader(const CBlockIndex* pindex, CBlockHeader& header)
+{
+    AssertLockHeld(cs_main);
+    auto it = mapBlockIndexPoW.find(pindex);
+    if (it == mapBlockIndexPoW.end()) return false;
+    header = pindex->GetBlockHeader(it->second);
+    return true;
+}
+
+bool ReadBlockHeaders(const std::vector<const CBlockIndex*>& indexes, std::vector<CBlockHeader>& headers)
+{
+    headers.clear();
+    std::vector<BlockHeaderPoW> pows(indexes.size());
+    std::vector<bool> unwritten(indexes.size(), false);
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < indexes.size(); ++i) {
+            auto it = mapBlockIndexPoW.find(indexes[i]);
+            if (it == mapBlockIndexPoW.end()) continue;
+            pows[i] = it->second;
+            unwritten[i] = true;
+        }
+    }
+    // Entries leave mapBlockIndexPoW only after they were written, and the
+    // header fields of a written entry never change, so the rest can be read
+    // from the block tree DB without cs_main.
+    headers.reserve(indexes.size());
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        if (!unwritten[i]) {
+            CDiskBlockIndex diskindex;
+            if (!pblocktree || !pblocktree->ReadBlockIndex(indexes[i]->GetBlockHash(), diskindex)) {
+                return error("%s: block index entry for %s not found", __func__, indexes[i]->GetBlockHash().ToString());
+            }
+            pows[i] = diskindex.GetPoW();
+        }
+        headers.push_back(indexes[i]->GetBlockHeader(pows[i]));
+    }
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1540,6 +2001,25 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
         }
         txdata.Init(tx, std::move(spent_outputs));
     }
+
+    if (!VerifyInputScripts(tx, state, flags, cacheSigStore, txdata, pvChecks)) return false;
+
+    if (cacheFullScriptStore && !pvChecks) {
+        // We executed all of the provided scripts, and were told to
+        // cache the result. Do so now.
+        g_scriptExecutionCache.insert(hashCacheEntry);
+    }
+
+    return true;
+}
+
+/**
+ * The script checks of CheckInputScripts, without the script execution cache.
+ * They need only the spent outputs in txdata, so unlike CheckInputScripts
+ * this does not require cs_main.
+ */
+static bool VerifyInputScripts(const CTransaction& tx, TxValidationState& state, unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck>* pvChecks)
+{
     assert(txdata.m_spent_outputs.size() == tx.vin.size());
 
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
@@ -1583,38 +2063,26 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
         }
     }
 
-    if (cacheFullScriptStore && !pvChecks) {
-        // We executed all of the provided scripts, and were told to
-        // cache the result. Do so now.
-        g_scriptExecutionCache.insert(hashCacheEntry);
-    }
-
     return true;
 }
 
 static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Write index header
-    unsigned int nSize = GetSerializeSize(blockundo, fileout.GetVersion());
-    fileout << messageStart << nSize;
-
-    // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    // Serialize index header and undo data; the write itself happens in the background
+    std::vector<unsigned char> data;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, data, 0);
+    unsigned int nSize = GetSerializeSize(blockundo, CLIENT_VERSION);
+    writer << messageStart << nSize << blockundo;
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
     hasher << blockundo;
-    fileout << hasher.GetHash();
+    writer << hasher.GetHash();
+
+    if (!g_block_writer.Write(UndoFileSeq(), pos, std::move(data)))
+        return error("%s: queueing write failed", __func__);
+    pos.nPos += CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize);
 
     return true;
 }
@@ -1766,7 +2234,7 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
 static void FlushUndoFile(int block_file, bool finalize = false)
 {
     FlatFilePos undo_pos_old(block_file, vinfoBlockFile[block_file].nUndoSize);
-    if (!UndoFileSeq().Flush(undo_pos_old, finalize)) {
+    if (!g_block_writer.Flush(UndoFileSeq(), undo_pos_old, finalize)) {
         AbortNode("Flushing undo file to disk failed. This is likely the result of an I/O error.");
     }
 }
@@ -1775,7 +2243,7 @@ static void FlushBlockFile(bool fFinalize = false, bool finalize_undo = false)
 {
     LOCK(cs_LastBlockFile);
     FlatFilePos block_pos_old(nLastBlockFile, vinfoBlockFile[nLastBlockFile].nSize);
-    if (!BlockFileSeq().Flush(block_pos_old, fFinalize)) {
+    if (!g_block_writer.Flush(BlockFileSeq(), block_pos_old, fFinalize)) {
         AbortNode("Flushing block file to disk failed. This is likely the result of an I/O error.");
     }
     // we do not always flush the undo file, as the chain tip may be lagging behind the incoming blocks,
@@ -1819,6 +2287,23 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+/** Run checks on the script-checking threads and wait until all passed or one failed. */
+static bool RunScriptChecksParallel(std::vector<CScriptCheck>& checks)
+{
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(checks);
+    return control.Wait();
+}
+
+/** Verify the input scripts of tx on the script-checking threads and wait for the result. */
+static bool VerifyInputScriptsParallel(const CTransaction& tx, unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata)
+{
+    std::vector<CScriptCheck> checks;
+    TxValidationState state_dummy; // Nothing is checked yet when collecting checks
+    VerifyInputScripts(tx, state_dummy, flags, cacheSigStore, txdata, &checks);
+    return RunScriptChecksParallel(checks);
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2218,7 +2703,8 @@ bool CChainState::FlushStateToDisk(
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FlushStateMode::IF_NEEDED && cache_state >= CoinsCacheSizeState::CRITICAL;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
-        bool fPeriodicWrite = mode == FlushStateMode::PERIODIC && nNow > nLastWrite + DATABASE_WRITE_INTERVAL;
+        // Also write the block index once many entries changed, as new entries keep their proof-of-work fields in memory until then.
+        bool fPeriodicWrite = mode == FlushStateMode::PERIODIC && (nNow > nLastWrite + DATABASE_WRITE_INTERVAL || setDirtyBlockIndex.size() >= MAX_DIRTY_BLOCK_INDEX);
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
         bool fPeriodicFlush = mode == FlushStateMode::PERIODIC && nNow > nLastFlush + DATABASE_FLUSH_INTERVAL;
         // Combine all conditions that result in a full cache flush.
@@ -2234,6 +2720,9 @@ bool CChainState::FlushStateToDisk(
 
                 // First make sure all block and undo data is flushed to disk.
                 FlushBlockFile();
+                if (!g_block_writer.Sync()) {
+                    return AbortNode(state, "Failed to write block and undo data to disk");
+                }
             }
 
             // Then update all block file information (which may refer to block and undo files).
@@ -2246,15 +2735,42 @@ bool CChainState::FlushStateToDisk(
                     vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
                     setDirtyFileInfo.erase(it++);
                 }
-                std::vector<const CBlockIndex*> vBlocks;
+                std::vector<CDiskBlockIndex> vBlocks;
                 vBlocks.reserve(setDirtyBlockIndex.size());
                 for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                    vBlocks.push_back(*it);
+                    auto pow_it = mapBlockIndexPoW.find(*it);
+                    if (pow_it != mapBlockIndexPoW.end()) {
+                        vBlocks.emplace_back(*it, pow_it->second);
+                    } else {
+                        // Only old entries change after their fields were
+                        // dropped from memory, when their block files are
+                        // pruned or they are invalidated by hand.
+                        CDiskBlockIndex diskindex;
+                        if (!pblocktree->ReadBlockIndex((*it)->GetBlockHash(), diskindex)) {
+                            return AbortNode(state, "Failed to read from block index database");
+                        }
+                        vBlocks.emplace_back(*it, diskindex.GetPoW());
+                    }
                     setDirtyBlockIndex.erase(it++);
                 }
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Failed to write to block index database");
                 }
+                // Everything in memory is written now; keep the fields of
+                // entries with block data near a tip.
+                int keep_above = std::numeric_limits<int>::max();
+                for (CChainState* chainstate : g_chainman.GetAll()) {
+                    // A background chainstate is done once the snapshot is validated.
+                    if (chainstate != &g_chainman.ActiveChainstate() && g_chainman.IsSnapshotValidated()) continue;
+                    keep_above = std::min(keep_above, chainstate->m_chain.Height() - BLOCK_INDEX_POW_DEPTH);
+                }
+                for (auto it = mapBlockIndexPoW.begin(); it != mapBlockIndexPoW.end(); ) {
+                    if ((it->first->nStatus & BLOCK_HAVE_DATA) && it->first->nHeight > keep_above) {
+                        ++it;
+                    } else {
+                        it = mapBlockIndexPoW.erase(it);
+                    }
+                }
             }
             // Finally remove any pruned files
             if (fFlushForPrune) {
@@ -2536,11 +3052,18 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
     // Remove conflicting transactions from the mempool.;
-    m_mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
-    disconnectpool.removeForBlock(blockConnecting.vtx);
+    if (!m_background_target) {
+        m_mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
+        disconnectpool.removeForBlock(blockConnecting.vtx);
+    }
     // Update m_chain & related variables.
     m_chain.SetTip(pindexNew);
-    UpdateTip(m_mempool, pindexNew, chainparams);
+    if (m_background_target) {
+        LogPrint(BCLog::VALIDATION, "[snapshot] background validation tip=%s height=%d\n",
+            pindexNew->GetBlockHash().ToString(), pindexNew->nHeight);
+    } else {
+        UpdateTip(m_mempool, pindexNew, chainparams);
+    }
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
@@ -2705,7 +3228,8 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         // any disconnected transactions back to the mempool.
         UpdateMempoolForReorg(m_mempool, disconnectpool, true);
     }
-    m_mempool.check(&CoinsTip());
+    // The mempool follows the active chainstate, not a background one.
+    if (!m_background_target) m_mempool.check(&CoinsTip());
 
     // Callbacks/notifications for a new best chain.
     if (fInvalidFound)
@@ -2811,9 +3335,12 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
                 }
                 pindexNewTip = m_chain.Tip();
 
-                for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
-                    assert(trace.pblock && trace.pindex);
-                    GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                // Subscribers only follow the active chainstate.
+                if (!m_background_target) {
+                    for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
+                        assert(trace.pblock && trace.pindex);
+                        GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                    }
                 }
             } while (!m_chain.Tip() || (starting_tip && CBlockIndexWorkComparator()(m_chain.Tip(), starting_tip)));
             if (!blocks_connected) return true;
@@ -2823,7 +3350,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
             // Notify external listeners about the new tip.
             // Enqueue while holding cs_main to ensure that UpdatedBlockTip is called in the order in which blocks are connected
-            if (pindexFork != pindexNewTip) {
+            if (pindexFork != pindexNewTip && !m_background_target) {
                 // Notify ValidationInterface subscribers
                 GetMainSignals().UpdatedBlockTip(pindexNewTip, pindexFork, fInitialDownload);
 
@@ -3076,7 +3603,7 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = m_index_arena.Emplace(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3097,6 +3624,7 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         pindexBestHeader = pindexNew;
 
     setDirtyBlockIndex.insert(pindexNew);
+    mapBlockIndexPoW.emplace(pindexNew, BlockHeaderPoW(block));
 
     return pindexNew;
 }
@@ -3115,6 +3643,7 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
     }
     pindexNew->RaiseValidity(BLOCK_VALID_TRANSACTIONS);
     setDirtyBlockIndex.insert(pindexNew);
+    mapBlockIndexPoW.emplace(pindexNew, BlockHeaderPoW(block));
 
     if (pindexNew->pprev == nullptr || pindexNew->pprev->HaveTxsDownloaded()) {
         // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
@@ -3502,7 +4031,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3522,7 +4051,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus())) {
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW)) {
             LogPrint(BCLog::VALIDATION, "%s: Consensus::CheckBlockHeader: %s, %s\n", __func__, hash.ToString(), state.ToString());
             return false;
         }
@@ -3609,6 +4138,13 @@ bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>&
                 *ppindex = pindex;
             }
         }
+        // A headers-only sync never reaches the periodic flush after block
+        // connection, so write the block index here before the proof-of-work
+        // fields of new headers pile up in memory.
+        if (setDirtyBlockIndex.size() >= MAX_DIRTY_BLOCK_INDEX) {
+            BlockValidationState flush_state;
+            ::ChainstateActive().FlushStateToDisk(chainparams, flush_state, FlushStateMode::PERIODIC);
+        }
     }
     if (NotifyHeaderTip()) {
         if (::ChainstateActive().IsInitialBlockDownload() && ppindex && *ppindex) {
@@ -3648,7 +4184,8 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex);
+    // A block that passed CheckBlock already had its proof of work verified.
+    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex, /* fCheckPOW */ !block.fChecked);
     CheckBlockIndex(chainparams.GetConsensus());
 
     if (!accepted_header)
@@ -3744,6 +4281,9 @@ bool ChainstateManager::ProcessNewBlock(const CChainParams& chainparams, const s
             GetMainSignals().BlockChecked(*pblock, state);
             return error("%s: AcceptBlock FAILED (%s)", __func__, state.ToString());
         }
+        if (m_snapshot_chainstate && !m_snapshot_validated) {
+            AddBackgroundBlockCandidate(pindex);
+        }
     }
 
     NotifyHeaderTip();
@@ -3752,6 +4292,16 @@ bool ChainstateManager::ProcessNewBlock(const CChainParams& chainparams, const s
     if (!::ChainstateActive().ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed (%s)", __func__, state.ToString());
 
+    CChainState* background = WITH_LOCK(::cs_main,
+        return m_snapshot_chainstate && !m_snapshot_validated ? m_ibd_chainstate.get() : nullptr);
+    if (background) {
+        BlockValidationState background_state;
+        if (!background->ActivateBestChain(background_state, chainparams, pblock)) {
+            return error("%s: background ActivateBestChain failed (%s)", __func__, background_state.ToString());
+        }
+        MaybeCompleteSnapshotValidation();
+    }
+
     return true;
 }
 
@@ -3945,11 +4495,13 @@ static FlatFileSeq UndoFileSeq()
 }
 
 FILE* OpenBlockFile(const FlatFilePos &pos, bool fReadOnly) {
+    g_block_writer.WaitForFile(BlockFileSeq(), pos.nFile);
     return BlockFileSeq().Open(pos, fReadOnly);
 }
 
 /** Open an undo file (rev?????.dat) */
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly) {
+    g_block_writer.WaitForFile(UndoFileSeq(), pos.nFile);
     return UndoFileSeq().Open(pos, fReadOnly);
 }
 
@@ -3971,7 +4523,7 @@ CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = m_index_arena.Emplace();
     mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4037,11 +4589,8 @@ void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
-    }
-
     m_block_index.clear();
+    m_index_arena.Clear();
 }
 
 bool static LoadBlockIndexDB(ChainstateManager& chainman, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -4475,12 +5024,22 @@ void CChainState::UnloadBlockIndex() {
     setBlockIndexCandidates.clear();
 }
 
+void StopBlockFileWriter()
+{
+    if (!g_block_writer.Sync()) {
+        LogPrintf("%s: failed to write block and undo data to disk\n", __func__);
+    }
+    g_block_writer.Stop();
+}
+
 // May NOT be used after any connections are up as much
 // of the peer-processing logic assumes a consistent
 // block index state
 void UnloadBlockIndex(CTxMemPool* mempool, ChainstateManager& chainman)
 {
     LOCK(cs_main);
+    // Queued writes refer to the file info that is about to be discarded.
+    g_block_writer.Sync();
     chainman.Unload();
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
@@ -4489,6 +5048,7 @@ void UnloadBlockIndex(CTxMemPool* mempool, ChainstateManager& chainman)
     nLastBlockFile = 0;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
+    mapBlockIndexPoW.clear();
     versionbitscache.Clear();
     for (int b = 0; b < VERSIONBITS_NUM_BITS; b++) {
         warningcache[b].clear();
@@ -4519,7 +5079,7 @@ bool ChainstateManager::LoadBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
-bool CChainState::LoadGenesisBlock(const CChainParams& chainparams)
+bool CChainState::LoadGenesisBlock(const CChainParams& chainparams, const FlatFilePos* dbp)
 {
     LOCK(cs_main);
 
@@ -4532,7 +5092,7 @@ bool CChainState::LoadGenesisBlock(const CChainParams& chainparams)
 
     try {
         const CBlock& block = chainparams.GenesisBlock();
-        FlatFilePos blockPos = SaveBlockToDisk(block, 0, chainparams, nullptr);
+        FlatFilePos blockPos = SaveBlockToDisk(block, 0, chainparams, dbp);
         if (blockPos.IsNull())
             return error("%s: writing genesis block to disk failed", __func__);
         CBlockIndex *pindex = m_blockman.AddToBlockIndex(block);
@@ -4549,121 +5109,227 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return ::ChainstateActive().LoadGenesisBlock(chainparams);
 }
 
+namespace {
+//! Block records read ahead of the one being accepted during an import.
+static constexpr size_t BLOCK_IMPORT_QUEUE_DEPTH = 32;
+//! Upper bound on the threads deserializing and checking imported blocks.
+static constexpr int MAX_BLOCK_IMPORT_THREADS = 16;
+
+//! A block record found in a block file. The reader fills in the raw data,
+//! a check worker the block, and the acceptance stage consumes it in file order.
+struct ImportedBlock {
+    CDataStream data{SER_DISK, CLIENT_VERSION};
+    FlatFilePos pos;
+    std::shared_ptr<CBlock> block;
+    uint256 hash;
+    std::string error;
+    std::promise<void> checked;
+};
+using ImportedBlockRef = std::shared_ptr<ImportedBlock>;
+} // namespace
+
 void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+    // Map of disk positions for blocks with unknown parent (only used for reindex),
+    // along with the block hash if its proof of work was already verified.
+    static std::multimap<uint256, std::pair<FlatFilePos, uint256>> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+
+    // The file is processed in three stages. A reader thread scans it for
+    // block records, a pool of workers deserializes them and runs CheckBlock
+    // (which verifies the KawPoW proof of work at the height in the header,
+    // the dominant cost), and this thread accepts the checked blocks in file
+    // order. Every record enters `ordered` before `to_check`.
+    BoundedQueue<ImportedBlockRef> ordered(BLOCK_IMPORT_QUEUE_DEPTH);
+    BoundedQueue<ImportedBlockRef> to_check(BLOCK_IMPORT_QUEUE_DEPTH);
+    std::atomic<bool> stop{false};
+    std::string reader_error;
+
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+    std::thread reader([&] {
+        util::ThreadRename("loadblkread");
+        try {
+            uint64_t nRewind = blkdat.GetPos();
+            while (!blkdat.eof() && !stop) {
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> buf;
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                try {
+                    // read block
+                    ImportedBlockRef item = std::make_shared<ImportedBlock>();
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    if (dbp) {
+                        item->pos = *dbp;
+                        item->pos.nPos = nBlockPos;
+                    }
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    item->data.resize(nSize);
+                    blkdat.read(item->data.data(), nSize);
+                    nRewind = blkdat.GetPos();
+                    if (!ordered.Push(item) || !to_check.Push(std::move(item))) break;
+                } catch (const std::exception& e) {
+                    LogPrintf("LoadExternalBlockFile: I/O error - %s\n", e.what());
+                }
+            }
+        } catch (const std::runtime_error& e) {
+            reader_error = e.what();
+        }
+        ordered.Close();
+        to_check.Close();
+    });
+
+    std::vector<std::thread> workers;
+    const int worker_count = std::max(1, std::min(GetNumCores(), MAX_BLOCK_IMPORT_THREADS));
+    for (int t = 0; t < worker_count; ++t) {
+        workers.emplace_back([&, t] {
+            util::ThreadRename(strprintf("loadblkchk.%i", t));
+            ImportedBlockRef item;
+            while (to_check.Pop(item)) {
+                if (!stop) {
+                    try {
+                        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                        item->data >> *pblock;
+                        item->hash = pblock->GetHash();
+                        // Sets fChecked on success, so AcceptBlock skips
+                        // these checks, including the proof of work. A
+                        // failure is reported again when accepting.
+                        BlockValidationState state;
+                        CheckBlock(*pblock, state, consensusParams);
+                        item->block = std::move(pblock);
+                    } catch (const std::exception& e) {
+                        item->error = e.what();
+                    }
+                }
+                item->data = CDataStream(SER_DISK, CLIENT_VERSION); // release the raw block
+                item->checked.set_value();
+            }
+        });
+    }
 
     int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            if (ShutdownRequested()) return;
-
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+    ImportedBlockRef item;
+    while (ordered.Pop(item)) {
+        if (ShutdownRequested()) break;
+        item->checked.get_future().wait();
+        if (!item->block) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, item->error);
+            continue;
+        }
+        try {
+            std::shared_ptr<CBlock> pblock = std::move(item->block);
+            FlatFilePos* block_pos = dbp ? &item->pos : nullptr;
+            CBlock& block = *pblock;
+            const uint256 hash = item->hash;
+            {
+                LOCK(cs_main);
+                // detect out of order blocks, and store them for later
+                if (hash != consensusParams.hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
+                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                            block.hashPrevBlock.ToString());
+                    if (dbp)
+                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, std::make_pair(*block_pos, block.fChecked ? hash : uint256())));
                     continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
-                    }
+                }
 
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      BlockValidationState state;
-                      if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
+                // process in case the block isn't known yet
+                CBlockIndex* pindex = LookupBlockIndex(hash);
+                if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+                  BlockValidationState state;
+                  if (hash == consensusParams.hashGenesisBlock) {
+                      // The genesis block has no parent to check it against
+                      // contextually, so index it where it is stored instead.
+                      if (::ChainstateActive().LoadGenesisBlock(chainparams, block_pos)) {
                           nLoaded++;
                       }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                      LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
-                    }
+                  } else if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, block_pos, nullptr)) {
+                      nLoaded++;
+                  }
+                  if (state.IsError()) {
+                      break;
+                  }
+                } else if (hash != consensusParams.hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+                  LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
                 }
+            }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    BlockValidationState state;
-                    if (!ActivateBestChain(state, chainparams, nullptr)) {
-                        break;
-                    }
+            // Activate the genesis block so normal node progress can continue
+            if (hash == consensusParams.hashGenesisBlock) {
+                BlockValidationState state;
+                if (!ActivateBestChain(state, chainparams, nullptr)) {
+                    break;
                 }
+            }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            BlockValidationState dummy;
-                            if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
+            NotifyHeaderTip();
+
+            // Recursively process earlier encountered successors of this block
+            std::deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                auto range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    auto it = range.first;
+                    std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                    if (ReadBlockFromDisk(*pblockrecursive, it->second.first, consensusParams))
+                    {
+                        const uint256 hash_recursive = pblockrecursive->GetHash();
+                        LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, hash_recursive.ToString(),
+                                head.ToString());
+                        // The proof of work of this header was verified when
+                        // it was first read, so only check the rest again.
+                        if (!it->second.second.IsNull() && hash_recursive == it->second.second) {
+                            BlockValidationState check_state;
+                            if (CheckBlock(*pblockrecursive, check_state, consensusParams, /* fCheckPOW */ false)) {
+                                pblockrecursive->fChecked = true;
                             }
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
+                        LOCK(cs_main);
+                        BlockValidationState dummy;
+                        if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second.first, nullptr))
+                        {
+                            nLoaded++;
+                            queue.push_back(hash_recursive);
+                        }
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
+                    NotifyHeaderTip();
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
+    }
+
+    stop = true;
+    ordered.Close();
+    to_check.Close();
+    reader.join();
+    for (auto& worker : workers) worker.join();
+
+    if (!reader_error.empty()) {
+        AbortNode(std::string("System error: ") + reader_error);
     }
     LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
 }
@@ -4684,6 +5350,12 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         return;
     }
 
+    // Chainstates involved in a UTXO snapshot have block index entries below the
+    // snapshot base without block data, which the checks below do not allow for.
+    if (!m_from_snapshot_blockhash.IsNull() || m_background_target) {
+        return;
+    }
+
     // Build forward-pointing map of the entire block tree.
     std::multimap<CBlockIndex*,CBlockIndex*> forward;
     for (const std::pair<const uint256, CBlockIndex*>& entry : m_blockman.m_block_index) {
@@ -4923,7 +5595,12 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(::ChainActive().Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_TIP = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+//! Number of transactions re-validated together when the mempool is restored
+//! on the chain tip it was dumped at.
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
 
 bool LoadMempool(CTxMemPool& pool)
 {
@@ -4942,13 +5619,24 @@ bool LoadMempool(CTxMemPool& pool)
     int64_t already_there = 0;
     int64_t unbroadcast = 0;
     int64_t nNow = GetTime();
+    bool same_tip = false;
 
+    // Mempool state is only restored once all the transactions are read, so
+    // that they can be checked in batches when the chain tip is unchanged.
+    std::vector<CTransactionRef> txs;
+    std::vector<int64_t> times;
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_TIP) {
             return false;
         }
+        if (version == MEMPOOL_DUMP_VERSION) {
+            uint256 tip_hash;
+            file >> tip_hash;
+            LOCK(cs_main);
+            same_tip = ::ChainActive().Tip() != nullptr && ::ChainActive().Tip()->GetBlockHash() == tip_hash;
+        }
         uint64_t num;
         file >> num;
         while (num--) {
@@ -4963,31 +5651,64 @@ bool LoadMempool(CTxMemPool& pool)
             if (amountdelta) {
                 pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
-            TxValidationState state;
             if (nTime > nNow - nExpiryTimeout) {
+                txs.push_back(std::move(tx));
+                times.push_back(nTime);
+            } else {
+                ++expired;
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    // mempool may contain a transaction already, e.g. from wallet(s) having
+    // loaded it while we were processing mempool transactions; consider these
+    // as valid, instead of failed, but mark them as 'already there'
+    const auto count_result = [&](const CTransaction& tx, bool accepted) {
+        if (accepted) {
+            ++count;
+        } else if (pool.exists(tx.GetHash())) {
+            ++already_there;
+        } else {
+            ++failed;
+        }
+    };
+
+    if (same_tip) {
+        // The transactions were valid on this chain tip when they were
+        // dumped, so nearly all of them will be accepted again: verify their
+        // scripts in parallel and add them a batch at a time, without
+        // repeating the policy checks. The dump lists parents before
+        // children, so each batch only depends on earlier ones.
+        for (size_t begin = 0; begin < txs.size(); begin += MEMPOOL_LOAD_BATCH_SIZE) {
+            const size_t end = std::min(txs.size(), begin + MEMPOOL_LOAD_BATCH_SIZE);
+            const std::vector<CTransactionRef> batch(txs.begin() + begin, txs.begin() + end);
+            const std::vector<int64_t> batch_times(times.begin() + begin, times.begin() + end);
+            std::vector<TxValidationState> states;
+            const std::vector<bool> accepted = AcceptToMemoryPoolBatch(pool, batch, states, nullptr /* plTxnReplaced */,
+                                                                       nullptr /* max_fees */, &batch_times);
+            for (size_t i = 0; i < batch.size(); ++i) count_result(*batch[i], accepted[i]);
+            if (ShutdownRequested())
+                return false;
+        }
+    } else {
+        for (size_t i = 0; i < txs.size(); ++i) {
+            TxValidationState state;
+            {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
+                AcceptToMemoryPoolWithTime(chainparams, pool, state, txs[i], times[i],
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */,
                                            false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
-                }
-            } else {
-                ++expired;
             }
+            count_result(*txs[i], state.IsValid());
             if (ShutdownRequested())
                 return false;
         }
+    }
+
+    try {
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
 
@@ -5014,7 +5735,8 @@ bool LoadMempool(CTxMemPool& pool)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there, %i waiting for initial broadcast\n", count, failed, expired, already_there, unbroadcast);
+    LogPrintf("Imported mempool transactions from disk%s: %i succeeded, %i failed, %i expired, %i already there, %i waiting for initial broadcast\n",
+              same_tip ? " on the same chain tip" : "", count, failed, expired, already_there, unbroadcast);
     return true;
 }
 
@@ -5025,12 +5747,15 @@ bool DumpMempool(const CTxMemPool& pool)
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
     std::set<uint256> unbroadcast_txids;
+    uint256 tip_hash;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
     {
-        LOCK(pool.cs);
+        // The mempool is consistent with the chain tip while both locks are held.
+        LOCK2(cs_main, pool.cs);
+        if (::ChainActive().Tip() != nullptr) tip_hash = ::ChainActive().Tip()->GetBlockHash();
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
@@ -5050,6 +5775,7 @@ bool DumpMempool(const CTxMemPool& pool)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << tip_hash;
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
@@ -5141,6 +5867,435 @@ CChainState& ChainstateManager::InitializeChainstate(CTxMemPool& mempool, const
     return *to_modify;
 }
 
+bool ChainstateManager::ActivateSnapshot(
+    CAutoFile& coins_file, const SnapshotMetadata& metadata, CTxMemPool& mempool, bool in_memory)
+{
+    int base_height;
+    {
+        LOCK(::cs_main);
+        BlockMap::const_iterator it = m_blockman.m_block_index.find(metadata.m_base_blockhash);
+        if (it == m_blockman.m_block_index.end()) {
+            LogPrintf("[snapshot] Did not find snapshot start blockheader %s\n",
+                metadata.m_base_blockhash.ToString());
+            return false;
+        }
+        base_height = it->second->nHeight;
+    }
+
+    const AssumeutxoData* au_data = ExpectedAssumeutxo(base_height, ::Params());
+    if (!au_data) {
+        LogPrintf("[snapshot] assumeutxo height in snapshot metadata not recognized " /* Continued */
+                  "(%d) - refusing to load snapshot\n", base_height);
+        return false;
+    }
+    return ActivateSnapshot(coins_file, metadata, *au_data, mempool, in_memory);
+}
+
+bool ChainstateManager::ActivateSnapshot(
+    CAutoFile& coins_file, const SnapshotMetadata& metadata, const AssumeutxoData& au_data,
+    CTxMemPool& mempool, bool in_memory)
+{
+    const uint256& base_blockhash = metadata.m_base_blockhash;
+
+    // Cache percentages to allocate to each chainstate while loading.
+    static constexpr double IBD_CACHE_PERC = 0.01;
+    static constexpr double SNAPSHOT_CACHE_PERC = 0.99;
+
+    int64_t current_coinsdb_cache_size{0};
+    int64_t current_coinstip_cache_size{0};
+    {
+        LOCK(::cs_main);
+        if (m_snapshot_chainstate) {
+            LogPrintf("[snapshot] can't activate a snapshot-based chainstate more than once\n");
+            return false;
+        }
+        BlockMap::const_iterator it = m_blockman.m_block_index.find(base_blockhash);
+        if (it == m_blockman.m_block_index.end()) {
+            LogPrintf("[snapshot] Did not find snapshot start blockheader %s\n", base_blockhash.ToString());
+            return false;
+        }
+        if (ActiveHeight() > it->second->nHeight) {
+            LogPrintf("[snapshot] active chain is already past snapshot base height %d - refusing to load snapshot\n",
+                it->second->nHeight);
+            return false;
+        }
+
+        // Shrink the IBD chainstate's caches so the snapshot load has room.
+        current_coinsdb_cache_size = ActiveChainstate().m_coinsdb_cache_size_bytes;
+        current_coinstip_cache_size = ActiveChainstate().m_coinstip_cache_size_bytes;
+        ActiveChainstate().ResizeCoinsCaches(
+            static_cast<size_t>(current_coinstip_cache_size * IBD_CACHE_PERC),
+            static_cast<size_t>(current_coinsdb_cache_size * IBD_CACHE_PERC));
+    }
+
+    auto snapshot_chainstate = MakeUnique<CChainState>(mempool, m_blockman, base_blockhash);
+    {
+        LOCK(::cs_main);
+        snapshot_chainstate->InitCoinsDB(
+            static_cast<size_t>(current_coinsdb_cache_size * SNAPSHOT_CACHE_PERC),
+            in_memory, /* should_wipe */ true, "chainstate");
+        snapshot_chainstate->InitCoinsCache(
+            static_cast<size_t>(current_coinstip_cache_size * SNAPSHOT_CACHE_PERC));
+    }
+
+    const bool snapshot_ok = PopulateAndValidateSnapshot(*snapshot_chainstate, coins_file, metadata, au_data);
+    if (!snapshot_ok) {
+        WITH_LOCK(::cs_main, MaybeRebalanceCaches());
+        return false;
+    }
+
+    {
+        LOCK2(::cs_main, mempool.cs);
+        assert(!m_snapshot_chainstate);
+        m_snapshot_chainstate.swap(snapshot_chainstate);
+        const bool chaintip_loaded = m_snapshot_chainstate->LoadChainTip(::Params());
+        assert(chaintip_loaded);
+
+        // The IBD chainstate now validates history up to the snapshot base in
+        // the background; the snapshot chainstate serves the tip.
+        CBlockIndex* target = m_snapshot_chainstate->m_chain.Tip();
+        m_ibd_chainstate->m_background_target = target;
+        auto& background_candidates = m_ibd_chainstate->setBlockIndexCandidates;
+        for (auto it = background_candidates.begin(); it != background_candidates.end();) {
+            if (target->GetAncestor((*it)->nHeight) != *it) {
+                it = background_candidates.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        m_snapshot_utxo_hash = au_data.hash_serialized;
+        m_active_chainstate = m_snapshot_chainstate.get();
+
+        // Mempool entries were validated against the old tip.
+        mempool.clear();
+
+        LogPrintf("[snapshot] successfully activated snapshot %s\n", base_blockhash.ToString());
+        LogPrintf("[snapshot] (%.2f MB)\n",
+            m_snapshot_chainstate->CoinsTip().DynamicMemoryUsage() / (1000 * 1000));
+
+        // Offer any blocks already on disk past the background tip.
+        const CBlockIndex* background_tip = m_ibd_chainstate->m_chain.Tip();
+        const int next_height = background_tip ? background_tip->nHeight + 1 : 0;
+        if (next_height <= target->nHeight) {
+            AddBackgroundBlockCandidate(target->GetAncestor(next_height));
+        }
+
+        MaybeRebalanceCaches();
+    }
+    return true;
+}
+
+namespace {
+//! Number of coins handed between the snapshot loading stages at a time.
+static constexpr size_t SNAPSHOT_LOAD_BATCH_SIZE = 10000;
+//! Batches buffered in front of each stage before the parser waits for it.
+static constexpr size_t SNAPSHOT_LOAD_QUEUE_DEPTH = 16;
+
+using SnapshotCoinBatchRef = std::shared_ptr<const SnapshotCoinBatch>;
+} // namespace
+
+bool ChainstateManager::PopulateAndValidateSnapshot(
+    CChainState& snapshot_chainstate,
+    CAutoFile& coins_file,
+    const SnapshotMetadata& metadata,
+    const AssumeutxoData& au_data)
+{
+    // It's okay to release cs_main before we're done using `coins_cache` because we know
+    // that nothing else will be referencing the newly created snapshot_chainstate yet.
+    CCoinsViewCache& coins_cache = *WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsTip());
+
+    const uint256& base_blockhash = metadata.m_base_blockhash;
+    CBlockIndex* snapshot_start_block;
+    {
+        LOCK(::cs_main);
+        BlockMap::const_iterator it = m_blockman.m_block_index.find(base_blockhash);
+        snapshot_start_block = it == m_blockman.m_block_index.end() ? nullptr : it->second;
+    }
+    if (!snapshot_start_block) {
+        LogPrintf("[snapshot] Did not find snapshot start blockheader %s\n", base_blockhash.ToString());
+        return false;
+    }
+    const int base_height = snapshot_start_block->nHeight;
+    const uint64_t coins_count = metadata.m_coins_count;
+
+    LogPrintf("[snapshot] loading %d coins from snapshot %s\n", coins_count, base_blockhash.ToString());
+    const int64_t load_start = GetTimeMillis();
+
+    // The file is parsed on this thread. Parsed batches are handed to two
+    // consumers that run concurrently: one inserts them into the snapshot
+    // coins cache, the other folds them into the UTXO set hash. A consumer
+    // that fails keeps draining its queue so the parser never blocks.
+    BoundedQueue<SnapshotCoinBatchRef> insert_queue(SNAPSHOT_LOAD_QUEUE_DEPTH);
+    BoundedQueue<SnapshotCoinBatchRef> hash_queue(SNAPSHOT_LOAD_QUEUE_DEPTH);
+    std::atomic<bool> insert_failed{false};
+    std::atomic<bool> hash_failed{false};
+
+    std::thread inserter([&] {
+        util::ThreadRename("snapshotload");
+        SnapshotCoinBatchRef batch;
+        uint64_t coins_inserted{0};
+        while (insert_queue.Pop(batch)) {
+            if (insert_failed) continue;
+            try {
+                for (const auto& entry : *batch) {
+                    COutPoint outpoint{entry.first};
+                    Coin coin{entry.second};
+                    coins_cache.EmplaceCoinInternalDANGER(std::move(outpoint), std::move(coin));
+                }
+                coins_inserted += batch->size();
+
+                const auto snapshot_cache_state = WITH_LOCK(::cs_main,
+                    return snapshot_chainstate.GetCoinsCacheSizeState(nullptr));
+                if (snapshot_cache_state >= CoinsCacheSizeState::CRITICAL) {
+                    LogPrintf("[snapshot] flushing coins cache (%.2f MB) after %d coins\n",
+                        coins_cache.DynamicMemoryUsage() / (1000 * 1000), coins_inserted);
+                    // We don't know the actual best block yet, but that doesn't
+                    // matter for flushing; it is set to base_blockhash once all
+                    // coins are loaded.
+                    coins_cache.SetBestBlock(GetRandHash());
+                    if (!coins_cache.Flush()) insert_failed = true;
+                }
+            } catch (const std::exception& e) {
+                LogPrintf("[snapshot] failed to insert coins: %s\n", e.what());
+                insert_failed = true;
+            }
+        }
+    });
+
+    CoinStatsHasher hasher(base_blockhash);
+    std::thread hashing([&] {
+        util::ThreadRename("snapshothash");
+        SnapshotCoinBatchRef batch;
+        while (hash_queue.Pop(batch)) {
+            if (hash_failed) continue;
+            for (const auto& entry : *batch) {
+                if (!hasher.Add(entry.first, entry.second)) {
+                    LogPrintf("[snapshot] bad snapshot - coin %s out of order or duplicated\n",
+                        entry.first.ToString());
+                    hash_failed = true;
+                    break;
+                }
+            }
+        }
+    });
+
+    uint64_t coins_left = coins_count;
+    auto coin_ok = [&](const COutPoint& outpoint, const Coin& coin) {
+        if (coin.nHeight > uint32_t(base_height) ||
+            outpoint.n >= std::numeric_limits<decltype(outpoint.n)>::max() || // Avoid integer wrap-around in coinstats.cpp:ApplyStats
+            !MoneyRange(coin.out.nValue)) {
+            LogPrintf("[snapshot] bad snapshot data after deserializing %d coins\n",
+                      coins_count - coins_left);
+            return false;
+        }
+        return true;
+    };
+    // Hand a parsed batch to both consumers. Returns false if loading should stop.
+    auto dispatch = [&](SnapshotCoinBatchRef ready) {
+        hash_queue.Push(ready);
+        insert_queue.Push(std::move(ready));
+
+        const uint64_t coins_processed = coins_count - coins_left;
+        if (coins_processed % 1000000 < SNAPSHOT_LOAD_BATCH_SIZE) {
+            LogPrintf("[snapshot] %d coins loaded (%.2f%%)\n",
+                coins_processed, static_cast<float>(coins_processed) * 100 / static_cast<float>(coins_count));
+        }
+        return !ShutdownRequested() && !insert_failed && !hash_failed;
+    };
+
+    bool parse_ok = true;
+    if (metadata.m_version >= 2) {
+        // Chunks are verified and decoded in parallel, then dispatched in file order.
+        parse_ok = ReadSnapshotChunks(coins_file, [&](SnapshotCoinBatch&& coins) {
+            if (coins.size() > coins_left) {
+                LogPrintf("[snapshot] bad snapshot - more coins than the %d in its metadata\n", coins_count);
+                return false;
+            }
+            for (const auto& entry : coins) {
+                if (!coin_ok(entry.first, entry.second)) return false;
+            }
+            coins_left -= coins.size();
+            return dispatch(std::make_shared<const SnapshotCoinBatch>(std::move(coins)));
+        });
+        if (parse_ok && coins_left != 0) {
+            LogPrintf("[snapshot] bad snapshot - expected %d coins but found %d\n",
+                coins_count, coins_count - coins_left);
+            parse_ok = false;
+        } else if (!parse_ok && !insert_failed && !hash_failed) {
+            LogPrintf("[snapshot] bad snapshot format, checksum or truncated snapshot after deserializing %d coins\n",
+                coins_count - coins_left);
+        }
+    } else {
+        auto batch = std::make_shared<SnapshotCoinBatch>();
+        batch->reserve(SNAPSHOT_LOAD_BATCH_SIZE);
+        while (coins_left > 0) {
+            COutPoint outpoint;
+            Coin coin;
+            try {
+                coins_file >> outpoint;
+                coins_file >> coin;
+            } catch (const std::ios_base::failure&) {
+                LogPrintf("[snapshot] bad snapshot format or truncated snapshot after deserializing %d coins\n",
+                          coins_count - coins_left);
+                parse_ok = false;
+                break;
+            }
+            if (!coin_ok(outpoint, coin)) {
+                parse_ok = false;
+                break;
+            }
+            batch->emplace_back(std::move(outpoint), std::move(coin));
+            --coins_left;
+
+            if (batch->size() == SNAPSHOT_LOAD_BATCH_SIZE || coins_left == 0) {
+                SnapshotCoinBatchRef ready = std::move(batch);
+                batch = std::make_shared<SnapshotCoinBatch>();
+                batch->reserve(SNAPSHOT_LOAD_BATCH_SIZE);
+                if (!dispatch(std::move(ready))) {
+                    parse_ok = false;
+                    break;
+                }
+            }
+        }
+    }
+    hash_queue.Close();
+    insert_queue.Close();
+    hashing.join();
+    inserter.join();
+
+    if (!parse_ok || insert_failed || hash_failed) {
+        return false;
+    }
+
+    if (metadata.m_version < 2) {
+        bool out_of_coins{false};
+        try {
+            COutPoint outpoint;
+            coins_file >> outpoint;
+        } catch (const std::ios_base::failure&) {
+            // We expect an exception since we should be out of coins.
+            out_of_coins = true;
+        }
+        if (!out_of_coins) {
+            LogPrintf("[snapshot] bad snapshot - coins left over after deserializing %d coins\n",
+                coins_count);
+            return false;
+        }
+    }
+
+    CCoinsStats stats;
+    hasher.Finalize(stats);
+    if (stats.hashSerialized != au_data.hash_serialized) {
+        LogPrintf("[snapshot] bad snapshot content hash: expected %s, got %s\n",
+            au_data.hash_serialized.ToString(), stats.hashSerialized.ToString());
+        return false;
+    }
+
+    // Important that we set this. This and the coins_cache accesses above are
+    // sort of a layer violation, but either we reach into the innards of
+    // CCoinsViewCache here or we have to invert some of the CChainState to
+    // embed them in a snapshot-activation-specific CCoinsViewCache bulk load
+    // method.
+    coins_cache.SetBestBlock(base_blockhash);
+
+    LogPrintf("[snapshot] loaded %d (%.2f MB) coins from snapshot %s in %dms\n",
+        coins_count, coins_cache.DynamicMemoryUsage() / (1000 * 1000),
+        base_blockhash.ToString(), GetTimeMillis() - load_start);
+
+    LogPrintf("[snapshot] flushing snapshot chainstate to disk\n");
+    // No need to acquire cs_main since this chainstate isn't being used yet.
+    if (!coins_cache.Flush()) {
+        LogPrintf("[snapshot] failed to flush snapshot chainstate\n");
+        return false;
+    }
+    assert(coins_cache.GetBestBlock() == base_blockhash);
+
+    // The remainder of this function requires modifying data protected by cs_main.
+    LOCK(::cs_main);
+
+    snapshot_chainstate.m_chain.SetTip(snapshot_start_block);
+
+    // Fake nChainTx for blocks we don't have the data for, so that they count
+    // as connectable and so that progress is reported sensibly. nChainTx is
+    // not persisted, so nothing bogus is written to the block tree DB.
+    for (int i = 0; i <= snapshot_chainstate.m_chain.Height(); ++i) {
+        CBlockIndex* index = snapshot_chainstate.m_chain[i];
+        if (!index->HaveTxsDownloaded()) {
+            index->nChainTx = (index->pprev ? index->pprev->nChainTx : 0) + std::max(index->nTx, 1u);
+        }
+    }
+    if (!(snapshot_start_block->nStatus & BLOCK_HAVE_DATA)) {
+        snapshot_start_block->nChainTx = au_data.nChainTx;
+    }
+    snapshot_chainstate.setBlockIndexCandidates.insert(snapshot_start_block);
+
+    LogPrintf("[snapshot] validated snapshot (%.2f MB)\n",
+        coins_cache.DynamicMemoryUsage() / (1000 * 1000));
+    return true;
+}
+
+void ChainstateManager::AddBackgroundBlockCandidate(CBlockIndex* pindex)
+{
+    AssertLockHeld(::cs_main);
+    if (!pindex || !m_ibd_chainstate) return;
+    CChainState& background = *m_ibd_chainstate;
+    CBlockIndex* target = background.m_background_target;
+    if (!target || !(pindex->nStatus & BLOCK_HAVE_DATA)) return;
+    if (target->GetAncestor(pindex->nHeight) != pindex) return;
+    const CBlockIndex* tip = background.m_chain.Tip();
+    if (tip && pindex->nHeight <= tip->nHeight) return;
+
+    // The background chainstate can only connect blocks whose whole path from
+    // its tip is on disk, so offer the furthest such block.
+    for (const CBlockIndex* walk = pindex->pprev; walk && walk != tip; walk = walk->pprev) {
+        if (!(walk->nStatus & BLOCK_HAVE_DATA)) return;
+    }
+    CBlockIndex* candidate = pindex;
+    while (candidate != target) {
+        CBlockIndex* next = target->GetAncestor(candidate->nHeight + 1);
+        if (!(next->nStatus & BLOCK_HAVE_DATA)) break;
+        candidate = next;
+    }
+    background.setBlockIndexCandidates.insert(candidate);
+}
+
+void ChainstateManager::MaybeCompleteSnapshotValidation()
+{
+    CCoinsViewDB* background_coinsdb;
+    uint256 expected_hash;
+    {
+        LOCK(::cs_main);
+        if (!m_snapshot_chainstate || m_snapshot_validated) return;
+        CChainState& background = *m_ibd_chainstate;
+        if (!background.m_chain.Tip() || background.m_chain.Tip() != background.m_background_target) return;
+        background.ForceFlushStateToDisk();
+        background_coinsdb = &background.CoinsDB();
+        expected_hash = m_snapshot_utxo_hash;
+    }
+
+    // Leveldb cursors iterate over a snapshot, and the background chainstate
+    // does not advance past its target, so the hash can be computed unlocked.
+    CCoinsStats stats;
+    if (!GetUTXOStats(background_coinsdb, stats, CoinStatsHashType::HASH_SERIALIZED, [] {})) {
+        LogPrintf("[snapshot] failed to generate coins stats for background chainstate\n");
+        return;
+    }
+
+    LOCK(::cs_main);
+    if (m_snapshot_validated) return;
+    if (stats.hashSerialized != expected_hash) {
+        AbortNode(strprintf("[snapshot] background validation of snapshot %s produced UTXO set hash %s, expected %s",
+            m_snapshot_chainstate->m_from_snapshot_blockhash.ToString(),
+            stats.hashSerialized.ToString(), expected_hash.ToString()),
+            _("The loaded UTXO snapshot does not match the validated chain. Restart the node to discard it."));
+        return;
+    }
+    m_snapshot_validated = true;
+    LogPrintf("[snapshot] snapshot beginning at %s has been fully validated\n",
+        m_snapshot_chainstate->m_from_snapshot_blockhash.ToString());
+    MaybeRebalanceCaches();
+}
+
 CChainState& ChainstateManager::ActiveChainstate() const
 {
     assert(m_active_chainstate);
@@ -5191,7 +6346,7 @@ void ChainstateManager::MaybeRebalanceCaches()
         // Allocate everything to the IBD chainstate.
         m_ibd_chainstate->ResizeCoinsCaches(m_total_coinstip_cache, m_total_coinsdb_cache);
     }
-    else if (m_snapshot_chainstate && !m_ibd_chainstate) {
+    else if (m_snapshot_chainstate && (!m_ibd_chainstate || m_snapshot_validated)) {
         LogPrintf("[snapshot] allocating all cache to the snapshot chainstate\n");
         // Allocate everything to the snapshot chainstate.
         m_snapshot_chainstate->ResizeCoinsCaches(m_total_coinstip_cache, m_total_coinsdb_cache);
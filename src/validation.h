@@ -12,8 +12,9 @@
 #endif
 
 #include <amount.h>
+#include <blockmap.h>
+#include <chain.h>
 #include <coins.h>
-#include <crypto/common.h> // for ReadLE64
 #include <fs.h>
 #include <optional.h>
 #include <policy/feerate.h>
@@ -35,6 +36,7 @@
 #include <vector>
 
 class CChainState;
+class CAutoFile;
 class BlockValidationState;
 class CBlockIndex;
 class CBlockTreeDB;
@@ -47,6 +49,8 @@ class CBlockPolicyEstimator;
 class CTxMemPool;
 class ChainstateManager;
 class TxValidationState;
+class SnapshotMetadata;
+struct AssumeutxoData;
 struct ChainTxData;
 
 struct DisconnectedBlockTransactions;
@@ -63,14 +67,22 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Default for -limitclustercount, max number of transactions in a cluster of connected in-mempool transactions (0 = no limit) */
+static const unsigned int DEFAULT_CLUSTER_LIMIT = 0;
+/** Default for -limitclustersize, maximum kilobytes of a cluster of connected in-mempool transactions (0 = no limit) */
+static const unsigned int DEFAULT_CLUSTER_SIZE_LIMIT = 0;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
+/** The maximum amount of block and undo data waiting to be written in the background */
+static const unsigned int MAX_BLOCK_WRITE_BUFFER = 0x4000000; // 64 MiB
 /** Maximum number of dedicated script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -parmempoolinputs, the input count from which mempool script checks use the script-checking threads */
+static const unsigned int DEFAULT_MEMPOOL_PARALLEL_SCRIPT_INPUTS = 16;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
@@ -95,14 +107,6 @@ static const unsigned int DEFAULT_CHECKLEVEL = 3;
 // Setting the target to >= 550 MiB will make it likely we can respect the target.
 static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 
-struct BlockHasher
-{
-    // this used to call `GetCheapHash()` in uint256, which was later moved; the
-    // cheap hash function simply calls ReadLE64() however, so the end result is
-    // identical
-    size_t operator()(const uint256& hash) const { return ReadLE64(hash.begin()); }
-};
-
 /** Current sync state passed to tip changed callbacks. */
 enum class SynchronizationState {
     INIT_REINDEX,
@@ -112,7 +116,6 @@ enum class SynchronizationState {
 
 extern RecursiveMutex cs_main;
 extern CBlockPolicyEstimator feeEstimator;
-typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern Mutex g_best_block_mutex;
 extern std::condition_variable g_best_block_cv;
 extern uint256 g_best_block;
@@ -122,6 +125,10 @@ extern std::atomic_bool fReindex;
  * False indicates all script checking is done on the main threadMessageHandler thread.
  */
 extern bool g_parallel_script_checks;
+/** Mempool acceptance verifies the scripts of transactions with at least this
+ * many inputs on the script-checking threads (0 = never).
+ */
+extern unsigned int g_mempool_parallel_script_inputs;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -159,6 +166,8 @@ void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex(CTxMemPool* mempool, ChainstateManager& chainman);
+/** Wait for queued block and undo writes to reach disk and join the writer thread */
+void StopBlockFileWriter();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
 /**
@@ -204,6 +213,35 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, bool test_accept=false, CAmount* fee_out=nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** (try to) add a batch of transactions to memory pool
+ * The cheap policy checks run under cs_main, then the script checks of all
+ * transactions run on the script-checking threads, and finally each
+ * transaction is added under cs_main again. Their results are kept unless the
+ * tip or the mempool changed in between, other than by additions from the
+ * batch; then each transaction is checked against the current mempool again.
+ * Callers that do not hold cs_main let it go during the script checks.
+ * Transactions are checked and added parents before children. Those that
+ * conflict with another transaction in the batch, and their descendants, are
+ * accepted one at a time afterwards.
+ * @param[out] states validation state of each transaction, in the order of txs
+ * @param[in] max_fees optional maximum fee of each transaction (0 for no limit)
+ * @param[in] accept_times optional acceptance time of each transaction (default: now)
+ * @returns whether each transaction was accepted **/
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs,
+                                          std::vector<TxValidationState>& states, std::list<CTransactionRef>* plTxnReplaced,
+                                          const std::vector<CAmount>* max_fees = nullptr,
+                                          const std::vector<int64_t>* accept_times = nullptr);
+
+/** test whether a package of transactions would be accepted to memory pool
+ * Transactions are evaluated parents first, each as if the earlier ones that
+ * passed had been added. Package limits only count in-mempool ancestors.
+ * @param[out] states validation state of each transaction, in the order of txs
+ * @param[out] fees fee of each transaction that passed
+ * @param[in] max_fees optional maximum fee of each transaction (0 for no limit)
+ * @returns whether each transaction would be accepted **/
+std::vector<bool> TestPackageAcceptance(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, std::vector<TxValidationState>& states,
+                                        std::vector<CAmount>& fees, const std::vector<CAmount>* max_fees = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -241,10 +279,12 @@ bool TestLockPointValidity(const LockPoints* lp) EXCLUSIVE_LOCKS_REQUIRED(cs_mai
  * of the block needed for calculation or skips the calculation and uses the LockPoints
  * passed in for evaluation.
  * The LockPoints should not be considered valid if CheckSequenceLocks returns false.
+ * The inputs are looked up in coins_view if given, otherwise in the mempool and
+ * the UTXO set.
  *
  * See consensus/consensus.h for flag definitions.
  */
-bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, pool.cs);
+bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false, const CCoinsView* coins_view = nullptr) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, pool.cs);
 
 /**
  * Closure representing one script verification
@@ -290,6 +330,27 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/**
+ * Turn a block read by ReadRawBlockFromDisk, which is stored in witness
+ * serialization, into its SERIALIZE_TRANSACTION_NO_WITNESS serialization in
+ * place, without deserializing any transactions.
+ * @returns false if the data is not a well-formed block; it is then left in an unspecified state.
+ */
+bool StripRawBlockWitness(std::vector<uint8_t>& block);
+
+/**
+ * Rebuild the full header of an indexed block from the KawPoW fields kept in
+ * memory, which CBlockIndex leaves out. Those are kept for entries not written
+ * yet and for recent blocks near the tip; returns false for any other entry,
+ * without reading the block tree DB.
+ */
+bool GetRecentBlockHeader(const CBlockIndex* pindex, CBlockHeader& header) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/**
+ * Rebuild the headers of a run of indexed blocks, reading the fields not kept
+ * in memory from the block tree DB without holding cs_main. Stops at the first
+ * entry that cannot be read and returns false in that case.
+ */
+bool ReadBlockHeaders(const std::vector<const CBlockIndex*>& indexes, std::vector<CBlockHeader>& headers) LOCKS_EXCLUDED(cs_main);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
@@ -374,6 +435,9 @@ private:
      */
     void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight, int chain_tip_height, bool is_ibd);
 
+    /** Storage for the CBlockIndex entries owned by m_block_index. */
+    ChunkArena<CBlockIndex> m_index_arena GUARDED_BY(cs_main);
+
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
@@ -430,12 +494,14 @@ public:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     * fCheckPOW may only be false if the caller has already verified the proof of work.
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
         BlockValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     ~BlockManager() {
         Unload();
@@ -576,6 +642,13 @@ public:
      */
     const uint256 m_from_snapshot_blockhash{};
 
+    /**
+     * Set on the IBD chainstate while it validates history underneath an active
+     * snapshot chainstate. It then never advances past this block and leaves
+     * the mempool and validation signals to the active chainstate.
+     */
+    CBlockIndex* m_background_target GUARDED_BY(::cs_main){nullptr};
+
     /**
      * The set of all CBlockIndex entries with BLOCK_VALID_TRANSACTIONS (for itself and all ancestors) and
      * as good as our current tip or better. Entries may be failed, though, and pruning nodes may be
@@ -678,7 +751,9 @@ public:
     /** Replay blocks that aren't fully applied to the database. */
     bool ReplayBlocks(const CChainParams& params);
     bool RewindBlockIndex(const CChainParams& params) LOCKS_EXCLUDED(cs_main);
-    bool LoadGenesisBlock(const CChainParams& chainparams);
+    //! Add the genesis block to the block index. If dbp is given the block is
+    //! already stored there (as during -reindex), otherwise it is written out.
+    bool LoadGenesisBlock(const CChainParams& chainparams, const FlatFilePos* dbp = nullptr);
 
     void PruneBlockIndexCandidates();
 
@@ -827,6 +902,30 @@ private:
     //! by the background validation chainstate.
     bool m_snapshot_validated{false};
 
+    //! The HASH_SERIALIZED UTXO commitment the active snapshot was verified
+    //! against, compared with the background chainstate once it reaches the
+    //! snapshot base.
+    uint256 m_snapshot_utxo_hash GUARDED_BY(::cs_main);
+
+    //! Internal helper for ActivateSnapshot().
+    //!
+    //! Streams coins out of the snapshot file and inserts them into the
+    //! snapshot chainstate while hashing them on a second thread, then checks
+    //! the result against the expected assumeutxo commitment.
+    bool PopulateAndValidateSnapshot(
+        CChainState& snapshot_chainstate,
+        CAutoFile& coins_file,
+        const SnapshotMetadata& metadata,
+        const AssumeutxoData& au_data);
+
+    //! Offer a newly stored block to the background chainstate if it lies on
+    //! the path to the snapshot base.
+    void AddBackgroundBlockCandidate(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+    //! Once the background chainstate has reached the snapshot base, compare
+    //! its UTXO set with the snapshot and mark the snapshot validated.
+    void MaybeCompleteSnapshotValidation() LOCKS_EXCLUDED(::cs_main);
+
     // For access to m_active_chainstate.
     friend CChainState& ChainstateActive();
     friend CChain& ChainActive();
@@ -857,6 +956,29 @@ public:
     //! Get all chainstates currently being used.
     std::vector<CChainState*> GetAll();
 
+    //! Construct and activate a chainstate on the basis of UTXO snapshot data.
+    //!
+    //! The snapshot base block header must already be known and its height
+    //! must have an entry in the chainparams assumeutxo data. Once activated,
+    //! the IBD chainstate keeps validating history in the background up to the
+    //! snapshot base.
+    //!
+    //! @param[in] mempool    The mempool for the new active chainstate; it is
+    //!                       cleared on activation.
+    //! @param[in] in_memory  Keep the snapshot coins database in memory (tests).
+    //!
+    //! @returns true if the snapshot was loaded, validated and activated.
+    bool ActivateSnapshot(
+        CAutoFile& coins_file, const SnapshotMetadata& metadata, CTxMemPool& mempool, bool in_memory)
+        LOCKS_EXCLUDED(::cs_main);
+
+    //! As above, but check the snapshot against the given commitment instead of
+    //! the chainparams assumeutxo data. Only for tests.
+    bool ActivateSnapshot(
+        CAutoFile& coins_file, const SnapshotMetadata& metadata, const AssumeutxoData& au_data,
+        CTxMemPool& mempool, bool in_memory)
+        LOCKS_EXCLUDED(::cs_main);
+
     //! The most-work chain.
     CChainState& ActiveChainstate() const;
     CChain& ActiveChain() const { return ActiveChainstate().m_chain; }
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021-2022 The Labyrinth Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test loading a UTXO snapshot with loadtxoutset.
+
+Node 0 mines the chain the regtest assumeutxo data in chainparams.cpp was
+taken from and dumps its UTXO set at the snapshot height. Nodes 1 and 2 are
+given only its headers, load the snapshot in either format, follow the
+chain from its base and validate the blocks below it in the background.
+"""
+import os
+
+from test_framework.messages import sha256
+from test_framework.script import CScript, OP_0, OP_TRUE
+from test_framework.test_framework import LabyrinthTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    assert_raises_rpc_error,
+)
+
+WITNESS_SCRIPT = CScript([OP_TRUE])
+SCRIPT_PUBKEY = CScript([OP_0, sha256(WITNESS_SCRIPT)])
+
+# Keep these in sync with the regtest assumeutxo data in chainparams.cpp.
+SNAPSHOT_MOCKTIME = 1700000000
+SNAPSHOT_HEIGHT = 110
+SNAPSHOT_UTXO_HASH = 'c78a5d133f9238bcc5d28ae3564177a826a03494771567010bf12376674d994b'
+FINAL_HEIGHT = SNAPSHOT_HEIGHT + 10
+
+
+class AssumeutxoTest(LabyrinthTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 3
+
+    def setup_network(self):
+        # Nodes 1 and 2 must not sync the chain before loading the snapshot.
+        self.setup_nodes()
+
+    def generate(self, node, count):
+        return node.generatetodescriptor(count, "raw({})".format(SCRIPT_PUBKEY.hex()))
+
+    def run_test(self):
+        n0, n1, n2 = self.nodes
+        n0.setmocktime(SNAPSHOT_MOCKTIME)
+        self.generate(n0, SNAPSHOT_HEIGHT)
+        assert_equal(n0.gettxoutsetinfo()['hash_serialized_2'], SNAPSHOT_UTXO_HASH)
+
+        self.log.info("Dump the UTXO set at the snapshot height in both formats")
+        dump_v1 = n0.dumptxoutset('utxos_v1.dat')
+        dump_v2 = n0.dumptxoutset('utxos_v2.dat', 2)
+        for dump in (dump_v1, dump_v2):
+            assert_equal(dump['base_height'], SNAPSHOT_HEIGHT)
+            assert_equal(dump['coins_written'], 2 * SNAPSHOT_HEIGHT)
+        # The chunked format stores the same coins in less space.
+        assert_greater_than(os.path.getsize(dump_v1['path']), os.path.getsize(dump_v2['path']))
+        assert_raises_rpc_error(-8, "Unsupported snapshot format 3", n0.dumptxoutset, 'utxos_v3.dat', 3)
+
+        self.generate(n0, FINAL_HEIGHT - SNAPSHOT_HEIGHT)
+        dump_final = n0.dumptxoutset('utxos_final.dat')
+
+        self.log.info("A snapshot whose base header is unknown is refused")
+        assert_raises_rpc_error(-5, "must appear in the headers chain", n1.loadtxoutset, dump_v1['path'])
+
+        for height in range(1, FINAL_HEIGHT + 1):
+            header = n0.getblockheader(n0.getblockhash(height), False)
+            n1.submitheader(header)
+            n2.submitheader(header)
+
+        self.log.info("A snapshot at a height without assumeutxo data is refused")
+        assert_raises_rpc_error(-32603, "Unable to load UTXO snapshot", n1.loadtxoutset, dump_final['path'])
+
+        for node, dump in ((n1, dump_v1), (n2, dump_v2)):
+            self.log.info("Load the snapshot of format {} on node {}".format(
+                1 if dump is dump_v1 else 2, node.index))
+            loaded = node.loadtxoutset(dump['path'])
+            assert_equal(loaded['coins_loaded'], dump['coins_written'])
+            assert_equal(loaded['base_height'], SNAPSHOT_HEIGHT)
+            assert_equal(node.getblockcount(), SNAPSHOT_HEIGHT)
+            assert_equal(node.getbestblockhash(), dump['base_hash'])
+
+            self.log.info("A second snapshot is refused")
+            assert_raises_rpc_error(-32603, "Unable to load UTXO snapshot", node.loadtxoutset, dump['path'])
+
+            self.log.info("Follow the chain from the snapshot and validate the blocks below it")
+            with node.assert_debug_log(["snapshot beginning at {} has been fully validated".format(dump['base_hash'])], timeout=60):
+                self.connect_nodes(node.index, 0)
+                self.sync_blocks([n0, node])
+            assert_equal(node.getbestblockhash(), n0.getbestblockhash())
+            assert_equal(node.gettxoutsetinfo()['hash_serialized_2'], n0.gettxoutsetinfo()['hash_serialized_2'])
+
+        for dump in (dump_v1, dump_v2, dump_final):
+            os.remove(dump['path'])
+
+
+if __name__ == '__main__':
+    AssumeutxoTest().main()
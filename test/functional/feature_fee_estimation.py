@@ -15,6 +15,7 @@ from test_framework.util import (
     assert_greater_than,
     assert_greater_than_or_equal,
     satoshi_round,
+    wait_until_helper,
 )
 
 # Construct 2 trivial P2SH's and the ScriptSigs that spend them
@@ -136,6 +137,8 @@ def check_smart_estimates(node, fees_seen):
             assert_greater_than_or_equal(i + 1, e["blocks"])
 
 def check_estimates(node, fees_seen):
+    # Smart fee estimates are computed in the background after each block.
+    wait_until_helper(lambda: node.estimatesmartfee(1)["height"] == node.getblockcount(), timeout=60)
     check_raw_estimates(node, fees_seen)
     check_smart_estimates(node, fees_seen)
 
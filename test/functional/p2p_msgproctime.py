@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021-2022 The Labyrinth Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the msgproctime field of getpeerinfo.
+
+Test that the time spent processing a peer's messages is reported and grows
+with the messages it sends, and that a peer which used up its share of
+processing time still gets the rest of its messages processed.
+"""
+
+from test_framework.messages import msg_ping
+from test_framework.p2p import P2PInterface
+from test_framework.test_framework import LabyrinthTestFramework
+from test_framework.util import assert_greater_than
+
+
+class MsgProcTimeTest(LabyrinthTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def msgproctime(self):
+        peer_info = self.nodes[0].getpeerinfo()
+        assert 'msgproctime' in peer_info[0]
+        return peer_info[0]['msgproctime']
+
+    def run_test(self):
+        peer = self.nodes[0].add_p2p_connection(P2PInterface())
+
+        self.log.info("Check that the processing time of a new peer is reported")
+        before = self.msgproctime()
+        assert before >= 0
+
+        self.log.info("Check that a burst of messages is processed and accounted for")
+        # Enough pings to use up the peer's processing time several times over,
+        # so it sits out and has to be picked up again.
+        for i in range(5000):
+            peer.send_message(msg_ping(nonce=i + 1))
+        peer.sync_with_ping(timeout=60)
+        assert_greater_than(self.msgproctime(), before)
+
+
+if __name__ == '__main__':
+    MsgProcTimeTest().main()
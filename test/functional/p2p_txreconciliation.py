@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021-2022 The Labyrinth Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test transaction reconciliation with an inbound peer.
+
+Test that a node started with -txreconciliation offers it before verack, that
+it answers one "reqrecon" per round and interval with a sketch, and that it
+announces the transactions of a round the peer doesn't finish in time.
+"""
+
+import time
+
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxInWitness,
+    CTxOut,
+    msg_reconcildiff,
+    msg_reqrecon,
+    msg_sendtxrcncl,
+    msg_verack,
+    msg_wtxidrelay,
+    MSG_WTX,
+    sha256,
+)
+from test_framework.p2p import (
+    P2PInterface,
+    p2p_lock,
+)
+from test_framework.script import (
+    CScript,
+    OP_0,
+    OP_TRUE,
+)
+from test_framework.test_framework import LabyrinthTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+)
+
+WITNESS_SCRIPT = CScript([OP_TRUE])
+SCRIPT_PUBKEY = CScript([OP_0, sha256(WITNESS_SCRIPT)])
+FEE = 1000  # satoshis per transaction
+NUM_TXS = 10
+
+# Keep these in sync with txreconciliation.h
+RECON_REQUEST_INTERVAL = 8
+RECON_RESPONSE_TIMEOUT = 60
+
+
+class ReconciliationPeer(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        self.announced = set()
+
+    def on_version(self, message):
+        # sendtxrcncl goes between wtxidrelay, which it requires, and verack.
+        self.send_message(msg_wtxidrelay())
+        self.send_message(msg_sendtxrcncl(version=1, salt=0x1337))
+        self.send_message(msg_verack())
+        self.nServices = message.nServices
+
+    def on_inv(self, message):
+        for inv in message.inv:
+            if inv.type == MSG_WTX:
+                self.announced.add(inv.hash)
+
+    def reqrecon(self, set_size=0):
+        """Send a reconciliation request and return the sketch in response, or None."""
+        with p2p_lock:
+            self.last_message.pop("sketch", None)
+        self.send_message(msg_reqrecon(set_size))
+        self.sync_with_ping()
+        with p2p_lock:
+            sketch = self.last_message.get("sketch")
+        return None if sketch is None else sketch.cells
+
+
+class TxReconciliationTest(LabyrinthTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-txreconciliation"]]
+
+    def mock_forward(self, delta):
+        self.mock_time += delta
+        self.nodes[0].setmocktime(self.mock_time)
+
+    def create_tx(self, coin):
+        """Spend a (txid, vout, value) P2WSH(OP_TRUE) output to the same script."""
+        txid, vout, value = coin
+        tx = CTransaction()
+        tx.vin = [CTxIn(COutPoint(int(txid, 16), vout), nSequence=0xffffffff)]
+        tx.vout = [CTxOut(value - FEE, SCRIPT_PUBKEY)]
+        tx.wit.vtxinwit.append(CTxInWitness())
+        tx.wit.vtxinwit[0].scriptWitness.stack = [WITNESS_SCRIPT]
+        tx.rehash()
+        return tx
+
+    def run_test(self):
+        node = self.nodes[0]
+        blocks = node.generatetodescriptor(100 + NUM_TXS, "raw({})".format(SCRIPT_PUBKEY.hex()))
+        self.coins = []
+        for blockhash in blocks[:NUM_TXS]:
+            coinbase = node.getblock(blockhash, 2)['tx'][0]
+            self.coins.append((coinbase['txid'], 0, int(coinbase['vout'][0]['value'] * COIN)))
+        self.mock_time = int(time.time())
+        self.mock_forward(0)
+
+        self.test_handshake()
+        self.test_requests()
+        self.test_response_timeout()
+
+    def test_handshake(self):
+        node = self.nodes[0]
+        self.log.info("Reconciliation is offered before verack")
+        peer = node.add_p2p_connection(ReconciliationPeer())
+        assert_equal(peer.last_message["sendtxrcncl"].version, 1)
+
+        self.log.info("A peer that didn't offer reconciliation gets no sketch")
+        plain_peer = node.add_p2p_connection(P2PInterface())
+        plain_peer.send_message(msg_reqrecon(0))
+        plain_peer.sync_with_ping()
+        assert "sketch" not in plain_peer.last_message
+
+        self.log.info("Offering reconciliation after verack is punished with a disconnect")
+        plain_peer.send_message(msg_sendtxrcncl())
+        plain_peer.wait_for_disconnect()
+        node.disconnect_p2ps()
+
+    def test_requests(self):
+        node = self.nodes[0]
+        peer = node.add_p2p_connection(ReconciliationPeer())
+
+        self.log.info("A request is answered with a sketch")
+        assert peer.reqrecon() is not None
+        peer.send_message(msg_reconcildiff(success=True))
+
+        self.log.info("Requests are ignored for an interval after the last one...")
+        assert peer.reqrecon() is None
+        self.mock_forward(RECON_REQUEST_INTERVAL)
+        assert peer.reqrecon() is not None
+
+        self.log.info("... and until the round is finished")
+        self.mock_forward(RECON_REQUEST_INTERVAL)
+        assert peer.reqrecon() is None
+        peer.send_message(msg_reconcildiff(success=True))
+        assert peer.reqrecon() is not None
+        peer.send_message(msg_reconcildiff(success=True))
+        peer.sync_with_ping()
+        node.disconnect_p2ps()
+
+    def test_response_timeout(self):
+        node = self.nodes[0]
+        peer = node.add_p2p_connection(ReconciliationPeer())
+
+        self.log.info("Transactions are left to reconciliation but for a few")
+        txs = [self.create_tx(coin) for coin in self.coins]
+        for tx in txs:
+            node.sendrawtransaction(tx.serialize().hex())
+        wtxids = set(tx.calc_sha256(with_witness=True) for tx in txs)
+        # Let the node's next announcement to the peer come due.
+        self.mock_forward(60)
+        peer.sync_with_ping()
+        peer.sync_with_ping()
+        with p2p_lock:
+            assert peer.announced != wtxids
+        self.mock_forward(RECON_REQUEST_INTERVAL)
+        sketch = peer.reqrecon()
+        # A sketch of more than 9 cells is sized for at least two transactions.
+        assert_greater_than(len(sketch), 9)
+
+        self.log.info("A round the peer doesn't finish in time is announced instead")
+        self.mock_forward(RECON_RESPONSE_TIMEOUT)
+        peer.wait_until(lambda: peer.announced == wtxids)
+
+
+if __name__ == '__main__':
+    TxReconciliationTest().main()
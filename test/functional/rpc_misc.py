@@ -42,6 +42,10 @@ class RpcMiscTest(LabyrinthTestFramework):
         assert_greater_than(memory['chunks_used'], 0)
         assert_greater_than(memory['chunks_free'], 0)
         assert_equal(memory['used'] + memory['free'], memory['total'])
+        buffers = node.getmemoryinfo()['buffers']
+        assert_greater_than_or_equal(1 << 20, buffers['cached'])
+        assert_greater_than_or_equal(buffers['hits'], 0)
+        assert_greater_than_or_equal(buffers['misses'], 0)
 
         self.log.info("test mallocinfo")
         try:
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021-2022 The Labyrinth Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the sendrawtransactions RPC.
+
+Test that a batch of raw transactions is accepted parents first, that one
+failing transaction does not keep the others out of the mempool, and that
+the batch size and the mempool package limits are enforced.
+"""
+
+from decimal import Decimal
+
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxInWitness,
+    CTxOut,
+    sha256,
+)
+from test_framework.script import (
+    CScript,
+    OP_0,
+    OP_TRUE,
+)
+from test_framework.test_framework import LabyrinthTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+WITNESS_SCRIPT = CScript([OP_TRUE])
+SCRIPT_PUBKEY = CScript([OP_0, sha256(WITNESS_SCRIPT)])
+FEE = 1000  # satoshis per transaction
+MAX_ANCESTORS = 5
+
+
+class SendRawTransactionsTest(LabyrinthTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [[
+            "-limitancestorcount={}".format(MAX_ANCESTORS),
+            "-limitdescendantcount={}".format(MAX_ANCESTORS),
+        ]]
+
+    def create_tx(self, inputs, num_outputs=1):
+        """Spend (txid, vout, value) P2WSH(OP_TRUE) outputs to num_outputs equal outputs of the same script, without signaling replaceability."""
+        tx = CTransaction()
+        tx.vin = [CTxIn(COutPoint(int(txid, 16), vout), nSequence=0xffffffff) for txid, vout, _ in inputs]
+        value = (sum(value for _, _, value in inputs) - FEE) // num_outputs
+        tx.vout = [CTxOut(value, SCRIPT_PUBKEY) for _ in range(num_outputs)]
+        for _ in inputs:
+            tx.wit.vtxinwit.append(CTxInWitness())
+            tx.wit.vtxinwit[-1].scriptWitness.stack = [WITNESS_SCRIPT]
+        tx.rehash()
+        return tx
+
+    def generate_blocks(self, num_blocks):
+        return self.nodes[0].generatetodescriptor(num_blocks, "raw({})".format(SCRIPT_PUBKEY.hex()))
+
+    def run_test(self):
+        node = self.nodes[0]
+        blocks = self.generate_blocks(110)
+        self.coins = []
+        for blockhash in blocks[:10]:
+            coinbase = node.getblock(blockhash, 2)['tx'][0]
+            self.coins.append((coinbase['txid'], 0, int(coinbase['vout'][0]['value'] * COIN)))
+
+        self.test_package()
+        self.test_partial_failure()
+        self.test_limits()
+
+    def test_package(self):
+        node = self.nodes[0]
+        self.log.info("A parent, child and grandchild submitted children first are all accepted")
+        parent = self.create_tx([self.coins.pop()], 2)
+        child = self.create_tx([(parent.hash, 0, parent.vout[0].nValue)])
+        grandchild = self.create_tx([(child.hash, 0, child.vout[0].nValue), (parent.hash, 1, parent.vout[1].nValue)])
+        package = [grandchild, child, parent]
+
+        result = node.sendrawtransactions([tx.serialize().hex() for tx in package])
+        assert_equal(result, [{"txid": tx.hash, "accepted": True} for tx in package])
+        assert_equal(sorted(node.getrawmempool()), sorted(tx.hash for tx in package))
+        assert_equal(node.getmempoolentry(grandchild.hash)['ancestorcount'], 3)
+
+        self.log.info("Transactions already in the mempool are reported as accepted")
+        result = node.sendrawtransactions([parent.serialize().hex()])
+        assert_equal(result, [{"txid": parent.hash, "accepted": True}])
+        self.generate_blocks(1)
+        assert_equal(node.getrawmempool(), [])
+
+    def test_partial_failure(self):
+        node = self.nodes[0]
+        self.log.info("Invalid transactions in a batch do not keep the valid ones out")
+        spent = self.coins.pop()
+        good = self.create_tx([spent])
+        good_child = self.create_tx([(good.hash, 0, good.vout[0].nValue)])
+        # Spends the same coin as good, which does not signal replaceability
+        conflict = self.create_tx([spent], 2)
+        # Spends an output that does not exist, and so does its child
+        orphan = self.create_tx([("ff" * 32, 0, 10 * COIN)])
+        orphan_child = self.create_tx([(orphan.hash, 0, orphan.vout[0].nValue)])
+        # Pays a fee rate above the maxfeerate argument
+        high_fee = self.create_tx([self.coins.pop()])
+        high_fee.vout[0].nValue -= COIN
+        high_fee.rehash()
+        batch = [good, conflict, orphan_child, good_child, orphan, high_fee]
+
+        result = node.sendrawtransactions([tx.serialize().hex() for tx in batch], Decimal("0.1"))
+        assert_equal(result, [
+            {"txid": good.hash, "accepted": True},
+            {"txid": conflict.hash, "accepted": False, "reject-reason": "txn-mempool-conflict"},
+            {"txid": orphan_child.hash, "accepted": False, "reject-reason": "missing-inputs"},
+            {"txid": good_child.hash, "accepted": True},
+            {"txid": orphan.hash, "accepted": False, "reject-reason": "missing-inputs"},
+            {"txid": high_fee.hash, "accepted": False, "reject-reason": "max-fee-exceeded"},
+        ])
+        assert_equal(sorted(node.getrawmempool()), sorted([good.hash, good_child.hash]))
+        self.generate_blocks(1)
+        assert_equal(node.getrawmempool(), [])
+
+    def test_limits(self):
+        node = self.nodes[0]
+        self.log.info("The batch must hold between 1 and 1000 transactions")
+        assert_raises_rpc_error(-8, "Array must contain between 1 and 1000 raw transactions", node.sendrawtransactions, [])
+        assert_raises_rpc_error(-8, "Array must contain between 1 and 1000 raw transactions", node.sendrawtransactions, ["00"] * 1001)
+        assert_raises_rpc_error(-22, "TX decode failed", node.sendrawtransactions, ["ff00baar"])
+
+        self.log.info("A chain longer than the ancestor limit is accepted up to the limit")
+        chain = []
+        coin = self.coins.pop()
+        for _ in range(MAX_ANCESTORS + 2):
+            tx = self.create_tx([coin])
+            chain.append(tx)
+            coin = (tx.hash, 0, tx.vout[0].nValue)
+
+        result = node.sendrawtransactions([tx.serialize().hex() for tx in reversed(chain)])
+        expected = [{"txid": tx.hash, "accepted": True} for tx in chain[:MAX_ANCESTORS]]
+        expected += [{"txid": tx.hash, "accepted": False, "reject-reason": "too-long-mempool-chain"} for tx in chain[MAX_ANCESTORS:MAX_ANCESTORS + 1]]
+        expected += [{"txid": tx.hash, "accepted": False, "reject-reason": "missing-inputs"} for tx in chain[MAX_ANCESTORS + 1:]]
+        assert_equal(result, list(reversed(expected)))
+        assert_equal(sorted(node.getrawmempool()), sorted(tx.hash for tx in chain[:MAX_ANCESTORS]))
+
+
+if __name__ == '__main__':
+    SendRawTransactionsTest().main()
@@ -1789,3 +1789,86 @@ class msg_cfcheckpt:
     def __repr__(self):
         return "msg_cfcheckpt(filter_type={:#x}, stop_hash={:x})".format(
             self.filter_type, self.stop_hash)
+
+class msg_sendtxrcncl:
+    __slots__ = ("version", "salt")
+    msgtype = b"sendtxrcncl"
+
+    def __init__(self, version=1, salt=0):
+        self.version = version
+        self.salt = salt
+
+    def deserialize(self, f):
+        self.version = struct.unpack("<I", f.read(4))[0]
+        self.salt = struct.unpack("<Q", f.read(8))[0]
+
+    def serialize(self):
+        r = b""
+        r += struct.pack("<I", self.version)
+        r += struct.pack("<Q", self.salt)
+        return r
+
+    def __repr__(self):
+        return "msg_sendtxrcncl(version=%lu, salt=%lu)" % (self.version, self.salt)
+
+
+class msg_reqrecon:
+    __slots__ = ("set_size",)
+    msgtype = b"reqrecon"
+
+    def __init__(self, set_size=0):
+        self.set_size = set_size
+
+    def deserialize(self, f):
+        self.set_size = struct.unpack("<H", f.read(2))[0]
+
+    def serialize(self):
+        return struct.pack("<H", self.set_size)
+
+    def __repr__(self):
+        return "msg_reqrecon(set_size=%d)" % self.set_size
+
+
+class msg_sketch:
+    """A sketch of a reconciliation set: a list of (count, id_sum, check_sum) cells."""
+    __slots__ = ("cells",)
+    msgtype = b"sketch"
+
+    def __init__(self, cells=None):
+        self.cells = cells if cells is not None else []
+
+    def deserialize(self, f):
+        self.cells = [struct.unpack("<BII", f.read(9)) for _ in range(deser_compact_size(f))]
+
+    def serialize(self):
+        r = ser_compact_size(len(self.cells))
+        for cell in self.cells:
+            r += struct.pack("<BII", *cell)
+        return r
+
+    def __repr__(self):
+        return "msg_sketch(cells=%d)" % len(self.cells)
+
+
+class msg_reconcildiff:
+    __slots__ = ("success", "short_ids")
+    msgtype = b"reconcildiff"
+
+    def __init__(self, success=False, short_ids=None):
+        self.success = success
+        self.short_ids = short_ids if short_ids is not None else []
+
+    def deserialize(self, f):
+        self.success = struct.unpack("<?", f.read(1))[0]
+        self.short_ids = [struct.unpack("<I", f.read(4))[0] for _ in range(deser_compact_size(f))]
+
+    def serialize(self):
+        r = b""
+        r += struct.pack("<?", self.success)
+        r += ser_compact_size(len(self.short_ids))
+        for short_id in self.short_ids:
+            r += struct.pack("<I", short_id)
+        return r
+
+    def __repr__(self):
+        return "msg_reconcildiff(success=%s, short_ids=%d)" % (self.success, len(self.short_ids))
@@ -107,6 +107,7 @@ BASE_SCRIPTS = [
     'p2p_segwit.py',
     'p2p_timeouts.py',
     'p2p_tx_download.py',
+    'p2p_txreconciliation.py',
     'mempool_updatefromblock.py',
     'wallet_dump.py --legacy-wallet',
     'wallet_listtransactions.py',
@@ -124,6 +125,7 @@ BASE_SCRIPTS = [
     'feature_csv_activation.py',
     'rpc_rawtransaction.py',
     'rpc_rawtransaction.py --descriptors',
+    'rpc_sendrawtransactions.py',
     'wallet_address_types.py',
     'wallet_address_types.py --descriptors',
     'feature_bip68_sequence.py',
@@ -194,6 +196,7 @@ BASE_SCRIPTS = [
     'p2p_invalid_messages.py',
     'p2p_invalid_tx.py',
     'feature_assumevalid.py',
+    'feature_assumeutxo.py',
     'example_test.py',
     'wallet_txn_doublespend.py',
     'wallet_txn_doublespend.py --descriptors',
@@ -270,6 +273,7 @@ BASE_SCRIPTS = [
     'rpc_deriveaddresses.py',
     'rpc_deriveaddresses.py --usecli',
     'p2p_ping.py',
+    'p2p_msgproctime.py',
     'rpc_scantxoutset.py',
     'feature_logging.py',
     'p2p_node_network_limited.py',